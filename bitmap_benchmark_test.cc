@@ -42,6 +42,11 @@
 // BM_RoaringDecompressToBitmap    17180132       17180604             40
 // BM_ZstdCompressBitmapBytes      11173145       11174765             63
 // BM_ZstdDecompressBitmapBytes     6565571        6566545            100
+//
+// The rank & select benchmarks don't need a bitmap file, they run on synthetic
+// bitmaps with the same density (4.3%) and the given number of bits.
+
+#include <random>
 
 #include "common/bitmap.h"
 #include "common/rle_bitmap.h"
@@ -88,6 +93,68 @@ Roaring RoaringFromBytes(const std::string& bytes) {
   return Roaring::readSafe(bytes.data(), bytes.size());
 }
 
+// Number of random positions probed per benchmark iteration.
+constexpr size_t kNumProbes = 1024;
+
+// Returns a bitmap with `num_bits` bits of which ~`density` are set.
+Bitmap64 CreateRandomBitmap(size_t num_bits, double density) {
+  std::mt19937 gen(42);
+  std::bernoulli_distribution dist(density);
+  Bitmap64 bitmap(num_bits);
+  for (size_t i = 0; i < num_bits; ++i) bitmap.Set(i, dist(gen));
+  return bitmap;
+}
+
+// Returns `kNumProbes` random values in [0, max).
+std::vector<size_t> RandomProbes(size_t max) {
+  std::mt19937 gen(17);
+  std::uniform_int_distribution<size_t> dist(0, max - 1);
+  std::vector<size_t> probes(kNumProbes);
+  for (size_t& probe : probes) probe = dist(gen);
+  return probes;
+}
+
+// **** Rank & select benchmarks ****
+
+void BM_Rank(benchmark::State& state) {
+  Bitmap64 bitmap = CreateRandomBitmap(state.range(0), /*density=*/0.043);
+  if (state.range(1)) bitmap.InitRankLookupTable();
+  const std::vector<size_t> probes = RandomProbes(bitmap.bits());
+
+  while (state.KeepRunning()) {
+    for (const size_t limit : probes)
+      benchmark::DoNotOptimize(bitmap.GetOnesCountBeforeLimit(limit));
+  }
+  state.SetItemsProcessed(state.iterations() * kNumProbes);
+}
+// Args: number of bits, whether to use the rank lookup table.
+BENCHMARK(BM_Rank)
+    ->Args({1 << 16, 0})
+    ->Args({1 << 16, 1})
+    ->Args({1 << 24, 1});
+
+void BM_Select(benchmark::State& state) {
+  Bitmap64 bitmap = CreateRandomBitmap(state.range(0), /*density=*/0.043);
+  bitmap.InitRankLookupTable();
+  const bool count_ones = state.range(1);
+  const std::vector<size_t> probes = RandomProbes(
+      count_ones ? bitmap.GetOnesCount() : bitmap.GetZeroesCount());
+
+  size_t pos;
+  while (state.KeepRunning()) {
+    for (const size_t ith : probes) {
+      benchmark::DoNotOptimize(count_ones ? bitmap.SelectOne(ith, &pos)
+                                          : bitmap.SelectZero(ith, &pos));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumProbes);
+}
+// Args: number of bits, whether to select set (1) or unset (0) bits.
+BENCHMARK(BM_Select)
+    ->Args({1 << 16, 1})
+    ->Args({1 << 24, 1})
+    ->Args({1 << 24, 0});
+
 // **** RLE benchmarks ****
 
 void BM_RLECompress(benchmark::State& state) {
@@ -124,6 +191,36 @@ void BM_RLEDecompressPartial(benchmark::State& state) {
 }
 BENCHMARK(BM_RLEDecompressPartial);
 
+// Point queries on a back-to-back encoded bitmap (global bitmap), as issued by
+// CuckooIndex::StripeContains(..).
+void BM_RLEGet(benchmark::State& state) {
+  const Bitmap64 bitmap = ReadBitmapFromFile(absl::GetFlag(FLAGS_path));
+  const RleBitmap rle_bitmap(bitmap);
+  const std::vector<size_t> probes = RandomProbes(bitmap.bits());
+
+  while (state.KeepRunning()) {
+    for (const size_t pos : probes)
+      benchmark::DoNotOptimize(rle_bitmap.Get(pos));
+  }
+  state.SetItemsProcessed(state.iterations() * kNumProbes);
+}
+BENCHMARK(BM_RLEGet);
+
+// Same as above, but going through Extract(..) of a single bit (which was how
+// RleBitmap::Get(..) was implemented before).
+void BM_RLEGetViaExtract(benchmark::State& state) {
+  const Bitmap64 bitmap = ReadBitmapFromFile(absl::GetFlag(FLAGS_path));
+  const RleBitmap rle_bitmap(bitmap);
+  const std::vector<size_t> probes = RandomProbes(bitmap.bits());
+
+  while (state.KeepRunning()) {
+    for (const size_t pos : probes)
+      benchmark::DoNotOptimize(rle_bitmap.Extract(pos, /*size=*/1).Get(0));
+  }
+  state.SetItemsProcessed(state.iterations() * kNumProbes);
+}
+BENCHMARK(BM_RLEGetViaExtract);
+
 // **** Roaring benchmarks ****
 
 void BM_RoaringCompressFromIndexes(benchmark::State& state) {
@@ -27,6 +27,10 @@
 // add --benchmark_format=csv --undefok=benchmark_format to output in the CSV
 // format.
 //
+// The binary links in common/allocation_hooks.cc, i.e., additionally reports
+// the allocations and the peak heap usage of every build phase (see
+// BM_BuildTime(..)). They slightly slow down the build times.
+//
 // Example run:
 // Run on (12 X 4500 MHz CPU s)
 // CPU Caches:
@@ -77,14 +81,20 @@
 
 #include <cstdlib>
 #include <random>
+#include <string>
+#include <utility>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "benchmark/benchmark.h"
 #include "common/profiling.h"
 #include "cuckoo_index.h"
 #include "cuckoo_utils.h"
+#include "data_generators.h"
 #include "index_structure.h"
+#include "per_stripe_blocked_bloom.h"
 #include "per_stripe_bloom.h"
 #include "per_stripe_xor.h"
 
@@ -92,6 +102,12 @@ ABSL_FLAG(long, generate_num_values, 100000,
 "Number of values to generate (number of rows).");
 ABSL_FLAG(long, num_unique_values, 1000,
 "Number of unique values to generate (cardinality).");
+ABSL_FLAG(std::string, distribution, "",
+          "Distribution of the generated data: 'UNIFORM', 'ZIPF', 'CLUSTERED', "
+          "'SORTED_RUNS' or 'NEAR_UNIQUE' (see ci::DataDistribution). If "
+          "empty, uses ci::GenerateUniformData(..).");
+ABSL_FLAG(long, num_generate_threads, 1,
+          "Number of threads generating the data for --distribution.");
 ABSL_FLAG(std::string, input_csv_path, "", "Path to the input CSV file.");
 ABSL_FLAG(std::vector<std::string>, columns_to_test, {},
           "Comma-separated list of columns to tests, e.g. "
@@ -100,6 +116,16 @@ ABSL_FLAG(std::string, sorting, "NONE",
           "Sorting to apply to the data. Supported values: 'NONE', "
           "'BY_CARDINALITY' (sorts lexicographically, starting with columns "
           "with the lowest cardinality), 'RANDOM'");
+ABSL_FLAG(long, num_build_threads, 1,
+          "Number of threads used by the CuckooIndexFactory to collect the "
+          "stripe bitmaps of the values.");
+ABSL_FLAG(long, num_load_threads, 1,
+          "Number of threads used to parse the input CSV file.");
+ABSL_FLAG(std::string, table_cache_path, "",
+          "Path of a binary copy of the table, which is opened instead of "
+          "loading or generating the table again (see "
+          "ci::GetOrCreateCachedTable(..)). Rows are sorted after loading, "
+          "i.e., the cache holds the unsorted table.");
 
 constexpr absl::string_view kNoSorting = "NONE";
 constexpr absl::string_view kByCardinalitySorting = "BY_CARDINALITY";
@@ -112,30 +138,66 @@ bool IsValidSorting(absl::string_view sorting) {
   return values->contains(sorting);
 }
 
+// The phases of building a CuckooIndex, in the order they're run.
+constexpr std::pair<absl::string_view, ci::Counter> kBuildPhases[] = {
+    {"1-ValueToStripeBitmaps", ci::Counter::ValueToStripeBitmaps},
+    {"2-DistributeValues", ci::Counter::DistributeValues},
+    {"3-CreateSlots", ci::Counter::CreateSlots},
+    {"4-CreateFingerprintStore", ci::Counter::CreateFingerprintStore},
+    {"5-GetGlobalBitmap", ci::Counter::GetGlobalBitmap}};
+
+// Reports per iteration: the time of every phase and, if the allocation hooks
+// are linked in, the bytes and number of allocations of every phase and how
+// far its heap usage peaked above its start (all summed up over worker
+// threads). Also reports the components of the index's byte_size() and the
+// peak RSS of the process so far.
 void BM_BuildTime(const ci::Column& column,
                   const ci::IndexStructureFactory& factory,
                   size_t num_rows_per_stripe, benchmark::State& state) {
-  ci::Profiler::GetThreadInstance().Reset();
+  ci::Profiler& profiler = ci::Profiler::GetThreadInstance();
+  profiler.Reset();
 
+  ci::IndexStructurePtr index;
   for (auto _ : state) {
-    benchmark::DoNotOptimize(factory.Create(column, num_rows_per_stripe));
+    // Destroys the previous index first to not count it towards the peak.
+    index.reset();
+    index = factory.Create(column, num_rows_per_stripe);
+    benchmark::DoNotOptimize(index);
   }
 
-  state.counters["1-ValueToStripeBitmaps"] = benchmark::Counter(
-      ci::Profiler::GetThreadInstance().GetValue(ci::Counter::ValueToStripeBitmaps),
-      benchmark::Counter::kAvgIterations);
-  state.counters["2-DistributeValues"] = benchmark::Counter(
-      ci::Profiler::GetThreadInstance().GetValue(ci::Counter::DistributeValues),
-      benchmark::Counter::kAvgIterations);
-  state.counters["3-CreateSlots"] = benchmark::Counter(
-      ci::Profiler::GetThreadInstance().GetValue(ci::Counter::CreateSlots),
-      benchmark::Counter::kAvgIterations);
-  state.counters["4-CreateFingerprintStore"] = benchmark::Counter(
-      ci::Profiler::GetThreadInstance().GetValue(ci::Counter::CreateFingerprintStore),
+  for (const auto& [name, counter] : kBuildPhases) {
+    state.counters[std::string(name)] = benchmark::Counter(
+        profiler.GetValue(counter), benchmark::Counter::kAvgIterations);
+    if (!ci::AllocationHooksInstalled()) continue;
+    const ci::MemoryUsage usage = profiler.GetMemoryUsage(counter);
+    state.counters[absl::StrCat(name, "/AllocatedBytes")] = benchmark::Counter(
+        usage.allocated_bytes, benchmark::Counter::kAvgIterations,
+        benchmark::Counter::kIs1024);
+    state.counters[absl::StrCat(name, "/NumAllocations")] = benchmark::Counter(
+        usage.num_allocations, benchmark::Counter::kAvgIterations);
+    state.counters[absl::StrCat(name, "/PeakBytes")] = benchmark::Counter(
+        usage.peak_bytes, benchmark::Counter::kAvgIterations,
+        benchmark::Counter::kIs1024);
+  }
+  state.counters["6-NumKicks"] = benchmark::Counter(
+      profiler.GetValue(ci::Counter::NumKicks),
       benchmark::Counter::kAvgIterations);
-  state.counters["5-GetGlobalBitmap"] = benchmark::Counter(
-      ci::Profiler::GetThreadInstance().GetValue(ci::Counter::GetGlobalBitmap),
+  state.counters["7-NumBuckets"] = benchmark::Counter(
+      profiler.GetValue(ci::Counter::NumBuckets),
       benchmark::Counter::kAvgIterations);
+
+  if (index != nullptr) {
+    for (const ci::ByteSizeComponent& component :
+         index->byte_size_breakdown()) {
+      state.counters[absl::StrCat("Size/", component.name)] =
+          benchmark::Counter(component.byte_size,
+                             benchmark::Counter::kDefaults,
+                             benchmark::Counter::kIs1024);
+    }
+  }
+  state.counters["PeakRSS"] =
+      benchmark::Counter(ci::GetPeakRssBytes(), benchmark::Counter::kDefaults,
+                         benchmark::Counter::kIs1024);
 }
 
 long main(long argc, char* argv[]) {
@@ -148,20 +210,44 @@ long main(long argc, char* argv[]) {
       columns_to_test = absl::GetFlag(FLAGS_columns_to_test);
 
   // Define data.
-  std::unique_ptr<ci::Table> table;
-  if (input_csv_path.empty() || columns_to_test.empty()) {
-    std::cerr
-        << "[WARNING] --input_csv_path or --columns_to_test not specified, "
-           "generating synthetic data." << std::endl;
-    std::cout << "Generating " << generate_num_values << " values ("
-              << static_cast<double>(num_unique_values) / generate_num_values
-                  * 100 << "% unique)..." << std::endl;
-    table = ci::GenerateUniformData(generate_num_values, num_unique_values);
-  } else {
-    std::cout << "Loading data from file " << input_csv_path << "..."
-              << std::endl;
-    table = ci::Table::FromCsv(input_csv_path, columns_to_test);
-  }
+  const std::string distribution = absl::GetFlag(FLAGS_distribution);
+  const bool load_csv = !input_csv_path.empty() && !columns_to_test.empty();
+  const std::string source =
+      load_csv ? ci::CsvTableSource(input_csv_path, columns_to_test,
+                                    ci::StringEncoding::DICTIONARY)
+               : absl::StrCat("generated: distribution=", distribution,
+                              " generate_num_values=", generate_num_values,
+                              " num_unique_values=", num_unique_values);
+  const std::unique_ptr<ci::Table> table = ci::GetOrCreateCachedTable(
+      absl::GetFlag(FLAGS_table_cache_path), source,
+      [&]() -> std::unique_ptr<ci::Table> {
+        if (load_csv) {
+          std::cout << "Loading data from file " << input_csv_path << "..."
+                    << std::endl;
+          return ci::Table::FromCsv(input_csv_path, columns_to_test,
+                                    ci::StringEncoding::DICTIONARY,
+                                    absl::GetFlag(FLAGS_num_load_threads));
+        }
+        std::cerr << "[WARNING] --input_csv_path or --columns_to_test not "
+                     "specified, generating synthetic data." << std::endl;
+        std::cout << "Generating " << generate_num_values << " values ("
+                  << static_cast<double>(num_unique_values) /
+                         generate_num_values * 100
+                  << "% unique)..." << std::endl;
+        if (distribution.empty())
+          return ci::GenerateUniformData(generate_num_values,
+                                         num_unique_values);
+        ci::DataGeneratorOptions options;
+        if (!ci::ParseDataDistribution(distribution, &options.distribution)) {
+          std::cerr << "Invalid distribution: " << distribution << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        options.num_rows = generate_num_values;
+        options.num_unique_values = num_unique_values;
+        return ci::DataGenerator(options).GenerateTable(
+            absl::GetFlag(FLAGS_num_generate_threads));
+      });
+  table->PrintColumns();
 
   // Potentially sort the data.
   const std::string sorting = absl::GetFlag(FLAGS_sorting);
@@ -182,9 +268,20 @@ long main(long argc, char* argv[]) {
   index_factories.push_back(absl::make_unique<ci::CuckooIndexFactory>(
       ci::CuckooAlgorithm::SKEWED_KICKING, ci::kMaxLoadFactor1SlotsPerBucket,
       /*scan_rate=*/0.01, /*slots_per_bucket=*/1,
-      /*prefix_bits_optimization=*/false));
+      /*prefix_bits_optimization=*/false, /*fingerprint_directory=*/0,
+      ci::HashingScheme::SEEDED_CITY64,
+      absl::GetFlag(FLAGS_num_build_threads)));
+  index_factories.push_back(absl::make_unique<ci::CuckooIndexFactory>(
+      ci::CuckooAlgorithm::BFS_KICKING, ci::kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.01, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false, /*fingerprint_directory=*/0,
+      ci::HashingScheme::SEEDED_CITY64,
+      absl::GetFlag(FLAGS_num_build_threads)));
   index_factories.push_back(
       absl::make_unique<ci::PerStripeBloomFactory>(/*num_bits_per_key=*/10));
+  index_factories.push_back(
+      absl::make_unique<ci::PerStripeBlockedBloomFactory>(
+          /*num_bits_per_key=*/10));
   index_factories.push_back(absl::make_unique<ci::PerStripeXorFactory>());
 
   // Set up the benchmarks.
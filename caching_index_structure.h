@@ -0,0 +1,150 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: caching_index_structure.h
+// -----------------------------------------------------------------------------
+//
+// An IndexStructure wrapper that caches the stripe bitmaps of recently looked
+// up values. Helps for skewed (e.g., Zipf distributed) lookups, where a few hot
+// values make up most of the probes and would otherwise decode the same
+// bitmaps over and over again.
+
+#ifndef CUCKOO_INDEX_CACHING_INDEX_STRUCTURE_H_
+#define CUCKOO_INDEX_CACHING_INDEX_STRUCTURE_H_
+
+#include <cassert>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "common/bitmap.h"
+#include "common/lru_cache.h"
+#include "index_structure.h"
+
+namespace ci {
+
+// Caches up to `capacity` stripe bitmaps of the wrapped index in a sharded LRU
+// cache (see LruCache, one mutex per shard), i.e., it can be shared by
+// concurrent lookups.
+class CachingIndexStructure : public IndexStructure {
+ public:
+  CachingIndexStructure(IndexStructurePtr index, size_t capacity,
+                        size_t num_shards = 16)
+      : index_(std::move(index)) {
+    assert(num_shards > 0);
+    assert(capacity >= num_shards);
+    shards_.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i)
+      shards_.push_back(absl::make_unique<Shard>(capacity / num_shards));
+  }
+
+  bool StripeContains(size_t stripe_id, long value) const override {
+    return index_->StripeContains(stripe_id, value);
+  }
+
+  Bitmap64 GetQualifyingStripes(long value, size_t num_stripes) const override {
+    return *GetOrCreate(value, num_stripes);
+  }
+
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override {
+    // Copy-assignment re-uses the memory of `result`.
+    *result = *GetOrCreate(value, num_stripes);
+  }
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override {
+    const std::shared_ptr<const Bitmap64> bitmap =
+        GetOrCreate(value, num_stripes);
+    stripe_ids->clear();
+    for (const size_t stripe_id : bitmap->TrueBitIndices())
+      stripe_ids->push_back(stripe_id);
+  }
+
+  // ANDs the cached bitmap instead of probing the wrapped index per stripe.
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override {
+    *candidates &= *GetOrCreate(value, candidates->bits());
+  }
+
+  // Cheap compared to a lookup, so not cached.
+  double EstimateSelectivity(long value) const override {
+    return index_->EstimateSelectivity(value);
+  }
+
+  std::string name() const override {
+    return absl::StrCat("Caching/", index_->name());
+  }
+
+  // The cache is a runtime structure and not counted.
+  size_t byte_size() const override { return index_->byte_size(); }
+
+  size_t compressed_byte_size() const override {
+    return index_->compressed_byte_size();
+  }
+
+  std::vector<ByteSizeComponent> byte_size_breakdown() const override {
+    return index_->byte_size_breakdown();
+  }
+
+  ci::BitmapStats bitmap_stats() override { return index_->bitmap_stats(); }
+
+  // Only lookups that miss the cache reach the wrapped index, i.e., count.
+  std::vector<ci::PruningStats> pruning_stats() const override {
+    return index_->pruning_stats();
+  }
+
+  void ResetPruningStats() const override { index_->ResetPruningStats(); }
+
+  size_t hits() const {
+    size_t hits = 0;
+    for (const auto& shard : shards_) hits += shard->hits();
+    return hits;
+  }
+  size_t misses() const {
+    size_t misses = 0;
+    for (const auto& shard : shards_) misses += shard->misses();
+    return misses;
+  }
+
+ private:
+  using BitmapPtr = std::shared_ptr<const Bitmap64>;
+  // Bitmaps are cached per (value, num_stripes), i.e., lookups of a prefix of
+  // the stripes get entries of their own.
+  using Key = std::pair<long, size_t>;
+  using Shard = LruCache<Key, Bitmap64>;
+
+  // Returns the cached bitmap of `value`, or looks it up in the wrapped index
+  // and caches it.
+  BitmapPtr GetOrCreate(long value, size_t num_stripes) const {
+    const Shard& shard = *shards_[absl::Hash<long>()(value) % shards_.size()];
+    return shard.GetOrCreate(Key(value, num_stripes), [&]() {
+      return std::make_shared<const Bitmap64>(
+          index_->GetQualifyingStripes(value, num_stripes));
+    });
+  }
+
+  const IndexStructurePtr index_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_CACHING_INDEX_STRUCTURE_H_
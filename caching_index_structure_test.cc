@@ -0,0 +1,179 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: caching_index_structure_test.cc
+// -----------------------------------------------------------------------------
+
+#include "caching_index_structure.h"
+
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "composite_index.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+#include "zone_map.h"
+
+namespace ci {
+
+IndexStructurePtr CreateZoneMap() {
+  return absl::make_unique<ZoneMap>(/*data=*/std::vector<long>{1, 2, 3, 4, 2, 5},
+                                    /*num_rows_per_stripe=*/2);
+}
+
+TEST(CachingIndexStructureTest, ReturnsResultsOfWrappedIndex) {
+  const IndexStructurePtr zone_map = CreateZoneMap();
+  CachingIndexStructure index(CreateZoneMap(), /*capacity=*/4,
+                              /*num_shards=*/1);
+  EXPECT_EQ(index.name(), "Caching/" + zone_map->name());
+  EXPECT_EQ(index.byte_size(), zone_map->byte_size());
+
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (long value = 0; value < 7; ++value) {
+    const std::string expected =
+        zone_map->GetQualifyingStripes(value, /*num_stripes=*/3).ToString();
+    EXPECT_EQ(index.GetQualifyingStripes(value, /*num_stripes=*/3).ToString(),
+              expected);
+    index.FillQualifyingStripes(value, /*num_stripes=*/3, &result);
+    EXPECT_EQ(result.ToString(), expected);
+    std::vector<uint32_t> expected_ids;
+    zone_map->FillQualifyingStripeIds(value, /*num_stripes=*/3, &expected_ids);
+    index.FillQualifyingStripeIds(value, /*num_stripes=*/3, &stripe_ids);
+    EXPECT_EQ(stripe_ids, expected_ids);
+  }
+}
+
+TEST(CachingIndexStructureTest, CountsHitsAndMisses) {
+  CachingIndexStructure index(CreateZoneMap(), /*capacity=*/2,
+                              /*num_shards=*/1);
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  EXPECT_EQ(index.misses(), 1);
+  EXPECT_EQ(index.hits(), 1);
+
+  // A different number of stripes is cached separately.
+  EXPECT_EQ(index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/2).bits(),
+            2);
+  EXPECT_EQ(index.misses(), 2);
+
+  // Evicts the least recently used entry once the capacity is exceeded.
+  index.GetQualifyingStripes(/*value=*/4, /*num_stripes=*/3);
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  index.GetQualifyingStripes(/*value=*/5, /*num_stripes=*/3);
+  EXPECT_EQ(index.misses(), 5);
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  EXPECT_EQ(index.hits(), 2);
+  index.GetQualifyingStripes(/*value=*/4, /*num_stripes=*/3);
+  EXPECT_EQ(index.misses(), 6);
+}
+
+TEST(CachingIndexStructureTest, PrefixLookupsOnCuckooIndex) {
+  std::vector<long> data;
+  for (long row = 0; row < 60; ++row) data.push_back(row % 7);
+  const ColumnPtr column = Column::IntColumn("long-column", std::move(data));
+  const size_t num_stripes = 20;
+  const IndexStructurePtr cuckoo_index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/false)
+          .Create(*column, /*num_rows_per_stripe=*/3);
+  CachingIndexStructure index(
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/false)
+          .Create(*column, /*num_rows_per_stripe=*/3),
+      /*capacity=*/4, /*num_shards=*/1);
+
+  // The second round of lookups of both the prefix and all stripes hits.
+  for (size_t round = 0; round < 2; ++round) {
+    for (const size_t n : {num_stripes / 2, num_stripes}) {
+      const Bitmap64 expected = cuckoo_index->GetQualifyingStripes(3, n);
+      const Bitmap64 result = index.GetQualifyingStripes(3, n);
+      ASSERT_EQ(result.bits(), n);
+      EXPECT_EQ(result.ToString(), expected.ToString());
+      Bitmap64 candidates(/*size=*/n, /*fill_value=*/true);
+      index.FilterQualifyingStripes(3, &candidates);
+      EXPECT_EQ(candidates.ToString(), expected.ToString());
+    }
+  }
+  EXPECT_EQ(index.misses(), 2);
+  EXPECT_EQ(index.hits(), 6);
+}
+
+// A zone map estimating the selectivity of `value` as `value` / 10.
+class SelectivityZoneMap : public ZoneMap {
+ public:
+  using ZoneMap::ZoneMap;
+
+  double EstimateSelectivity(long value) const override { return value / 10.0; }
+};
+
+TEST(CachingIndexStructureTest, ForwardsSelectivityEstimates) {
+  CachingIndexStructure index(
+      absl::make_unique<SelectivityZoneMap>(
+          /*data=*/std::vector<long>{1, 2, 3, 4, 2, 5},
+          /*num_rows_per_stripe=*/2),
+      /*capacity=*/4, /*num_shards=*/1);
+  EXPECT_DOUBLE_EQ(index.EstimateSelectivity(3), 0.3);
+  EXPECT_DOUBLE_EQ(index.EstimateSelectivity(7), 0.7);
+  // Estimates don't look up the value.
+  EXPECT_EQ(index.misses(), 0);
+}
+
+TEST(CachingIndexStructureTest, ForwardsPruningStats) {
+  std::vector<IndexStructurePtr> children;
+  children.push_back(CreateZoneMap());
+  children.push_back(CreateZoneMap());
+  CachingIndexStructure index(
+      absl::make_unique<CompositeIndex>(std::move(children)), /*capacity=*/4,
+      /*num_shards=*/1);
+  // Stripe 1 ([3, 4]) qualifies for neither child.
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  index.GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3);
+  std::vector<PruningStats> stats = index.pruning_stats();
+  ASSERT_EQ(stats.size(), 2);
+  // The second lookup is a hit and doesn't reach the children.
+  EXPECT_EQ(stats[0].num_candidate_stripes(), 3);
+  EXPECT_EQ(stats[0].num_pruned_stripes(), 1);
+
+  index.ResetPruningStats();
+  stats = index.pruning_stats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].num_candidate_stripes(), 0);
+}
+
+TEST(CachingIndexStructureTest, ConcurrentLookups) {
+  CachingIndexStructure index(CreateZoneMap(), /*capacity=*/4,
+                              /*num_shards=*/2);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&index]() {
+      for (size_t i = 0; i < 1000; ++i) {
+        const long value = i % 3 + 1;
+        const Bitmap64 result = index.GetQualifyingStripes(value, 3);
+        EXPECT_EQ(result.Get(0), value <= 2);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(index.hits() + index.misses(), 4000);
+}
+
+}  // namespace ci
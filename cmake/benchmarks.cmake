@@ -4,25 +4,76 @@ add_executable(build_benchmark "${PROJECT_SOURCE_DIR}/build_benchmark.cc")
 target_link_libraries(build_benchmark 
   cuckoo_index
   cuckoo_utils
+  data_generators
   index_structure
+  per_stripe_blocked_bloom
   per_stripe_bloom
   per_stripe_xor
+  common_allocation_hooks
   common_profiling
   absl::flags
   absl::flags_parse
+  absl::strings
   benchmark
   gtest
 )
 
+add_executable(concurrent_lookup_benchmark "${PROJECT_SOURCE_DIR}/concurrent_lookup_benchmark.cc")
+target_link_libraries(concurrent_lookup_benchmark 
+  caching_index_structure
+  cuckoo_index
+  cuckoo_utils
+  data
+  index_structure
+  per_stripe_blocked_bloom
+  per_stripe_bloom
+  per_stripe_xor
+  zone_map
+  absl::flags
+  absl::flags_parse
+  absl::memory
+  absl::strings
+  absl::str_format
+  benchmark
+)
+
 add_executable(lookup_benchmark "${PROJECT_SOURCE_DIR}/lookup_benchmark.cc")
 target_link_libraries(lookup_benchmark 
+  caching_index_structure
   cuckoo_index
   cuckoo_utils
+  data_generators
   index_structure
+  per_stripe_blocked_bloom
   per_stripe_bloom
   per_stripe_xor
+  common_latency_histogram
+  common_perf_counters
+  common_profiling
   absl::flags
   absl::flags_parse
+  absl::random_random
+  absl::strings
+  absl::str_format
+  absl::span
   benchmark
   gtest
-)
\ No newline at end of file
+)
+
+add_executable(scaling_benchmark "${PROJECT_SOURCE_DIR}/scaling_benchmark.cc")
+target_link_libraries(scaling_benchmark 
+  cuckoo_index
+  cuckoo_utils
+  data_generators
+  index_structure
+  per_stripe_bloom
+  per_stripe_xor
+  common_bitmap
+  absl::flags
+  absl::flags_parse
+  absl::memory
+  absl::strings
+  absl::str_format
+  absl::span
+  benchmark
+)
@@ -1,3 +1,10 @@
+# Replaces the global operator new and delete, so it's an object library that
+# is linked in even though nothing references it.
+add_library(common_allocation_hooks OBJECT "${PROJECT_SOURCE_DIR}/common/allocation_hooks.cc")
+target_link_libraries(common_allocation_hooks
+  common_profiling
+)
+
 add_library(common_byte_coding "${PROJECT_SOURCE_DIR}/common/byte_coding.h")
 target_link_libraries(common_byte_coding
   absl::strings
@@ -16,12 +23,39 @@ target_link_libraries(common_bit_packing
 add_library(common_bitmap "${PROJECT_SOURCE_DIR}/common/bitmap.h")
 target_link_libraries(common_bitmap
   absl::strings
-  Boost::dynamic_bitset
+)
+
+add_library(common_hyper_log_log "${PROJECT_SOURCE_DIR}/common/hyper_log_log.h")
+
+add_library(common_latency_histogram "${PROJECT_SOURCE_DIR}/common/latency_histogram.h")
+
+add_library(common_mapped_file "${PROJECT_SOURCE_DIR}/common/mapped_file.cc" "${PROJECT_SOURCE_DIR}/common/mapped_file.h")
+target_link_libraries(common_mapped_file
+  absl::memory
+  absl::strings
+)
+
+add_library(common_lru_cache "${PROJECT_SOURCE_DIR}/common/lru_cache.h")
+target_link_libraries(common_lru_cache
+  absl::flat_hash_map
+  absl::synchronization
+)
+
+add_library(common_memoized "${PROJECT_SOURCE_DIR}/common/memoized.h")
+target_link_libraries(common_memoized
+  absl::base
+)
+
+add_library(common_perf_counters "${PROJECT_SOURCE_DIR}/common/perf_counters.cc" "${PROJECT_SOURCE_DIR}/common/perf_counters.h")
+target_link_libraries(common_perf_counters
+  absl::memory
 )
 
 add_library(common_profiling "${PROJECT_SOURCE_DIR}/common/profiling.cc" "${PROJECT_SOURCE_DIR}/common/profiling.h")
 target_link_libraries(common_profiling
+  absl::core_headers
   absl::flat_hash_map
+  absl::synchronization
   absl::time
 )
 
@@ -29,5 +63,15 @@ add_library(common_rle_bitmap "${PROJECT_SOURCE_DIR}/common/rle_bitmap.cc" "${PR
 target_link_libraries(common_rle_bitmap
   common_bit_packing
   common_bitmap
+  common_byte_coding
+  common_profiling
+  absl::memory
   absl::strings
+  absl::span
+)
+
+add_library(common_stripe_set "${PROJECT_SOURCE_DIR}/common/stripe_set.cc" "${PROJECT_SOURCE_DIR}/common/stripe_set.h")
+target_link_libraries(common_stripe_set
+  common_bitmap
+  absl::memory
 )
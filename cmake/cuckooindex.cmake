@@ -49,13 +49,25 @@ add_library(data "${PROJECT_SOURCE_DIR}/data.cc" "${PROJECT_SOURCE_DIR}/data.h")
 target_link_libraries(data
   evaluation_utils
   common_byte_coding
+  common_hyper_log_log
+  common_mapped_file
+  common_memoized
   Boost::math
   Boost::multiprecision
+  absl::flat_hash_map
   absl::flat_hash_set
+  absl::city
   absl::memory
   absl::random_random
   absl::strings
-  csv-parser
+)
+
+add_library(data_generators "${PROJECT_SOURCE_DIR}/data_generators.cc" "${PROJECT_SOURCE_DIR}/data_generators.h")
+target_link_libraries(data_generators
+  cuckoo_utils
+  data
+  absl::strings
+  absl::span
 )
 
 add_library(per_stripe_bloom "${PROJECT_SOURCE_DIR}/per_stripe_bloom.h")
@@ -63,47 +75,119 @@ target_link_libraries(per_stripe_bloom
   data
   evaluation_utils
   index_structure
+  common_memoized
+  absl::flat_hash_set
+  absl::memory
   absl::strings
+  absl::span
   leveldb
 )
 
+add_library(per_stripe_blocked_bloom "${PROJECT_SOURCE_DIR}/per_stripe_blocked_bloom.h")
+target_link_libraries(per_stripe_blocked_bloom
+  data
+  evaluation_utils
+  index_structure
+  common_memoized
+  absl::flat_hash_set
+  absl::memory
+  absl::span
+)
+
 add_library(xor_filter "${PROJECT_SOURCE_DIR}/xor_filter.h")
 target_link_libraries(xor_filter
   absl::strings
   xor_singleheader
 )
 
-add_library(per_stripe_xor "${PROJECT_SOURCE_DIR}/per_stripe_xor.h")
+add_library(per_stripe_xor "${PROJECT_SOURCE_DIR}/per_stripe_xor.cc" "${PROJECT_SOURCE_DIR}/per_stripe_xor.h")
 target_link_libraries(per_stripe_xor
   data
   evaluation_utils
   index_structure
+  common_mapped_file
+  common_memoized
+  absl::flat_hash_set
+  absl::memory
   absl::strings
-  xor_singleheader
+  absl::span
 )
 
 add_library(cuckoo_index "${PROJECT_SOURCE_DIR}/cuckoo_index.cc" "${PROJECT_SOURCE_DIR}/cuckoo_index.h")
 target_link_libraries(cuckoo_index
   cuckoo_kicker
+  cuckoo_matcher
   cuckoo_utils
   evaluation_utils
   fingerprint_store
   index_structure
+  slot_bitmaps
   common_byte_coding
+  common_mapped_file
+  common_memoized
   common_profiling
   common_rle_bitmap
+  common_stripe_set
+  croaring
+  absl::flat_hash_map
+  absl::memory
+  absl::strings
+  absl::synchronization
+)
+
+add_library(partitioned_cuckoo_index "${PROJECT_SOURCE_DIR}/partitioned_cuckoo_index.cc" "${PROJECT_SOURCE_DIR}/partitioned_cuckoo_index.h")
+target_link_libraries(partitioned_cuckoo_index
+  cuckoo_index
+  cuckoo_utils
+  data
+  index_structure
+  common_byte_coding
+  common_mapped_file
+  common_profiling
+  common_stripe_set
   absl::flat_hash_map
   absl::memory
   absl::strings
+  absl::synchronization
+  absl::span
+)
+
+add_library(compressed_chunks "${PROJECT_SOURCE_DIR}/compressed_chunks.cc" "${PROJECT_SOURCE_DIR}/compressed_chunks.h")
+target_link_libraries(compressed_chunks
+  evaluation_utils
+  common_byte_coding
+  common_lru_cache
+  absl::strings
+  absl::span
+)
+
+add_library(slot_bitmaps "${PROJECT_SOURCE_DIR}/slot_bitmaps.cc" "${PROJECT_SOURCE_DIR}/slot_bitmaps.h")
+target_link_libraries(slot_bitmaps
+  compressed_chunks
+  common_bitmap
+  common_byte_coding
+  common_rle_bitmap
+  croaring
+  absl::memory
+  absl::strings
+  absl::span
 )
 
 add_library(cuckoo_kicker "${PROJECT_SOURCE_DIR}/cuckoo_kicker.cc" "${PROJECT_SOURCE_DIR}/cuckoo_kicker.h")
 target_link_libraries(cuckoo_kicker
   cuckoo_utils
+  common_profiling
   absl::flat_hash_map
+  absl::flat_hash_set
   absl::random_random
 )
 
+add_library(cuckoo_matcher "${PROJECT_SOURCE_DIR}/cuckoo_matcher.cc" "${PROJECT_SOURCE_DIR}/cuckoo_matcher.h")
+target_link_libraries(cuckoo_matcher
+  cuckoo_utils
+  absl::span
+)
+
 add_library(evaluation_utils "${PROJECT_SOURCE_DIR}/evaluation_utils.cc" "${PROJECT_SOURCE_DIR}/evaluation_utils.h")
 target_link_libraries(evaluation_utils
   evaluation_cc_proto
@@ -120,6 +204,7 @@ target_link_libraries(cuckoo_utils
   common_bit_packing
   common_bitmap
   common_byte_coding
+  common_profiling
   croaring
   absl::flat_hash_set
   absl::city
@@ -130,11 +215,15 @@ target_link_libraries(cuckoo_utils
 
 add_library(fingerprint_store "${PROJECT_SOURCE_DIR}/fingerprint_store.cc" "${PROJECT_SOURCE_DIR}/fingerprint_store.h")
 target_link_libraries(fingerprint_store
+  compressed_chunks
   cuckoo_utils
   evaluation_utils
   common_bitmap
+  common_memoized
+  common_profiling
   common_rle_bitmap
   absl::flat_hash_map
+  absl::memory
   absl::strings
 )
 
@@ -142,15 +231,77 @@ add_library(index_structure "${PROJECT_SOURCE_DIR}/index_structure.h")
 target_link_libraries(index_structure
   data
   evaluation_cc_proto
+  absl::memory
+  absl::strings
+  absl::span
 )
 
-add_library(zone_map "${PROJECT_SOURCE_DIR}/zone_map.h")
+add_library(zone_map "${PROJECT_SOURCE_DIR}/zone_map.cc" "${PROJECT_SOURCE_DIR}/zone_map.h")
 target_link_libraries(zone_map
   data
   evaluation_utils
   index_structure
+  common_bit_packing
+  common_byte_coding
+  common_memoized
+  absl::memory
+  absl::strings
+  absl::span
+)
+
+add_library(caching_index_structure "${PROJECT_SOURCE_DIR}/caching_index_structure.h")
+target_link_libraries(caching_index_structure
+  common_bitmap
+  common_lru_cache
+  index_structure
+  absl::hash
+  absl::memory
+  absl::strings
+)
+
+add_library(composite_index "${PROJECT_SOURCE_DIR}/composite_index.cc" "${PROJECT_SOURCE_DIR}/composite_index.h")
+target_link_libraries(composite_index
+  data
+  evaluation_cc_proto
+  index_structure
   absl::memory
   absl::strings
+  absl::span
+)
+
+add_library(index_advisor "${PROJECT_SOURCE_DIR}/index_advisor.cc" "${PROJECT_SOURCE_DIR}/index_advisor.h")
+target_link_libraries(index_advisor
+  cuckoo_index
+  data
+  evaluation_utils
+  index_structure
+  per_stripe_bloom
+  per_stripe_xor
+  zone_map
+  common_bitmap
+  absl::flat_hash_map
+  absl::flat_hash_set
+  absl::memory
+  absl::strings
+  absl::span
+)
+
+add_library(table_indexer "${PROJECT_SOURCE_DIR}/table_indexer.cc" "${PROJECT_SOURCE_DIR}/table_indexer.h")
+target_link_libraries(table_indexer
+  data
+  index_structure
+  common_profiling
+  absl::flat_hash_map
+  absl::synchronization
+  absl::span
+)
+
+add_library(predicate_evaluator "${PROJECT_SOURCE_DIR}/predicate_evaluator.cc" "${PROJECT_SOURCE_DIR}/predicate_evaluator.h")
+target_link_libraries(predicate_evaluator
+  index_structure
+  table_indexer
+  common_bitmap
+  absl::span
 )
 
 add_library(evaluator "${PROJECT_SOURCE_DIR}/evaluator.cc" "${PROJECT_SOURCE_DIR}/evaluator.h")
@@ -158,12 +309,16 @@ target_link_libraries(evaluator
   data
   evaluation_cc_proto
   index_structure
+  common_bitmap
+  common_stripe_set
+  absl::flat_hash_map
   absl::random_random
   absl::str_format
 )
 
 add_executable(evaluate "${PROJECT_SOURCE_DIR}/evaluate.cc")
 target_link_libraries(evaluate 
+  composite_index
   cuckoo_index
   cuckoo_utils
   data
@@ -6,6 +6,20 @@ target_link_libraries(data_test
   gtest_main
 )
 
+add_executable(data_generators_test "${PROJECT_SOURCE_DIR}/data_generators_test.cc")
+target_link_libraries(data_generators_test 
+  data_generators
+  absl::flat_hash_map
+  absl::flat_hash_set
+  gtest_main
+)
+
+add_executable(per_stripe_blocked_bloom_test "${PROJECT_SOURCE_DIR}/per_stripe_blocked_bloom_test.cc")
+target_link_libraries(per_stripe_blocked_bloom_test 
+  per_stripe_blocked_bloom
+  gtest_main
+)
+
 add_executable(per_stripe_bloom_test "${PROJECT_SOURCE_DIR}/per_stripe_bloom_test.cc")
 target_link_libraries(per_stripe_bloom_test 
   per_stripe_bloom
@@ -30,12 +44,37 @@ target_link_libraries(cuckoo_index_test
   gtest_main
 )
 
+add_executable(partitioned_cuckoo_index_test "${PROJECT_SOURCE_DIR}/partitioned_cuckoo_index_test.cc")
+target_link_libraries(partitioned_cuckoo_index_test 
+  partitioned_cuckoo_index
+  gtest_main
+)
+
+add_executable(compressed_chunks_test "${PROJECT_SOURCE_DIR}/compressed_chunks_test.cc")
+target_link_libraries(compressed_chunks_test 
+  compressed_chunks
+  gtest_main
+)
+
+add_executable(slot_bitmaps_test "${PROJECT_SOURCE_DIR}/slot_bitmaps_test.cc")
+target_link_libraries(slot_bitmaps_test 
+  slot_bitmaps
+  gtest_main
+)
+
 add_executable(cuckoo_kicker_test "${PROJECT_SOURCE_DIR}/cuckoo_kicker_test.cc")
 target_link_libraries(cuckoo_kicker_test 
   cuckoo_kicker
   gtest_main
 )
 
+add_executable(cuckoo_matcher_test "${PROJECT_SOURCE_DIR}/cuckoo_matcher_test.cc")
+target_link_libraries(cuckoo_matcher_test 
+  cuckoo_kicker
+  cuckoo_matcher
+  gtest_main
+)
+
 add_executable(evaluation_utils_test "${PROJECT_SOURCE_DIR}/evaluation_utils_test.cc")
 target_link_libraries(evaluation_utils_test 
   evaluation_utils
@@ -46,6 +85,7 @@ add_executable(cuckoo_utils_test "${PROJECT_SOURCE_DIR}/cuckoo_utils_test.cc")
 target_link_libraries(cuckoo_utils_test 
   cuckoo_utils
   evaluation_utils
+  absl::memory
   gtest_main
 )
 
@@ -55,6 +95,60 @@ target_link_libraries(fingerprint_store_test
   gtest_main
 )
 
+add_executable(caching_index_structure_test "${PROJECT_SOURCE_DIR}/caching_index_structure_test.cc")
+target_link_libraries(caching_index_structure_test 
+  caching_index_structure
+  composite_index
+  cuckoo_index
+  cuckoo_utils
+  data
+  zone_map
+  gtest_main
+)
+
+add_executable(composite_index_test "${PROJECT_SOURCE_DIR}/composite_index_test.cc")
+target_link_libraries(composite_index_test 
+  composite_index
+  cuckoo_index
+  cuckoo_utils
+  partitioned_cuckoo_index
+  per_stripe_blocked_bloom
+  zone_map
+  gtest_main
+)
+
+add_executable(index_advisor_test "${PROJECT_SOURCE_DIR}/index_advisor_test.cc")
+target_link_libraries(index_advisor_test 
+  data_generators
+  index_advisor
+  absl::strings
+  gtest_main
+)
+
+add_executable(table_indexer_test "${PROJECT_SOURCE_DIR}/table_indexer_test.cc")
+target_link_libraries(table_indexer_test 
+  table_indexer
+  cuckoo_index
+  zone_map
+  gtest_main
+)
+
+add_executable(predicate_evaluator_test "${PROJECT_SOURCE_DIR}/predicate_evaluator_test.cc")
+target_link_libraries(predicate_evaluator_test 
+  predicate_evaluator
+  cuckoo_index
+  zone_map
+  gtest_main
+)
+
+add_executable(evaluator_test "${PROJECT_SOURCE_DIR}/evaluator_test.cc")
+target_link_libraries(evaluator_test 
+  evaluator
+  per_stripe_bloom
+  zone_map
+  gtest_main
+)
+
 add_executable(zone_map_test "${PROJECT_SOURCE_DIR}/zone_map_test.cc")
 target_link_libraries(zone_map_test 
   zone_map
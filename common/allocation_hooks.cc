@@ -0,0 +1,146 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: allocation_hooks.cc
+// -----------------------------------------------------------------------------
+//
+// Replaces the global operator new and delete to count the allocations of each
+// thread in GetThreadAllocationStats() (see common/profiling.h). Every
+// allocation then costs a malloc_usable_size(..) call and a few thread-local
+// adds, so only link this into binaries reporting memory usage (e.g.,
+// build_benchmark).
+
+#include <malloc.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "common/profiling.h"
+
+namespace {
+
+void RecordAllocation(void* ptr) {
+  ci::AllocationStats& stats = ci::GetThreadAllocationStats();
+  const int64_t size = malloc_usable_size(ptr);
+  stats.allocated_bytes += size;
+  ++stats.num_allocations;
+  stats.live_bytes += size;
+  if (stats.live_bytes > stats.peak_live_bytes)
+    stats.peak_live_bytes = stats.live_bytes;
+}
+
+// Returns nullptr if out of memory.
+void* Allocate(std::size_t size) {
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr != nullptr) RecordAllocation(ptr);
+  return ptr;
+}
+
+void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, static_cast<std::size_t>(alignment),
+                     size == 0 ? 1 : size) != 0)
+    return nullptr;
+  RecordAllocation(ptr);
+  return ptr;
+}
+
+void Deallocate(void* ptr) {
+  if (ptr == nullptr) return;
+  ci::GetThreadAllocationStats().live_bytes -= malloc_usable_size(ptr);
+  std::free(ptr);
+}
+
+[[maybe_unused]] const bool kRegistered =
+    (ci::internal::SetAllocationHooksInstalled(), true);
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  void* ptr = Allocate(size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  void* ptr = AllocateAligned(size, alignment);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { Deallocate(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept { Deallocate(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  Deallocate(ptr);
+}
@@ -224,6 +224,8 @@ class BitPackedReader {
   BitPackedReader(const BitPackedReader&) = default;
   BitPackedReader& operator=(const BitPackedReader&) = default;
 
+  long bit_width() const { return bit_width_; }
+
   // Read the value at the given index.
   T Get(size_t index) const {
     const size_t bit0_offset = index * bit_width_;
@@ -251,9 +253,21 @@ class BitPackedReader {
     return static_cast<T>(val & internal::FastBitMask(bit_width_));
   }
 
+  // Returns the `num_values` values starting at `index` packed into a single
+  // word, the first one in the least significant bits. E.g., for bit_width() =
+  // 1 this reads `num_values` bits at once. Requires `num_values` *
+  // bit_width() <= 57.
+  uint64_t GetPacked(size_t index, size_t num_values) const {
+    const size_t bit0_offset = index * bit_width_;
+    assert(num_values * bit_width_ < internal::kMaxSingleWordBitWidth);
+    return (absl::little_endian::Load64(data_ + (bit0_offset >> 3)) >>
+            (bit0_offset & 0x7)) &
+           internal::FastBitMask(num_values * bit_width_);
+  }
+
   // Unpacks 'size' values starting at index 0. For each value calls
   // 'add_value(size_t i, T value)'; appending the values one-by-one for
-  // increasing 'i'. Note: currently only implemented for T = uint32_t.
+  // increasing 'i'.
   //
   // Note: we could consider getting rid of the lambda and instead always
   // fill an array. This would simplify the code and lead to less inlining.
@@ -332,13 +346,146 @@ struct Unroll<kBitWidth, kShift, kMaxIndex, kMaxIndex> {
                          const AddValueLambda& add_value) {}
 };
 
+// The variant of Unroll for uint64_t values: walks 64 bit words, and values
+// crossing a word boundary are combined from both words. After 64 values
+// `kShift` is back at 0 for every bit-width.
+constexpr size_t kUnrollCount64 = 64;
+
+template <size_t kBitWidth, size_t kShift, size_t kMaxIndex, size_t kIndex>
+struct Unroll64 {
+  template <typename AddValueLambda>
+  static inline void Get(const char** data, const AddValueLambda& add_value) {
+    uint64_t value = absl::little_endian::Load64(*data) >> kShift;
+    if constexpr (kShift + kBitWidth > 64)
+      value |= absl::little_endian::Load64(*data + 8) << (64 - kShift);
+    constexpr uint64_t mask =
+        kBitWidth == 64 ? ~0ULL : (1ULL << (kBitWidth % 64)) - 1;
+    add_value(kIndex, value & mask);
+
+    // Advance data if we reached into the next 8 byte word.
+    if (kShift + kBitWidth >= 64) *data += 8;
+
+    const size_t kNextShift = (kShift + kBitWidth) % 64;
+    Unroll64<kBitWidth, kNextShift, kMaxIndex, kIndex + 1>::Get(data,
+                                                                add_value);
+  }
+};
+
+template <size_t kBitWidth, size_t kShift, size_t kMaxIndex>
+struct Unroll64<kBitWidth, kShift, kMaxIndex, kMaxIndex> {
+  template <typename AddValueLambda>
+  static inline void Get(const char** /*data*/,
+                         const AddValueLambda& /*add_value*/) {}
+};
+
 }  // namespace internal
 
 template <typename T>
 template <typename AddValueLambda>
 inline void BitPackedReader<T>::GetBatch(size_t size,
                                          const AddValueLambda& add_value) {
-  // "Transform" the member field 'bit_width_' into a constexpr.
+  // "Transform" the member field 'bit_width_' into a constexpr. Bit-widths
+  // above 32 only exist for uint64_t.
+  if constexpr (std::is_same<T, uint64_t>::value) {
+    switch (bit_width_) {
+      case 33:
+        GetBatchImpl<AddValueLambda, 33>(size, add_value);
+        return;
+      case 34:
+        GetBatchImpl<AddValueLambda, 34>(size, add_value);
+        return;
+      case 35:
+        GetBatchImpl<AddValueLambda, 35>(size, add_value);
+        return;
+      case 36:
+        GetBatchImpl<AddValueLambda, 36>(size, add_value);
+        return;
+      case 37:
+        GetBatchImpl<AddValueLambda, 37>(size, add_value);
+        return;
+      case 38:
+        GetBatchImpl<AddValueLambda, 38>(size, add_value);
+        return;
+      case 39:
+        GetBatchImpl<AddValueLambda, 39>(size, add_value);
+        return;
+      case 40:
+        GetBatchImpl<AddValueLambda, 40>(size, add_value);
+        return;
+      case 41:
+        GetBatchImpl<AddValueLambda, 41>(size, add_value);
+        return;
+      case 42:
+        GetBatchImpl<AddValueLambda, 42>(size, add_value);
+        return;
+      case 43:
+        GetBatchImpl<AddValueLambda, 43>(size, add_value);
+        return;
+      case 44:
+        GetBatchImpl<AddValueLambda, 44>(size, add_value);
+        return;
+      case 45:
+        GetBatchImpl<AddValueLambda, 45>(size, add_value);
+        return;
+      case 46:
+        GetBatchImpl<AddValueLambda, 46>(size, add_value);
+        return;
+      case 47:
+        GetBatchImpl<AddValueLambda, 47>(size, add_value);
+        return;
+      case 48:
+        GetBatchImpl<AddValueLambda, 48>(size, add_value);
+        return;
+      case 49:
+        GetBatchImpl<AddValueLambda, 49>(size, add_value);
+        return;
+      case 50:
+        GetBatchImpl<AddValueLambda, 50>(size, add_value);
+        return;
+      case 51:
+        GetBatchImpl<AddValueLambda, 51>(size, add_value);
+        return;
+      case 52:
+        GetBatchImpl<AddValueLambda, 52>(size, add_value);
+        return;
+      case 53:
+        GetBatchImpl<AddValueLambda, 53>(size, add_value);
+        return;
+      case 54:
+        GetBatchImpl<AddValueLambda, 54>(size, add_value);
+        return;
+      case 55:
+        GetBatchImpl<AddValueLambda, 55>(size, add_value);
+        return;
+      case 56:
+        GetBatchImpl<AddValueLambda, 56>(size, add_value);
+        return;
+      case 57:
+        GetBatchImpl<AddValueLambda, 57>(size, add_value);
+        return;
+      case 58:
+        GetBatchImpl<AddValueLambda, 58>(size, add_value);
+        return;
+      case 59:
+        GetBatchImpl<AddValueLambda, 59>(size, add_value);
+        return;
+      case 60:
+        GetBatchImpl<AddValueLambda, 60>(size, add_value);
+        return;
+      case 61:
+        GetBatchImpl<AddValueLambda, 61>(size, add_value);
+        return;
+      case 62:
+        GetBatchImpl<AddValueLambda, 62>(size, add_value);
+        return;
+      case 63:
+        GetBatchImpl<AddValueLambda, 63>(size, add_value);
+        return;
+      case 64:
+        GetBatchImpl<AddValueLambda, 64>(size, add_value);
+        return;
+    }
+  }
   switch (bit_width_) {
     case 0:
       GetBatchImpl<AddValueLambda, 0>(size, add_value);
@@ -448,16 +595,27 @@ template <typename T>
 template <typename AddValueLambda, long kBitWidth>
 inline void BitPackedReader<T>::GetBatchImpl(size_t size,
                                              const AddValueLambda& add_value) {
-  static_assert(std::is_same<T, uint32_t>::value, "Unexpected type");
   assert(kBitWidth == bit_width_);
-  const uint32_t* data = reinterpret_cast<const uint32_t*>(data_);
 
-  // Retrieve the batch of values by repeatedly calling Unroll::Get(..).
+  // Retrieve the batch of values by repeatedly calling Unroll::Get(..) (or
+  // Unroll64::Get(..)).
   size_t offset = 0;
-  while (offset + internal::kUnrollCount <= size) {
-    internal::Unroll<kBitWidth, 0, internal::kUnrollCount, 0>::Get(
-        &data, [&](size_t i, uint32_t value) { add_value(offset + i, value); });
-    offset += internal::kUnrollCount;
+  if constexpr (std::is_same<T, uint64_t>::value) {
+    const char* data = data_;
+    while (offset + internal::kUnrollCount64 <= size) {
+      internal::Unroll64<kBitWidth, 0, internal::kUnrollCount64, 0>::Get(
+          &data,
+          [&](size_t i, uint64_t value) { add_value(offset + i, value); });
+      offset += internal::kUnrollCount64;
+    }
+  } else {
+    const uint32_t* data = reinterpret_cast<const uint32_t*>(data_);
+    while (offset + internal::kUnrollCount <= size) {
+      internal::Unroll<kBitWidth, 0, internal::kUnrollCount, 0>::Get(
+          &data,
+          [&](size_t i, uint32_t value) { add_value(offset + i, value); });
+      offset += internal::kUnrollCount;
+    }
   }
   // Take care of the remaining 'size - offset' values.
   while (offset < size) {
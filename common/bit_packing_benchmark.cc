@@ -52,10 +52,13 @@
 // BM_BatchRead_6Bits_31Vals      0.852 ns        0.852 ns    799455187
 
 #include <limits>
+#include <random>
 #include <vector>
 
 #include "benchmark/benchmark.h"
 #include "common/bit_packing.h"
+#include "common/bitmap.h"
+#include "common/rle_bitmap.h"
 
 namespace ci {
 namespace {
@@ -202,5 +205,122 @@ static void BM_BatchRead_6Bits_31Vals(benchmark::State& state) {
 }
 BENCHMARK(BM_BatchRead_6Bits_31Vals);
 
+// 64 bit versions of the above, e.g., for reading fingerprint blocks.
+void ReadBitPacked64(benchmark::State& state, long size, uint64_t value) {
+  const std::vector<uint64_t> vec(size, value);
+  const long bw = BitWidth(value);
+  ByteBuffer buffer;
+  StoreBitPacked<uint64_t>(vec, bw, &buffer);
+  PutSlopBytes(&buffer);
+
+  while (state.KeepRunningBatch(size)) {
+    BitPackedReader<uint64_t> reader(bw, buffer.data());
+    for (long i = 0; i < size; ++i) benchmark::DoNotOptimize(reader.Get(i));
+  }
+}
+
+void BatchReadBitPacked64(benchmark::State& state, long size, uint64_t value) {
+  const std::vector<uint64_t> vec(size, value);
+  const long bw = BitWidth(value);
+  ByteBuffer buffer;
+  StoreBitPacked<uint64_t>(vec, bw, &buffer);
+  PutSlopBytes(&buffer);
+
+  std::vector<uint64_t> batch(size);
+  while (state.KeepRunningBatch(size)) {
+    BitPackedReader<uint64_t> reader(bw, buffer.data());
+    reader.GetBatch(size, [&](size_t i, uint64_t value) { batch[i] = value; });
+    benchmark::DoNotOptimize(batch.data());
+  }
+  assert(batch[0] == value);
+}
+
+static void BM_Read64_7Bits(benchmark::State& state) {
+  ReadBitPacked64(state, kArraySize, 127);
+}
+BENCHMARK(BM_Read64_7Bits);
+
+static void BM_Read64_45Bits(benchmark::State& state) {
+  ReadBitPacked64(state, kArraySize, (1ULL << 45) - 1);
+}
+BENCHMARK(BM_Read64_45Bits);
+
+static void BM_Read64_61Bits(benchmark::State& state) {
+  ReadBitPacked64(state, kArraySize, (1ULL << 61) - 1);
+}
+BENCHMARK(BM_Read64_61Bits);
+
+static void BM_BatchRead64_7Bits(benchmark::State& state) {
+  BatchReadBitPacked64(state, kArraySize, 127);
+}
+BENCHMARK(BM_BatchRead64_7Bits);
+
+static void BM_BatchRead64_45Bits(benchmark::State& state) {
+  BatchReadBitPacked64(state, kArraySize, (1ULL << 45) - 1);
+}
+BENCHMARK(BM_BatchRead64_45Bits);
+
+static void BM_BatchRead64_61Bits(benchmark::State& state) {
+  BatchReadBitPacked64(state, kArraySize, (1ULL << 61) - 1);
+}
+BENCHMARK(BM_BatchRead64_61Bits);
+
+static void BM_BatchRead64_64Bits(benchmark::State& state) {
+  BatchReadBitPacked64(state, kArraySize,
+                       std::numeric_limits<uint64_t>::max());
+}
+BENCHMARK(BM_BatchRead64_64Bits);
+
+// Measures the throughput (in bits) of extracting all of `bitmap` from its
+// RleBitmap.
+void ExtractRleBitmap(benchmark::State& state, const Bitmap64& bitmap) {
+  const RleBitmap rle_bitmap(bitmap);
+  Bitmap64 result;
+  while (state.KeepRunningBatch(bitmap.bits())) {
+    rle_bitmap.ExtractInto(/*offset=*/0, bitmap.bits(), &result);
+    benchmark::DoNotOptimize(result.GetWord(0));
+  }
+}
+
+// Returns a bitmap with runs of ones and zeroes of up to `max_run_length`
+// bits, and each bit set with `density` in between.
+Bitmap64 CreateRleInput(size_t max_run_length, double density) {
+  std::mt19937 gen(42);
+  std::bernoulli_distribution bit(density);
+  std::uniform_int_distribution<size_t> run_length(1, max_run_length);
+  Bitmap64 bitmap(kArraySize);
+  for (size_t i = 0; i < bitmap.bits();) {
+    const size_t end = std::min<size_t>(i + run_length(gen), bitmap.bits());
+    const size_t kind = gen() % 3;
+    for (; i < end; ++i) bitmap.Set(i, kind == 0 ? bit(gen) : kind == 1);
+  }
+  return bitmap;
+}
+
+static void BM_Extract_RandomBits(benchmark::State& state) {
+  ExtractRleBitmap(state, CreateRleInput(/*max_run_length=*/1,
+                                         /*density=*/0.5));
+}
+BENCHMARK(BM_Extract_RandomBits);
+
+static void BM_Extract_ShortRuns(benchmark::State& state) {
+  ExtractRleBitmap(state, CreateRleInput(/*max_run_length=*/64,
+                                         /*density=*/0.5));
+}
+BENCHMARK(BM_Extract_ShortRuns);
+
+static void BM_Extract_LongRuns(benchmark::State& state) {
+  ExtractRleBitmap(state, CreateRleInput(/*max_run_length=*/1024,
+                                         /*density=*/0.5));
+}
+BENCHMARK(BM_Extract_LongRuns);
+
+static void BM_Extract_Sparse(benchmark::State& state) {
+  Bitmap64 bitmap(kArraySize);
+  for (size_t i = 0; i < bitmap.bits(); i += 997) bitmap.Set(i, true);
+  ExtractRleBitmap(state, bitmap);
+}
+BENCHMARK(BM_Extract_Sparse);
+
 }  // namespace
 }  // namespace ci
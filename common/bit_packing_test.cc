@@ -181,6 +181,50 @@ TEST(BitPackingTest, BitPack32GetRange) {
   }
 }
 
+// Test bit-widths 0-64 with array-lengths 0-300.
+TEST(BitPackingTest, BitPack64GetRange) {
+  constexpr long kMaxLength = 300;
+
+  for (long bit_width = 0; bit_width <= 64; ++bit_width) {
+    // Fill an array with values that take up to bit_width bits.
+    std::vector<uint64_t> src(kMaxLength);
+    if (bit_width > 0) {
+      for (long i = 0; i < kMaxLength; ++i) src[i] = 1ULL << (i % bit_width);
+    }
+    ASSERT_EQ(MaxBitWidth<uint64_t>(src), bit_width);
+    ByteBuffer buffer;
+    StoreBitPacked<uint64_t>(src, bit_width, &buffer);
+    PutSlopBytes(&buffer);
+    BitPackedReader<uint64_t> reader(bit_width, buffer.data());
+
+    for (long length = 0; length < kMaxLength; ++length) {
+      std::vector<uint64_t> result(length);
+      reader.GetBatch(length,
+                      [&](size_t i, uint64_t value) { result[i] = value; });
+      ASSERT_EQ(result, absl::Span<uint64_t>(src.data(), length))
+          << "bit_width: " << bit_width << ", length: " << length;
+    }
+  }
+}
+
+TEST(BitPackingTest, GetPacked) {
+  const std::vector<uint32_t> bits{1, 0, 1, 1, 0, 0, 0, 1, 1, 0, 1};
+  ByteBuffer buffer;
+  StoreBitPacked<uint32_t>(bits, /*bit_width=*/1, &buffer);
+  PutSlopBytes(&buffer);
+  BitPackedReader<uint32_t> reader(/*bit_width=*/1, buffer.data());
+  EXPECT_EQ(reader.GetPacked(/*index=*/0, /*num_values=*/4), 0b1101);
+  EXPECT_EQ(reader.GetPacked(/*index=*/7, /*num_values=*/4), 0b1011);
+  EXPECT_EQ(reader.GetPacked(/*index=*/3, /*num_values=*/0), 0);
+
+  const std::vector<uint32_t> values{5, 3, 7};
+  buffer.set_pos(0);
+  StoreBitPacked<uint32_t>(values, /*bit_width=*/3, &buffer);
+  PutSlopBytes(&buffer);
+  BitPackedReader<uint32_t> reader3(/*bit_width=*/3, buffer.data());
+  EXPECT_EQ(reader3.GetPacked(/*index=*/1, /*num_values=*/2), 3 | 7 << 3);
+}
+
 TEST(BitPackingTest, BitPack64EmptyArray) {
   const std::vector<uint64_t> empty;
   CheckBitPack<uint64_t>(empty, 0);
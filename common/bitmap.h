@@ -19,30 +19,230 @@
 #ifndef CUCKOO_INDEX_COMMON_BITMAP_H_
 #define CUCKOO_INDEX_COMMON_BITMAP_H_
 
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <string>
 #include <vector>
 
 #include "absl/strings/string_view.h"
-#include "boost/dynamic_bitset.hpp"
 
 namespace ci {
 
 // Note: Rank implementation is adapted from SuRF:
 // https://github.com/efficient/SuRF/blob/master/include/rank.hpp
 // Like SuRF, we precompute the ranks of bit-blocks of size `kRankBlockSize`
-// (512 by default), which adds around 6% of size overhead.
+// (512 by default), which adds around 6% of size overhead. Ranks within a rank
+// block are computed by popcounting 64-bit words.
+//
+// Select uses the rank lookup table: similar to Poppy, we sample the rank block
+// of every `kSelectSampleRate`-th set (unset) bit, which narrows down the
+// binary search over rank blocks to a few entries.
 
 // Number of bits in a rank block.
 static constexpr size_t kRankBlockSize = 512;
 
+// Every `kSelectSampleRate`-th set (or unset) bit is sampled for select.
+static constexpr size_t kSelectSampleRate = 8192;
+
 class Bitmap64;
 using Bitmap64Ptr = std::unique_ptr<Bitmap64>;
 
+namespace internal {
+
+// Alignment of the words of a Bitmap64, i.e., a cache line.
+static constexpr size_t kBitmapAlignment = 64;
+
+// Allocates `kBitmapAlignment`-aligned memory, so that bulk operations can use
+// aligned vector loads and stores.
+template <typename T>
+struct CacheLineAlignedAllocator {
+  using value_type = T;
+
+  CacheLineAlignedAllocator() = default;
+  template <typename U>
+  CacheLineAlignedAllocator(const CacheLineAlignedAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(
+        n * sizeof(T), std::align_val_t(kBitmapAlignment)));
+  }
+  void deallocate(T* ptr, size_t) {
+    ::operator delete(ptr, std::align_val_t(kBitmapAlignment));
+  }
+
+  template <typename U>
+  bool operator==(const CacheLineAlignedAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const CacheLineAlignedAllocator<U>&) const {
+    return false;
+  }
+};
+
+inline size_t GetNumWords(size_t num_bits) { return (num_bits + 63) / 64; }
+
+// Returns the mask of the used bits of the last word of a `num_bits` bitmap.
+inline uint64_t GetLastWordMask(size_t num_bits) {
+  return num_bits % 64 == 0 ? ~0ULL : (1ULL << (num_bits % 64)) - 1ULL;
+}
+
+// Returns the `word_idx`-th little-endian word of `data`, which doesn't need
+// to be aligned.
+inline uint64_t LoadWord(const char* data, size_t word_idx) {
+  uint64_t word;
+  std::memcpy(&word, data + word_idx * sizeof(uint64_t), sizeof(uint64_t));
+  return word;
+}
+
+enum class WordOp { kAnd, kOr, kAndNot };
+
+// Sets dst[i] = dst[i] `kOp` src[i] for the `num_words` words of the
+// `kBitmapAlignment`-aligned `dst` and of `src` (which may be unaligned).
+template <WordOp kOp>
+inline void CombineWords(uint64_t* dst, const char* src, size_t num_words) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_words; i += 4) {
+    __m256i* dst_vector = reinterpret_cast<__m256i*>(dst + i);
+    const __m256i a = _mm256_load_si256(dst_vector);
+    const __m256i b = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + i * sizeof(uint64_t)));
+    if constexpr (kOp == WordOp::kAnd) {
+      _mm256_store_si256(dst_vector, _mm256_and_si256(a, b));
+    } else if constexpr (kOp == WordOp::kOr) {
+      _mm256_store_si256(dst_vector, _mm256_or_si256(a, b));
+    } else {
+      // andnot(x, y) computes ~x & y.
+      _mm256_store_si256(dst_vector, _mm256_andnot_si256(b, a));
+    }
+  }
+#endif
+  for (; i < num_words; ++i) {
+    const uint64_t word = LoadWord(src, i);
+    if constexpr (kOp == WordOp::kAnd) {
+      dst[i] &= word;
+    } else if constexpr (kOp == WordOp::kOr) {
+      dst[i] |= word;
+    } else {
+      dst[i] &= ~word;
+    }
+  }
+}
+
+// Returns the number of set bits in the `num_words` words of `data`.
+inline size_t PopCountWords(const char* data, size_t num_words) {
+  size_t i = 0;
+  size_t ones_count = 0;
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+  __m512i counts = _mm512_setzero_si512();
+  for (; i + 8 <= num_words; i += 8) {
+    counts = _mm512_add_epi64(
+        counts, _mm512_popcnt_epi64(
+                    _mm512_loadu_si512(data + i * sizeof(uint64_t))));
+  }
+  ones_count = _mm512_reduce_add_epi64(counts);
+#endif
+  // Independent sums, so that the popcounts don't wait for each other.
+  size_t counts0 = 0, counts1 = 0, counts2 = 0, counts3 = 0;
+  for (; i + 4 <= num_words; i += 4) {
+    counts0 += __builtin_popcountll(LoadWord(data, i));
+    counts1 += __builtin_popcountll(LoadWord(data, i + 1));
+    counts2 += __builtin_popcountll(LoadWord(data, i + 2));
+    counts3 += __builtin_popcountll(LoadWord(data, i + 3));
+  }
+  for (; i < num_words; ++i) counts0 += __builtin_popcountll(LoadWord(data, i));
+  return ones_count + counts0 + counts1 + counts2 + counts3;
+}
+
+}  // namespace internal
+
+// A read-only bitmap over external little-endian words, e.g., the bits of an
+// encoded (possibly memory-mapped) bitmap. The words don't need to be aligned
+// and aren't copied, i.e., the buffer needs to outlive the view. Bits of the
+// last word past bits() are ignored.
+class Bitmap64View {
+ public:
+  Bitmap64View() : data_(nullptr), num_bits_(0) {}
+
+  // `data` points to the GetNumWords(`num_bits`) words.
+  Bitmap64View(const char* data, size_t num_bits)
+      : data_(data), num_bits_(num_bits) {}
+
+  size_t bits() const { return num_bits_; }
+
+  size_t num_words() const { return internal::GetNumWords(num_bits_); }
+
+  // Points to the words of the view.
+  const char* data() const { return data_; }
+
+  bool Get(size_t pos) const {
+    assert(pos < bits());
+    return (internal::LoadWord(data_, pos / 64) >> (pos % 64)) & 1ULL;
+  }
+
+  // Returns the 64 bits starting at 64 * `word_idx` (least significant first).
+  uint64_t GetWord(size_t word_idx) const {
+    assert(word_idx < num_words());
+    const uint64_t word = internal::LoadWord(data_, word_idx);
+    return word_idx + 1 == num_words()
+               ? word & internal::GetLastWordMask(num_bits_)
+               : word;
+  }
+
+  size_t GetOnesCount() const {
+    if (num_bits_ == 0) return 0;
+    // Popcounts the last word separately to mask its unused bits.
+    return internal::PopCountWords(data_, num_words() - 1) +
+           __builtin_popcountll(GetWord(num_words() - 1));
+  }
+
+  // Returns the number of set bits in [0, limit). Popcounts every word before
+  // `limit`, i.e., views don't use the rank lookup table of the encoding.
+  size_t GetOnesCountBeforeLimit(size_t limit) const {
+    assert(limit <= bits());
+    return Bitmap64View(data_, limit).GetOnesCount();
+  }
+
+  bool IsAllZeroes() const {
+    for (size_t word_idx = 0; word_idx < num_words(); ++word_idx) {
+      if (GetWord(word_idx) != 0) return false;
+    }
+    return true;
+  }
+
+  // Calls `fn(pos)` for every set bit in increasing order.
+  template <typename Fn>
+  void ForEachSetBit(const Fn& fn) const {
+    for (size_t word_idx = 0; word_idx < num_words(); ++word_idx) {
+      for (uint64_t word = GetWord(word_idx); word != 0; word &= word - 1)
+        fn(word_idx * 64 + __builtin_ctzll(word));
+    }
+  }
+
+  // Copies the bits into a Bitmap64.
+  Bitmap64 ToBitmap() const;
+
+ private:
+  const char* data_;
+  size_t num_bits_;
+};
+
+// A bitmap stored as `kBitmapAlignment`-aligned 64-bit words (the unused bits
+// of the last word are always unset). Bulk operations work on whole words and
+// use AVX2 if available.
 class Bitmap64 {
  public:
+  // Concatenates `bitmaps` (skipping nullptrs), a word at a time.
   static Bitmap64 GetGlobalBitmap(const std::vector<Bitmap64Ptr>& bitmaps) {
     size_t num_bits = 0;
     for (const Bitmap64Ptr& bitmap : bitmaps) {
@@ -53,8 +253,16 @@ class Bitmap64 {
     size_t base_index = 0;
     for (const Bitmap64Ptr& bitmap : bitmaps) {
       if (bitmap == nullptr) continue;
-      for (const size_t index : bitmap->TrueBitIndices()) {
-        global_bitmap.Set(base_index + index, true);
+      const size_t shift = base_index % 64;
+      uint64_t* words = global_bitmap.words_.data() + base_index / 64;
+      for (size_t word_idx = 0; word_idx < bitmap->words_.size(); ++word_idx) {
+        const uint64_t word = bitmap->words_[word_idx];
+        if (word == 0) continue;
+        words[word_idx] |= word << shift;
+        // The unused bits of `bitmap` are unset, i.e., the upper part of a word
+        // only spills into the next one if that one exists.
+        if (shift != 0 && (word >> (64 - shift)) != 0)
+          words[word_idx + 1] |= word >> (64 - shift);
       }
       base_index += bitmap->bits();
     }
@@ -62,9 +270,8 @@ class Bitmap64 {
   }
 
   static void DenseEncode(const Bitmap64& bitmap, std::string* out) {
-    using Block = boost::dynamic_bitset<>::block_type;
-    const size_t
-        bitmap_size_in_bytes = bitmap.bitset_.num_blocks() * sizeof(Block);
+    const size_t bitmap_size_in_bytes =
+        bitmap.words_.size() * sizeof(uint64_t);
     const uint32_t num_rank_blocks = bitmap.rank_lookup_table_.size();
     const size_t rank_size_in_bytes = num_rank_blocks * sizeof(uint32_t);
     const size_t size_in_bytes = sizeof(uint32_t) // Number of bits.
@@ -76,62 +283,133 @@ class Bitmap64 {
 
     // Encode bitmap.
     const uint32_t num_bits = bitmap.bits();
-    *reinterpret_cast<uint32_t*>(out->data()) = num_bits;
+    std::memcpy(out->data(), &num_bits, sizeof(uint32_t));
     size_t pos = sizeof(uint32_t);
-    boost::to_block_range(bitmap.bitset_,
-                          reinterpret_cast<Block*>(out->data() + pos));
+    std::memcpy(out->data() + pos, bitmap.words_.data(), bitmap_size_in_bytes);
     pos += bitmap_size_in_bytes;
 
     // Encode `rank_lookup_table_`.
-    *reinterpret_cast<uint32_t*>(out->data() + pos) = num_rank_blocks;
+    std::memcpy(out->data() + pos, &num_rank_blocks, sizeof(uint32_t));
     pos += sizeof(uint32_t);
     std::memcpy(out->data() + pos,
                 bitmap.rank_lookup_table_.data(),
                 rank_size_in_bytes);
   }
 
-  static Bitmap64 DenseDecode(absl::string_view encoded) {
-    using DynamicBitset = boost::dynamic_bitset<>;
-    using Block = DynamicBitset::block_type;
+  // Returns a view of the bits of a bitmap encoded with DenseEncode(..)
+  // without copying them, i.e., `encoded` needs to outlive the view.
+  static Bitmap64View DenseDecodeView(absl::string_view encoded) {
+    uint32_t num_bits;
+    std::memcpy(&num_bits, encoded.data(), sizeof(uint32_t));
+    return Bitmap64View(encoded.data() + sizeof(uint32_t), num_bits);
+  }
 
+  static Bitmap64 DenseDecode(absl::string_view encoded) {
     // Decode bitmap.
-    const uint32_t
-        num_bits = *reinterpret_cast<const uint32_t*>(encoded.data());
-    size_t pos = sizeof(uint32_t);
-    const Block* begin = reinterpret_cast<const Block*>(encoded.data() + pos);
-    Bitmap64 decoded(num_bits);
-    size_t num_blocks = std::ceil(static_cast<double>(num_bits)
-                                      / DynamicBitset::bits_per_block);
-    boost::from_block_range(begin, begin + num_blocks, decoded.bitset_);
-    pos += num_blocks * sizeof(Block);
+    const Bitmap64View view = DenseDecodeView(encoded);
+    Bitmap64 decoded = view.ToBitmap();
+    size_t pos = sizeof(uint32_t) + view.num_words() * sizeof(uint64_t);
 
     // Decode `rank_lookup_table_`.
-    const uint32_t
-        num_rank_blocks =
-        *reinterpret_cast<const uint32_t*>(encoded.data() + pos);
+    uint32_t num_rank_blocks;
+    std::memcpy(&num_rank_blocks, encoded.data() + pos, sizeof(uint32_t));
     pos += sizeof(uint32_t);
     decoded.rank_lookup_table_.resize(num_rank_blocks);
     std::memcpy(decoded.rank_lookup_table_.data(),
                 encoded.data() + pos,
                 num_rank_blocks * sizeof(uint32_t));
+    decoded.InitSelectSamples();
 
     return decoded;
   }
 
-  Bitmap64() = default;
+  Bitmap64() : num_bits_(0) {}
 
-  explicit Bitmap64(size_t num_bits) : bitset_(num_bits) {}
+  explicit Bitmap64(size_t num_bits)
+      : num_bits_(num_bits), words_(internal::GetNumWords(num_bits), 0) {}
 
   Bitmap64(size_t num_bits, bool fill_value) : Bitmap64(num_bits) {
-    for (size_t i = 0; i < bits(); ++i) bitset_[i] = fill_value;
+    if (fill_value && num_bits_ > 0) {
+      std::fill(words_.begin(), words_.end(), ~0ULL);
+      words_.back() &= internal::GetLastWordMask(num_bits_);
+    }
+  }
+
+  // Only copies the bits, not the rank lookup table (nor the select samples).
+  Bitmap64(const Bitmap64& other)
+      : num_bits_(other.num_bits_), words_(other.words_) {}
+  // Likewise, and clears the tables of this bitmap. Re-uses its memory for the
+  // bits if possible.
+  Bitmap64& operator=(const Bitmap64& other) {
+    if (this == &other) return *this;
+    num_bits_ = other.num_bits_;
+    words_ = other.words_;
+    rank_lookup_table_.clear();
+    select_one_samples_.clear();
+    select_zero_samples_.clear();
+    return *this;
+  }
+
+  // Moving also moves the rank lookup table and avoids copying the bits, e.g.,
+  // when returning bitmaps in containers. Leaves `other` empty.
+  Bitmap64(Bitmap64&& other) noexcept
+      : num_bits_(other.num_bits_),
+        words_(std::move(other.words_)),
+        rank_lookup_table_(std::move(other.rank_lookup_table_)),
+        select_one_samples_(std::move(other.select_one_samples_)),
+        select_zero_samples_(std::move(other.select_zero_samples_)) {
+    other.num_bits_ = 0;
+    other.words_.clear();
+  }
+  Bitmap64& operator=(Bitmap64&& other) noexcept {
+    if (this == &other) return *this;
+    num_bits_ = other.num_bits_;
+    words_ = std::move(other.words_);
+    rank_lookup_table_ = std::move(other.rank_lookup_table_);
+    select_one_samples_ = std::move(other.select_one_samples_);
+    select_zero_samples_ = std::move(other.select_zero_samples_);
+    other.num_bits_ = 0;
+    other.words_.clear();
+    return *this;
+  }
+
+  size_t bits() const { return num_bits_; }
+
+  // Returns a view of the bits, valid until the bitmap is modified.
+  Bitmap64View view() const {
+    return Bitmap64View(reinterpret_cast<const char*>(words_.data()),
+                        num_bits_);
+  }
+
+  // Resizes the bitmap to `num_bits` unset bits. Re-uses the allocated memory
+  // if possible, i.e., lets callers recycle a bitmap across many queries.
+  void Reset(size_t num_bits) {
+    num_bits_ = num_bits;
+    words_.assign(internal::GetNumWords(num_bits), 0);
+    rank_lookup_table_.clear();
+    select_one_samples_.clear();
+    select_zero_samples_.clear();
   }
 
-  // Calls copy constructor of underlying boost dynamic bitset.
-  Bitmap64(const Bitmap64& other) : bitset_(other.bitset_) {}
+  // Replaces the bits by the ones of `view`, e.g., to copy a bitmap out of an
+  // encoding with a single memcpy.
+  void Assign(const Bitmap64View& view) {
+    Reset(view.bits());
+    if (words_.empty()) return;
+    std::memcpy(words_.data(), view.data(), words_.size() * sizeof(uint64_t));
+    words_.back() &= internal::GetLastWordMask(num_bits_);
+  }
 
-  size_t bits() const { return bitset_.size(); }
+  bool Get(size_t pos) const {
+    assert(pos < bits());
+    return (words_[pos / 64] >> (pos % 64)) & 1ULL;
+  }
 
-  bool Get(size_t pos) const { return bitset_[pos]; }
+  // Prefetches the word of bit `pos`, e.g., some lookups before Get(pos).
+  void Prefetch(size_t pos) const {
+    assert(pos < bits());
+    __builtin_prefetch(&words_[pos / 64]);
+  }
 
   // Initializes `rank_lookup_table_`. Precomputes the ranks of bit-blocks of
   // size `kRankBlockSize`.
@@ -150,6 +428,7 @@ class Bitmap64 {
                                                     kRankBlockSize);
     }
     rank_lookup_table_[num_rank_blocks - 1] = cumulative_rank;
+    InitSelectSamples();
   }
 
   // Returns rank of `limit`, i.e., the number of set bits in [0, limit).
@@ -160,9 +439,7 @@ class Bitmap64 {
 
     if (rank_lookup_table_.empty()) {
       // No precomputed ranks. Compute rank manually.
-      size_t ones_count = 0;
-      for (size_t i = 0; i < limit; ++i) ones_count += bitset_[i];
-      return ones_count;
+      return GetOnesCountInRange(/*start=*/0, /*end=*/limit);
     }
 
     // Get rank from `rank_lookup_table_` and add rank of last rank block.
@@ -173,27 +450,134 @@ class Bitmap64 {
         + GetOnesCountInRankBlock(rank_block_id, limit_within_block);
   }
 
-  size_t GetOnesCount() const { return GetOnesCountBeforeLimit(bits()); }
+  // Uses the rank lookup table if initialized and popcounts all words (the
+  // unused bits of the last one are unset) otherwise.
+  size_t GetOnesCount() const {
+    if (!rank_lookup_table_.empty()) return GetOnesCountBeforeLimit(bits());
+    return internal::PopCountWords(
+        reinterpret_cast<const char*>(words_.data()), words_.size());
+  }
 
   size_t GetZeroesCount() const { return bits() - GetOnesCount(); }
 
-  bool IsAllZeroes() const { return bitset_.none(); }
+  bool IsAllZeroes() const {
+    for (const uint64_t word : words_) {
+      if (word != 0) return false;
+    }
+    return true;
+  }
 
-  void Set(size_t pos, bool value) { bitset_[pos] = value; }
+  bool IsAllOnes() const { return GetOnesCount() == bits(); }
 
-  std::vector<size_t> TrueBitIndices() const {
-    std::vector<size_t> indices;
+  // Unsets all bits that are unset in `other`. Both bitmaps need to have the
+  // same size.
+  void And(const Bitmap64View& other) {
+    assert(bits() == other.bits());
+    internal::CombineWords<internal::WordOp::kAnd>(words_.data(), other.data(),
+                                                   words_.size());
+  }
+
+  // Sets all bits that are set in `other`. Both bitmaps need to have the same
+  // size.
+  void Or(const Bitmap64View& other) {
+    assert(bits() == other.bits());
+    internal::CombineWords<internal::WordOp::kOr>(words_.data(), other.data(),
+                                                  words_.size());
+    // `other` may have set bits past bits().
+    if (!words_.empty()) words_.back() &= internal::GetLastWordMask(num_bits_);
+  }
 
-    for (size_t i = 0; i < bits(); ++i) {
-      if (bitset_[i]) indices.push_back(i);
+  // Unsets all bits that are set in `other`. Both bitmaps need to have the
+  // same size.
+  void AndNot(const Bitmap64View& other) {
+    assert(bits() == other.bits());
+    internal::CombineWords<internal::WordOp::kAndNot>(
+        words_.data(), other.data(), words_.size());
+  }
+
+  Bitmap64& operator|=(const Bitmap64& other) {
+    Or(other.view());
+    return *this;
+  }
+
+  Bitmap64& operator&=(const Bitmap64& other) {
+    And(other.view());
+    return *this;
+  }
+
+  void Set(size_t pos, bool value) {
+    assert(pos < bits());
+    const uint64_t mask = 1ULL << (pos % 64);
+    if (value) {
+      words_[pos / 64] |= mask;
+    } else {
+      words_[pos / 64] &= ~mask;
     }
+  }
+
+  // Returns the 64 bits starting at 64 * `word_idx` (least significant first).
+  uint64_t GetWord(size_t word_idx) const {
+    assert(word_idx * 64 < bits());
+    return words_[word_idx];
+  }
+
+  // Sets the 64 bits starting at 64 * `word_idx` to the bits of `word` (least
+  // significant first), e.g., for filling bitmaps a word at a time. Bits past
+  // bits() are ignored.
+  void SetWord(size_t word_idx, uint64_t word) {
+    assert(word_idx * 64 < bits());
+    if (word_idx == words_.size() - 1)
+      word &= internal::GetLastWordMask(num_bits_);
+    words_[word_idx] = word;
+  }
+
+  // Sets `pos` to the position of the `ith` (0-based) set bit. Returns false if
+  // there are no `ith` + 1 set bits. Only scans a single rank block if
+  // `rank_lookup_table_` is initialized.
+  bool SelectOne(size_t ith, size_t* pos) const {
+    return Select(ith, /*count_ones=*/true, pos);
+  }
+
+  // Same as above, for unset bits.
+  bool SelectZero(size_t ith, size_t* pos) const {
+    return Select(ith, /*count_ones=*/false, pos);
+  }
 
+  // Unsets every set bit `pos` for which `keep(pos)` returns false. Visits the
+  // set bits in increasing order, a word at a time.
+  template <typename Predicate>
+  void RetainIf(const Predicate& keep) {
+    for (size_t word_idx = 0; word_idx < words_.size(); ++word_idx) {
+      const uint64_t word = words_[word_idx];
+      uint64_t retained = word;
+      for (uint64_t remaining = word; remaining != 0;
+           remaining &= remaining - 1) {
+        const size_t bit = __builtin_ctzll(remaining);
+        if (!keep(word_idx * 64 + bit)) retained &= ~(1ULL << bit);
+      }
+      words_[word_idx] = retained;
+    }
+  }
+
+  // Calls `fn(pos)` for every set bit in increasing order.
+  template <typename Fn>
+  void ForEachSetBit(const Fn& fn) const {
+    for (size_t word_idx = 0; word_idx < words_.size(); ++word_idx) {
+      for (uint64_t word = words_[word_idx]; word != 0; word &= word - 1)
+        fn(word_idx * 64 + __builtin_ctzll(word));
+    }
+  }
+
+  std::vector<size_t> TrueBitIndices() const {
+    std::vector<size_t> indices;
+    ForEachSetBit([&](size_t pos) { indices.push_back(pos); });
     return indices;
   }
 
+  // Returns the bits as '0's and '1's, the last bit first.
   std::string ToString() const {
-    std::string result;
-    boost::to_string(bitset_, result);
+    std::string result(bits(), '0');
+    ForEachSetBit([&](size_t pos) { result[bits() - 1 - pos] = '1'; });
     return result;
   }
 
@@ -203,20 +587,132 @@ class Bitmap64 {
   size_t GetOnesCountInRankBlock(const size_t rank_block_id,
                                  const size_t limit_within_block) const {
     const size_t start = rank_block_id * kRankBlockSize;
-    const size_t end = start + limit_within_block;
+    return GetOnesCountInRange(start, start + limit_within_block);
+  }
+
+  // Returns the number of set bits in [start, end). `start` needs to be a
+  // multiple of 64.
+  size_t GetOnesCountInRange(const size_t start, const size_t end) const {
+    assert(start % 64 == 0);
     assert(end <= bits());
+    const uint64_t* words = words_.data();
     size_t ones_count = 0;
-    for (size_t i = start; i < end; ++i) {
-      ones_count += bitset_[i];
+    size_t word_idx = start / 64;
+    for (; word_idx < end / 64; ++word_idx)
+      ones_count += __builtin_popcountll(words[word_idx]);
+    if (end % 64 != 0) {
+      ones_count += __builtin_popcountll(words[word_idx] &
+                                         ((1ULL << (end % 64)) - 1ULL));
     }
     return ones_count;
   }
 
-  boost::dynamic_bitset<> bitset_;
+  // Returns the number of set (or unset) bits before rank block
+  // `rank_block_id`.
+  size_t GetCountBeforeRankBlock(const size_t rank_block_id,
+                                 const bool count_ones) const {
+    const size_t ones_count = rank_lookup_table_[rank_block_id];
+    return count_ones ? ones_count : rank_block_id * kRankBlockSize - ones_count;
+  }
+
+  // Samples the rank block of every `kSelectSampleRate`-th set and unset bit.
+  // Requires `rank_lookup_table_`.
+  void InitSelectSamples() {
+    for (const bool count_ones : {true, false}) {
+      std::vector<uint32_t>& samples =
+          count_ones ? select_one_samples_ : select_zero_samples_;
+      samples.clear();
+      if (rank_lookup_table_.empty()) continue;
+      const size_t total = count_ones ? GetOnesCount() : GetZeroesCount();
+      size_t rank_block_id = 0;
+      for (size_t ith = 0; ith < total; ith += kSelectSampleRate) {
+        while (rank_block_id + 1 < rank_lookup_table_.size() &&
+               GetCountBeforeRankBlock(rank_block_id + 1, count_ones) <= ith) {
+          ++rank_block_id;
+        }
+        samples.push_back(rank_block_id);
+      }
+    }
+  }
+
+  // Returns the position of the `ith` (0-based) set bit in `word`.
+  static size_t SelectInWord(uint64_t word, size_t ith) {
+#if defined(__BMI2__)
+    return __builtin_ctzll(_pdep_u64(1ULL << ith, word));
+#else
+    for (size_t i = 0; i < ith; ++i) word &= word - 1;
+    return __builtin_ctzll(word);
+#endif
+  }
+
+  // Helper that implements SelectOne() or SelectZero() depending on whether
+  // `count_ones` is set.
+  bool Select(const size_t ith, const bool count_ones, size_t* pos) const {
+    size_t word_idx = 0;
+    size_t remaining = ith;
+    if (!rank_lookup_table_.empty()) {
+      const size_t total = count_ones ? GetOnesCount() : GetZeroesCount();
+      if (ith >= total) return false;
+
+      // Binary search for the last rank block with at most `ith` set (unset)
+      // bits before it. The samples bound the search range.
+      const std::vector<uint32_t>& samples =
+          count_ones ? select_one_samples_ : select_zero_samples_;
+      size_t lo = 0;
+      size_t hi = rank_lookup_table_.size();
+      const size_t sample_idx = ith / kSelectSampleRate;
+      if (sample_idx < samples.size()) {
+        lo = samples[sample_idx];
+        if (sample_idx + 1 < samples.size()) hi = samples[sample_idx + 1] + 1;
+      }
+      while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (GetCountBeforeRankBlock(mid, count_ones) <= ith) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      word_idx = lo * kRankBlockSize / 64;
+      remaining = ith - GetCountBeforeRankBlock(lo, count_ones);
+    }
+
+    // Scan words of the rank block (or the whole bitmap).
+    const uint64_t* words = words_.data();
+    const size_t num_words = words_.size();
+    for (; word_idx < num_words; ++word_idx) {
+      uint64_t word = count_ones ? words[word_idx] : ~words[word_idx];
+      // Don't count the unused bits of the last word.
+      if (word_idx == num_words - 1 && bits() % 64 != 0)
+        word &= (1ULL << (bits() % 64)) - 1ULL;
+      const size_t word_count = __builtin_popcountll(word);
+      if (remaining < word_count) {
+        *pos = word_idx * 64 + SelectInWord(word, remaining);
+        return true;
+      }
+      remaining -= word_count;
+    }
+    return false;
+  }
+
+  size_t num_bits_;
+  // GetNumWords(num_bits_) words, least significant bit first.
+  std::vector<uint64_t, internal::CacheLineAlignedAllocator<uint64_t>> words_;
   // Stores precomputed ranks of bit-blocks of size `kRankBlockSize`.
   std::vector<uint32_t> rank_lookup_table_;
+  // Rank blocks of every `kSelectSampleRate`-th set (unset) bit. Only
+  // initialized along with `rank_lookup_table_`.
+  std::vector<uint32_t> select_one_samples_;
+  std::vector<uint32_t> select_zero_samples_;
 };
 
+
+inline Bitmap64 Bitmap64View::ToBitmap() const {
+  Bitmap64 bitmap;
+  bitmap.Assign(*this);
+  return bitmap;
+}
+
 }  // namespace ci
 
 #endif  // CUCKOO_INDEX_COMMON_BITMAP_H_
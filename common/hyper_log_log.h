@@ -0,0 +1,82 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: hyper_log_log.h
+// -----------------------------------------------------------------------------
+//
+// A HyperLogLog sketch estimating the number of distinct (hashed) values in a
+// single pass and a few KB of memory, e.g., for ranking columns by cardinality
+// without materializing their distinct values.
+
+#ifndef CUCKOO_INDEX_COMMON_HYPER_LOG_LOG_H_
+#define CUCKOO_INDEX_COMMON_HYPER_LOG_LOG_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ci {
+
+class HyperLogLog {
+ public:
+  // Uses 2^`precision` one-byte registers, for a standard error of
+  // 1.04 / sqrt(2^`precision`), i.e., ~1.6% for the default of 12.
+  explicit HyperLogLog(size_t precision = 12)
+      : precision_(precision), registers_(size_t{1} << precision, 0) {}
+
+  // Adds a value by its 64-bit `hash`, whose bits need to be uniformly
+  // distributed.
+  void Add(uint64_t hash) {
+    const size_t idx = hash >> (64 - precision_);
+    const uint64_t rest = hash << precision_;
+    // Position of the leftmost 1-bit among the remaining bits.
+    const uint8_t rank =
+        rest == 0 ? 64 - precision_ + 1 : __builtin_clzll(rest) + 1;
+    registers_[idx] = std::max(registers_[idx], rank);
+  }
+
+  // Adds all values of `other`, which needs the same precision.
+  void Merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < registers_.size(); ++i)
+      registers_[i] = std::max(registers_[i], other.registers_[i]);
+  }
+
+  // Returns the estimated number of distinct values added.
+  double Estimate() const {
+    const double m = registers_.size();
+    double sum = 0;
+    size_t num_zero_registers = 0;
+    for (const uint8_t rank : registers_) {
+      sum += std::ldexp(1.0, -rank);
+      num_zero_registers += rank == 0;
+    }
+    const double alpha = 0.7213 / (1 + 1.079 / m);
+    const double estimate = alpha * m * m / sum;
+    // Small cardinalities are estimated more precisely by linear counting.
+    if (estimate <= 2.5 * m && num_zero_registers > 0)
+      return m * std::log(m / num_zero_registers);
+    return estimate;
+  }
+
+ private:
+  size_t precision_;
+  std::vector<uint8_t> registers_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_HYPER_LOG_LOG_H_
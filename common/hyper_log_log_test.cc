@@ -0,0 +1,55 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: hyper_log_log_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/hyper_log_log.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+TEST(HyperLogLogTest, EstimatesNumDistinctValues) {
+  std::mt19937_64 gen(42);
+  for (const size_t num_values : {0, 10, 1000, 100000}) {
+    HyperLogLog sketch;
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < num_values; ++i) hashes.push_back(gen());
+    // Duplicates don't change the estimate.
+    for (int i = 0; i < 3; ++i) {
+      for (const uint64_t hash : hashes) sketch.Add(hash);
+    }
+    EXPECT_NEAR(sketch.Estimate(), num_values, 0.05 * num_values + 1);
+  }
+}
+
+TEST(HyperLogLogTest, Merge) {
+  std::mt19937_64 gen(42);
+  HyperLogLog lhs, rhs, both;
+  for (size_t i = 0; i < 10000; ++i) {
+    const uint64_t hash = gen();
+    (i % 2 == 0 ? lhs : rhs).Add(hash);
+    both.Add(hash);
+  }
+  lhs.Merge(rhs);
+  EXPECT_EQ(lhs.Estimate(), both.Estimate());
+}
+
+}  // namespace ci
@@ -0,0 +1,112 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: latency_histogram.h
+// -----------------------------------------------------------------------------
+//
+// A histogram of latencies (or any other non-negative integers) with a bounded
+// relative error, similar to HdrHistogram: values are bucketed by their highest
+// set bit and the `kSubBucketBits` bits below it. Values below
+// 2^`kSubBucketBits` are counted exactly, larger ones with a relative error of
+// at most 2^-`kSubBucketBits` (~3%). Recording a value is a few instructions
+// and doesn't allocate.
+
+#ifndef CUCKOO_INDEX_COMMON_LATENCY_HISTOGRAM_H_
+#define CUCKOO_INDEX_COMMON_LATENCY_HISTOGRAM_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ci {
+
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 5;
+
+  LatencyHistogram() : counts_(kNumBuckets, 0), count_(0), max_(0) {}
+
+  void Record(uint64_t value) {
+    ++counts_[BucketIndex(value)];
+    ++count_;
+    max_ = std::max(max_, value);
+  }
+
+  // Adds all values of `other`.
+  void Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  void Reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    max_ = 0;
+  }
+
+  // Returns the number of recorded values.
+  uint64_t count() const { return count_; }
+
+  uint64_t max() const { return max_; }
+
+  // Returns the (upper bound of the bucket of the) smallest recorded value
+  // that is greater or equal to a `quantile` (in [0, 1]) of all values, e.g.,
+  // the p99 for 0.99. Returns 0 if no values were recorded.
+  uint64_t Quantile(double quantile) const {
+    if (count_ == 0) return 0;
+    const uint64_t rank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(quantile * count_)));
+    uint64_t num_values = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      num_values += counts_[i];
+      if (num_values >= rank) return std::min(BucketUpperBound(i), max_);
+    }
+    return max_;
+  }
+
+ private:
+  static constexpr size_t kNumSubBuckets = size_t{1} << kSubBucketBits;
+  // The values below kNumSubBuckets, followed by kNumSubBuckets buckets for
+  // each highest set bit from kSubBucketBits to 63.
+  static constexpr size_t kNumBuckets =
+      (64 - kSubBucketBits + 1) * kNumSubBuckets;
+
+  static size_t BucketIndex(uint64_t value) {
+    if (value < kNumSubBuckets) return value;
+    const size_t shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+    // Includes the highest set bit, i.e., is in [kNumSubBuckets,
+    // 2 * kNumSubBuckets).
+    const size_t sub_bucket = value >> shift;
+    return shift * kNumSubBuckets + sub_bucket;
+  }
+
+  static uint64_t BucketUpperBound(size_t index) {
+    if (index < kNumSubBuckets) return index;
+    const size_t shift = index / kNumSubBuckets - 1;
+    const uint64_t sub_bucket = index % kNumSubBuckets + kNumSubBuckets;
+    return (sub_bucket << shift) + ((uint64_t{1} << shift) - 1);
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t max_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_LATENCY_HISTOGRAM_H_
@@ -0,0 +1,86 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: latency_histogram_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/latency_histogram.h"
+
+#include <cstdint>
+#include <limits>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+TEST(LatencyHistogramTest, Empty) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.count(), 0);
+  EXPECT_EQ(histogram.Quantile(0.5), 0);
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 20; ++value) histogram.Record(value);
+  EXPECT_EQ(histogram.count(), 20);
+  EXPECT_EQ(histogram.max(), 20);
+  EXPECT_EQ(histogram.Quantile(0.0), 1);
+  EXPECT_EQ(histogram.Quantile(0.5), 10);
+  EXPECT_EQ(histogram.Quantile(0.9), 18);
+  EXPECT_EQ(histogram.Quantile(1.0), 20);
+}
+
+TEST(LatencyHistogramTest, BoundsRelativeError) {
+  std::mt19937_64 gen(42);
+  std::uniform_int_distribution<int> shift_d(0, 63);
+  for (int i = 0; i < 10000; ++i) {
+    const uint64_t value = gen() >> shift_d(gen);
+    LatencyHistogram histogram;
+    histogram.Record(value);
+    // Only use the bucket's upper bound.
+    histogram.Record(std::numeric_limits<uint64_t>::max());
+    const uint64_t quantile = histogram.Quantile(0.5);
+    EXPECT_GE(quantile, value);
+    EXPECT_LE(quantile - value,
+              value >> LatencyHistogram::kSubBucketBits);
+  }
+}
+
+TEST(LatencyHistogramTest, Quantiles) {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 100000; ++value) histogram.Record(value);
+  for (const double quantile : {0.5, 0.9, 0.99, 0.999}) {
+    EXPECT_NEAR(histogram.Quantile(quantile), quantile * 100000,
+                quantile * 100000 / 32 + 1);
+  }
+  EXPECT_EQ(histogram.Quantile(1.0), 100000);
+}
+
+TEST(LatencyHistogramTest, Merge) {
+  LatencyHistogram lhs, rhs;
+  for (uint64_t value = 1; value <= 10; ++value) lhs.Record(value);
+  for (uint64_t value = 11; value <= 20; ++value) rhs.Record(value);
+  lhs.Merge(rhs);
+  EXPECT_EQ(lhs.count(), 20);
+  EXPECT_EQ(lhs.max(), 20);
+  EXPECT_EQ(lhs.Quantile(0.5), 10);
+
+  lhs.Reset();
+  EXPECT_EQ(lhs.count(), 0);
+  EXPECT_EQ(lhs.max(), 0);
+}
+
+}  // namespace ci
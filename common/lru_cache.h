@@ -0,0 +1,104 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: lru_cache.h
+// -----------------------------------------------------------------------------
+
+#ifndef CUCKOO_INDEX_COMMON_LRU_CACHE_H_
+#define CUCKOO_INDEX_COMMON_LRU_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace ci {
+
+// An LRU cache of at most `capacity` values (one mutex for all of them, i.e.,
+// it can be shared by concurrent lookups). A returned value stays valid as
+// long as it is held, even if it's evicted in the meantime. Neither copyable
+// nor movable.
+template <typename K, typename V>
+class LruCache {
+ public:
+  using ValuePtr = std::shared_ptr<const V>;
+
+  explicit LruCache(size_t capacity) : capacity_(capacity) {}
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // Returns the cached value of `key` if `is_valid(value)` holds for it, or
+  // calls `create()` and caches its result (replacing an invalid value).
+  template <typename Create, typename IsValid>
+  ValuePtr GetOrCreate(const K& key, const Create& create,
+                       const IsValid& is_valid) const {
+    {
+      absl::MutexLock lock(&mutex_);
+      const auto it = entries_.find(key);
+      if (it != entries_.end() && is_valid(*it->second->second)) {
+        lru_list_.splice(lru_list_.begin(), lru_list_, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+      }
+    }
+
+    // Create outside the lock. Concurrent misses on the same key may both
+    // create the value; the last one wins.
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    ValuePtr value = create();
+
+    absl::MutexLock lock(&mutex_);
+    const auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      lru_list_.erase(it->second);
+      entries_.erase(it);
+    }
+    if (capacity_ == 0) return value;
+    if (entries_.size() >= capacity_) {
+      entries_.erase(lru_list_.back().first);
+      lru_list_.pop_back();
+    }
+    lru_list_.emplace_front(key, value);
+    entries_[key] = lru_list_.begin();
+    return value;
+  }
+
+  template <typename Create>
+  ValuePtr GetOrCreate(const K& key, const Create& create) const {
+    return GetOrCreate(key, create, [](const V&) { return true; });
+  }
+
+  size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  size_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+ private:
+  using Entry = std::pair<K, ValuePtr>;
+
+  const size_t capacity_;
+  mutable absl::Mutex mutex_;
+  // Most recently used entries first.
+  mutable std::list<Entry> lru_list_;
+  mutable absl::flat_hash_map<K, typename std::list<Entry>::iterator> entries_;
+  mutable std::atomic<size_t> hits_{0};
+  mutable std::atomic<size_t> misses_{0};
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_LRU_CACHE_H_
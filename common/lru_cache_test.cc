@@ -0,0 +1,72 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: lru_cache_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/lru_cache.h"
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+std::shared_ptr<const std::string> MakeValue(const std::string& value) {
+  return std::make_shared<const std::string>(value);
+}
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+  const LruCache<int, std::string> cache(/*capacity=*/2);
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("a"); }), "a");
+  const std::shared_ptr<const std::string> held =
+      cache.GetOrCreate(2, [] { return MakeValue("b"); });
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("x"); }), "a");
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 2);
+
+  // Evicts 2, the least recently used key, but a held value stays valid.
+  EXPECT_EQ(*cache.GetOrCreate(3, [] { return MakeValue("c"); }), "c");
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("x"); }), "a");
+  EXPECT_EQ(*cache.GetOrCreate(2, [] { return MakeValue("d"); }), "d");
+  EXPECT_EQ(*held, "b");
+  EXPECT_EQ(cache.hits(), 2);
+  EXPECT_EQ(cache.misses(), 4);
+}
+
+TEST(LruCacheTest, ReplacesInvalidValues) {
+  const LruCache<int, std::string> cache(/*capacity=*/2);
+  const auto is_long = [](const std::string& value) {
+    return value.size() > 1;
+  };
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("a"); }), "a");
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("ab"); }, is_long),
+            "ab");
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("x"); }, is_long),
+            "ab");
+  EXPECT_EQ(cache.hits(), 1);
+  EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST(LruCacheTest, WithoutCapacity) {
+  const LruCache<int, std::string> cache(/*capacity=*/0);
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("a"); }), "a");
+  EXPECT_EQ(*cache.GetOrCreate(1, [] { return MakeValue("b"); }), "b");
+  EXPECT_EQ(cache.hits(), 0);
+  EXPECT_EQ(cache.misses(), 2);
+}
+
+}  // namespace ci
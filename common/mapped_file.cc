@@ -0,0 +1,67 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: mapped_file.cc
+// -----------------------------------------------------------------------------
+
+#include "common/mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+
+#include "absl/memory/memory.h"
+
+namespace ci {
+
+MappedFilePtr MappedFile::Open(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Couldn't open file: " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    std::cerr << "Couldn't stat file: " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const size_t size = file_stat.st_size;
+
+  // mmap(..) doesn't support empty mappings.
+  const void* data = nullptr;
+  if (size > 0) {
+    data = mmap(/*addr=*/nullptr, size, PROT_READ, MAP_SHARED, fd,
+                /*offset=*/0);
+    if (data == MAP_FAILED) {
+      std::cerr << "Couldn't mmap file: " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  // The mapping stays valid after closing the file descriptor.
+  close(fd);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  return absl::WrapUnique(new MappedFile(data, size));
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) munmap(const_cast<void*>(data_), size_);
+}
+
+}  // namespace ci
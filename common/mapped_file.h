@@ -0,0 +1,64 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: mapped_file.h
+// -----------------------------------------------------------------------------
+//
+// A read-only memory mapping of a file. Used to open serialized data-structures
+// in place, i.e., without copying them to the heap. Multiple processes mapping
+// the same file share a single copy in the page cache.
+
+#ifndef CUCKOO_INDEX_COMMON_MAPPED_FILE_H_
+#define CUCKOO_INDEX_COMMON_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace ci {
+
+class MappedFile;
+using MappedFilePtr = std::unique_ptr<MappedFile>;
+
+class MappedFile {
+ public:
+  // Maps the file at `path` read-only into memory. Exits on failure.
+  static MappedFilePtr Open(const std::string& path);
+
+  // Forbid copying and moving.
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&&) = delete;
+  MappedFile& operator=(MappedFile&&) = delete;
+
+  ~MappedFile();
+
+  // Returns the mapped bytes. Only valid during the lifetime of this object.
+  absl::string_view data() const {
+    return absl::string_view(static_cast<const char*>(data_), size_);
+  }
+
+ private:
+  MappedFile(const void* data, size_t size) : data_(data), size_(size) {}
+
+  const void* data_;
+  size_t size_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_MAPPED_FILE_H_
@@ -0,0 +1,59 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: memoized.h
+// -----------------------------------------------------------------------------
+
+#ifndef CUCKOO_INDEX_COMMON_MEMOIZED_H_
+#define CUCKOO_INDEX_COMMON_MEMOIZED_H_
+
+#include <utility>
+
+#include "absl/base/call_once.h"
+
+namespace ci {
+
+// Holds a value which is computed on first use, e.g., the (compressed) size of
+// an encoding that is only needed for stats. Safe to use from const methods
+// called concurrently. Neither copyable nor movable.
+template <typename T>
+class Memoized {
+ public:
+  Memoized() = default;
+
+  Memoized(const Memoized&) = delete;
+  Memoized& operator=(const Memoized&) = delete;
+
+  // Returns the value, calling `compute()` to obtain it on the first call.
+  template <typename Fn>
+  const T& Get(const Fn& compute) const {
+    absl::call_once(once_, [&]() { value_ = compute(); });
+    return value_;
+  }
+
+  // Sets the value unless it was computed (or set) before, e.g., to a value
+  // stored along with the data it's computed from.
+  void Set(T value) {
+    absl::call_once(once_, [&]() { value_ = std::move(value); });
+  }
+
+ private:
+  mutable absl::once_flag once_;
+  mutable T value_{};
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_MEMOIZED_H_
@@ -0,0 +1,104 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: perf_counters.cc
+// -----------------------------------------------------------------------------
+
+#include "common/perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "absl/memory/memory.h"
+
+namespace ci {
+
+namespace {
+
+// Opens a counter of the calling thread on any CPU. Returns -1 on failure.
+int OpenCounter(uint64_t config, int group_fd) {
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  // The group is enabled through its leader.
+  attr.disabled = group_fd == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, /*pid=*/0,
+                                  /*cpu=*/-1, group_fd, /*flags=*/0));
+}
+
+}  // namespace
+
+PerfCountersPtr PerfCounters::Open() {
+  // In the order of `Event`.
+  constexpr uint64_t kConfigs[kNumEvents] = {PERF_COUNT_HW_INSTRUCTIONS,
+                                             PERF_COUNT_HW_BRANCH_MISSES,
+                                             PERF_COUNT_HW_CACHE_MISSES};
+  std::array<int, kNumEvents> fds;
+  for (size_t i = 0; i < kNumEvents; ++i) {
+    fds[i] = OpenCounter(kConfigs[i], /*group_fd=*/i == 0 ? -1 : fds[0]);
+    if (fds[i] < 0) {
+      for (size_t j = 0; j < i; ++j) close(fds[j]);
+      return nullptr;
+    }
+  }
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  return absl::WrapUnique(new PerfCounters(fds));
+}
+
+PerfCounters::~PerfCounters() {
+  for (const int fd : fds_) close(fd);
+}
+
+void PerfCounters::Start() {
+  ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::Stop() {
+  ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  // PERF_FORMAT_GROUP: the number of events, followed by their counts.
+  uint64_t values[1 + kNumEvents];
+  if (read(fds_[0], values, sizeof(values)) != sizeof(values) ||
+      values[0] != kNumEvents) {
+    std::cerr << "Couldn't read perf counters." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < kNumEvents; ++i) totals_[i] += values[1 + i];
+}
+
+const char* PerfCounters::EventName(Event event) {
+  switch (event) {
+    case Event::INSTRUCTIONS:
+      return "instructions";
+    case Event::BRANCH_MISSES:
+      return "branch_misses";
+    case Event::LLC_MISSES:
+      return "llc_misses";
+  }
+  return "unknown";
+}
+
+}  // namespace ci
@@ -0,0 +1,80 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: perf_counters.h
+// -----------------------------------------------------------------------------
+//
+// Hardware counters of the calling thread, read with perf_event_open(2), e.g.,
+// to attribute cache and branch misses to lookups. Opening fails without the
+// needed permissions (see /proc/sys/kernel/perf_event_paranoid) and on most
+// virtual machines, so callers need to handle their absence.
+
+#ifndef CUCKOO_INDEX_COMMON_PERF_COUNTERS_H_
+#define CUCKOO_INDEX_COMMON_PERF_COUNTERS_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ci {
+
+class PerfCounters;
+using PerfCountersPtr = std::unique_ptr<PerfCounters>;
+
+class PerfCounters {
+ public:
+  enum class Event { INSTRUCTIONS, BRANCH_MISSES, LLC_MISSES };
+  static constexpr size_t kNumEvents = 3;
+
+  // Opens (but doesn't start) the counters of all events for the calling
+  // thread. Returns nullptr if that's not possible.
+  static PerfCountersPtr Open();
+
+  // Forbid copying and moving.
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  PerfCounters(PerfCounters&&) = delete;
+  PerfCounters& operator=(PerfCounters&&) = delete;
+
+  ~PerfCounters();
+
+  // Counts events (of the thread that called Open()) until Stop() is called.
+  // All events are counted as a group, i.e., over the same time.
+  void Start();
+
+  // Adds the events counted since Start() to the totals.
+  void Stop();
+
+  // Returns the total number of `event`s counted between calls to Start() and
+  // Stop().
+  uint64_t Get(Event event) const {
+    return totals_[static_cast<size_t>(event)];
+  }
+
+  static const char* EventName(Event event);
+
+ private:
+  explicit PerfCounters(const std::array<int, kNumEvents>& fds)
+      : fds_(fds), totals_({}) {}
+
+  // The first one is the group leader.
+  std::array<int, kNumEvents> fds_;
+  std::array<uint64_t, kNumEvents> totals_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_PERF_COUNTERS_H_
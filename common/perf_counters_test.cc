@@ -0,0 +1,52 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: perf_counters_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/perf_counters.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+TEST(PerfCountersTest, CountsInstructions) {
+  const PerfCountersPtr counters = PerfCounters::Open();
+  if (counters == nullptr) GTEST_SKIP() << "perf counters are unavailable";
+
+  EXPECT_EQ(counters->Get(PerfCounters::Event::INSTRUCTIONS), 0);
+  counters->Start();
+  volatile uint64_t sum = 0;
+  for (uint64_t i = 0; i < 100000; ++i) sum = sum + i;
+  counters->Stop();
+  const uint64_t instructions =
+      counters->Get(PerfCounters::Event::INSTRUCTIONS);
+  EXPECT_GE(instructions, 100000);
+
+  // Totals accumulate over several runs.
+  counters->Start();
+  for (uint64_t i = 0; i < 100000; ++i) sum = sum + i;
+  counters->Stop();
+  EXPECT_GT(counters->Get(PerfCounters::Event::INSTRUCTIONS), instructions);
+}
+
+TEST(PerfCountersTest, EventName) {
+  EXPECT_STREQ(PerfCounters::EventName(PerfCounters::Event::LLC_MISSES),
+               "llc_misses");
+}
+
+}  // namespace ci
@@ -1,5 +1,12 @@
 #include "common/profiling.h"
 
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
 namespace ci {
 
 Profiler& Profiler::GetThreadInstance() {
@@ -7,4 +14,102 @@ Profiler& Profiler::GetThreadInstance() {
   return static_profiler;
 }
 
+namespace {
+
+// Only set during static initialization, i.e., before any reads.
+bool allocation_hooks_installed = false;
+
+}  // namespace
+
+bool AllocationHooksInstalled() { return allocation_hooks_installed; }
+
+namespace internal {
+void SetAllocationHooksInstalled() { allocation_hooks_installed = true; }
+}  // namespace internal
+
+int64_t GetPeakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  // Linux reports kilobytes.
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+}
+
+namespace {
+
+using ThreadValues = std::array<std::atomic<int64_t>, kNumLookupCounters>;
+
+// The counters of all running threads, and the sums of the exited ones.
+struct LookupCountersRegistry {
+  absl::Mutex mutex;
+  std::vector<ThreadValues*> thread_values ABSL_GUARDED_BY(mutex);
+  LookupCounterValues exited_values ABSL_GUARDED_BY(mutex) = {};
+};
+
+// Never destroyed, since threads may exit after static destruction.
+LookupCountersRegistry& GetLookupCountersRegistry() {
+  static auto* registry = new LookupCountersRegistry;
+  return *registry;
+}
+
+}  // namespace
+
+LookupCounters::ThreadCounters::ThreadCounters() {
+  for (std::atomic<int64_t>& value : values) value.store(0);
+  LookupCountersRegistry& registry = GetLookupCountersRegistry();
+  absl::MutexLock lock(&registry.mutex);
+  registry.thread_values.push_back(&values);
+}
+
+LookupCounters::ThreadCounters::~ThreadCounters() {
+  LookupCountersRegistry& registry = GetLookupCountersRegistry();
+  absl::MutexLock lock(&registry.mutex);
+  for (size_t i = 0; i < kNumLookupCounters; ++i)
+    registry.exited_values[i] += values[i].load(std::memory_order_relaxed);
+  registry.thread_values.erase(std::find(registry.thread_values.begin(),
+                                         registry.thread_values.end(),
+                                         &values));
+}
+
+LookupCounterValues LookupCounters::GetSnapshot() {
+  LookupCountersRegistry& registry = GetLookupCountersRegistry();
+  absl::MutexLock lock(&registry.mutex);
+  LookupCounterValues result = registry.exited_values;
+  for (const ThreadValues* thread_values : registry.thread_values) {
+    for (size_t i = 0; i < kNumLookupCounters; ++i)
+      result[i] += (*thread_values)[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+void LookupCounters::Reset() {
+  LookupCountersRegistry& registry = GetLookupCountersRegistry();
+  absl::MutexLock lock(&registry.mutex);
+  registry.exited_values = {};
+  for (ThreadValues* thread_values : registry.thread_values) {
+    // Races with the owning thread, which may overwrite the reset.
+    for (std::atomic<int64_t>& value : *thread_values)
+      value.store(0, std::memory_order_relaxed);
+  }
+}
+
+const char* LookupCounters::Name(LookupCounter counter) {
+  switch (counter) {
+    case LookupCounter::BucketsProbed:
+      return "buckets_probed";
+    case LookupCounter::PrimaryBucketHits:
+      return "primary_bucket_hits";
+    case LookupCounter::SecondaryBucketHits:
+      return "secondary_bucket_hits";
+    case LookupCounter::FingerprintBlocksWalked:
+      return "fingerprint_blocks_walked";
+    case LookupCounter::RankCalls:
+      return "rank_calls";
+    case LookupCounter::RleRunsSkipped:
+      return "rle_runs_skipped";
+    case LookupCounter::BytesDecoded:
+      return "bytes_decoded";
+  }
+  return "unknown";
+}
+
 }  // namespace ci
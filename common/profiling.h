@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/time/time.h"
@@ -10,13 +15,82 @@ enum class Counter {
   DistributeValues,
   CreateSlots,
   CreateFingerprintStore,
-  GetGlobalBitmap
+  GetGlobalBitmap,
+  // Not a timer: the number of values moved by CuckooKicker.
+  NumKicks,
+  // Not a timer: the number of buckets of the built CuckooIndexes.
+  NumBuckets
+};
+
+// Heap usage of a thread as counted by the allocation hooks (see
+// allocation_hooks.cc, which replaces the global operator new and delete).
+// Stays all zero unless the hooks are linked into the binary.
+struct AllocationStats {
+  // Usable bytes and number of all allocations so far.
+  int64_t allocated_bytes = 0;
+  int64_t num_allocations = 0;
+  // Bytes allocated minus bytes freed by this thread (i.e., negative if it
+  // frees memory allocated by others), and their maximum since the current
+  // `ScopedProfile` started.
+  int64_t live_bytes = 0;
+  int64_t peak_live_bytes = 0;
+};
+
+// Returns the stats of the calling thread. Constant-initialized, so that the
+// allocation hooks can use it at any time (even during thread exit).
+inline AllocationStats& GetThreadAllocationStats() {
+  thread_local AllocationStats stats;
+  return stats;
+}
+
+// Adds the `AllocationStats` of worker threads (started with all-zero stats,
+// e.g., taken right before each worker exits) to the ones of the calling
+// thread, e.g., after joining them. The scopes of the calling thread then
+// include the heap usage of its workers (and memory they allocated but the
+// calling thread frees doesn't make its live bytes drop below their start).
+// Like Profiler::Merge(..), the peaks are summed up, i.e., as if all workers
+// peaked at the same time.
+inline void MergeWorkerAllocationStats(
+    const std::vector<AllocationStats>& workers) {
+  AllocationStats& stats = GetThreadAllocationStats();
+  int64_t peak_live_bytes = 0;
+  for (const AllocationStats& worker : workers) {
+    stats.allocated_bytes += worker.allocated_bytes;
+    stats.num_allocations += worker.num_allocations;
+    peak_live_bytes += worker.peak_live_bytes;
+  }
+  stats.peak_live_bytes =
+      std::max(stats.peak_live_bytes, stats.live_bytes + peak_live_bytes);
+  for (const AllocationStats& worker : workers)
+    stats.live_bytes += worker.live_bytes;
+}
+
+// Returns true if allocation_hooks.cc is linked in, i.e., if the
+// `AllocationStats` and `MemoryUsage`s are actually counted.
+bool AllocationHooksInstalled();
+
+namespace internal {
+// Called by allocation_hooks.cc during static initialization.
+void SetAllocationHooksInstalled();
+}  // namespace internal
+
+// Returns the peak resident set size of the process so far (getrusage(..)).
+int64_t GetPeakRssBytes();
+
+// Heap usage of the scopes of a counter (see ScopedProfile).
+struct MemoryUsage {
+  // Usable bytes and number of allocations of the scopes.
+  int64_t allocated_bytes = 0;
+  int64_t num_allocations = 0;
+  // How far the heap usage of the scopes peaked above their start.
+  int64_t peak_bytes = 0;
 };
 
 // A simple profiler that can collect stats. Use `ScopedProfile` for registering
 // counters to profile.
 //
-// Is thread-safe, because there can be only a single instance per thread.
+// Is thread-safe, because there can be only a single instance per thread. Use
+// Merge(..) to aggregate the counters of worker threads.
 class Profiler {
  public:
   // Retrieves a `Profiler` instance for the current thread.
@@ -31,7 +105,35 @@ class Profiler {
     return value_it != counters_.end() ? value_it->second : 0;
   }
 
-  void Reset() { counters_.clear(); }
+  // Returns the heap usage of the scopes of `counter` (summed up over all
+  // scopes). All zero unless the allocation hooks are linked in.
+  MemoryUsage GetMemoryUsage(Counter counter) const {
+    const auto usage_it = memory_usages_.find(counter);
+    return usage_it != memory_usages_.end() ? usage_it->second : MemoryUsage();
+  }
+
+  void Reset() {
+    counters_.clear();
+    memory_usages_.clear();
+  }
+
+  // Adds `value` to the given (non-timer) counter.
+  void Add(Counter counter, int64_t value) { counters_[counter] += value; }
+
+  // Adds all counters of `other` to this profiler. Timers are summed up as
+  // well, i.e., give the total time spent by all threads. So are the peaks of
+  // the heap usage, i.e., as if all threads peaked at the same time. No timer
+  // of `other` may be running.
+  void Merge(const Profiler& other) {
+    for (const auto& [counter, value] : other.counters_)
+      counters_[counter] += value;
+    for (const auto& [counter, usage] : other.memory_usages_) {
+      MemoryUsage& merged = memory_usages_[counter];
+      merged.allocated_bytes += usage.allocated_bytes;
+      merged.num_allocations += usage.num_allocations;
+      merged.peak_bytes += usage.peak_bytes;
+    }
+  }
 
  private:
   friend class ScopedProfile;
@@ -43,16 +145,33 @@ class Profiler {
     counters_[counter] -= absl::GetCurrentTimeNanos();
   }
 
-  // Stops profiling for the given counter.
-  void Stop(Counter counter) {
-    counters_[counter] += absl::GetCurrentTimeNanos();
+  // Stops profiling for the given counter, whose scope started with the
+  // thread's allocation stats at `start`.
+  void Stop(Counter counter, const AllocationStats& start) {
+    const int64_t now = absl::GetCurrentTimeNanos();
+    AllocationStats& stats = GetThreadAllocationStats();
+    const MemoryUsage scope_usage = {
+        stats.allocated_bytes - start.allocated_bytes,
+        stats.num_allocations - start.num_allocations,
+        stats.peak_live_bytes - start.live_bytes};
+    // Enclosing scopes need the peak since their own start.
+    stats.peak_live_bytes =
+        std::max(stats.peak_live_bytes, start.peak_live_bytes);
+
+    counters_[counter] += now;
+    MemoryUsage& usage = memory_usages_[counter];
+    usage.allocated_bytes += scope_usage.allocated_bytes;
+    usage.num_allocations += scope_usage.num_allocations;
+    usage.peak_bytes += scope_usage.peak_bytes;
   }
 
   absl::flat_hash_map<Counter, int64_t> counters_;
+  absl::flat_hash_map<Counter, MemoryUsage> memory_usages_;
 };
 
-// Instantiate a local variable with this class to profile the local scope.
-// Example:
+// Instantiate a local variable with this class to profile the local scope, i.e.,
+// its time and (with the allocation hooks) the heap usage of the calling
+// thread. Example:
 //   void MyClass::MyMethod() {
 //     ScopedProfile t(Counters::MyClass_MyMethod);
 //     .... // Do expensive stuff.
@@ -65,12 +184,96 @@ class ScopedProfile {
 
   explicit ScopedProfile(Counter counter) : counter_(counter) {
     Profiler::GetThreadInstance().Start(counter);
+    AllocationStats& stats = GetThreadAllocationStats();
+    start_ = stats;
+    stats.peak_live_bytes = stats.live_bytes;
   }
 
-  ~ScopedProfile() { Profiler::GetThreadInstance().Stop(counter_); }
+  ~ScopedProfile() { Profiler::GetThreadInstance().Stop(counter_, start_); }
 
  private:
   Counter counter_;
+  AllocationStats start_;
+};
+
+// Counters of the lookup path, e.g., for exporting how much work lookups do
+// and spotting when the layout of an index degrades. Unlike `Counter`s, they're
+// only counted when compiled with -DCUCKOO_INDEX_LOOKUP_COUNTERS (e.g., with
+// bazel's --copt or CMake's CUCKOOINDEX_LOOKUP_COUNTERS option, see
+// CUCKOO_INDEX_COUNT_LOOKUP below), and then cost a thread-local add.
+enum class LookupCounter {
+  // Buckets whose fingerprints were compared.
+  BucketsProbed,
+  // Lookups that found their fingerprint in the primary (secondary) bucket.
+  PrimaryBucketHits,
+  SecondaryBucketHits,
+  // Blocks searched by FingerprintStore to locate a bucket (i.e., without the
+  // directory or cache lines).
+  FingerprintBlocksWalked,
+  // Rank queries on bitmaps (see GetRank(..)).
+  RankCalls,
+  // Runs RleBitmap::Extract(..) decoded before reaching the extracted range.
+  RleRunsSkipped,
+  // Bytes of bit-packed runs and bits decoded by RleBitmap::Extract(..).
+  BytesDecoded,
+};
+
+constexpr size_t kNumLookupCounters =
+    static_cast<size_t>(LookupCounter::BytesDecoded) + 1;
+
+#ifdef CUCKOO_INDEX_LOOKUP_COUNTERS
+constexpr bool kLookupCountersEnabled = true;
+#define CUCKOO_INDEX_COUNT_LOOKUP(counter, value) \
+  ::ci::LookupCounters::Add(::ci::LookupCounter::counter, (value))
+#else
+constexpr bool kLookupCountersEnabled = false;
+// Doesn't evaluate `value` (but keeps the variables in it used).
+#define CUCKOO_INDEX_COUNT_LOOKUP(counter, value) \
+  static_cast<void>(sizeof((value)))
+#endif
+
+using LookupCounterValues = std::array<int64_t, kNumLookupCounters>;
+
+// Per-thread storage of the lookup counters. Every thread owns a fixed array,
+// which only it writes to, and which is registered globally so that
+// GetSnapshot() can aggregate the counters of all threads.
+class LookupCounters {
+ public:
+  // Adds `value` to `counter` of the calling thread. Use
+  // CUCKOO_INDEX_COUNT_LOOKUP(..) on the lookup path instead, which compiles
+  // to nothing by default.
+  static void Add(LookupCounter counter, int64_t value) {
+    std::atomic<int64_t>& count =
+        GetThreadCounters().values[static_cast<size_t>(counter)];
+    // There's a single writer, i.e., no need for an atomic read-modify-write.
+    count.store(count.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+  }
+
+  // Returns the sums of the counters of all threads (including exited ones)
+  // since the last Reset().
+  static LookupCounterValues GetSnapshot();
+
+  // Resets the counters of all threads. Events counted concurrently may get
+  // lost.
+  static void Reset();
+
+  static const char* Name(LookupCounter counter);
+
+ private:
+  // Cache-line aligned to not share lines between threads.
+  struct alignas(64) ThreadCounters {
+    // (De-)registers the counters globally.
+    ThreadCounters();
+    ~ThreadCounters();
+
+    std::array<std::atomic<int64_t>, kNumLookupCounters> values;
+  };
+
+  static ThreadCounters& GetThreadCounters() {
+    thread_local static ThreadCounters counters;
+    return counters;
+  }
 };
 
 }  // namespace ci
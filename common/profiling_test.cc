@@ -0,0 +1,123 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: profiling_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/profiling.h"
+
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+TEST(ScopedProfileTest, CountsAllocations) {
+  if (!AllocationHooksInstalled())
+    GTEST_SKIP() << "allocation_hooks.cc isn't linked in.";
+  constexpr int64_t kOuterSize = 1 << 20;
+  constexpr int64_t kInnerSize = 1 << 16;
+  Profiler& profiler = Profiler::GetThreadInstance();
+  profiler.Reset();
+  {
+    ScopedProfile profile(Counter::CreateSlots);
+    // Calls operator new directly, since allocations of new-expressions may
+    // be elided.
+    void* outer = ::operator new(kOuterSize);
+    {
+      ScopedProfile inner_profile(Counter::GetGlobalBitmap);
+      ::operator delete(::operator new(kInnerSize));
+    }
+    ::operator delete(outer);
+  }
+
+  const MemoryUsage inner = profiler.GetMemoryUsage(Counter::GetGlobalBitmap);
+  EXPECT_GE(inner.allocated_bytes, kInnerSize);
+  EXPECT_GE(inner.num_allocations, 1);
+  EXPECT_GE(inner.peak_bytes, kInnerSize);
+  EXPECT_LT(inner.peak_bytes, kOuterSize);
+
+  // The peak of the outer scope includes the one of the inner scope.
+  const MemoryUsage outer = profiler.GetMemoryUsage(Counter::CreateSlots);
+  EXPECT_GE(outer.allocated_bytes, kOuterSize + kInnerSize);
+  EXPECT_GE(outer.num_allocations, 2);
+  EXPECT_GE(outer.peak_bytes, kOuterSize + kInnerSize);
+
+  profiler.Reset();
+  EXPECT_EQ(profiler.GetMemoryUsage(Counter::CreateSlots).allocated_bytes, 0);
+}
+
+TEST(ScopedProfileTest, MergesWorkerAllocationStats) {
+  if (!AllocationHooksInstalled())
+    GTEST_SKIP() << "allocation_hooks.cc isn't linked in.";
+  constexpr int64_t kWorkerSize = 1 << 20;
+  Profiler& profiler = Profiler::GetThreadInstance();
+  profiler.Reset();
+  {
+    ScopedProfile profile(Counter::CreateSlots);
+    std::vector<AllocationStats> worker_stats(2);
+    std::vector<void*> allocations(2);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 2; ++i) {
+      threads.emplace_back([&, i]() {
+        allocations[i] = ::operator new(kWorkerSize);
+        worker_stats[i] = GetThreadAllocationStats();
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+    MergeWorkerAllocationStats(worker_stats);
+    // Frees memory of the workers, i.e., balances their live bytes.
+    for (void* allocation : allocations) ::operator delete(allocation);
+  }
+
+  const MemoryUsage usage = profiler.GetMemoryUsage(Counter::CreateSlots);
+  EXPECT_GE(usage.allocated_bytes, 2 * kWorkerSize);
+  EXPECT_GE(usage.num_allocations, 2);
+  EXPECT_GE(usage.peak_bytes, 2 * kWorkerSize);
+  profiler.Reset();
+}
+
+TEST(LookupCountersTest, AggregatesThreads) {
+  LookupCounters::Reset();
+  LookupCounters::Add(LookupCounter::BucketsProbed, 2);
+
+  // Counters of exited threads are kept.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([]() {
+      LookupCounters::Add(LookupCounter::BucketsProbed, 1);
+      LookupCounters::Add(LookupCounter::RankCalls, 3);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  const LookupCounterValues values = LookupCounters::GetSnapshot();
+  EXPECT_EQ(values[static_cast<size_t>(LookupCounter::BucketsProbed)], 6);
+  EXPECT_EQ(values[static_cast<size_t>(LookupCounter::RankCalls)], 12);
+  EXPECT_EQ(values[static_cast<size_t>(LookupCounter::BytesDecoded)], 0);
+
+  LookupCounters::Reset();
+  for (const int64_t value : LookupCounters::GetSnapshot())
+    EXPECT_EQ(value, 0);
+}
+
+TEST(LookupCountersTest, Name) {
+  EXPECT_STREQ(LookupCounters::Name(LookupCounter::PrimaryBucketHits),
+               "primary_bucket_hits");
+}
+
+}  // namespace ci
@@ -18,10 +18,15 @@
 
 #include "common/rle_bitmap.h"
 
+#include <algorithm>
+#include <climits>
 #include <cmath>
 #include <numeric>
 #include <vector>
 
+#include "absl/memory/memory.h"
+#include "common/profiling.h"
+
 namespace ci {
 namespace {
 
@@ -33,6 +38,51 @@ constexpr uint32_t kMinDenseRunLength = 18;
 // to a good trade-off in size and helps ZSTD when compressing the entries.
 constexpr uint32_t kMaxDenseRunLength = 128;
 
+// Sets the bits [begin, end) of `bitmap`, whole words at a time.
+void SetRange(size_t begin, size_t end, Bitmap64* bitmap) {
+  while (begin < end) {
+    const size_t word_idx = begin / 64;
+    const size_t word_end = std::min(end, (word_idx + 1) * 64);
+    const size_t length = word_end - begin;
+    if (length == 64) {
+      bitmap->SetWord(word_idx, ~0ULL);
+    } else {
+      const uint64_t mask = ((1ULL << length) - 1ULL) << (begin % 64);
+      bitmap->SetWord(word_idx, bitmap->GetWord(word_idx) | mask);
+    }
+    begin = word_end;
+  }
+}
+
+// Sets the bits of `bitmap` at `pos` + i for the set bits i of the lowest
+// `num_bits` (< 64) bits of `bits`.
+void OrBits(uint64_t bits, size_t num_bits, size_t pos, Bitmap64* bitmap) {
+  if (bits == 0) return;
+  const size_t word_idx = pos / 64;
+  const size_t shift = pos % 64;
+  bitmap->SetWord(word_idx, bitmap->GetWord(word_idx) | (bits << shift));
+  if (shift + num_bits > 64) {
+    bitmap->SetWord(word_idx + 1,
+                    bitmap->GetWord(word_idx + 1) | (bits >> (64 - shift)));
+  }
+}
+
+// Unsets the bits [begin, end) of `bitmap`, whole words at a time.
+void ClearRange(size_t begin, size_t end, Bitmap64* bitmap) {
+  while (begin < end) {
+    const size_t word_idx = begin / 64;
+    const size_t word_end = std::min(end, (word_idx + 1) * 64);
+    const uint64_t word = bitmap->GetWord(word_idx);
+    if (word != 0) {
+      const size_t length = word_end - begin;
+      const uint64_t mask =
+          (length == 64 ? ~0ULL : ((1ULL << length) - 1ULL)) << (begin % 64);
+      bitmap->SetWord(word_idx, word & ~mask);
+    }
+    begin = word_end;
+  }
+}
+
 // The "fudge factor" to apply when deciding whether to use the sparse encoding.
 // Slightly prefer sparse, since it tends to compress better with zstd.
 constexpr double kSparseFudgeFactor = 1.1;
@@ -127,8 +177,9 @@ void EncodeSparseRunLengths(const Bitmap64& bitmap,
 // `skip_offsets[0]` is the sum of entries `run_lengths[0]` ..
 // `run_lengths[skip_offsets_step - 1]`. `skip_offsets[1]` gives the position in
 // `bits` to which `run_lengths[skip_offsets_step]` is referring to.
+template <typename T>
 std::vector<uint32_t> ComputeDenseSkipOffsets(
-    const std::vector<uint32_t>& run_lengths, uint32_t skip_offsets_step) {
+    const std::vector<T>& run_lengths, uint32_t skip_offsets_step) {
   std::vector<uint32_t> skip_offsets;
   for (size_t i = 0; i < run_lengths.size(); i += skip_offsets_step) {
     uint32_t uncompressed_count = 0;
@@ -152,8 +203,9 @@ std::vector<uint32_t> ComputeDenseSkipOffsets(
 // run_lengths entries with a "stride" of `skip_offsets_step`. `skip_offsets[i]`
 // is the sum of entries `run_lengths[i]` .. `run_lengths[i + skip_offsets_step
 // - 1]`
+template <typename T>
 std::vector<uint32_t> ComputeSparseSkipOffsets(
-    const std::vector<uint32_t>& run_lengths, uint32_t skip_offsets_step) {
+    const std::vector<T>& run_lengths, uint32_t skip_offsets_step) {
   std::vector<uint32_t> skip_offsets;
   for (size_t i = 0; i < run_lengths.size(); i += skip_offsets_step) {
     uint32_t count = 0;
@@ -166,6 +218,47 @@ std::vector<uint32_t> ComputeSparseSkipOffsets(
   return skip_offsets;
 }
 
+// The (exclusive) upper bound of bits EncodeDenseRunLengths(..) looks at
+// beyond the current position before adding the next entries:
+// `count_raw` < kMaxDenseRunLength and
+// `count_rep` < kMaxDenseRunLength + kMinDenseRunLength - 1 hold while it
+// keeps scanning.
+constexpr size_t kMaxDenseLookAhead =
+    2 * kMaxDenseRunLength + kMinDenseRunLength - 1;
+
+// RleBitmapBuilder stores the run-lengths in bytes.
+static_assert(((kMaxDenseRunLength - 1) << 1 | 1) <= UINT8_MAX,
+              "Dense run-lengths must fit into a byte");
+static_assert(kMaxSparseRunLength <= UINT8_MAX,
+              "Sparse run-lengths must fit into a byte");
+
+// Appends the entries of the sparse encoding for a 1-bit `offset` bits after
+// the previous one (see EncodeSparseRunLengths(..)).
+void AddSparseOffset(size_t offset, std::vector<uint8_t>* run_lengths) {
+  while (offset > kMaxSparseRunLength) {
+    run_lengths->push_back(0);
+    offset -= kMaxSparseRunLength;
+  }
+  assert(offset >= 1);
+  run_lengths->push_back(offset);
+}
+
+// Same as StoreBitPacked<uint32_t>(..), but for byte-sized entries.
+void StoreBitPackedBytes(const std::vector<uint8_t>& array,
+                         const long bit_width, ByteBuffer* buffer) {
+  if (bit_width == 0) return;
+  const size_t new_pos =
+      buffer->pos() + BitPackingBytesRequired(bit_width * array.size());
+  buffer->EnsureCapacity(new_pos + internal::kSlopBytes);
+  char* data = buffer->data() + buffer->pos();
+  size_t shift = 0;
+  uint64_t word = 0;
+  for (const uint8_t val : array)
+    internal::StoreValue<uint32_t>(val, bit_width, &word, &shift, &data);
+  absl::little_endian::Store64(data, word);
+  buffer->set_pos(new_pos);
+}
+
 }  // namespace
 
 RleBitmap::RleBitmap(const Bitmap64& bitmap) {
@@ -227,6 +320,7 @@ RleBitmap::RleBitmap(const Bitmap64& bitmap) {
 
   // Copy the serialized encoding to the string `data_`.
   data_ = std::string(result.data(), result.pos());
+  encoded_ = data_;
 
   // Set all three BitPackedReaders for convenient & fast access.
   skip_offsets_ = BitPackedReader<uint32_t>(skip_offsets_bit_width,
@@ -236,13 +330,292 @@ RleBitmap::RleBitmap(const Bitmap64& bitmap) {
   bits_ = BitPackedReader<uint32_t>(1, data_.data() + bits_pos);
 }
 
+RleBitmapPtr RleBitmap::Decode(absl::string_view data) {
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  RleBitmapPtr bitmap = absl::WrapUnique(new RleBitmap());
+  bitmap->encoded_ = data;
+  bitmap->InitFromEncoded();
+  return bitmap;
+}
+
+void RleBitmap::InitFromEncoded() {
+  const absl::Span<const char> data =
+      absl::MakeConstSpan(encoded_.data(), encoded_.size());
+  size_t pos = 0;
+  // Read the header in the same order as it was written in the c'tor above.
+  is_sparse_ = GetVarint32(data, &pos) == 1;
+  size_ = GetVarint32(data, &pos);
+  skip_offsets_step_ = GetVarint32(data, &pos);
+  skip_offsets_size_ = GetVarint32(data, &pos);
+  run_lengths_size_ = GetVarint32(data, &pos);
+  bits_size_ = GetVarint32(data, &pos);
+  // ** The `skip_offsets`.
+  const uint32_t skip_offsets_bit_width = GetVarint32(data, &pos);
+  skip_offsets_ =
+      BitPackedReader<uint32_t>(skip_offsets_bit_width, data.data() + pos);
+  pos += BitPackingBytesRequired(skip_offsets_size_ * skip_offsets_bit_width);
+  // ** The `run_lengths`.
+  const uint32_t run_lengths_bit_width = GetVarint32(data, &pos);
+  run_lengths_ =
+      BitPackedReader<uint32_t>(run_lengths_bit_width, data.data() + pos);
+  pos += BitPackingBytesRequired(run_lengths_size_ * run_lengths_bit_width);
+  // ** The bits.
+  bits_ = BitPackedReader<uint32_t>(1, data.data() + pos);
+  assert(pos + BitPackingBytesRequired(bits_size_) <= data.size());
+}
+
 Bitmap64 RleBitmap::Extract(size_t offset, size_t size) const {
-  return is_sparse_ ? ExtractSparse(offset, size) : ExtractDense(offset, size);
+  Bitmap64 result;
+  ExtractInto(offset, size, &result);
+  return result;
+}
+
+void RleBitmap::ExtractInto(size_t offset, size_t size,
+                            Bitmap64* result) const {
+  result->Reset(size);
+  if (is_sparse_) {
+    ExtractSparse(offset, size, result);
+  } else {
+    ExtractDense(offset, size, result);
+  }
+}
+
+void RleBitmap::ExtractUnionInto(absl::Span<const size_t> offsets,
+                                 size_t size, Bitmap64* result) const {
+  result->Reset(size);
+  // Stop once all bits of `result` are set.
+  size_t ones_count = 0;
+  const auto set_bit = [&](size_t pos) {
+    if (!result->Get(pos)) {
+      result->Set(pos, true);
+      ++ones_count;
+    }
+  };
+  if (is_sparse_) {
+    ScanSparse(offsets, size, [&](size_t, size_t pos) {
+      set_bit(pos);
+      return ones_count < size;
+    });
+  } else {
+    ScanDense(offsets, size,
+              [&](size_t, size_t pos, size_t length, bool value) {
+                if (value) {
+                  for (size_t i = pos; i < pos + length; ++i) set_bit(i);
+                }
+                return ones_count < size;
+              });
+  }
+}
+
+void RleBitmap::IntersectInto(size_t offset, Bitmap64* candidates) const {
+  assert(offset + candidates->bits() <= size_);
+  const size_t num_candidates = candidates->GetOnesCount();
+  size_t first;
+  size_t last;
+  if (!candidates->SelectOne(0, &first)) return;
+  candidates->SelectOne(num_candidates - 1, &last);
+  const size_t size = last + 1 - first;
+  if (is_sparse_) {
+    // Only 1-bits are encoded, so collect the ones among the candidates.
+    Bitmap64 ones(/*size=*/candidates->bits());
+    ScanSparse({offset + first}, size, [&](size_t, size_t pos) {
+      ones.Set(first + pos, true);
+      return true;
+    });
+    *candidates &= ones;
+  } else {
+    ScanDense({offset + first}, size,
+              [&](size_t, size_t pos, size_t length, bool value) {
+                if (!value) ClearRange(first + pos, first + pos + length,
+                                       candidates);
+                return true;
+              });
+  }
+}
+
+void RleBitmap::TrueBitIndicesInRange(size_t offset, size_t size,
+                                      std::vector<uint32_t>* indices) const {
+  assert(offset + size <= size_);
+  indices->clear();
+  if (is_sparse_) {
+    ScanSparse({offset}, size, [&](size_t, size_t pos) {
+      indices->push_back(pos);
+      return true;
+    });
+  } else {
+    ScanDense({offset}, size,
+              [&](size_t, size_t pos, size_t length, bool value) {
+      if (value) {
+        for (size_t i = pos; i < pos + length; ++i) indices->push_back(i);
+      }
+      return true;
+    });
+  }
+}
+
+bool RleBitmap::Get(size_t pos) const {
+  assert(pos < size_);
+  bool result = false;
+  if (is_sparse_) {
+    ScanSparse({pos}, /*size=*/1, [&](size_t, size_t) {
+      result = true;
+      return false;
+    });
+  } else {
+    ScanDense({pos}, /*size=*/1, [&](size_t, size_t, size_t, bool value) {
+      result = value;
+      return false;
+    });
+  }
+  return result;
+}
+
+size_t RleBitmap::GetOnesCountInRange(size_t offset, size_t size) const {
+  assert(offset + size <= size_);
+  size_t ones_count = 0;
+  if (is_sparse_) {
+    ScanSparse({offset}, size, [&](size_t, size_t) {
+      ++ones_count;
+      return true;
+    });
+  } else {
+    ScanDense({offset}, size, [&](size_t, size_t, size_t length, bool value) {
+      if (value) ones_count += length;
+      return true;
+    });
+  }
+  return ones_count;
+}
+
+bool RleBitmap::IsAllZeroesInRange(size_t offset, size_t size) const {
+  assert(offset + size <= size_);
+  bool all_zeroes = true;
+  if (is_sparse_) {
+    ScanSparse({offset}, size, [&](size_t, size_t) {
+      all_zeroes = false;
+      return false;
+    });
+  } else {
+    ScanDense({offset}, size, [&](size_t, size_t, size_t, bool value) {
+      all_zeroes = !value;
+      return all_zeroes;
+    });
+  }
+  return all_zeroes;
+}
+
+template <typename Fn>
+void RleBitmap::ScanDense(absl::Span<const size_t> offsets, size_t size,
+                          const Fn& fn) const {
+  // Current run: its index in `run_lengths_`, its position in `bits_` and its
+  // (uncompressed) position.
+  size_t rle_pos = 0;
+  size_t bits_pos = 0;
+  size_t run_begin = 0;
+  // Next skip-offsets entry and the run it skips to.
+  size_t skip_idx = 0;
+  size_t skip_rle_pos = 0;
+  size_t skip_bits_pos = 0;
+  size_t skip_begin = 0;
+  assert(skip_offsets_size_ % 2 == 0);
+
+  for (size_t range_idx = 0; range_idx < offsets.size(); ++range_idx) {
+    const size_t offset = offsets[range_idx];
+    const size_t end = offset + size;
+    assert(range_idx == 0 || offsets[range_idx - 1] + size <= offset);
+
+    // Use the skip-list to jump forward to the run containing `offset` (in
+    // case it's not already within reach of the current run).
+    while (skip_idx < skip_offsets_size_ &&
+           skip_begin + skip_offsets_.Get(skip_idx) <= offset) {
+      skip_begin += skip_offsets_.Get(skip_idx);
+      skip_bits_pos += skip_offsets_.Get(skip_idx + 1);
+      skip_rle_pos += skip_offsets_step_;
+      skip_idx += 2;
+    }
+    if (skip_rle_pos > rle_pos) {
+      rle_pos = skip_rle_pos;
+      bits_pos = skip_bits_pos;
+      run_begin = skip_begin;
+    }
+
+    // Step over whole runs, only raw runs that overlap the range are read bit
+    // by bit.
+    while (run_begin < end && rle_pos < run_lengths_size_) {
+      const uint32_t rle_entry = run_lengths_.Get(rle_pos);
+      const bool is_raw = rle_entry & 1;
+      const size_t count =
+          (rle_entry >> 1) + (is_raw ? 1 : kMinDenseRunLength);
+      const size_t overlap_begin = std::max(run_begin, offset);
+      const size_t overlap_end = std::min(run_begin + count, end);
+      if (overlap_begin < overlap_end) {
+        if (is_raw) {
+          for (size_t j = overlap_begin; j < overlap_end; ++j) {
+            if (!fn(range_idx, j - offset, /*length=*/1,
+                    bits_.Get(bits_pos + j - run_begin)))
+              return;
+          }
+        } else if (!fn(range_idx, overlap_begin - offset,
+                       overlap_end - overlap_begin, bits_.Get(bits_pos))) {
+          return;
+        }
+      }
+      // Keep runs that extend into the next range.
+      if (run_begin + count > end) break;
+      ++rle_pos;
+      bits_pos += is_raw ? count : 1;
+      run_begin += count;
+    }
+  }
 }
 
-Bitmap64 RleBitmap::ExtractDense(size_t offset, size_t size) const {
-  Bitmap64 result(size);
+template <typename Fn>
+void RleBitmap::ScanSparse(absl::Span<const size_t> offsets, size_t size,
+                           const Fn& fn) const {
+  // Next entry in `run_lengths_` and the position of the last visited 1-bit.
+  size_t rle_pos = 0;
+  int64_t i = -1;
+  // Next skip-offsets entry and the entry & position it skips to.
+  size_t skip_idx = 0;
+  size_t skip_rle_pos = 0;
+  int64_t skip_i = -1;
+
+  for (size_t range_idx = 0; range_idx < offsets.size(); ++range_idx) {
+    const int64_t offset = offsets[range_idx];
+    const int64_t end = offset + size;
+    assert(range_idx == 0 || offsets[range_idx - 1] + size <= offsets[range_idx]);
 
+    // Use the skip-list to jump forward (in case `offset` is not already
+    // within reach of the current entry).
+    while (skip_idx < skip_offsets_size_ &&
+           skip_i + skip_offsets_.Get(skip_idx) < offset) {
+      skip_i += skip_offsets_.Get(skip_idx);
+      skip_rle_pos += skip_offsets_step_;
+      ++skip_idx;
+    }
+    if (skip_rle_pos > rle_pos) {
+      rle_pos = skip_rle_pos;
+      i = skip_i;
+    }
+
+    while (rle_pos < run_lengths_size_) {
+      const uint32_t count = run_lengths_.Get(rle_pos);
+      if (count == 0) {
+        i += kMaxSparseRunLength;
+        ++rle_pos;
+        continue;
+      }
+      // Keep 1-bits beyond this range for the next range.
+      if (i + count >= end) break;
+      i += count;
+      ++rle_pos;
+      if (i >= offset && !fn(range_idx, i - offset)) return;
+    }
+  }
+}
+
+void RleBitmap::ExtractDense(size_t offset, size_t size,
+                             Bitmap64* result) const {
   size_t rle_pos = 0;
   size_t bits_pos = 0;
   // Use the skip-list to find where to start scanning run_lengths_ and bits_.
@@ -253,38 +626,46 @@ Bitmap64 RleBitmap::ExtractDense(size_t offset, size_t size) const {
     rle_pos += skip_offsets_step_;
     bits_pos += skip_offsets_.Get(i + 1);
   }
+  const size_t begin_rle_pos = rle_pos;
+  const size_t begin_bits_pos = bits_pos;
+  size_t num_skipped_runs = 0;
 
-  // Scan from rle_pos and bits_pos on.
-  size_t count_rep = 0;
-  size_t count_raw = 0;
-  for (size_t i = 0; i < offset + size; ++i) {
-    if (count_rep == 0 && count_raw == 0) {
-      const uint32_t rle_entry = run_lengths_.Get(rle_pos++);
-      if (rle_entry & 1) {
-        count_raw = (rle_entry >> 1) + 1;
-      } else {
-        count_rep = (rle_entry >> 1) + kMinDenseRunLength;
+  // Scan run by run from rle_pos and bits_pos on. Repeated runs of ones are
+  // filled a word at a time, raw runs are copied in chunks of up to 57 bits.
+  constexpr size_t kMaxChunkBits = 57;
+  const size_t end = offset + size;
+  size_t run_begin = 0;
+  while (run_begin < end) {
+    const uint32_t rle_entry = run_lengths_.Get(rle_pos++);
+    const bool is_raw = rle_entry & 1;
+    const size_t run_end =
+        run_begin + (rle_entry >> 1) + (is_raw ? 1 : kMinDenseRunLength);
+    // The part of the run within [offset, end).
+    const size_t begin = std::max(run_begin, offset);
+    const size_t stop = std::min(run_end, end);
+    if (is_raw) {
+      for (size_t pos = begin; pos < stop; pos += kMaxChunkBits) {
+        const size_t num_bits = std::min(kMaxChunkBits, stop - pos);
+        OrBits(bits_.GetPacked(bits_pos + pos - run_begin, num_bits),
+               num_bits, pos - offset, result);
       }
-    }
-    bool bit;
-    if (count_rep > 0) {
-      count_rep--;
-      bit = bits_.Get(bits_pos);
-      if (count_rep == 0) bits_pos++;
+      bits_pos += run_end - run_begin;
     } else {
-      assert(count_raw > 0);
-      count_raw--;
-      bit = bits_.Get(bits_pos++);
+      if (bits_.Get(bits_pos++) && begin < stop)
+        SetRange(begin - offset, stop - offset, result);
     }
-    // Set the bit accordingly (once we've reached at least the offset).
-    if (i >= offset && bit) result.Set(i - offset, true);
+    num_skipped_runs += run_end <= offset;
+    run_begin = run_end;
   }
-  return result;
+  CUCKOO_INDEX_COUNT_LOOKUP(RleRunsSkipped, num_skipped_runs);
+  CUCKOO_INDEX_COUNT_LOOKUP(
+      BytesDecoded,
+      ((rle_pos - begin_rle_pos) * run_lengths_.bit_width() + bits_pos -
+       begin_bits_pos + 7) / 8);
 }
 
-Bitmap64 RleBitmap::ExtractSparse(size_t offset, size_t size) const {
-  Bitmap64 result(size);
-
+void RleBitmap::ExtractSparse(size_t offset, size_t size,
+                              Bitmap64* result) const {
   size_t rle_pos = 0;
   // Use the skip-list to find where to start scanning run_lengths_.
   for (size_t i = 0; i < skip_offsets_size_; ++i) {
@@ -292,6 +673,16 @@ Bitmap64 RleBitmap::ExtractSparse(size_t offset, size_t size) const {
     offset -= skip_offsets_.Get(i);
     rle_pos += skip_offsets_step_;
   }
+  const size_t begin_rle_pos = rle_pos;
+  size_t num_skipped_runs = 0;
+
+  // The set bits are increasing, so they're collected in `word` and written a
+  // word at a time.
+  size_t word_idx = 0;
+  uint64_t word = 0;
+  auto flush_word = [&]() {
+    if (word != 0) result->SetWord(word_idx, result->GetWord(word_idx) | word);
+  };
 
   // Scan from rle_pos on.
   int64_t i = -1;
@@ -304,11 +695,198 @@ Bitmap64 RleBitmap::ExtractSparse(size_t offset, size_t size) const {
       i += count;
       if (i >= static_cast<int64_t>(offset) &&
           i < static_cast<int64_t>(offset + size)) {
-        result.Set(i - offset, true);
+        const size_t pos = i - offset;
+        if (pos / 64 != word_idx) {
+          flush_word();
+          word_idx = pos / 64;
+          word = 0;
+        }
+        word |= 1ULL << (pos % 64);
       }
     }
+    num_skipped_runs += i < static_cast<int64_t>(offset);
   }
-  return result;
+  flush_word();
+  CUCKOO_INDEX_COUNT_LOOKUP(RleRunsSkipped, num_skipped_runs);
+  CUCKOO_INDEX_COUNT_LOOKUP(
+      BytesDecoded,
+      ((rle_pos - begin_rle_pos) * run_lengths_.bit_width() + 7) / 8);
+}
+
+void RleBitmapBuilder::AddBitmap(const Bitmap64& bitmap) {
+  size_t pos = 0;
+  for (const size_t index : bitmap.TrueBitIndices()) {
+    AddRun(false, index - pos);
+    AddRun(true, 1);
+    pos = index + 1;
+  }
+  AddRun(false, bitmap.bits() - pos);
+}
+
+void RleBitmapBuilder::AddTrueBitIndices(absl::Span<const uint32_t> indices,
+                                         size_t size) {
+  size_t pos = 0;
+  for (const uint32_t index : indices) {
+    assert(index >= pos);
+    assert(index < size);
+    AddRun(false, index - pos);
+    AddRun(true, 1);
+    pos = index + 1;
+  }
+  AddRun(false, size - pos);
+}
+
+void RleBitmapBuilder::AddRun(bool value, size_t length) {
+  if (length == 0) return;
+  if (!pending_.empty() && pending_.back().value == value) {
+    pending_.back().length += length;
+  } else {
+    pending_.push_back({value, length});
+  }
+  pending_bits_ += length;
+  size_ += length;
+  if (value) ones_count_ += length;
+  // Only encode with enough look-ahead, otherwise the entries could differ
+  // from the ones of EncodeDenseRunLengths(..).
+  while (pending_bits_ > kMaxDenseLookAhead) EncodeDenseStep();
+}
+
+void RleBitmapBuilder::EncodeDenseStep() {
+  assert(!pending_.empty());
+  // Same as one iteration of the outer loop of EncodeDenseRunLengths(..), but
+  // steps over whole runs of equal bits.
+  uint32_t count_rep = 1;
+  uint32_t count_raw = 0;
+  size_t run = 0;
+  size_t pos_in_run = 1;
+  while (pos_in_run < pending_[run].length || run + 1 < pending_.size()) {
+    if (count_rep >= kMaxDenseRunLength + kMinDenseRunLength - 1 ||
+        count_raw >= kMaxDenseRunLength)
+      break;
+    if (pos_in_run < pending_[run].length) {
+      const size_t count = std::min<size_t>(
+          pending_[run].length - pos_in_run,
+          kMaxDenseRunLength + kMinDenseRunLength - 1 - count_rep);
+      count_rep += count;
+      pos_in_run += count;
+    } else {
+      if (count_rep >= kMinDenseRunLength) break;
+      count_raw += count_rep;
+      count_rep = 1;
+      ++run;
+      pos_in_run = 1;
+    }
+  }
+  if (count_rep < kMinDenseRunLength) {
+    count_raw += count_rep;
+    count_rep = 0;
+  }
+  if (count_raw > kMaxDenseRunLength) {
+    count_raw = kMaxDenseRunLength;
+    count_rep = 0;
+  }
+  if (count_raw > 0) {
+    run_lengths_.push_back((count_raw - 1) << 1 | 1);
+    ConsumePending(count_raw, /*copy=*/true);
+  }
+  if (count_rep > 0) {
+    run_lengths_.push_back((count_rep - kMinDenseRunLength) << 1 | 0);
+    AppendBit(pending_.front().value);
+    ConsumePending(count_rep, /*copy=*/false);
+  }
+}
+
+void RleBitmapBuilder::ConsumePending(size_t count, bool copy) {
+  assert(count <= pending_bits_);
+  pending_bits_ -= count;
+  while (count > 0) {
+    Run& run = pending_.front();
+    const size_t num_consumed = std::min(count, run.length);
+    if (copy) {
+      for (size_t i = 0; i < num_consumed; ++i) AppendBit(run.value);
+    }
+    run.length -= num_consumed;
+    count -= num_consumed;
+    if (run.length == 0) pending_.pop_front();
+  }
+}
+
+void RleBitmapBuilder::AppendBit(bool value) {
+  if (num_bits_ % CHAR_BIT == 0) bits_.push_back(0);
+  bits_.back() |= static_cast<uint8_t>(value) << (num_bits_ % CHAR_BIT);
+  ++num_bits_;
+}
+
+RleBitmapPtr RleBitmapBuilder::Build() {
+  while (!pending_.empty()) EncodeDenseStep();
+
+  // Same decision as in RleBitmap(const Bitmap64&).
+  const bool is_sparse =
+      ones_count_ < kSparseFudgeFactor * run_lengths_.size() + num_bits_ / 8;
+  if (is_sparse) {
+    // Decode the dense entries to the offsets from one 1-bit to the next.
+    std::vector<uint8_t> sparse_run_lengths;
+    size_t pos = 0;
+    size_t bit_pos = 0;
+    // The position following the previous 1-bit.
+    size_t next_pos = 0;
+    for (const uint8_t run_length : run_lengths_) {
+      const bool is_raw = run_length & 1;
+      const size_t count =
+          (run_length >> 1) + (is_raw ? 1 : kMinDenseRunLength);
+      const auto get_bit = [&](size_t index) {
+        return (bits_[index / CHAR_BIT] >> (index % CHAR_BIT)) & 1;
+      };
+      // Repeated runs of 0-bits don't add any entries.
+      if (is_raw || get_bit(bit_pos)) {
+        for (size_t i = 0; i < count; ++i) {
+          if (is_raw && !get_bit(bit_pos + i)) continue;
+          AddSparseOffset(pos + i + 1 - next_pos, &sparse_run_lengths);
+          next_pos = pos + i + 1;
+        }
+      }
+      pos += count;
+      bit_pos += is_raw ? count : 1;
+    }
+    // The virtual 1-bit at position `size_`.
+    AddSparseOffset(size_ + 1 - next_pos, &sparse_run_lengths);
+    run_lengths_ = std::move(sparse_run_lengths);
+    bits_.clear();
+    num_bits_ = 0;
+  }
+  const uint32_t skip_offsets_step = std::sqrt(run_lengths_.size());
+  const std::vector<uint32_t> skip_offsets =
+      is_sparse ? ComputeSparseSkipOffsets(run_lengths_, skip_offsets_step)
+                : ComputeDenseSkipOffsets(run_lengths_, skip_offsets_step);
+
+  // Write the same layout as RleBitmap(const Bitmap64&).
+  ByteBuffer result;
+  PutVarint32(is_sparse ? 1 : 0, &result);
+  PutVarint32(size_, &result);
+  PutVarint32(skip_offsets_step, &result);
+  PutVarint32(skip_offsets.size(), &result);
+  PutVarint32(run_lengths_.size(), &result);
+  PutVarint32(num_bits_, &result);
+  const int32_t skip_offsets_bit_width = MaxBitWidth<uint32_t>(skip_offsets);
+  PutVarint32(static_cast<uint32_t>(skip_offsets_bit_width), &result);
+  StoreBitPacked<uint32_t>(skip_offsets, skip_offsets_bit_width, &result);
+  const int32_t run_lengths_bit_width =
+      run_lengths_.empty()
+          ? 0
+          : BitWidth<uint32_t>(
+                *std::max_element(run_lengths_.begin(), run_lengths_.end()));
+  PutVarint32(static_cast<uint32_t>(run_lengths_bit_width), &result);
+  StoreBitPackedBytes(run_lengths_, run_lengths_bit_width, &result);
+  // The bits are already bit-packed.
+  PutBytes(reinterpret_cast<const char*>(bits_.data()), bits_.size(), &result);
+  PutSlopBytes(&result);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  RleBitmapPtr bitmap = absl::WrapUnique(new RleBitmap());
+  bitmap->data_ = std::string(result.data(), result.pos());
+  bitmap->encoded_ = bitmap->data_;
+  bitmap->InitFromEncoded();
+  return bitmap;
 }
 
 }  // namespace ci
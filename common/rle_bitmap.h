@@ -20,39 +20,104 @@
 #define CUCKOO_INDEX_COMMON_RLE_BITMAP_H_
 
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "common/bit_packing.h"
 #include "common/bitmap.h"
 
 namespace ci {
 
 class RleBitmap;
+class RleBitmapBuilder;
 using RleBitmapPtr = std::unique_ptr<RleBitmap>;
 
 class RleBitmap {
  public:
   explicit RleBitmap(const Bitmap64& bitmap);
 
+  // Decodes an RleBitmap from bytes previously returned by data(). Does *not*
+  // copy `data`, i.e., its lifetime must be longer than the lifetime of the
+  // returned bitmap.
+  static RleBitmapPtr Decode(absl::string_view data);
+
   // Forbid copying and moving.
   RleBitmap(const RleBitmap&) = delete;
   RleBitmap& operator=(const RleBitmap&) = delete;
   RleBitmap(RleBitmap&&) = delete;
   RleBitmap& operator=(RleBitmap&&) = delete;
 
-  absl::string_view data() const { return data_; }
+  absl::string_view data() const { return encoded_; }
+
+  // Returns the number of (uncompressed) bits.
+  size_t size() const { return size_; }
 
   // Returns the slice of the bitmap from `offset` on of the given `size`.
   Bitmap64 Extract(size_t offset, size_t size) const;
 
-  bool Get(size_t pos) const { return Extract(pos, 1).Get(0); }
+  // Same as above, but writes the slice to the caller-owned `result` (which is
+  // reset first).
+  void ExtractInto(size_t offset, size_t size, Bitmap64* result) const;
+
+  // Sets `result` to the union (bitwise OR) of the slices of the given `size`
+  // at `offsets`. `offsets` need to be sorted and the slices must not overlap.
+  // Scans the encoding only once and stops early once all bits are set.
+  void ExtractUnionInto(absl::Span<const size_t> offsets, size_t size,
+                        Bitmap64* result) const;
+
+  // Unsets the bits of `candidates` that are unset in the slice of the bitmap
+  // from `offset` on of size `candidates->bits()`. Only scans the part of the
+  // slice between the first and the last set bit of `candidates`, i.e.,
+  // skips runs that can't affect the result.
+  void IntersectInto(size_t offset, Bitmap64* candidates) const;
+
+  // Sets `indices` to the sorted positions (relative to `offset`) of the set
+  // bits in [offset, offset + size).
+  void TrueBitIndicesInRange(size_t offset, size_t size,
+                             std::vector<uint32_t>* indices) const;
+
+  // Returns bit `pos`. Unlike Extract(..), point and range queries don't
+  // materialize a Bitmap64: they use the skip-offsets to jump close to `pos`
+  // and then step over whole runs.
+  bool Get(size_t pos) const;
+
+  // Returns the number of set bits in [offset, offset + size).
+  size_t GetOnesCountInRange(size_t offset, size_t size) const;
+
+  // Returns true if no bit in [offset, offset + size) is set. Stops at the
+  // first set bit.
+  bool IsAllZeroesInRange(size_t offset, size_t size) const;
 
  private:
+  friend class RleBitmapBuilder;
+
+  RleBitmap() = default;
+
+  // Parses the header of `encoded_` and sets up the BitPackedReaders.
+  void InitFromEncoded();
+
   // Extract(..) implementations for the dense and the sparse encoding.
-  Bitmap64 ExtractDense(size_t offset, size_t size) const;
-  Bitmap64 ExtractSparse(size_t offset, size_t size) const;
+  void ExtractDense(size_t offset, size_t size, Bitmap64* result) const;
+  void ExtractSparse(size_t offset, size_t size, Bitmap64* result) const;
+
+  // Calls `fn(range_idx, pos, length, value)` for consecutive segments of equal
+  // bits in the ranges [offsets[range_idx], offsets[range_idx] + size) of the
+  // dense encoding, where `pos` is relative to the range's offset. `offsets`
+  // need to be sorted and the ranges must not overlap; they are visited in a
+  // single forward pass. Stops once `fn` returns false.
+  template <typename Fn>
+  void ScanDense(absl::Span<const size_t> offsets, size_t size,
+                 const Fn& fn) const;
+
+  // Calls `fn(range_idx, pos)` for all set bits in the given ranges of the
+  // sparse encoding. Same requirements as above.
+  template <typename Fn>
+  void ScanSparse(absl::Span<const size_t> offsets, size_t size,
+                  const Fn& fn) const;
 
   bool is_sparse_;
   size_t size_;
@@ -60,13 +125,75 @@ class RleBitmap {
   size_t skip_offsets_size_;
   size_t run_lengths_size_;
   size_t bits_size_;
+  // Owned encoding (empty for decoded bitmaps).
   std::string data_;
+  // Points either to `data_` or to the external bytes passed to Decode(..).
+  absl::string_view encoded_;
 
   BitPackedReader<uint32_t> skip_offsets_;
   BitPackedReader<uint32_t> run_lengths_;
   BitPackedReader<uint32_t> bits_;
 };
 
+// Builds an RleBitmap from consecutive slices (e.g., one per slot) without
+// materializing the uncompressed bitmap: the dense encoding is created on the
+// fly and only converted to the sparse one in Build(..) if that is smaller.
+// Memory is therefore bounded by the size of the encoding and not by the
+// number of bits. The result is identical to RleBitmap(bitmap) for the
+// concatenation of all added slices.
+class RleBitmapBuilder {
+ public:
+  RleBitmapBuilder() : pending_bits_(0), size_(0), ones_count_(0),
+                       num_bits_(0) {}
+
+  // Forbid copying and moving.
+  RleBitmapBuilder(const RleBitmapBuilder&) = delete;
+  RleBitmapBuilder& operator=(const RleBitmapBuilder&) = delete;
+
+  // Appends the bits of `bitmap`.
+  void AddBitmap(const Bitmap64& bitmap);
+
+  // Appends `size` bits of which (only) the sorted positions `indices` are set.
+  void AddTrueBitIndices(absl::Span<const uint32_t> indices, size_t size);
+
+  // Appends `length` copies of `value`.
+  void AddRun(bool value, size_t length);
+
+  // Returns the number of bits added so far.
+  size_t size() const { return size_; }
+
+  // Returns the encoding of all added bits. May only be called once.
+  RleBitmapPtr Build();
+
+ private:
+  struct Run {
+    bool value;
+    size_t length;
+  };
+
+  // Adds the next one or two entries of the dense encoding for the bits at the
+  // front of `pending_`.
+  void EncodeDenseStep();
+
+  // Removes `count` bits from the front of `pending_`. Copies them to `bits_`
+  // if `copy` is set.
+  void ConsumePending(size_t count, bool copy);
+
+  void AppendBit(bool value);
+
+  // Not yet encoded bits as runs of equal values. Kept only until enough
+  // look-ahead for the next dense entry is available.
+  std::deque<Run> pending_;
+  size_t pending_bits_;
+  size_t size_;
+  size_t ones_count_;
+  // The dense encoding so far: all run-lengths fit into a byte, the bits are
+  // packed (LSB first) just as in the final encoding.
+  std::vector<uint8_t> run_lengths_;
+  std::vector<uint8_t> bits_;
+  size_t num_bits_;
+};
+
 }  // namespace ci
 
 #endif  // CUCKOO_INDEX_COMMON_RLE_BITMAP_H_
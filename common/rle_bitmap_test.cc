@@ -18,6 +18,10 @@
 
 #include "common/rle_bitmap.h"
 
+#include <random>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 #include "common/bitmap.h"
 #include "gtest/gtest.h"
 
@@ -30,10 +34,70 @@ void CheckBitmap(const Bitmap64& bitmap) {
   for (size_t offset = 0; offset < bitmap.bits(); ++offset) {
     for (size_t size = 0; size < bitmap.bits() - offset; size = size * 2 + 1) {
       const Bitmap64 extracted = rle_bitmap.Extract(offset, size);
-      for (size_t i = 0; i < size; ++i)
+      size_t ones_count = 0;
+      for (size_t i = 0; i < size; ++i) {
         ASSERT_EQ(extracted.Get(i), bitmap.Get(i + offset));
+        ones_count += bitmap.Get(i + offset);
+      }
+      ASSERT_EQ(rle_bitmap.GetOnesCountInRange(offset, size), ones_count);
+      ASSERT_EQ(rle_bitmap.IsAllZeroesInRange(offset, size), ones_count == 0);
+    }
+  }
+
+  // Check unions of non-overlapping slices, visited in a single pass.
+  for (size_t size = 1; size <= bitmap.bits(); size = size * 3 + 1) {
+    for (size_t stride = size; stride <= bitmap.bits(); stride = stride * 2 + 1) {
+      std::vector<size_t> offsets;
+      Bitmap64 expected(size);
+      for (size_t offset = stride / 2; offset + size <= bitmap.bits();
+           offset += stride) {
+        offsets.push_back(offset);
+        for (size_t i = 0; i < size; ++i) {
+          if (bitmap.Get(offset + i)) expected.Set(i, true);
+        }
+      }
+      Bitmap64 result;
+      rle_bitmap.ExtractUnionInto(offsets, size, &result);
+      ASSERT_EQ(result.ToString(), expected.ToString());
+    }
+  }
+
+  // Check intersections of slices with candidates (every `stride`-th bit in
+  // the middle of the slice, or none).
+  for (size_t size = 1; size <= bitmap.bits(); size = size * 3 + 1) {
+    for (size_t offset = 0; offset + size <= bitmap.bits();
+         offset += size / 2 + 1) {
+      for (size_t stride = 1; stride <= size + 1; stride = stride * 2 + 1) {
+        Bitmap64 candidates(size);
+        Bitmap64 expected(size);
+        for (size_t i = size / 4; i < size - size / 4; i += stride) {
+          candidates.Set(i, true);
+          expected.Set(i, bitmap.Get(offset + i));
+        }
+        if (stride > size) {
+          candidates.Reset(size);
+          expected.Reset(size);
+        }
+        rle_bitmap.IntersectInto(offset, &candidates);
+        ASSERT_EQ(candidates.ToString(), expected.ToString());
+      }
     }
   }
+
+  // Check point queries.
+  for (size_t i = 0; i < bitmap.bits(); ++i)
+    ASSERT_EQ(rle_bitmap.Get(i), bitmap.Get(i));
+
+  // Check that a decoded copy (referencing the original encoding) agrees.
+  const RleBitmapPtr decoded = RleBitmap::Decode(rle_bitmap.data());
+  ASSERT_EQ(decoded->size(), bitmap.bits());
+  const Bitmap64 extracted = decoded->Extract(0, bitmap.bits());
+  for (size_t i = 0; i < bitmap.bits(); ++i) {
+    ASSERT_EQ(extracted.Get(i), bitmap.Get(i));
+    ASSERT_EQ(decoded->Get(i), bitmap.Get(i));
+  }
+  ASSERT_EQ(decoded->GetOnesCountInRange(0, bitmap.bits()),
+            bitmap.GetOnesCount());
 }
 
 TEST(RleBitmapTest, EmptyBitmap) { CheckBitmap(Bitmap64()); }
@@ -78,4 +142,72 @@ TEST(RleBitmapTest, InterleavedBitmap) {
   CheckBitmap(bitmap);
 }
 
+TEST(RleBitmapTest, RandomAndRepeatedRuns) {
+  // Alternates random stretches (encoded as raw runs of up to 128 bits) with
+  // runs of ones and zeroes spanning several words.
+  std::mt19937 gen(42);
+  Bitmap64 bitmap(3000);
+  size_t i = 0;
+  for (size_t length = 1; i < bitmap.bits(); length = length * 3 % 257 + 1) {
+    const size_t end = std::min(i + length, bitmap.bits());
+    const int kind = length % 3;
+    for (; i < end; ++i) bitmap.Set(i, kind == 0 ? gen() % 2 == 0 : kind == 1);
+  }
+  CheckBitmap(bitmap);
+}
+
+// Checks that RleBitmapBuilder creates the same encoding as RleBitmap(..) when
+// adding `bitmap` in slices of (at most) `slice_size` bits.
+void CheckBuilder(const Bitmap64& bitmap, size_t slice_size) {
+  RleBitmapBuilder builder;
+  for (size_t offset = 0; offset < bitmap.bits(); offset += slice_size) {
+    Bitmap64 slice(std::min(slice_size, bitmap.bits() - offset));
+    for (size_t i = 0; i < slice.bits(); ++i)
+      slice.Set(i, bitmap.Get(offset + i));
+    builder.AddBitmap(slice);
+  }
+  ASSERT_EQ(builder.size(), bitmap.bits());
+  const RleBitmapPtr built = builder.Build();
+  const RleBitmap rle_bitmap(bitmap);
+  ASSERT_EQ(built->data(), rle_bitmap.data());
+  ASSERT_EQ(built->Extract(0, bitmap.bits()).ToString(), bitmap.ToString());
+}
+
+TEST(RleBitmapBuilderTest, SameEncodingAsRleBitmap) {
+  CheckBuilder(Bitmap64(), /*slice_size=*/1);
+  CheckBuilder(Bitmap64(2000, false), /*slice_size=*/7);
+  CheckBuilder(Bitmap64(2000, true), /*slice_size=*/7);
+
+  std::mt19937 gen(42);
+  // Vary the density and the lengths of runs of equal bits to hit both the
+  // sparse and the dense encoding.
+  for (const double density : {0.001, 0.05, 0.5, 0.95}) {
+    for (const size_t max_run_length : {1, 20, 200}) {
+      std::uniform_int_distribution<size_t> run_length(1, max_run_length);
+      std::bernoulli_distribution bit(density);
+      Bitmap64 bitmap(20000);
+      for (size_t i = 0; i < bitmap.bits();) {
+        const bool value = bit(gen);
+        for (size_t end = std::min(bitmap.bits(), i + run_length(gen)); i < end;
+             ++i)
+          bitmap.Set(i, value);
+      }
+      for (const size_t slice_size : {1, 64, 1000, 20000}) {
+        SCOPED_TRACE(absl::StrCat("density: ", density, ", max_run_length: ",
+                                  max_run_length, ", slice_size: ", slice_size));
+        CheckBuilder(bitmap, slice_size);
+      }
+    }
+  }
+}
+
+TEST(RleBitmapBuilderTest, AddTrueBitIndices) {
+  Bitmap64 bitmap(1000);
+  RleBitmapBuilder builder;
+  const std::vector<uint32_t> indices = {3, 4, 5, 400, 999};
+  for (const uint32_t index : indices) bitmap.Set(index, true);
+  builder.AddTrueBitIndices(indices, bitmap.bits());
+  EXPECT_EQ(builder.Build()->data(), RleBitmap(bitmap).data());
+}
+
 }  // namespace ci
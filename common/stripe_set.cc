@@ -0,0 +1,131 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: stripe_set.cc
+// -----------------------------------------------------------------------------
+
+#include "common/stripe_set.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "absl/memory/memory.h"
+
+namespace ci {
+namespace {
+
+// Initial capacity (in ids) of the array representation.
+constexpr uint32_t kMinArrayCapacity = 4;
+
+}  // namespace
+
+uint64_t* StripeSetArena::Allocate(size_t num_words) {
+  if (num_words > kBlockSize / 4) {
+    large_blocks_.push_back(absl::make_unique<uint64_t[]>(num_words));
+    byte_size_ += num_words * sizeof(uint64_t);
+    return large_blocks_.back().get();
+  }
+  if (pos_ + num_words > kBlockSize) {
+    blocks_.push_back(absl::make_unique<uint64_t[]>(kBlockSize));
+    byte_size_ += kBlockSize * sizeof(uint64_t);
+    pos_ = 0;
+  }
+  uint64_t* result = blocks_.back().get() + pos_;
+  pos_ += num_words;
+  return result;
+}
+
+void StripeSet::Add(uint32_t stripe_id, StripeSetArena* arena) {
+  if (is_dense()) {
+    assert(stripe_id < num_words() * 64);
+    const uint64_t mask = 1ULL << (stripe_id % 64);
+    if ((words_[stripe_id / 64] & mask) == 0) {
+      words_[stripe_id / 64] |= mask;
+      ++size_;
+    }
+    return;
+  }
+  if (size_ == 0) {
+    single_ = stripe_id;
+    size_ = 1;
+    return;
+  }
+  const uint32_t last = capacity_ == 0 ? single_ : ids_[size_ - 1];
+  if (stripe_id == last) return;
+  assert(stripe_id > last);
+  if (size_ == capacity_ || capacity_ == 0) {
+    assert(capacity_ < kDenseFlag / 2);
+    const uint32_t new_capacity = std::max(kMinArrayCapacity, 2 * capacity_);
+    // Switch to a bitmap once the array would use more memory.
+    if (arena->num_words() > 0 &&
+        (new_capacity + 1) / 2 >= arena->num_words()) {
+      ConvertToDense(arena);
+      Add(stripe_id, arena);
+      return;
+    }
+    uint32_t* ids = reinterpret_cast<uint32_t*>(
+        arena->Allocate((new_capacity + 1) / 2));
+    if (capacity_ == 0) {
+      ids[0] = single_;
+    } else {
+      std::copy(ids_, ids_ + size_, ids);
+    }
+    ids_ = ids;
+    capacity_ = new_capacity;
+  }
+  ids_[size_++] = stripe_id;
+}
+
+void StripeSet::Union(const StripeSet& other, StripeSetArena* arena) {
+  if (other.empty()) return;
+  if (other.is_dense() && !is_dense()) ConvertToDense(arena);
+  if (is_dense()) {
+    if (other.is_dense()) {
+      assert(other.num_words() == num_words());
+      size_ = 0;
+      for (size_t i = 0; i < num_words(); ++i) {
+        words_[i] |= other.words_[i];
+        size_ += __builtin_popcountll(words_[i]);
+      }
+    } else {
+      other.ForEach([&](uint32_t id) { Add(id, arena); });
+    }
+    return;
+  }
+  // Merge the two sorted lists and add them again (the old array stays in the
+  // arena). Only happens for values spread over stripes added separately.
+  std::vector<uint32_t> lhs;
+  std::vector<uint32_t> rhs;
+  FillStripeIds(&lhs);
+  other.FillStripeIds(&rhs);
+  std::vector<uint32_t> merged;
+  merged.reserve(lhs.size() + rhs.size());
+  std::set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                 std::back_inserter(merged));
+  *this = StripeSet();
+  for (const uint32_t id : merged) Add(id, arena);
+}
+
+void StripeSet::ConvertToDense(StripeSetArena* arena) {
+  assert(!is_dense());
+  assert(arena->num_words() > 0);
+  assert(arena->num_words() < kDenseFlag);
+  uint64_t* words = arena->Allocate(arena->num_words());
+  ForEach([words](uint32_t id) { words[id / 64] |= 1ULL << (id % 64); });
+  words_ = words;
+  capacity_ = static_cast<uint32_t>(arena->num_words()) | kDenseFlag;
+}
+
+}  // namespace ci
@@ -0,0 +1,155 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: stripe_set.h
+// -----------------------------------------------------------------------------
+//
+// Compact sets of stripe ids, used instead of one Bitmap64 per distinct value
+// while building an index. Most values of high-cardinality columns occur in a
+// single stripe, so sets start with an inline stripe id, then become a sorted
+// array and only switch to a bitmap once that is smaller. Arrays and bitmaps
+// are allocated from a StripeSetArena.
+
+#ifndef CUCKOO_INDEX_COMMON_STRIPE_SET_H_
+#define CUCKOO_INDEX_COMMON_STRIPE_SET_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common/bitmap.h"
+
+namespace ci {
+
+// Bump allocator for the arrays and bitmaps of the StripeSets of one universe
+// of `num_stripes` stripes. Memory is only released with the arena, i.e., the
+// arrays outgrown by a set are not re-used.
+class StripeSetArena {
+ public:
+  // Use for sets whose number of stripes isn't known upfront. Those sets never
+  // switch to the bitmap representation.
+  static constexpr size_t kUnknownNumStripes = 0;
+
+  explicit StripeSetArena(size_t num_stripes)
+      : num_stripes_(num_stripes),
+        num_words_((num_stripes + 63) / 64),
+        pos_(kBlockSize) {}
+
+  // Movable, but not copyable. Allocated memory stays valid when moving.
+  StripeSetArena(const StripeSetArena&) = delete;
+  StripeSetArena& operator=(const StripeSetArena&) = delete;
+  StripeSetArena(StripeSetArena&&) = default;
+  StripeSetArena& operator=(StripeSetArena&&) = default;
+
+  size_t num_stripes() const { return num_stripes_; }
+
+  // Returns the number of words of a bitmap over all stripes, or 0 for
+  // kUnknownNumStripes.
+  size_t num_words() const { return num_words_; }
+
+  // Returns `num_words` zero-initialized words, valid for the lifetime of the
+  // arena.
+  uint64_t* Allocate(size_t num_words);
+
+  // Returns the number of bytes allocated from the system.
+  size_t byte_size() const { return byte_size_; }
+
+ private:
+  // Words per block. Larger requests get a block of their own.
+  static constexpr size_t kBlockSize = 1 << 16;
+
+  size_t num_stripes_;
+  size_t num_words_;
+  // Position in the last entry of `blocks_`.
+  size_t pos_;
+  size_t byte_size_ = 0;
+  std::vector<std::unique_ptr<uint64_t[]>> blocks_;
+  std::vector<std::unique_ptr<uint64_t[]>> large_blocks_;
+};
+
+// A set of stripe ids. Trivially copyable: copies share the array or bitmap
+// allocated from the arena, so only one of them may be modified (afterwards).
+class StripeSet {
+ public:
+  StripeSet() : size_(0), capacity_(0), single_(0) {}
+
+  // Returns the number of stripes in the set.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Adds `stripe_id`, which must not be smaller than any id added before
+  // (i.e., stripes are added in order; re-adding the last one is a no-op).
+  // The arenas passed to a set must all have the same number of stripes and
+  // outlive the set.
+  void Add(uint32_t stripe_id, StripeSetArena* arena);
+
+  // Adds all stripes of `other` (in any order w.r.t. the stripes of this set).
+  void Union(const StripeSet& other, StripeSetArena* arena);
+
+  // Calls `fn(stripe_id)` for all stripes in ascending order.
+  template <typename Fn>
+  void ForEach(const Fn& fn) const {
+    if (is_dense()) {
+      for (size_t i = 0; i < num_words(); ++i) {
+        for (uint64_t word = words_[i]; word != 0; word &= word - 1)
+          fn(static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)));
+      }
+    } else if (capacity_ == 0) {
+      if (size_ == 1) fn(single_);
+    } else {
+      for (size_t i = 0; i < size_; ++i) fn(ids_[i]);
+    }
+  }
+
+  // Sets `stripe_ids` to the sorted stripes of the set.
+  void FillStripeIds(std::vector<uint32_t>* stripe_ids) const {
+    stripe_ids->clear();
+    ForEach([stripe_ids](uint32_t id) { stripe_ids->push_back(id); });
+  }
+
+  // Returns the set as a bitmap of `num_stripes` bits.
+  Bitmap64 ToBitmap(size_t num_stripes) const {
+    Bitmap64 bitmap(num_stripes);
+    ForEach([&bitmap](uint32_t id) { bitmap.Set(id, true); });
+    return bitmap;
+  }
+
+ private:
+  // Set in `capacity_` for the bitmap representation. The remaining bits then
+  // hold the number of words of the bitmap.
+  static constexpr uint32_t kDenseFlag = 1U << 31;
+
+  bool is_dense() const { return capacity_ & kDenseFlag; }
+  size_t num_words() const { return capacity_ & ~kDenseFlag; }
+
+  // Switches to a bitmap (over `arena->num_stripes()` stripes).
+  void ConvertToDense(StripeSetArena* arena);
+
+  uint32_t size_;
+  // 0 for the inline representation (size_ <= 1), else the number of ids
+  // fitting in `ids_` or the number of words of `words_` | kDenseFlag.
+  uint32_t capacity_;
+  union {
+    uint32_t single_;
+    uint32_t* ids_;
+    uint64_t* words_;
+  };
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMMON_STRIPE_SET_H_
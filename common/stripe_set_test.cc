@@ -0,0 +1,125 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: stripe_set_test.cc
+// -----------------------------------------------------------------------------
+
+#include "common/stripe_set.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "common/bitmap.h"
+#include "gtest/gtest.h"
+
+namespace ci {
+
+// Returns the sorted ids of stripes added with probability `density`.
+std::vector<uint32_t> RandomStripeIds(size_t num_stripes, double density,
+                                      std::mt19937* gen) {
+  std::bernoulli_distribution add(density);
+  std::vector<uint32_t> stripe_ids;
+  for (uint32_t id = 0; id < num_stripes; ++id)
+    if (add(*gen)) stripe_ids.push_back(id);
+  return stripe_ids;
+}
+
+void CheckStripeSet(const StripeSet& set, size_t num_stripes,
+                    const std::vector<uint32_t>& expected) {
+  ASSERT_EQ(set.size(), expected.size());
+  std::vector<uint32_t> stripe_ids;
+  set.FillStripeIds(&stripe_ids);
+  ASSERT_EQ(stripe_ids, expected);
+  const Bitmap64 bitmap = set.ToBitmap(num_stripes);
+  ASSERT_EQ(bitmap.GetOnesCount(), expected.size());
+  for (const uint32_t id : expected) ASSERT_TRUE(bitmap.Get(id));
+}
+
+TEST(StripeSetTest, EmptyAndSingleStripe) {
+  StripeSetArena arena(/*num_stripes=*/100);
+  StripeSet set;
+  CheckStripeSet(set, 100, {});
+  set.Add(42, &arena);
+  set.Add(42, &arena);
+  CheckStripeSet(set, 100, {42});
+  // A single stripe is stored inline.
+  EXPECT_EQ(arena.byte_size(), 0);
+}
+
+TEST(StripeSetTest, AddInOrder) {
+  std::mt19937 gen(42);
+  for (const size_t num_stripes : {1, 10, 64, 1000, 5000}) {
+    for (const double density : {0.001, 0.01, 0.1, 0.5, 1.0}) {
+      SCOPED_TRACE(testing::Message() << "num_stripes: " << num_stripes
+                                      << ", density: " << density);
+      const std::vector<uint32_t> expected =
+          RandomStripeIds(num_stripes, density, &gen);
+      StripeSetArena arena(num_stripes);
+      StripeSetArena unknown_arena(StripeSetArena::kUnknownNumStripes);
+      StripeSet set;
+      StripeSet unknown_set;
+      for (const uint32_t id : expected) {
+        set.Add(id, &arena);
+        unknown_set.Add(id, &unknown_arena);
+      }
+      CheckStripeSet(set, num_stripes, expected);
+      CheckStripeSet(unknown_set, num_stripes, expected);
+    }
+  }
+}
+
+TEST(StripeSetTest, Union) {
+  std::mt19937 gen(42);
+  for (const size_t num_stripes : {10, 1000}) {
+    for (const double lhs_density : {0.0, 0.005, 0.5}) {
+      for (const double rhs_density : {0.0, 0.005, 0.5}) {
+        SCOPED_TRACE(testing::Message()
+                     << "num_stripes: " << num_stripes << ", densities: "
+                     << lhs_density << ", " << rhs_density);
+        const std::vector<uint32_t> lhs_ids =
+            RandomStripeIds(num_stripes, lhs_density, &gen);
+        const std::vector<uint32_t> rhs_ids =
+            RandomStripeIds(num_stripes, rhs_density, &gen);
+        StripeSetArena arena(num_stripes);
+        StripeSet lhs;
+        StripeSet rhs;
+        for (const uint32_t id : lhs_ids) lhs.Add(id, &arena);
+        for (const uint32_t id : rhs_ids) rhs.Add(id, &arena);
+        lhs.Union(rhs, &arena);
+        std::vector<uint32_t> expected;
+        std::set_union(lhs_ids.begin(), lhs_ids.end(), rhs_ids.begin(),
+                       rhs_ids.end(), std::back_inserter(expected));
+        CheckStripeSet(lhs, num_stripes, expected);
+        CheckStripeSet(rhs, num_stripes, rhs_ids);
+      }
+    }
+  }
+}
+
+TEST(StripeSetTest, AllStripes) {
+  constexpr size_t kNumStripes = 64 * 1024;
+  StripeSetArena arena(kNumStripes);
+  StripeSet set;
+  for (uint32_t id = 0; id < kNumStripes; ++id) set.Add(id, &arena);
+  CheckStripeSet(set, kNumStripes, [] {
+    std::vector<uint32_t> ids(kNumStripes);
+    for (uint32_t id = 0; id < kNumStripes; ++id) ids[id] = id;
+    return ids;
+  }());
+}
+
+}  // namespace ci
@@ -0,0 +1,173 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: composite_index.cc
+// -----------------------------------------------------------------------------
+
+#include "composite_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+
+namespace ci {
+
+CompositeIndex::CompositeIndex(std::vector<IndexStructurePtr> children)
+    : children_(std::move(children)),
+      counters_(absl::make_unique<ChildCounters[]>(children_.size())) {
+  if (children_.empty()) {
+    std::cerr << "A composite index needs at least one child." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+bool CompositeIndex::StripeContains(size_t stripe_id, long value) const {
+  for (size_t child = 0; child < children_.size(); ++child) {
+    const bool contains = children_[child]->StripeContains(stripe_id, value);
+    CountProbe(child, /*num_candidates=*/1, /*num_remaining=*/contains);
+    if (!contains) return false;
+  }
+  return true;
+}
+
+void CompositeIndex::FillQualifyingStripes(long value, size_t num_stripes,
+                                           Bitmap64* result) const {
+  // The first child probes all stripes.
+  children_[0]->FillQualifyingStripes(value, num_stripes, result);
+  CountProbe(/*child=*/0, num_stripes, result->GetOnesCount());
+  Filter(value, /*first_child=*/1, result);
+}
+
+void CompositeIndex::FillQualifyingStripeIds(
+    long value, size_t num_stripes, std::vector<uint32_t>* stripe_ids) const {
+  Bitmap64 result;
+  FillQualifyingStripes(value, num_stripes, &result);
+  stripe_ids->clear();
+  for (const size_t stripe_id : result.TrueBitIndices())
+    stripe_ids->push_back(stripe_id);
+}
+
+void CompositeIndex::Filter(long value, size_t first_child,
+                            Bitmap64* candidates) const {
+  size_t num_candidates = candidates->GetOnesCount();
+  for (size_t child = first_child;
+       child < children_.size() && num_candidates > 0; ++child) {
+    children_[child]->FilterQualifyingStripes(value, candidates);
+    const size_t num_remaining = candidates->GetOnesCount();
+    CountProbe(child, num_candidates, num_remaining);
+    num_candidates = num_remaining;
+  }
+}
+
+double CompositeIndex::EstimateSelectivity(long value) const {
+  double selectivity = 1.0;
+  for (const IndexStructurePtr& child : children_)
+    selectivity = std::min(selectivity, child->EstimateSelectivity(value));
+  return selectivity;
+}
+
+std::string CompositeIndex::name() const {
+  return absl::StrCat(
+      "Composite/",
+      absl::StrJoin(children_, "+",
+                    [](std::string* out, const IndexStructurePtr& child) {
+                      absl::StrAppend(out, child->name());
+                    }));
+}
+
+size_t CompositeIndex::byte_size() const {
+  size_t byte_size = 0;
+  for (const IndexStructurePtr& child : children_)
+    byte_size += child->byte_size();
+  return byte_size;
+}
+
+size_t CompositeIndex::compressed_byte_size() const {
+  size_t compressed_byte_size = 0;
+  for (const IndexStructurePtr& child : children_)
+    compressed_byte_size += child->compressed_byte_size();
+  return compressed_byte_size;
+}
+
+std::vector<ci::PruningStats> CompositeIndex::pruning_stats() const {
+  std::vector<ci::PruningStats> stats(children_.size());
+  for (size_t child = 0; child < children_.size(); ++child) {
+    const int64_t num_candidate_stripes =
+        counters_[child].num_candidate_stripes.load(std::memory_order_relaxed);
+    const int64_t num_pruned_stripes =
+        counters_[child].num_pruned_stripes.load(std::memory_order_relaxed);
+    stats[child].set_index_structure(children_[child]->name());
+    stats[child].set_num_candidate_stripes(num_candidate_stripes);
+    stats[child].set_num_pruned_stripes(num_pruned_stripes);
+    stats[child].set_pruning_rate(
+        num_candidate_stripes == 0
+            ? 0.0
+            : static_cast<double>(num_pruned_stripes) / num_candidate_stripes);
+  }
+  return stats;
+}
+
+void CompositeIndex::ResetPruningStats() const {
+  for (size_t child = 0; child < children_.size(); ++child) {
+    counters_[child].num_candidate_stripes.store(0, std::memory_order_relaxed);
+    counters_[child].num_pruned_stripes.store(0, std::memory_order_relaxed);
+  }
+}
+
+IndexStructurePtr CompositeIndexBuilder::Finish() {
+  std::vector<IndexStructurePtr> children;
+  children.reserve(builders_.size());
+  for (const IndexStructureBuilderPtr& builder : builders_)
+    children.push_back(builder->Finish());
+  return absl::make_unique<CompositeIndex>(std::move(children));
+}
+
+CompositeIndexFactory::CompositeIndexFactory(
+    std::vector<std::unique_ptr<IndexStructureFactory>> factories)
+    : factories_(std::move(factories)) {}
+
+IndexStructurePtr CompositeIndexFactory::Create(
+    const Column& column, size_t num_rows_per_stripe) const {
+  std::vector<IndexStructurePtr> children;
+  children.reserve(factories_.size());
+  for (const std::unique_ptr<IndexStructureFactory>& factory : factories_)
+    children.push_back(factory->Create(column, num_rows_per_stripe));
+  return absl::make_unique<CompositeIndex>(std::move(children));
+}
+
+IndexStructureBuilderPtr CompositeIndexFactory::CreateBuilder() const {
+  std::vector<IndexStructureBuilderPtr> builders;
+  builders.reserve(factories_.size());
+  for (const std::unique_ptr<IndexStructureFactory>& factory : factories_)
+    builders.push_back(factory->CreateBuilder());
+  return absl::make_unique<CompositeIndexBuilder>(std::move(builders));
+}
+
+std::string CompositeIndexFactory::index_name() const {
+  return absl::StrCat(
+      "Composite/",
+      absl::StrJoin(factories_, "+",
+                    [](std::string* out,
+                       const std::unique_ptr<IndexStructureFactory>& factory) {
+                      absl::StrAppend(out, factory->index_name());
+                    }));
+}
+
+}  // namespace ci
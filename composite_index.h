@@ -0,0 +1,140 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: composite_index.h
+// -----------------------------------------------------------------------------
+
+#ifndef CUCKOO_INDEX_COMPOSITE_INDEX_H_
+#define CUCKOO_INDEX_COMPOSITE_INDEX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "data.h"
+#include "evaluation.pb.h"
+#include "index_structure.h"
+
+namespace ci {
+
+// Chains index structures: a stripe qualifies if it qualifies for all of them.
+// The children are probed in the given order, each one only for the stripes
+// that qualified for the preceding ones (see
+// IndexStructure::FilterQualifyingStripes(..)), and the remaining children are
+// skipped once no stripe qualifies. Cheap pre-filters (e.g., a `ZoneMap`)
+// should therefore come first.
+//
+// Counts how many candidate stripes each child pruned (see pruning_stats()).
+// The counters are atomic, i.e., the index can be shared by concurrent
+// lookups.
+class CompositeIndex : public IndexStructure {
+ public:
+  explicit CompositeIndex(std::vector<IndexStructurePtr> children);
+
+  bool StripeContains(size_t stripe_id, long value) const override;
+
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override;
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override;
+
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override {
+    Filter(value, /*first_child=*/0, candidates);
+  }
+
+  // A stripe only qualifies if it qualifies for all children, i.e., returns
+  // the smallest estimate of the children.
+  double EstimateSelectivity(long value) const override;
+
+  // Returns "Composite/" followed by the names of the children, joined by "+".
+  std::string name() const override;
+
+  size_t byte_size() const override;
+
+  size_t compressed_byte_size() const override;
+
+  std::vector<ci::PruningStats> pruning_stats() const override;
+
+  void ResetPruningStats() const override;
+
+  const std::vector<IndexStructurePtr>& children() const { return children_; }
+
+ private:
+  struct ChildCounters {
+    std::atomic<int64_t> num_candidate_stripes{0};
+    std::atomic<int64_t> num_pruned_stripes{0};
+  };
+
+  // Calls FilterQualifyingStripes(..) of the children starting at
+  // `first_child` until no candidate is left.
+  void Filter(long value, size_t first_child, Bitmap64* candidates) const;
+
+  void CountProbe(size_t child, size_t num_candidates,
+                  size_t num_remaining) const {
+    counters_[child].num_candidate_stripes.fetch_add(
+        num_candidates, std::memory_order_relaxed);
+    counters_[child].num_pruned_stripes.fetch_add(
+        num_candidates - num_remaining, std::memory_order_relaxed);
+  }
+
+  const std::vector<IndexStructurePtr> children_;
+  // One entry per child.
+  const std::unique_ptr<ChildCounters[]> counters_;
+};
+
+// Builds a `CompositeIndex` by passing the stripes to the builders of all
+// children.
+class CompositeIndexBuilder : public IndexStructureBuilder {
+ public:
+  explicit CompositeIndexBuilder(std::vector<IndexStructureBuilderPtr> builders)
+      : builders_(std::move(builders)) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    for (const IndexStructureBuilderPtr& builder : builders_)
+      builder->AddStripe(stripe);
+  }
+
+  IndexStructurePtr Finish() override;
+
+ private:
+  std::vector<IndexStructureBuilderPtr> builders_;
+};
+
+class CompositeIndexFactory : public IndexStructureFactory {
+ public:
+  // The children are created (and probed) in the order of `factories`.
+  explicit CompositeIndexFactory(
+      std::vector<std::unique_ptr<IndexStructureFactory>> factories);
+
+  IndexStructurePtr Create(const Column& column,
+                           size_t num_rows_per_stripe) const override;
+
+  IndexStructureBuilderPtr CreateBuilder() const override;
+
+  std::string index_name() const override;
+
+ private:
+  const std::vector<std::unique_ptr<IndexStructureFactory>> factories_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMPOSITE_INDEX_H_
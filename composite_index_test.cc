@@ -0,0 +1,218 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: composite_index_test.cc
+// -----------------------------------------------------------------------------
+
+#include "composite_index.h"
+
+#include <random>
+
+#include "absl/memory/memory.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+#include "partitioned_cuckoo_index.h"
+#include "per_stripe_blocked_bloom.h"
+#include "zone_map.h"
+
+namespace ci {
+
+constexpr size_t kNumStripes = 200;
+constexpr size_t kNumRowsPerStripe = 10;
+
+// Sorted column, i.e., stripe `i` contains the values [5 * i + 1, 5 * i + 6)
+// (0 is the NULL sentinel).
+ColumnPtr CreateColumn() {
+  std::vector<long> data(kNumStripes * kNumRowsPerStripe);
+  for (size_t row = 0; row < data.size(); ++row)
+    data[row] = row / kNumRowsPerStripe * 5 + row % 5 + 1;
+  return Column::IntColumn("column", std::move(data));
+}
+
+std::unique_ptr<CompositeIndexFactory> CreateFactory() {
+  std::vector<std::unique_ptr<IndexStructureFactory>> factories;
+  factories.push_back(absl::make_unique<ZoneMapFactory>());
+  factories.push_back(
+      absl::make_unique<PerStripeBlockedBloomFactory>(/*num_bits_per_key=*/10));
+  factories.push_back(absl::make_unique<CuckooIndexFactory>(
+      CuckooAlgorithm::SKEWED_KICKING, kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.02, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false));
+  return absl::make_unique<CompositeIndexFactory>(std::move(factories));
+}
+
+// Returns the AND of the results of all children.
+Bitmap64 GetExpectedStripes(const CompositeIndex& index, long value) {
+  Bitmap64 expected(/*size=*/kNumStripes, /*fill_value=*/true);
+  for (const IndexStructurePtr& child : index.children())
+    expected &= child->GetQualifyingStripes(value, kNumStripes);
+  return expected;
+}
+
+TEST(CompositeIndexTest, ReturnsIntersectionOfChildren) {
+  const ColumnPtr column = CreateColumn();
+  const std::unique_ptr<CompositeIndexFactory> factory = CreateFactory();
+  const IndexStructurePtr index_ptr =
+      factory->Create(*column, kNumRowsPerStripe);
+  const auto& index = static_cast<const CompositeIndex&>(*index_ptr);
+  EXPECT_EQ(index.name(), factory->index_name());
+
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (long value = -10; value < 5 * static_cast<long>(kNumStripes) + 10;
+       ++value) {
+    const Bitmap64 expected = GetExpectedStripes(index, value);
+    index.FillQualifyingStripes(value, kNumStripes, &result);
+    ASSERT_EQ(result.ToString(), expected.ToString());
+    index.FillQualifyingStripeIds(value, kNumStripes, &stripe_ids);
+    ASSERT_EQ(stripe_ids.size(), expected.GetOnesCount());
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+      ASSERT_EQ(index.StripeContains(stripe_id, value),
+                expected.Get(stripe_id));
+    }
+    // No false negatives.
+    if (value > 0 && value <= 5 * static_cast<long>(kNumStripes)) {
+      ASSERT_TRUE(result.Get((value - 1) / 5));
+    }
+  }
+}
+
+TEST(CompositeIndexTest, ChildrenOnlyKeepQualifyingCandidates) {
+  const ColumnPtr column = CreateColumn();
+  const IndexStructurePtr index_ptr =
+      CreateFactory()->Create(*column, kNumRowsPerStripe);
+  const auto& index = static_cast<const CompositeIndex&>(*index_ptr);
+
+  std::mt19937 gen(42);
+  std::bernoulli_distribution coin(0.5);
+  for (long value = 1; value <= 5 * static_cast<long>(kNumStripes);
+       value += 7) {
+    Bitmap64 candidates(/*size=*/kNumStripes);
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id)
+      candidates.Set(stripe_id, coin(gen));
+    // Override of every child as well as the chain itself.
+    std::vector<const IndexStructure*> filters = {&index};
+    for (const IndexStructurePtr& child : index.children())
+      filters.push_back(child.get());
+    for (const IndexStructure* filter : filters) {
+      Bitmap64 expected = candidates;
+      expected &= filter->GetQualifyingStripes(value, kNumStripes);
+      Bitmap64 filtered = candidates;
+      filter->FilterQualifyingStripes(value, &filtered);
+      ASSERT_EQ(filtered.ToString(), expected.ToString()) << filter->name();
+    }
+  }
+}
+
+TEST(CompositeIndexTest, CountsPrunedStripes) {
+  const ColumnPtr column = CreateColumn();
+  const IndexStructurePtr index =
+      CreateFactory()->Create(*column, kNumRowsPerStripe);
+  index->ResetPruningStats();
+
+  Bitmap64 result;
+  // Only stripe 2 qualifies for the zone map, and it contains the value.
+  index->FillQualifyingStripes(/*value=*/12, kNumStripes, &result);
+  std::vector<PruningStats> stats = index->pruning_stats();
+  ASSERT_EQ(stats.size(), 3);
+  EXPECT_EQ(stats[0].index_structure(), "ZoneMap");
+  EXPECT_EQ(stats[0].num_candidate_stripes(), kNumStripes);
+  EXPECT_EQ(stats[0].num_pruned_stripes(), kNumStripes - 1);
+  EXPECT_DOUBLE_EQ(stats[0].pruning_rate(),
+                   static_cast<double>(kNumStripes - 1) / kNumStripes);
+  for (size_t child = 1; child < stats.size(); ++child) {
+    EXPECT_EQ(stats[child].num_candidate_stripes(), 1);
+    EXPECT_EQ(stats[child].num_pruned_stripes(), 0);
+  }
+
+  // No stripe qualifies for the zone map, so the other children are skipped.
+  index->ResetPruningStats();
+  index->FillQualifyingStripes(/*value=*/-1, kNumStripes, &result);
+  stats = index->pruning_stats();
+  EXPECT_EQ(stats[0].num_pruned_stripes(), kNumStripes);
+  for (size_t child = 1; child < stats.size(); ++child) {
+    EXPECT_EQ(stats[child].num_candidate_stripes(), 0);
+    EXPECT_EQ(stats[child].pruning_rate(), 0.0);
+  }
+
+  // Stripe-wise probes are counted as well.
+  index->ResetPruningStats();
+  EXPECT_FALSE(index->StripeContains(/*stripe_id=*/0, /*value=*/12));
+  EXPECT_TRUE(index->StripeContains(/*stripe_id=*/2, /*value=*/12));
+  stats = index->pruning_stats();
+  EXPECT_EQ(stats[0].num_candidate_stripes(), 2);
+  EXPECT_EQ(stats[0].num_pruned_stripes(), 1);
+  EXPECT_EQ(stats[1].num_candidate_stripes(), 1);
+  EXPECT_EQ(stats[2].num_candidate_stripes(), 1);
+}
+
+TEST(CompositeIndexTest, Builder) {
+  const ColumnPtr column = CreateColumn();
+  const std::unique_ptr<CompositeIndexFactory> factory = CreateFactory();
+  IndexStructureBuilderPtr builder = factory->CreateBuilder();
+  for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+    builder->AddStripe(absl::MakeConstSpan(column->data())
+                           .subspan(stripe_id * kNumRowsPerStripe,
+                                    kNumRowsPerStripe));
+  }
+  const IndexStructurePtr built = builder->Finish();
+  const IndexStructurePtr created = factory->Create(*column, kNumRowsPerStripe);
+  EXPECT_EQ(built->name(), created->name());
+  for (long value = 1; value <= 5 * static_cast<long>(kNumStripes); ++value) {
+    // The zone map only lets the stripe containing the value pass.
+    ASSERT_EQ(built->GetQualifyingStripes(value, kNumStripes).ToString(),
+              created->GetQualifyingStripes(value, kNumStripes).ToString());
+  }
+}
+
+TEST(CompositeIndexTest, BuilderWithPartialLastStripe) {
+  std::vector<std::unique_ptr<IndexStructureFactory>> factories;
+  factories.push_back(absl::make_unique<ZoneMapFactory>());
+  factories.push_back(
+      absl::make_unique<PerStripeBlockedBloomFactory>(/*num_bits_per_key=*/10));
+  const CuckooIndexFactory cuckoo_factory(
+      CuckooAlgorithm::SKEWED_KICKING, kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.02, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false);
+  factories.push_back(absl::make_unique<CuckooIndexFactory>(cuckoo_factory));
+  // Uses the default (buffering) builder.
+  factories.push_back(absl::make_unique<PartitionedCuckooIndexFactory>(
+      cuckoo_factory, /*num_partitions=*/2));
+  const CompositeIndexFactory factory(std::move(factories));
+
+  // Every child indexes the partial last stripe as a stripe of its own.
+  const ColumnPtr column = CreateColumn();
+  IndexStructureBuilderPtr builder = factory.CreateBuilder();
+  for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+    builder->AddStripe(absl::MakeConstSpan(column->data())
+                           .subspan(stripe_id * kNumRowsPerStripe,
+                                    kNumRowsPerStripe));
+  }
+  const long last_value = 5 * kNumStripes + 1;
+  builder->AddStripe({last_value, last_value + 1, last_value + 2});
+  const IndexStructurePtr built = builder->Finish();
+  for (const IndexStructurePtr& child :
+       static_cast<const CompositeIndex&>(*built).children()) {
+    EXPECT_TRUE(child->StripeContains(/*stripe_id=*/kNumStripes, last_value))
+        << child->name();
+    const Bitmap64 stripes =
+        child->GetQualifyingStripes(last_value + 2, kNumStripes + 1);
+    EXPECT_TRUE(stripes.Get(kNumStripes)) << child->name();
+    EXPECT_EQ(stripes.GetOnesCount(), 1) << child->name();
+  }
+}
+
+}  // namespace ci
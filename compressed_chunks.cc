@@ -0,0 +1,71 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: compressed_chunks.cc
+// -----------------------------------------------------------------------------
+
+#include "compressed_chunks.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "common/byte_coding.h"
+#include "evaluation_utils.h"
+
+namespace ci {
+
+std::string EncodeCompressedChunks(absl::Span<const std::string> chunks) {
+  std::string compressed_chunks;
+  ByteBuffer directory;
+  PutVarint32(chunks.size(), &directory);
+  for (const std::string& chunk : chunks) {
+    absl::StrAppend(&compressed_chunks, Compress(chunk));
+    PutPrimitive<uint32_t>(compressed_chunks.size(), &directory);
+  }
+  return absl::StrCat(absl::string_view(directory.data(), directory.pos()),
+                      compressed_chunks);
+}
+
+CompressedChunks::CompressedChunks(absl::string_view data) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  num_chunks_ = GetVarint32(span, &pos);
+  end_offsets_ = data.data() + pos;
+  chunks_ = end_offsets_ + num_chunks_ * sizeof(uint32_t);
+  assert(num_chunks_ == 0 ||
+         chunks_ + GetEndOffset(num_chunks_ - 1) == data.data() + data.size());
+}
+
+absl::string_view CompressedChunks::GetCompressed(size_t chunk_idx) const {
+  assert(chunk_idx < num_chunks_);
+  const size_t begin = chunk_idx == 0 ? 0 : GetEndOffset(chunk_idx - 1);
+  return absl::string_view(chunks_ + begin, GetEndOffset(chunk_idx) - begin);
+}
+
+std::string CompressedChunks::Uncompress(size_t chunk_idx) const {
+  return ci::Uncompress(GetCompressed(chunk_idx));
+}
+
+size_t CompressedChunks::GetEndOffset(size_t chunk_idx) const {
+  // The directory may not be aligned.
+  uint32_t end_offset;
+  std::memcpy(&end_offset, end_offsets_ + chunk_idx * sizeof(uint32_t),
+              sizeof(uint32_t));
+  return end_offset;
+}
+
+}  // namespace ci
@@ -0,0 +1,104 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: compressed_chunks.h
+// -----------------------------------------------------------------------------
+//
+// Sections of an index split into independently ZSTD-compressed chunks, so
+// that lookups on an opened index only decompress the chunks they touch. The
+// encoding starts with a directory of the chunk offsets:
+//   varint32 num_chunks
+//   uint32 end offset of each compressed chunk (relative to the first chunk)
+//   the compressed chunks
+
+#ifndef CUCKOO_INDEX_COMPRESSED_CHUNKS_H_
+#define CUCKOO_INDEX_COMPRESSED_CHUNKS_H_
+
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/lru_cache.h"
+
+namespace ci {
+
+// Returns the `chunks`, each compressed on its own, preceded by the directory.
+std::string EncodeCompressedChunks(absl::Span<const std::string> chunks);
+
+// Reads chunks encoded by EncodeCompressedChunks(..). Does *not* copy `data`,
+// i.e., its lifetime must be longer than the lifetime of the reader.
+class CompressedChunks {
+ public:
+  explicit CompressedChunks(absl::string_view data);
+
+  size_t num_chunks() const { return num_chunks_; }
+
+  // Returns the compressed bytes of chunk `chunk_idx`.
+  absl::string_view GetCompressed(size_t chunk_idx) const;
+
+  // Decompresses chunk `chunk_idx`.
+  std::string Uncompress(size_t chunk_idx) const;
+
+ private:
+  size_t GetEndOffset(size_t chunk_idx) const;
+
+  size_t num_chunks_;
+  // Point into the encoding.
+  const char* end_offsets_;
+  const char* chunks_;
+};
+
+// Keeps the `T`s decoded from the most recently used chunks in an LRU cache of
+// at most `capacity` chunks (see LruCache), i.e., it can be shared by
+// concurrent lookups. A returned chunk stays valid as long as it is held, even
+// if it's evicted in the meantime.
+template <typename T>
+class ChunkCache {
+ public:
+  using ChunkPtr = std::shared_ptr<const T>;
+  // Creates the `T` of a chunk from its uncompressed bytes.
+  using Decoder = std::function<ChunkPtr(std::string uncompressed)>;
+
+  // Does *not* copy `data`, i.e., its lifetime must be longer than the
+  // lifetime of the cache.
+  ChunkCache(absl::string_view data, size_t capacity, Decoder decode)
+      : chunks_(data), cache_(capacity), decode_(std::move(decode)) {}
+
+  size_t num_chunks() const { return chunks_.num_chunks(); }
+
+  // Returns the cached chunk `chunk_idx`, or decompresses, decodes and caches
+  // it.
+  ChunkPtr Get(size_t chunk_idx) const {
+    assert(chunk_idx < num_chunks());
+    return cache_.GetOrCreate(
+        chunk_idx, [&]() { return decode_(chunks_.Uncompress(chunk_idx)); });
+  }
+
+  size_t hits() const { return cache_.hits(); }
+  size_t misses() const { return cache_.misses(); }
+
+ private:
+  const CompressedChunks chunks_;
+  const LruCache<size_t, T> cache_;
+  const Decoder decode_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_COMPRESSED_CHUNKS_H_
@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: compressed_chunks_test.cc
+// -----------------------------------------------------------------------------
+
+#include "compressed_chunks.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+std::vector<std::string> CreateChunks() {
+  // Includes an empty chunk.
+  return {std::string(1000, 'a'), "", "some chunk", std::string(5000, 'b')};
+}
+
+std::shared_ptr<const std::string> DecodeString(std::string uncompressed) {
+  return std::make_shared<const std::string>(std::move(uncompressed));
+}
+
+TEST(CompressedChunksTest, EncodeAndDecode) {
+  const std::vector<std::string> chunks = CreateChunks();
+  const std::string encoded = EncodeCompressedChunks(chunks);
+  const CompressedChunks decoded(encoded);
+  ASSERT_EQ(decoded.num_chunks(), chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i)
+    EXPECT_EQ(decoded.Uncompress(i), chunks[i]);
+  // The long runs compress well.
+  EXPECT_LT(decoded.GetCompressed(3).size(), chunks[3].size() / 10);
+
+  EXPECT_EQ(CompressedChunks(EncodeCompressedChunks({})).num_chunks(), 0);
+}
+
+TEST(CompressedChunksTest, ChunkCacheEvictsLeastRecentlyUsed) {
+  const std::vector<std::string> chunks = CreateChunks();
+  const std::string encoded = EncodeCompressedChunks(chunks);
+  const ChunkCache<std::string> cache(encoded, /*capacity=*/2, DecodeString);
+
+  EXPECT_EQ(*cache.Get(0), chunks[0]);
+  EXPECT_EQ(*cache.Get(2), chunks[2]);
+  EXPECT_EQ(*cache.Get(0), chunks[0]);
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(cache.hits(), 1);
+
+  // Evicts chunk 0, the least recently used one.
+  const std::shared_ptr<const std::string> held = cache.Get(2);
+  EXPECT_EQ(*cache.Get(3), chunks[3]);
+  EXPECT_EQ(cache.misses(), 3);
+  EXPECT_EQ(*cache.Get(2), chunks[2]);
+  EXPECT_EQ(cache.misses(), 3);
+
+  // Evicts chunk 3 and then chunk 2, but a held chunk stays valid.
+  EXPECT_EQ(*cache.Get(0), chunks[0]);
+  EXPECT_EQ(*cache.Get(3), chunks[3]);
+  EXPECT_EQ(cache.misses(), 5);
+  EXPECT_EQ(cache.hits(), 3);
+  EXPECT_EQ(*held, chunks[2]);
+}
+
+TEST(CompressedChunksTest, ChunkCacheWithoutCapacity) {
+  const std::vector<std::string> chunks = CreateChunks();
+  const std::string encoded = EncodeCompressedChunks(chunks);
+  const ChunkCache<std::string> cache(encoded, /*capacity=*/0, DecodeString);
+  EXPECT_EQ(*cache.Get(1), chunks[1]);
+  EXPECT_EQ(*cache.Get(1), chunks[1]);
+  EXPECT_EQ(cache.misses(), 2);
+  EXPECT_EQ(cache.hits(), 0);
+}
+
+}  // namespace ci
@@ -0,0 +1,290 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: concurrent_lookup_benchmark.cc
+// -----------------------------------------------------------------------------
+//
+// Measures how lookups scale when many threads probe one shared (read-only)
+// `IndexStructure`, e.g., to find contention points like allocations on the
+// lookup path. Every index is probed by 1, 2, 4, ... up to --max_threads
+// threads. `lookups_per_thread` is the throughput of a single thread, i.e.,
+// stays constant for perfect scaling, while `items_per_second` is the
+// throughput of all threads.
+//
+// With --lookup_cpus, the lookup threads are pinned to the given CPUs. With
+// --index_cpu, the indexes are built on a thread pinned to that CPU, i.e.,
+// their memory is (first-touch) allocated on its NUMA node. Combining both
+// measures cross-socket probing, e.g., with CPUs of node 0 building and CPUs of
+// node 1 probing.
+//
+// To run the benchmark run:
+// bazel run -c opt --cxxopt='-std=c++17' --dynamic_mode=off
+// :concurrent_lookup_benchmark -- --input_csv_path='...'
+// --columns_to_test='A,B,C' --max_threads=32
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "benchmark/benchmark.h"
+#include "caching_index_structure.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "data.h"
+#include "index_structure.h"
+#include "per_stripe_blocked_bloom.h"
+#include "per_stripe_bloom.h"
+#include "per_stripe_xor.h"
+#include "zone_map.h"
+
+ABSL_FLAG(long, generate_num_values, 100000,
+          "Number of values to generate (number of rows).");
+ABSL_FLAG(long, num_unique_values, 1000,
+          "Number of unique values to generate (cardinality).");
+ABSL_FLAG(std::string, input_csv_path, "", "Path to the input CSV file.");
+ABSL_FLAG(std::vector<std::string>, columns_to_test, {},
+          "Comma-separated list of columns to tests, e.g. "
+          "'company_name,country_code'.");
+ABSL_FLAG(long, num_load_threads, 1,
+          "Number of threads used to parse the input CSV file.");
+ABSL_FLAG(std::string, table_cache_path, "",
+          "Path of a binary copy of the table, which is opened instead of "
+          "loading or generating the table again (see "
+          "ci::GetOrCreateCachedTable(..)).");
+ABSL_FLAG(long, num_rows_per_stripe, 10000, "Number of rows per stripe.");
+ABSL_FLAG(long, max_threads, 0,
+          "Maximum number of lookup threads. Defaults to the number of CPUs.");
+ABSL_FLAG(std::vector<std::string>, lookup_cpus, {},
+          "Comma-separated list of CPUs the lookup threads are pinned to "
+          "(round-robin). Threads aren't pinned if empty.");
+ABSL_FLAG(long, index_cpu, -1,
+          "CPU whose NUMA node the indexes are allocated on, i.e., the CPU "
+          "of the thread building them. Built on the main thread if < 0.");
+ABSL_FLAG(long, cache_capacity, 1024,
+          "Number of stripe bitmaps cached by the CachingIndexStructure.");
+
+// The values looked up by all threads. Each thread starts at another offset,
+// i.e., threads don't probe the same values at the same time.
+constexpr size_t kNumLookupValues = 1 << 20;
+
+// Pins the calling thread to `cpu`.
+void PinToCpu(long cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    std::cerr << "Failed to pin thread to CPU " << cpu << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+std::vector<long> ParseCpus(const std::vector<std::string>& strs) {
+  std::vector<long> cpus;
+  for (const std::string& str : strs) {
+    long cpu;
+    if (!absl::SimpleAtoi(str, &cpu) || cpu < 0) {
+      std::cerr << "Invalid CPU: " << str << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+// Returns `kNumLookupValues` values drawn uniformly from the distinct
+// (non-NULL) values of `column`.
+std::vector<long> DrawPositiveValues(const ci::Column& column) {
+  std::mt19937 gen(42);
+  std::vector<long> distinct_values = column.distinct_values();
+  distinct_values.erase(
+      std::remove(distinct_values.begin(), distinct_values.end(),
+                  ci::Column::kIntNullSentinel),
+      distinct_values.end());
+  std::uniform_int_distribution<size_t> offset_d(0,
+                                                 distinct_values.size() - 1);
+  std::vector<long> values;
+  values.reserve(kNumLookupValues);
+  for (size_t i = 0; i < kNumLookupValues; ++i)
+    values.push_back(distinct_values[offset_d(gen)]);
+  return values;
+}
+
+// Returns `kNumLookupValues` random values not present in `column`.
+std::vector<long> DrawNegativeValues(const ci::Column& column) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<long> value_d(std::numeric_limits<long>::min(),
+                                             std::numeric_limits<long>::max());
+  std::vector<long> values;
+  values.reserve(kNumLookupValues);
+  for (size_t i = 0; i < kNumLookupValues; ++i) {
+    long value = value_d(gen);
+    while (column.Contains(value)) value = value_d(gen);
+    values.push_back(value);
+  }
+  return values;
+}
+
+// Run by each of the `state.threads()` threads: looks up `values` in the
+// shared `index` with GetQualifyingStripes(..), i.e., including the allocation
+// of the result as for a query.
+void BM_ConcurrentLookup(const ci::IndexStructure& index,
+                         const std::vector<long>& values,
+                         const long num_stripes, const std::vector<long>& cpus,
+                         benchmark::State& state) {
+  if (!cpus.empty()) PinToCpu(cpus[state.thread_index() % cpus.size()]);
+
+  size_t pos = state.thread_index() * values.size() / state.threads();
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(
+        index.GetQualifyingStripes(values[pos], num_stripes));
+    if (++pos == values.size()) pos = 0;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["lookups_per_thread"] = benchmark::Counter(
+      static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads);
+}
+
+// Creates an index for `column` on a thread pinned to `cpu` (if >= 0).
+ci::IndexStructurePtr CreateIndex(const ci::IndexStructureFactory& factory,
+                                  const ci::Column& column,
+                                  size_t num_rows_per_stripe, long cpu) {
+  if (cpu < 0) return factory.Create(column, num_rows_per_stripe);
+  ci::IndexStructurePtr index;
+  std::thread thread([&]() {
+    PinToCpu(cpu);
+    index = factory.Create(column, num_rows_per_stripe);
+  });
+  thread.join();
+  return index;
+}
+
+long main(long argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const std::string input_csv_path = absl::GetFlag(FLAGS_input_csv_path);
+  const std::vector<std::string> columns_to_test =
+      absl::GetFlag(FLAGS_columns_to_test);
+  const size_t num_rows_per_stripe = absl::GetFlag(FLAGS_num_rows_per_stripe);
+  const long max_threads =
+      absl::GetFlag(FLAGS_max_threads) > 0
+          ? absl::GetFlag(FLAGS_max_threads)
+          : std::max<long>(1, std::thread::hardware_concurrency());
+  const std::vector<long> lookup_cpus =
+      ParseCpus(absl::GetFlag(FLAGS_lookup_cpus));
+  const long index_cpu = absl::GetFlag(FLAGS_index_cpu);
+
+  // Define data.
+  const size_t generate_num_values = absl::GetFlag(FLAGS_generate_num_values);
+  const size_t num_unique_values = absl::GetFlag(FLAGS_num_unique_values);
+  const bool load_csv = !input_csv_path.empty() && !columns_to_test.empty();
+  const std::string source =
+      load_csv ? ci::CsvTableSource(input_csv_path, columns_to_test,
+                                    ci::StringEncoding::DICTIONARY)
+               : absl::StrCat("uniform: generate_num_values=",
+                              generate_num_values,
+                              " num_unique_values=", num_unique_values);
+  const std::unique_ptr<ci::Table> table = ci::GetOrCreateCachedTable(
+      absl::GetFlag(FLAGS_table_cache_path), source, [&]() {
+        if (!load_csv) {
+          std::cerr
+              << "[WARNING] --input_csv_path or --columns_to_test not "
+                 "specified, generating synthetic data."
+              << std::endl;
+          return ci::GenerateUniformData(generate_num_values,
+                                         num_unique_values);
+        }
+        std::cout << "Loading data from file " << input_csv_path << "..."
+                  << std::endl;
+        return ci::Table::FromCsv(input_csv_path, columns_to_test,
+                                  ci::StringEncoding::DICTIONARY,
+                                  absl::GetFlag(FLAGS_num_load_threads));
+      });
+  table->PrintColumns();
+
+  std::vector<std::unique_ptr<ci::IndexStructureFactory>> index_factories;
+  index_factories.push_back(absl::make_unique<ci::CuckooIndexFactory>(
+      ci::CuckooAlgorithm::SKEWED_KICKING, ci::kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.02, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false));
+  index_factories.push_back(
+      absl::make_unique<ci::PerStripeBloomFactory>(/*num_bits_per_key=*/10));
+  index_factories.push_back(
+      absl::make_unique<ci::PerStripeBlockedBloomFactory>(
+          /*num_bits_per_key=*/10));
+  index_factories.push_back(absl::make_unique<ci::PerStripeXorFactory>());
+  index_factories.push_back(absl::make_unique<ci::ZoneMapFactory>());
+
+  // Set up the benchmarks. The indexes and values are kept alive by the
+  // lambdas.
+  for (const std::unique_ptr<ci::Column>& column : table->GetColumns()) {
+    const long num_stripes = column->num_rows() / num_rows_per_stripe;
+    auto positive_values =
+        std::make_shared<const std::vector<long>>(DrawPositiveValues(*column));
+    auto negative_values =
+        std::make_shared<const std::vector<long>>(DrawNegativeValues(*column));
+
+    std::vector<std::shared_ptr<ci::IndexStructure>> indexes;
+    for (const std::unique_ptr<ci::IndexStructureFactory>& factory :
+         index_factories) {
+      indexes.push_back(
+          CreateIndex(*factory, *column, num_rows_per_stripe, index_cpu));
+    }
+    // The sharded cache is shared by all threads as well.
+    indexes.push_back(std::make_shared<ci::CachingIndexStructure>(
+        CreateIndex(*index_factories[0], *column, num_rows_per_stripe,
+                    index_cpu),
+        absl::GetFlag(FLAGS_cache_capacity)));
+
+    for (const std::shared_ptr<ci::IndexStructure>& index : indexes) {
+      for (const auto& [name, values] :
+           {std::make_pair("PositiveDistinct", positive_values),
+            std::make_pair("Negative", negative_values)}) {
+        const std::string benchmark_name = absl::StrFormat(
+            "Concurrent%sLookup/%s/%d/%s", name, column->name(),
+            num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            benchmark_name.c_str(),
+            [index, values = values, num_stripes,
+             &lookup_cpus](::benchmark::State& st) {
+              BM_ConcurrentLookup(*index, *values, num_stripes, lookup_cpus,
+                                  st);
+            })
+            ->ThreadRange(1, max_threads)
+            ->UseRealTime();
+      }
+    }
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+
+  return EXIT_SUCCESS;
+}
@@ -18,17 +18,23 @@
 
 #include "cuckoo_index.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "common/byte_coding.h"
 #include "common/profiling.h"
 #include "common/rle_bitmap.h"
 #include "cuckoo_kicker.h"
+#include "cuckoo_matcher.h"
 #include "cuckoo_utils.h"
 #include "evaluation_utils.h"
 #include "fingerprint_store.h"
@@ -40,22 +46,111 @@ namespace {
 // increase the number of requested buckets by this factor.
 constexpr double kNumBucketsGrowFactor = 1.01;
 
-// Returns a map from values to their stripe-bitmaps.
-const absl::flat_hash_map<long, Bitmap64Ptr> ValueToStripeBitmaps(
-    const Column& column, size_t num_rows_per_stripe) {
+// Number of lookups whose bucket accesses are overlapped in
+// CuckooIndex::GetQualifyingStripesBatch(..). Large enough to hide memory
+// latency, small enough for the touched cache lines to still be cached when
+// the lookups are resolved.
+constexpr size_t kLookupGroupSize = 16;
+
+// Buckets with 2 to `kMaxSlotsPerBucketForBucketProbe` slots (and those of the
+// specialized lookup paths, see CuckooIndex::LookupFns) are probed as a whole:
+// their fingerprints are fetched with a single block lookup and compared to
+// the probe at once (see GetFingerprintMatchMask(..)).
+constexpr size_t kMaxSlotsPerBucketForBucketProbe = 8;
+
+// Splits [0, `num_items`) into `num_chunks` contiguous chunks whose boundaries
+// are multiples of `alignment` and calls `fn(chunk_idx, begin, end)` for each
+// chunk, every one on its own thread (for `num_chunks` > 1). The profiles and
+// heap usage of the threads are merged into the ones of the calling thread, so
+// that its enclosing ScopedProfile counts them.
+template <typename Fn>
+void ForEachChunkInParallel(size_t num_items, size_t num_chunks,
+                            size_t alignment, const Fn& fn) {
+  if (num_chunks <= 1) {
+    fn(/*chunk_idx=*/0, /*begin=*/0, /*end=*/num_items);
+    return;
+  }
+  auto boundary = [&](size_t chunk_idx) {
+    const size_t pos = chunk_idx * num_items / num_chunks;
+    return std::min(num_items, (pos + alignment - 1) / alignment * alignment);
+  };
+  Profiler& caller_profiler = Profiler::GetThreadInstance();
+  absl::Mutex profiler_mutex;
+  std::vector<AllocationStats> allocation_stats(num_chunks);
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks);
+  for (size_t i = 0; i < num_chunks; ++i) {
+    threads.emplace_back([&, i]() {
+      fn(i, boundary(i), boundary(i + 1));
+      allocation_stats[i] = GetThreadAllocationStats();
+      // The calling thread is blocked in join() below.
+      absl::MutexLock lock(&profiler_mutex);
+      caller_profiler.Merge(Profiler::GetThreadInstance());
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  MergeWorkerAllocationStats(allocation_stats);
+}
+
+// Adds the rows of stripes [`begin_stripe`, `end_stripe`) to `stripe_sets`.
+void AddStripesToSets(const Column& column, size_t num_rows_per_stripe,
+                      size_t begin_stripe, size_t end_stripe,
+                      StripeSetArena* arena,
+                      absl::flat_hash_map<long, StripeSet>* stripe_sets) {
+  for (size_t stripe = begin_stripe; stripe < end_stripe; ++stripe) {
+    const size_t end_row = (stripe + 1) * num_rows_per_stripe;
+    for (size_t row = stripe * num_rows_per_stripe; row < end_row; ++row) {
+      // A single hash probe per row.
+      (*stripe_sets)[column[row]].Add(stripe, arena);
+    }
+  }
+}
+
+// Returns a map from values to the sets of stripes they occur in, allocated
+// from `arenas`. With `num_threads` > 1, each thread builds a map for a
+// contiguous range of stripes (with an arena of its own), which are then
+// merged (by uniting the sets of values occurring in several ranges).
+absl::flat_hash_map<long, StripeSet> ValueToStripeSets(
+    const Column& column, size_t num_rows_per_stripe, size_t num_threads,
+    std::vector<StripeSetArena>* arenas) {
   ScopedProfile profile(Counter::ValueToStripeBitmaps);
-  absl::flat_hash_map<long, Bitmap64Ptr> bitmaps;
   // Round down the number of rows to the next multiple of
   // `num_rows_per_stripe`, i.e., ignore the last stripe as elsewhere.
   const size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  const size_t num_rows = num_stripes * num_rows_per_stripe;
-  for (size_t row = 0; row < num_rows; ++row) {
-    const long value = column[row];
-    if (!bitmaps.contains(value))
-      bitmaps[value] = absl::make_unique<Bitmap64>(/*size=*/num_stripes);
-    bitmaps[value]->Set(row / num_rows_per_stripe, true);
+  num_threads = std::max<size_t>(1, std::min(num_threads, num_stripes));
+
+  arenas->clear();
+  for (size_t i = 0; i < num_threads; ++i) arenas->emplace_back(num_stripes);
+  std::vector<absl::flat_hash_map<long, StripeSet>> partial_sets(num_threads);
+  ForEachChunkInParallel(
+      num_stripes, num_threads, /*alignment=*/1,
+      [&](size_t chunk_idx, size_t begin_stripe, size_t end_stripe) {
+        AddStripesToSets(column, num_rows_per_stripe, begin_stripe,
+                         end_stripe, &(*arenas)[chunk_idx],
+                         &partial_sets[chunk_idx]);
+      });
+  if (num_threads == 1) return std::move(partial_sets[0]);
+
+  // Merge into the largest map to move as few entries as possible. The sets
+  // keep pointing into the arenas of the threads that created them.
+  const size_t largest = std::max_element(partial_sets.begin(),
+                                          partial_sets.end(),
+                                          [](const auto& lhs, const auto& rhs) {
+                                            return lhs.size() < rhs.size();
+                                          }) -
+                         partial_sets.begin();
+  absl::flat_hash_map<long, StripeSet> stripe_sets =
+      std::move(partial_sets[largest]);
+  for (size_t i = 0; i < num_threads; ++i) {
+    if (i == largest) continue;
+    for (const auto& [value, stripe_set] : partial_sets[i]) {
+      const auto [it, inserted] = stripe_sets.try_emplace(value, stripe_set);
+      if (!inserted) it->second.Union(stripe_set, &(*arenas)[largest]);
+    }
+    // Free memory early.
+    partial_sets[i].clear();
   }
-  return bitmaps;
+  return stripe_sets;
 }
 
 // Distributes the `values` to buckets with the "kicking algorithm". Returns an
@@ -63,14 +158,16 @@ const absl::flat_hash_map<long, Bitmap64Ptr> ValueToStripeBitmaps(
 std::vector<Bucket> DistributeByKicking(size_t num_buckets,
                                         size_t slots_per_bucket,
                                         const std::vector<CuckooValue>& values,
-                                        bool skew_kicking) {
+                                        bool skew_kicking,
+                                        KickingStrategy strategy) {
   std::vector<Bucket> buckets;
   buckets.reserve(num_buckets);
   for (size_t i = 0; i < num_buckets; ++i)
     buckets.push_back(Bucket(/*num_slots=*/slots_per_bucket));
 
   // Try to insert values with kicking.
-  CuckooKicker kicker(slots_per_bucket, absl::MakeSpan(buckets), skew_kicking);
+  CuckooKicker kicker(slots_per_bucket, absl::MakeSpan(buckets), skew_kicking,
+                      CuckooKicker::kDefaultMaxKicks, strategy);
   const bool success = kicker.InsertValues(values);
   kicker.PrintStats();
   if (!success) return std::vector<Bucket>();
@@ -86,25 +183,50 @@ std::vector<Bucket> DistributeByKicking(size_t num_buckets,
   return buckets;
 }
 
+// Distributes the `values` to buckets by computing a maximum matching. Returns
+// an empty vector if no placement exists, i.e., if there were too few buckets.
+std::vector<Bucket> DistributeByMatching(
+    size_t num_buckets, size_t slots_per_bucket,
+    const std::vector<CuckooValue>& values) {
+  std::vector<Bucket> buckets(num_buckets, Bucket(slots_per_bucket));
+  CuckooMatcher matcher(slots_per_bucket, absl::MakeSpan(buckets));
+  const bool success = matcher.InsertValues(values);
+  matcher.PrintStats();
+  if (!success) return std::vector<Bucket>();
+
+  for (const CuckooValue& value : values) {
+    bool in_primary;
+    LookupValueInBuckets(buckets, value, &in_primary);
+    if (!in_primary) buckets[value.primary_bucket].kicked_.push_back(value);
+  }
+
+  return buckets;
+}
+
 // Distributes the `distinct_values` to buckets. Returns an empty vector if this
 // failed, i.e., if there were too few buckets.
 std::vector<Bucket> Distribute(
     size_t num_buckets, size_t slots_per_bucket, CuckooAlgorithm cuckoo_alg,
-    const absl::flat_hash_set<long>& distinct_values) {
+    HashingScheme hashing_scheme, absl::Span<const long> distinct_values) {
   std::vector<CuckooValue> values;
   values.reserve(distinct_values.size());
-  for (size_t value : distinct_values)
-    values.push_back(CuckooValue(value, num_buckets));
+  for (const long value : distinct_values)
+    values.push_back(CuckooValue(value, num_buckets, hashing_scheme));
   switch (cuckoo_alg) {
     case CuckooAlgorithm::KICKING:
       return DistributeByKicking(num_buckets, slots_per_bucket, values,
-                                 /*skew_kicking=*/false);
+                                 /*skew_kicking=*/false,
+                                 KickingStrategy::RANDOM_WALK);
     case CuckooAlgorithm::SKEWED_KICKING:
       return DistributeByKicking(num_buckets, slots_per_bucket, values,
-                                 /*skew_kicking=*/true);
+                                 /*skew_kicking=*/true,
+                                 KickingStrategy::RANDOM_WALK);
+    case CuckooAlgorithm::BFS_KICKING:
+      return DistributeByKicking(num_buckets, slots_per_bucket, values,
+                                 /*skew_kicking=*/false,
+                                 KickingStrategy::BREADTH_FIRST);
     case CuckooAlgorithm::MATCHING:
-      std::cerr << "Not implemented." << std::endl;
-      std::exit(-1);
+      return DistributeByMatching(num_buckets, slots_per_bucket, values);
   }
 
   std::cerr << "Unknown algorithm: " << static_cast<int32_t>(cuckoo_alg)
@@ -112,16 +234,76 @@ std::vector<Bucket> Distribute(
   std::exit(-1);
 }
 
+// Returns the buckets for the first number of buckets, starting at
+// `num_buckets` (the number of buckets for the max load factor, but at least
+// enough slots for all values) and growing it by kNumBucketsGrowFactor, for
+// which the matching finds a placement. I.e., the max load factor is never
+// exceeded. Since the matching finds a placement whenever one exists, the first
+// probe usually succeeds, and each further probe only costs one matching.
+std::vector<Bucket> DistributeToFirstFeasibleNumBuckets(
+    size_t num_buckets, size_t slots_per_bucket, HashingScheme hashing_scheme,
+    absl::Span<const long> distinct_values) {
+  num_buckets = std::max<size_t>(
+      {num_buckets, 1,
+       (distinct_values.size() + slots_per_bucket - 1) / slots_per_bucket});
+  std::vector<Bucket> buckets;
+  while ((buckets = Distribute(num_buckets, slots_per_bucket,
+                               CuckooAlgorithm::MATCHING, hashing_scheme,
+                               distinct_values))
+             .empty()) {
+    num_buckets =
+        std::max(static_cast<size_t>(num_buckets * kNumBucketsGrowFactor),
+                 num_buckets + 1);
+  }
+  return buckets;
+}
+
+// Returns the minimum number of bits >= `min_num_bits` for the fingerprints of
+// a bucket to reach the `scan_rate`, given the average stripe density (i.e.,
+// the fraction of stripes containing a value) of the bucket's values.
+//
+// The scan rate of a bucket is estimated by averaging the local scan rates of
+// all its values. The intuition here is that a lookup can only match with a
+// single fingerprint & that for an infinite number of lookups we expect the
+// scan rate to average out. It is adjusted by: 1) taking the density (aka
+// load-factor) of the table into account and 2) taking into account that for
+// every lookup we may actually check two buckets: the primary and the
+// secondary. I.e., we need the smallest `num_bits` with:
+//   2^-num_bits * avg_stripe_density * bucket_density * 2 <= scan_rate
+size_t GetNumBitsForScanRate(double scan_rate, double avg_stripe_density,
+                             double bucket_density, size_t min_num_bits) {
+  const double max_scan_rate = avg_stripe_density * bucket_density * 2;
+  auto reaches_scan_rate = [&](size_t num_bits) {
+    return std::ldexp(max_scan_rate, -static_cast<int>(num_bits)) <= scan_rate;
+  };
+  size_t num_bits = min_num_bits;
+  if (max_scan_rate > scan_rate) {
+    const size_t closed_form_num_bits =
+        static_cast<size_t>(std::ceil(std::log2(max_scan_rate / scan_rate)));
+    num_bits = std::max(min_num_bits, closed_form_num_bits);
+    // Guard against rounding in the closed form.
+    while (num_bits > min_num_bits && reaches_scan_rate(num_bits - 1))
+      --num_bits;
+  }
+  while (!reaches_scan_rate(num_bits)) ++num_bits;
+  // Check if can reach the desired scan rate.
+  assert(num_bits <= 64);
+  return num_bits;
+}
+
 // Computes the minimum `num_bits` which can be used per bucket and fills
-// `slot_fingerprints` accordingly, also moves the `value_to_bitmap` entries to
-// the corresponding `slot_bitmaps` entries.
+// `slot_fingerprints` accordingly, also points the `slot_stripes` entries to
+// the corresponding `value_to_stripes` entries (nullptr for empty slots). With
+// `num_threads` > 1, processes chunks of buckets in parallel.
 void CreateSlots(double scan_rate, size_t slots_per_bucket,
                  const std::vector<Bucket>& buckets,
-                 absl::flat_hash_map<long, Bitmap64Ptr>* value_to_bitmap,
+                 const absl::flat_hash_map<long, StripeSet>& value_to_stripes,
+                 size_t num_stripes,
                  std::vector<Fingerprint>* slot_fingerprints,
                  const bool prefix_bits_optimization,
                  Bitmap64Ptr* use_prefix_bits_bitmap,
-                 std::vector<Bitmap64Ptr>* slot_bitmaps) {
+                 std::vector<const StripeSet*>* slot_stripes,
+                 size_t num_threads) {
   ScopedProfile profile(Counter::CreateSlots);
   const size_t num_buckets = buckets.size();
   const size_t num_slots = num_buckets * slots_per_bucket;
@@ -134,145 +316,559 @@ void CreateSlots(double scan_rate, size_t slots_per_bucket,
   slot_fingerprints->resize(num_slots);
   if (prefix_bits_optimization)
     *use_prefix_bits_bitmap = absl::make_unique<Bitmap64>(num_buckets);
-  slot_bitmaps->resize(num_slots);
-  for (size_t bucket_id = 0; bucket_id < num_buckets; ++bucket_id) {
-    const Bucket& bucket = buckets[bucket_id];
+  slot_stripes->assign(num_slots, nullptr);
 
-    // Start by determining the minimum number of bits needed to avoid
-    // collisions of values which are contained in the bucket or were kicked
-    // from this bucket (which was their primary bucket).
+  // Threads only read `value_to_stripes`. Chunks are aligned to 64 buckets, so
+  // that threads don't share words of `use_prefix_bits_bitmap`.
+  auto create_slots = [&](size_t /*chunk_idx*/, size_t begin_bucket,
+                          size_t end_bucket) {
     std::vector<uint64_t> possibly_colliding_fingerprints;
-    for (const CuckooValue& value : bucket.slots_)
-      possibly_colliding_fingerprints.push_back(value.fingerprint);
-    for (const CuckooValue& value : bucket.kicked_)
-      possibly_colliding_fingerprints.push_back(value.fingerprint);
-    bool use_prefix_bits;
-    size_t num_bits;
-    if (prefix_bits_optimization) {
-      num_bits = GetMinCollisionFreeFingerprintPrefixOrSuffix(
-          possibly_colliding_fingerprints, &use_prefix_bits);
-      (*use_prefix_bits_bitmap)->Set(bucket_id, use_prefix_bits);
-    } else {
-      num_bits = GetMinCollisionFreeFingerprintLength(
-          possibly_colliding_fingerprints, /*use_prefix_bits=*/false);
-    }
+    for (size_t bucket_id = begin_bucket; bucket_id < end_bucket; ++bucket_id) {
+      const Bucket& bucket = buckets[bucket_id];
 
-    // Now add more bits if needed to ensure the desired `scan_rate`.
-    for (; num_bits <= 65; ++num_bits) {
-      // Compute `actual_scan_rate` of `bucket` by averaging the
-      // local scan rates of all items in `bucket`. The intuition here is that a
-      // lookup can only match with a single fingerprint & that for an infinite
-      // number of lookups we expect the scan rate to average out.
-      const double fp_prob = 1.0 / std::pow(2, num_bits);
-      double sum_scan_rate = 0.0;
-      for (const CuckooValue& value : bucket.slots_) {
-        const Bitmap64Ptr& bitmap = (*value_to_bitmap)[value.orig_value];
-        assert(bitmap != nullptr);
-        sum_scan_rate += (fp_prob * bitmap->GetOnesCount()) / bitmap->bits();
-      }
-      double actual_scan_rate = sum_scan_rate / bucket.slots_.size();
-      // Adjust the scan rate by: 1) taking the density (aka load-factor) into
-      // account and 2) taking into account that for every lookup we may
-      // actually check two buckets: the primary and the secondary.
-      actual_scan_rate *= bucket_density * 2;
-      if (actual_scan_rate <= scan_rate) break;
-    }
-    // Check if can reach the desired scan rate.
-    assert(num_bits != 65);
-
-    // We have successfully determined `num_bits` => set the actual slots.
-    for (size_t i = 0; i < slots_per_bucket; ++i) {
-      const size_t slot = bucket_id * slots_per_bucket + i;
-      Fingerprint& fp = (*slot_fingerprints)[slot];
-      if (i >= bucket.slots_.size()) {
-        fp.active = false;
-        fp.num_bits = 0;
-        fp.fingerprint = 0ULL;
+      // Start by determining the minimum number of bits needed to avoid
+      // collisions of values which are contained in the bucket or were kicked
+      // from this bucket (which was their primary bucket).
+      possibly_colliding_fingerprints.clear();
+      for (const CuckooValue& value : bucket.slots_)
+        possibly_colliding_fingerprints.push_back(value.fingerprint);
+      for (const CuckooValue& value : bucket.kicked_)
+        possibly_colliding_fingerprints.push_back(value.fingerprint);
+      bool use_prefix_bits = false;
+      size_t num_bits;
+      if (prefix_bits_optimization) {
+        num_bits = GetMinCollisionFreeFingerprintPrefixOrSuffix(
+            possibly_colliding_fingerprints, &use_prefix_bits);
+        (*use_prefix_bits_bitmap)->Set(bucket_id, use_prefix_bits);
       } else {
-        fp.active = true;
-        fp.num_bits = num_bits;
-        fp.fingerprint =
-            prefix_bits_optimization && use_prefix_bits
-                ? GetFingerprintPrefix(bucket.slots_[i].fingerprint, num_bits)
-                : GetFingerprintSuffix(bucket.slots_[i].fingerprint, num_bits);
-        (*slot_bitmaps)[slot] =
-            std::move((*value_to_bitmap)[bucket.slots_[i].orig_value]);
+        num_bits = GetMinCollisionFreeFingerprintLength(
+            possibly_colliding_fingerprints, /*use_prefix_bits=*/false);
+      }
+
+      // Now add more bits if needed to ensure the desired `scan_rate`. The
+      // stripe densities don't depend on `num_bits`, so compute them once.
+      // Empty buckets have no active slots, so their `num_bits` don't matter.
+      if (!bucket.slots_.empty()) {
+        double sum_stripe_density = 0.0;
+        for (const CuckooValue& value : bucket.slots_) {
+          sum_stripe_density +=
+              static_cast<double>(
+                  value_to_stripes.find(value.orig_value)->second.size()) /
+              num_stripes;
+        }
+        num_bits = GetNumBitsForScanRate(
+            scan_rate, sum_stripe_density / bucket.slots_.size(),
+            bucket_density, num_bits);
+      }
+
+      // We have successfully determined `num_bits` => set the actual slots.
+      for (size_t i = 0; i < slots_per_bucket; ++i) {
+        const size_t slot = bucket_id * slots_per_bucket + i;
+        Fingerprint& fp = (*slot_fingerprints)[slot];
+        if (i >= bucket.slots_.size()) {
+          fp.active = false;
+          fp.num_bits = 0;
+          fp.fingerprint = 0ULL;
+        } else {
+          fp.active = true;
+          fp.num_bits = num_bits;
+          fp.fingerprint =
+              use_prefix_bits
+                  ? GetFingerprintPrefix(bucket.slots_[i].fingerprint, num_bits)
+                  : GetFingerprintSuffix(bucket.slots_[i].fingerprint, num_bits);
+          (*slot_stripes)[slot] =
+              &value_to_stripes.find(bucket.slots_[i].orig_value)->second;
+        }
       }
     }
-  }
+  };
+  ForEachChunkInParallel(
+      num_buckets,
+      std::max<size_t>(1, std::min(num_threads, num_buckets / 64)),
+      /*alignment=*/64, create_slots);
 }
 
-// Returns the fingerprints and bitmaps encoded in a compact manner.
-std::string Encode(const FingerprintStore& fingerprint_store,
+// Returns the fingerprints and bitmaps encoded in a compact manner. This is
+// also the on-disk format read by CuckooIndex::Open(..). For `chunk_size` > 0,
+// the fingerprints and the slot bitmaps are compressed in chunks of about
+// that many bytes instead (the format read by CuckooIndex::OpenCompressed(..)).
+// If given, sets `breakdown` to the sizes of the encoded parts (see
+// CuckooIndex::byte_size_breakdown()).
+std::string Encode(const std::string& name, const size_t num_stripes,
+                   const FingerprintStore& fingerprint_store,
                    const size_t slots_per_bucket,
                    const bool prefix_bits_optimization,
                    const Bitmap64Ptr& prefix_bits_bitmap,
-                   const RleBitmap& global_slot_bitmap) {
+                   const SlotBitmaps& slot_bitmaps,
+                   const HashingScheme hashing_scheme,
+                   const size_t chunk_size = 0,
+                   std::vector<ByteSizeComponent>* breakdown = nullptr) {
   ByteBuffer result;
-  PutString(fingerprint_store.Encode(), &result);
-  const size_t fp_size = result.pos();
-  std::cout << "Encoded fingerprints: " << fp_size << std::endl;
+  // Header with the parameters needed to answer lookups.
+  PutString(name, &result);
+  PutVarint32(num_stripes, &result);
+  PutVarint32(slots_per_bucket, &result);
+
+  FingerprintStore::EncodedSizes fingerprint_store_sizes;
+  PutString(chunk_size == 0
+                ? fingerprint_store.Encode(/*bitmaps_only=*/false,
+                                           &fingerprint_store_sizes)
+                : fingerprint_store.EncodeCompressed(chunk_size,
+                                                     &fingerprint_store_sizes),
+            &result);
 
   // Flag that denotes whether we use the prefix bits optimization. If set, the
   // flag is followed by the prefix bits bitmap.
   PutPrimitive(prefix_bits_optimization, &result);
+  const size_t before_prefix_bits_bitmap = result.pos();
   if (prefix_bits_optimization) {
     // Encode prefix bits bitmap as RleBitmap (util::bitmap::DenseEncode() needs
     // significantly more space in sparse cases).
     const RleBitmap rle_bitmap(*prefix_bits_bitmap);
     PutString(rle_bitmap.data(), &result);
-    std::cout << "Encoded prefix bits bitmap: " << result.pos() - fp_size
-              << std::endl;
   }
 
-  // Add the global bitmap, encoded as RleBitmap.
+  // Add the slot bitmaps (in the format of their encoding).
   const size_t before_global_bitmap = result.pos();
-  PutString(global_slot_bitmap.data(), &result);
-  std::cout << "Encoded bitmaps: " << result.pos() - before_global_bitmap
-            << std::endl;
+  const size_t prefix_bits_bitmap_size =
+      before_global_bitmap - before_prefix_bits_bitmap;
+  if (chunk_size == 0) {
+    PutString(slot_bitmaps.data(), &result);
+  } else {
+    // The bitmaps only exist for non-empty slots.
+    const size_t num_active_slots =
+        fingerprint_store.EmptySlotsBitmap().GetZeroesCount();
+    PutString(CompressedSlotBitmaps::Encode(slot_bitmaps, num_active_slots,
+                                            chunk_size),
+              &result);
+  }
+  const size_t slot_bitmaps_size = result.pos() - before_global_bitmap;
+
+  // Other hashing schemes than the original one and other slot bitmap
+  // encodings than RLE are denoted by an optional trailer, so that earlier
+  // encodings remain valid. Compressed bitmaps store their encoding
+  // themselves.
+  const bool has_slot_bitmap_encoding =
+      chunk_size == 0 && slot_bitmaps.encoding() != SlotBitmapEncoding::RLE;
+  if (hashing_scheme != HashingScheme::SEEDED_CITY64 ||
+      has_slot_bitmap_encoding)
+    PutVarint32(static_cast<uint32_t>(hashing_scheme), &result);
+  if (has_slot_bitmap_encoding)
+    PutVarint32(static_cast<uint32_t>(slot_bitmaps.encoding()), &result);
+
+  if (breakdown != nullptr) {
+    *breakdown = {
+        {"fingerprints", fingerprint_store_sizes.fingerprints},
+        {"block_bitmaps", fingerprint_store_sizes.block_bitmaps},
+        {"empty_slots_bitmap", fingerprint_store_sizes.empty_slots_bitmap},
+        {"prefix_bits_bitmap", prefix_bits_bitmap_size},
+        {"slot_bitmaps", slot_bitmaps_size}};
+    // The rest are the headers, flags and length prefixes.
+    size_t other_size = result.pos();
+    for (const ByteSizeComponent& component : *breakdown)
+      other_size -= component.byte_size;
+    breakdown->push_back({"other", other_size});
+  }
   return std::string(result.data(), result.pos());
 }
 
 }  // namespace
 
+std::unique_ptr<CuckooIndex> CuckooIndex::Open(absl::string_view data,
+                                               size_t fingerprint_directory,
+                                               bool cache_line_fingerprints) {
+  return Decode(data, fingerprint_directory, cache_line_fingerprints,
+                /*compressed=*/false, /*max_cached_chunks=*/0);
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndex::OpenCompressed(
+    absl::string_view data, size_t max_cached_chunks) {
+  return Decode(data, /*fingerprint_directory=*/0,
+                /*cache_line_fingerprints=*/false, /*compressed=*/true,
+                max_cached_chunks);
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndex::Decode(absl::string_view data,
+                                                 size_t fingerprint_directory,
+                                                 bool cache_line_fingerprints,
+                                                 bool compressed,
+                                                 size_t max_cached_chunks) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  const std::string name(GetString(span, &pos));
+  const size_t num_stripes = GetVarint32(span, &pos);
+  const size_t slots_per_bucket = GetVarint32(span, &pos);
+
+  const absl::string_view encoded_fingerprint_store = GetString(span, &pos);
+  std::unique_ptr<FingerprintStore> fingerprint_store =
+      compressed ? FingerprintStore::DecodeCompressed(encoded_fingerprint_store,
+                                                      max_cached_chunks)
+                 : FingerprintStore::Decode(encoded_fingerprint_store);
+  if (fingerprint_directory > 0)
+    fingerprint_store->InitDirectory(fingerprint_directory);
+  if (cache_line_fingerprints) fingerprint_store->InitCacheLines();
+
+  // The prefix bits bitmap has a single bit per bucket => expand it, so that
+  // BucketContains(..) doesn't need to scan the RLE encoding for every lookup.
+  Bitmap64Ptr use_prefix_bits_bitmap;
+  if (GetPrimitive<bool>(span, &pos)) {
+    const RleBitmapPtr rle_bitmap = RleBitmap::Decode(GetString(span, &pos));
+    use_prefix_bits_bitmap = absl::make_unique<Bitmap64>(
+        rle_bitmap->Extract(/*offset=*/0, /*size=*/rle_bitmap->size()));
+  }
+
+  const absl::string_view encoded_slot_bitmaps = GetString(span, &pos);
+
+  HashingScheme hashing_scheme = HashingScheme::SEEDED_CITY64;
+  if (pos < data.size())
+    hashing_scheme = static_cast<HashingScheme>(GetVarint32(span, &pos));
+  SlotBitmapEncoding slot_bitmap_encoding = SlotBitmapEncoding::RLE;
+  if (pos < data.size())
+    slot_bitmap_encoding =
+        static_cast<SlotBitmapEncoding>(GetVarint32(span, &pos));
+  assert(pos == data.size());
+  SlotBitmapsPtr slot_bitmaps =
+      compressed ? absl::make_unique<CompressedSlotBitmaps>(
+                       num_stripes, encoded_slot_bitmaps, max_cached_chunks)
+                 : SlotBitmaps::Decode(slot_bitmap_encoding, num_stripes,
+                                       encoded_slot_bitmaps);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  std::unique_ptr<CuckooIndex> index = absl::WrapUnique<CuckooIndex>(
+      new CuckooIndex(name, num_stripes, slots_per_bucket,
+                      std::move(fingerprint_store),
+                      std::move(use_prefix_bits_bitmap),
+                      std::move(slot_bitmaps), hashing_scheme));
+  index->encoded_ = data;
+  index->compressed_ = compressed;
+  return index;
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndex::OpenFile(
+    const std::string& path, size_t fingerprint_directory,
+    bool cache_line_fingerprints) {
+  MappedFilePtr mapped_file = MappedFile::Open(path);
+  std::unique_ptr<CuckooIndex> index = Open(
+      mapped_file->data(), fingerprint_directory, cache_line_fingerprints);
+  index->mapped_file_ = std::move(mapped_file);
+  return index;
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndex::OpenCompressedFile(
+    const std::string& path, size_t max_cached_chunks) {
+  MappedFilePtr mapped_file = MappedFile::Open(path);
+  std::unique_ptr<CuckooIndex> index =
+      OpenCompressed(mapped_file->data(), max_cached_chunks);
+  index->mapped_file_ = std::move(mapped_file);
+  return index;
+}
+
+std::string CuckooIndex::EncodeSlotKeys() const {
+  ByteBuffer result;
+  PutVarint32(slot_keys_.size(), &result);
+  for (const long key : slot_keys_) PutPrimitive(key, &result);
+  return std::string(result.data(), result.pos());
+}
+
+void CuckooIndex::DecodeSlotKeys(absl::string_view data) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  const size_t num_keys = GetVarint32(span, &pos);
+  if (num_keys != active_slots()) {
+    std::cerr << "Expected " << active_slots()
+              << " slot keys, got " << num_keys << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  slot_keys_.clear();
+  slot_keys_.reserve(num_keys);
+  for (size_t i = 0; i < num_keys; ++i)
+    slot_keys_.push_back(GetPrimitive<long>(span, &pos));
+  assert(pos == data.size());
+}
+
+std::string CuckooIndex::Encode() const {
+  CheckNotCompressed();
+  return ci::Encode(name_, num_stripes_, *fingerprint_store_,
+                    slots_per_bucket_,
+                    /*prefix_bits_optimization=*/use_prefix_bits_bitmap_ !=
+                        nullptr,
+                    use_prefix_bits_bitmap_, *slot_bitmaps_, hashing_scheme_);
+}
+
+std::string CuckooIndex::EncodeCompressed(size_t chunk_size) const {
+  CheckNotCompressed();
+  assert(chunk_size > 0);
+  return ci::Encode(name_, num_stripes_, *fingerprint_store_,
+                    slots_per_bucket_,
+                    /*prefix_bits_optimization=*/use_prefix_bits_bitmap_ !=
+                        nullptr,
+                    use_prefix_bits_bitmap_, *slot_bitmaps_, hashing_scheme_,
+                    chunk_size);
+}
+
+std::vector<ByteSizeComponent> CuckooIndex::byte_size_breakdown() const {
+  // The parts of compressed encodings aren't re-encoded.
+  if (compressed_) return IndexStructure::byte_size_breakdown();
+  std::vector<ByteSizeComponent> breakdown;
+  ci::Encode(name_, num_stripes_, *fingerprint_store_, slots_per_bucket_,
+             /*prefix_bits_optimization=*/use_prefix_bits_bitmap_ != nullptr,
+             use_prefix_bits_bitmap_, *slot_bitmaps_, hashing_scheme_,
+             /*chunk_size=*/0, &breakdown);
+  return breakdown;
+}
+
 bool CuckooIndex::StripeContains(size_t stripe_id, long value) const {
-  const CuckooValue val(value, num_buckets_);
-  size_t slot;
-  if (!BucketContains(val.primary_bucket, val.fingerprint, &slot)) {
-    if (!BucketContains(val.secondary_bucket, val.fingerprint, &slot))
-      return false;
+  size_t actual_slot;
+  if (!FindNonEmptySlot(value, &actual_slot)) return false;
+  return slot_bitmaps_->Get(actual_slot, stripe_id);
+}
+
+void CuckooIndex::FillQualifyingStripes(long value, size_t num_stripes,
+                                        Bitmap64* result) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  size_t actual_slot;
+  if (!FindNonEmptySlot(value, &actual_slot)) {
+    // Not found. Return an empty bitmap.
+    result->Reset(num_stripes);
+    return;
   }
+  slot_bitmaps_->ExtractInto(actual_slot, /*size=*/num_stripes, result);
+}
 
-  // Inactive slots are empty and their corresponding bitmaps are skipped in the
-  // `global_slot_bitmap_`, so we need to compute the actual slot by subtracting
-  // the number of skipped (empty) slots before `slot`.
-  const size_t actual_slot = GetNthNonEmptyBitmapSlot(slot);
-  const size_t global_slot_bitmap_offset =
-      num_stripes_ * actual_slot + stripe_id;
-  return global_slot_bitmap_->Get(global_slot_bitmap_offset);
+void CuckooIndex::FillQualifyingStripeIds(
+    long value, size_t num_stripes, std::vector<uint32_t>* stripe_ids) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  size_t actual_slot;
+  if (!FindNonEmptySlot(value, &actual_slot)) {
+    stripe_ids->clear();
+    return;
+  }
+  slot_bitmaps_->TrueBitIndices(actual_slot, /*size=*/num_stripes, stripe_ids);
 }
 
-Bitmap64 CuckooIndex::GetQualifyingStripes(long value,
-                                           size_t num_stripes) const {
-  const CuckooValue val(value, num_buckets_);
-  size_t slot;
-  if (!BucketContains(val.primary_bucket, val.fingerprint, &slot)) {
-    if (!BucketContains(val.secondary_bucket, val.fingerprint, &slot)) {
-      // Not found. Return an empty bitmap.
-      return Bitmap64(/*size=*/num_stripes);
+void CuckooIndex::FilterQualifyingStripes(long value,
+                                          Bitmap64* candidates) const {
+  CheckNumStripes(candidates->bits(), num_stripes_);
+  size_t actual_slot;
+  if (!FindNonEmptySlot(value, &actual_slot)) {
+    candidates->Reset(candidates->bits());
+    return;
+  }
+  slot_bitmaps_->IntersectInto(actual_slot, candidates);
+}
+
+double CuckooIndex::EstimateSelectivity(long value) const {
+  size_t actual_slot;
+  if (num_stripes_ == 0 || !FindNonEmptySlot(value, &actual_slot)) return 0.0;
+  return static_cast<double>(slot_bitmaps_->GetOnesCount(actual_slot)) /
+         num_stripes_;
+}
+
+std::vector<Bitmap64> CuckooIndex::GetQualifyingStripesBatch(
+    absl::Span<const long> values, size_t num_stripes) const {
+  return (this->*lookup_fns_.get_qualifying_stripes_batch)(values,
+                                                          num_stripes);
+}
+
+template <size_t kSlotsPerBucket, bool kHasPrefixBits>
+std::vector<Bitmap64> CuckooIndex::GetQualifyingStripesBatchImpl(
+    absl::Span<const long> values, size_t num_stripes) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  // (1) Hash the whole batch.
+  std::vector<CuckooValue> hashed_values;
+  hashed_values.reserve(values.size());
+  for (const long value : values)
+    hashed_values.push_back(CuckooValue(value, num_buckets_, hashing_scheme_));
+
+  // (2) Prefetch both candidate buckets of the values of a group (see
+  // FingerprintStore::PrefetchBucket(..)). Each group prefetches the next one
+  // before resolving its own lookups, i.e., the misses of the next group
+  // overlap with the work of the current one.
+  const auto prefetch_group = [&](size_t begin) {
+    const size_t end =
+        std::min(hashed_values.size(), begin + kLookupGroupSize);
+    for (size_t i = begin; i < end; ++i) {
+      const CuckooValue& val = hashed_values[i];
+      fingerprint_store_->PrefetchBucket(val.primary_bucket);
+      fingerprint_store_->PrefetchBucket(val.secondary_bucket);
+      if (kHasPrefixBits) {
+        use_prefix_bits_bitmap_->Prefetch(val.primary_bucket);
+        use_prefix_bits_bitmap_->Prefetch(val.secondary_bucket);
+      }
+    }
+  };
+  prefetch_group(/*begin=*/0);
+
+  std::vector<Bitmap64> results;
+  results.reserve(values.size());
+  // Per-group bucket metadata, indexed by 2 * (i - begin) (+ 1 for secondary).
+  bool bucket_empty[2 * kLookupGroupSize];
+  bool use_prefix_bits[2 * kLookupGroupSize];
+  for (size_t begin = 0; begin < hashed_values.size();
+       begin += kLookupGroupSize) {
+    const size_t end =
+        std::min(hashed_values.size(), begin + kLookupGroupSize);
+    prefetch_group(end);
+
+    // (3) Load the metadata of both candidate buckets of the whole group.
+    // These loads are independent of each other, i.e., their cache misses
+    // overlap (if not prefetched already).
+    for (size_t i = begin; i < end; ++i) {
+      const CuckooValue& val = hashed_values[i];
+      const size_t j = 2 * (i - begin);
+      bucket_empty[j] = IsBucketEmpty<kSlotsPerBucket>(val.primary_bucket);
+      bucket_empty[j + 1] =
+          IsBucketEmpty<kSlotsPerBucket>(val.secondary_bucket);
+      use_prefix_bits[j] = UsePrefixBits<kHasPrefixBits>(val.primary_bucket);
+      use_prefix_bits[j + 1] =
+          UsePrefixBits<kHasPrefixBits>(val.secondary_bucket);
+    }
+
+    // (4) Resolve the lookups, skipping empty buckets.
+    for (size_t i = begin; i < end; ++i) {
+      const CuckooValue& val = hashed_values[i];
+      const size_t j = 2 * (i - begin);
+      size_t slot;
+      bool found = !bucket_empty[j] &&
+                   BucketContains<kSlotsPerBucket>(
+                       val.primary_bucket, val.fingerprint,
+                       use_prefix_bits[j], &slot);
+      if (found) {
+        CUCKOO_INDEX_COUNT_LOOKUP(PrimaryBucketHits, 1);
+      } else {
+        found = !bucket_empty[j + 1] &&
+                BucketContains<kSlotsPerBucket>(
+                    val.secondary_bucket, val.fingerprint,
+                    use_prefix_bits[j + 1], &slot);
+        if (found) CUCKOO_INDEX_COUNT_LOOKUP(SecondaryBucketHits, 1);
+      }
+      if (!found) {
+        results.push_back(Bitmap64(/*size=*/num_stripes));
+        continue;
+      }
+      const size_t actual_slot =
+          GetNthNonEmptyBitmapSlot<kSlotsPerBucket>(slot);
+      results.emplace_back();
+      slot_bitmaps_->ExtractInto(actual_slot, /*size=*/num_stripes,
+                                 &results.back());
     }
   }
+  return results;
+}
 
-  const size_t actual_slot = GetNthNonEmptyBitmapSlot(slot);
-  return global_slot_bitmap_->Extract(/*offset=*/num_stripes_ * actual_slot,
-                                      /*size=*/num_stripes_);
+Bitmap64 CuckooIndex::GetQualifyingStripesForAny(
+    absl::Span<const long> values, size_t num_stripes) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  // Collect the distinct slots of all found values, in the order of their
+  // bitmaps in `slot_bitmaps_`.
+  std::vector<size_t> slots;
+  slots.reserve(values.size());
+  size_t actual_slot;
+  for (const long value : values) {
+    if (FindNonEmptySlot(value, &actual_slot)) slots.push_back(actual_slot);
+  }
+  if (slots.empty()) return Bitmap64(/*size=*/num_stripes);
+  std::sort(slots.begin(), slots.end());
+  slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+  Bitmap64 result;
+  slot_bitmaps_->ExtractUnionInto(slots, &result);
+  if (num_stripes == num_stripes_) return result;
+  // Only keep the first `num_stripes` bits, like the not-found path above.
+  Bitmap64 prefix;
+  prefix.Assign(Bitmap64View(result.view().data(), num_stripes));
+  return prefix;
+}
+
+Roaring CuckooIndex::GetQualifyingStripesRoaring(long value) const {
+  size_t actual_slot;
+  if (!FindNonEmptySlot(value, &actual_slot)) return Roaring();
+  return slot_bitmaps_->ToRoaring(actual_slot);
+}
+
+CuckooIndex::LookupFns CuckooIndex::GetLookupFns(
+    size_t slots_per_bucket, bool has_prefix_bits_bitmap) {
+  switch (slots_per_bucket) {
+    case 1:
+      return GetLookupFns<1>(has_prefix_bits_bitmap);
+    case 2:
+      return GetLookupFns<2>(has_prefix_bits_bitmap);
+    case 4:
+      return GetLookupFns<4>(has_prefix_bits_bitmap);
+    case 8:
+      return GetLookupFns<8>(has_prefix_bits_bitmap);
+    default:
+      return GetLookupFns<0>(has_prefix_bits_bitmap);
+  }
+}
+
+template <size_t kSlotsPerBucket>
+CuckooIndex::LookupFns CuckooIndex::GetLookupFns(bool has_prefix_bits_bitmap) {
+  if (has_prefix_bits_bitmap) {
+    return LookupFns{
+        &CuckooIndex::FindNonEmptySlotImpl<kSlotsPerBucket, true>,
+        &CuckooIndex::GetQualifyingStripesBatchImpl<kSlotsPerBucket, true>};
+  }
+  return LookupFns{
+      &CuckooIndex::FindNonEmptySlotImpl<kSlotsPerBucket, false>,
+      &CuckooIndex::GetQualifyingStripesBatchImpl<kSlotsPerBucket, false>};
 }
 
+template <size_t kSlotsPerBucket, bool kHasPrefixBits>
+bool CuckooIndex::FindNonEmptySlotImpl(long value, size_t* actual_slot) const {
+  const CuckooValue val(value, num_buckets_, hashing_scheme_);
+  size_t slot;
+  if (BucketContains<kSlotsPerBucket>(
+          val.primary_bucket, val.fingerprint,
+          UsePrefixBits<kHasPrefixBits>(val.primary_bucket), &slot)) {
+    CUCKOO_INDEX_COUNT_LOOKUP(PrimaryBucketHits, 1);
+  } else if (BucketContains<kSlotsPerBucket>(
+                 val.secondary_bucket, val.fingerprint,
+                 UsePrefixBits<kHasPrefixBits>(val.secondary_bucket), &slot)) {
+    CUCKOO_INDEX_COUNT_LOOKUP(SecondaryBucketHits, 1);
+  } else {
+    return false;
+  }
+
+  // Inactive slots are empty and their corresponding bitmaps are skipped in the
+  // `slot_bitmaps_`, so we need to compute the actual slot by subtracting
+  // the number of skipped (empty) slots before `slot`.
+  *actual_slot = GetNthNonEmptyBitmapSlot<kSlotsPerBucket>(slot);
+  return true;
+}
+
+template <size_t kSlotsPerBucket>
 bool CuckooIndex::BucketContains(size_t bucket, uint64_t fingerprint,
-                                 size_t* slot) const {
-  const bool use_prefix_bits = use_prefix_bits_bitmap_ == nullptr
-                                   ? false
-                                   : use_prefix_bits_bitmap_->Get(bucket);
+                                 bool use_prefix_bits, size_t* slot) const {
+  CUCKOO_INDEX_COUNT_LOOKUP(BucketsProbed, 1);
+  // With a compile-time number of slots, the loads and compares below are
+  // fully unrolled and the bucket offset is a shift.
+  const size_t slots_per_bucket =
+      kSlotsPerBucket == 0 ? slots_per_bucket_ : kSlotsPerBucket;
+  if (kSlotsPerBucket > 0 ||
+      (slots_per_bucket > 1 &&
+       slots_per_bucket <= kMaxSlotsPerBucketForBucketProbe)) {
+    uint64_t fingerprints[kMaxSlotsPerBucketForBucketProbe];
+    size_t num_bits;
+    const uint32_t active_mask =
+        fingerprint_store_->GetBucketFingerprints<kSlotsPerBucket>(
+            bucket, fingerprints, &num_bits);
+    if (active_mask == 0) return false;
+    // All fingerprints of a bucket have the same length, so the probe only
+    // needs to be masked once.
+    const uint64_t probe = use_prefix_bits
+                               ? GetFingerprintPrefix(fingerprint, num_bits)
+                               : GetFingerprintSuffix(fingerprint, num_bits);
+    const uint32_t match_mask =
+        GetFingerprintMatchMask(fingerprints, slots_per_bucket, probe) &
+        active_mask;
+    if (match_mask == 0) return false;
+    *slot = bucket * slots_per_bucket + __builtin_ctz(match_mask);
+    return true;
+  }
+
   for (*slot = bucket * slots_per_bucket_;
        *slot < (bucket + 1) * slots_per_bucket_; ++(*slot)) {
     const Fingerprint& fp = fingerprint_store_->GetFingerprint(*slot);
@@ -290,14 +886,37 @@ bool CuckooIndex::BucketContains(size_t bucket, uint64_t fingerprint,
 
 std::unique_ptr<IndexStructure> CuckooIndexFactory::Create(
     const Column& column, size_t num_rows_per_stripe) const {
-  absl::flat_hash_map<long, Bitmap64Ptr> value_to_bitmap =
-      ValueToStripeBitmaps(column, num_rows_per_stripe);
-  // Fetch the set of distinct-values in `value_to_bitmap`. Note that this is
-  // not necessarily the same as column.distinct_values(), since rows may have
-  // been dropped at the end (so each stripe has the same size).
-  absl::flat_hash_set<long> distinct_values;
-  distinct_values.reserve(value_to_bitmap.size());
-  for (const auto& [value, _] : value_to_bitmap) distinct_values.insert(value);
+  std::vector<StripeSetArena> arenas;
+  return CreateFromStripeSets(
+      ValueToStripeSets(column, num_rows_per_stripe, num_threads_, &arenas),
+      /*num_stripes=*/column.num_rows() / num_rows_per_stripe);
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndexFactory::CreateMergeable(
+    const Column& column, size_t num_rows_per_stripe) const {
+  std::vector<StripeSetArena> arenas;
+  return CreateFromStripeSets(
+      ValueToStripeSets(column, num_rows_per_stripe, num_threads_, &arenas),
+      /*num_stripes=*/column.num_rows() / num_rows_per_stripe,
+      /*keep_slot_keys=*/true);
+}
+
+IndexStructureBuilderPtr CuckooIndexFactory::CreateBuilder() const {
+  return absl::make_unique<CuckooIndexBuilder>(*this);
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndexFactory::CreateFromStripeSets(
+    const absl::flat_hash_map<long, StripeSet>& value_to_stripes,
+    size_t num_stripes, bool keep_slot_keys) const {
+  // Fetch the distinct values in `value_to_stripes`. Note that this is not
+  // necessarily the same as column.distinct_values(), since rows may have been
+  // dropped at the end (so each stripe has the same size). Sorted, so that the
+  // distribution doesn't depend on how `value_to_stripes` was built.
+  std::vector<long> distinct_values;
+  distinct_values.reserve(value_to_stripes.size());
+  for (const auto& [value, _] : value_to_stripes)
+    distinct_values.push_back(value);
+  std::sort(distinct_values.begin(), distinct_values.end());
 
   size_t num_buckets = GetMinNumBuckets(distinct_values.size(),
                                         slots_per_bucket_, max_load_factor_);
@@ -305,6 +924,12 @@ std::unique_ptr<IndexStructure> CuckooIndexFactory::Create(
   std::vector<Bucket> buckets;
   {
     ScopedProfile profile(Counter::DistributeValues);
+    // The matching finds a placement whenever one exists, so it only grows the
+    // number of buckets when none exists (rather than when kicking gives up).
+    if (cuckoo_alg_ == CuckooAlgorithm::MATCHING) {
+      buckets = DistributeToFirstFeasibleNumBuckets(
+          num_buckets, slots_per_bucket_, hashing_scheme_, distinct_values);
+    }
     while (buckets.empty()) {
       std::cout << "Attempting to distribute " << distinct_values.size()
                 << " values to " << num_buckets << " buckets with "
@@ -313,49 +938,135 @@ std::unique_ptr<IndexStructure> CuckooIndexFactory::Create(
                     (slots_per_bucket_ * num_buckets)
                 << std::endl;
       buckets = Distribute(num_buckets, slots_per_bucket_, cuckoo_alg_,
+                           hashing_scheme_,
                            distinct_values);
       num_buckets =
           std::max(static_cast<size_t>(num_buckets * kNumBucketsGrowFactor),
                    num_buckets + 1);
     }
   }
+  Profiler::GetThreadInstance().Add(Counter::NumBuckets, buckets.size());
 
   std::vector<Fingerprint> slot_fingerprints;
   Bitmap64Ptr use_prefix_bits_bitmap;
-  std::vector<Bitmap64Ptr> slot_bitmaps;
-  CreateSlots(scan_rate_, slots_per_bucket_, buckets, &value_to_bitmap,
-              &slot_fingerprints, prefix_bits_optimization_,
-              &use_prefix_bits_bitmap, &slot_bitmaps);
+  std::vector<const StripeSet*> slot_stripes;
+  CreateSlots(scan_rate_, slots_per_bucket_, buckets, value_to_stripes,
+              num_stripes, &slot_fingerprints, prefix_bits_optimization_,
+              &use_prefix_bits_bitmap, &slot_stripes, num_threads_);
   std::unique_ptr<FingerprintStore> fingerprint_store;
   {
     ScopedProfile profile(Counter::CreateFingerprintStore);
     fingerprint_store = absl::make_unique<FingerprintStore>(
         slot_fingerprints, slots_per_bucket_,
         /*use_rle_to_encode_block_bitmaps=*/false);
+    if (fingerprint_directory_ > 0)
+      fingerprint_store->InitDirectory(fingerprint_directory_);
+    if (cache_line_fingerprints_) fingerprint_store->InitCacheLines();
   }
 
-  RleBitmapPtr global_slot_bitmap;
+  SlotBitmapsPtr slot_bitmaps;
   {
     ScopedProfile profile(Counter::GetGlobalBitmap);
-    global_slot_bitmap =
-        absl::make_unique<RleBitmap>(GetGlobalBitmap(slot_bitmaps));
+    std::vector<uint32_t> stripe_ids;
+    SlotBitmapEncoding encoding = slot_bitmap_encoding_;
+    if (encoding == SlotBitmapEncoding::ADAPTIVE) {
+      // Determine the density and clustering of all slot bitmaps.
+      size_t num_bits = 0;
+      size_t num_ones = 0;
+      size_t num_one_fills = 0;
+      for (const StripeSet* stripes : slot_stripes) {
+        if (stripes == nullptr) continue;
+        stripes->FillStripeIds(&stripe_ids);
+        num_bits += num_stripes;
+        num_ones += stripe_ids.size();
+        for (size_t i = 0; i < stripe_ids.size(); ++i) {
+          if (i == 0 || stripe_ids[i] != stripe_ids[i - 1] + 1)
+            ++num_one_fills;
+        }
+      }
+      encoding = ChooseSlotBitmapEncoding(num_bits, num_ones, num_one_fills);
+    }
+    // Encode the stripes of the active slots one after the other instead of
+    // concatenating them to an uncompressed global bitmap first.
+    SlotBitmapsBuilder builder(encoding, num_stripes);
+    for (const StripeSet* stripes : slot_stripes) {
+      if (stripes == nullptr) continue;
+      stripes->FillStripeIds(&stripe_ids);
+      builder.AddSlot(stripe_ids);
+    }
+    slot_bitmaps = builder.Build();
   }
 
-  const std::string data =
-      Encode(*fingerprint_store, slots_per_bucket_, prefix_bits_optimization_,
-             use_prefix_bits_bitmap, *global_slot_bitmap);
-
   // Need to use WrapUnique<>(..) since we're calling a private c'tor.
-  return absl::WrapUnique<CuckooIndex>(new CuckooIndex(
-      index_name(), /*num_stripes=*/column.num_rows() / num_rows_per_stripe,
-      slots_per_bucket_, std::move(fingerprint_store),
-      std::move(use_prefix_bits_bitmap), std::move(global_slot_bitmap),
-      data.size(), Compress(data).size()));
+  std::unique_ptr<CuckooIndex> index = absl::WrapUnique<CuckooIndex>(
+      new CuckooIndex(index_name(), num_stripes, slots_per_bucket_,
+                      std::move(fingerprint_store),
+                      std::move(use_prefix_bits_bitmap),
+                      std::move(slot_bitmaps), hashing_scheme_));
+  if (keep_slot_keys) {
+    // The active slots are the filled slots of the buckets in order.
+    index->slot_keys_.reserve(distinct_values.size());
+    for (const Bucket& bucket : buckets) {
+      for (const CuckooValue& value : bucket.slots_)
+        index->slot_keys_.push_back(value.orig_value);
+    }
+  }
+  return index;
+}
+
+std::unique_ptr<CuckooIndex> CuckooIndexFactory::Merge(
+    const CuckooIndex& lhs, const CuckooIndex& rhs) const {
+  for (const CuckooIndex* index : {&lhs, &rhs}) {
+    if (index->slot_keys_.size() != index->active_slots()) {
+      std::cerr << "Merging requires the slot keys of both indexes."
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  const size_t num_stripes = lhs.num_stripes_ + rhs.num_stripes_;
+  StripeSetArena arena(num_stripes);
+  absl::flat_hash_map<long, StripeSet> value_to_stripes;
+  value_to_stripes.reserve(lhs.slot_keys_.size() + rhs.slot_keys_.size());
+  {
+    ScopedProfile profile(Counter::ValueToStripeBitmaps);
+    std::vector<uint32_t> stripe_ids;
+    // Stripes of `lhs` come first, so each set is still added to in order.
+    size_t stripe_offset = 0;
+    for (const CuckooIndex* index : {&lhs, &rhs}) {
+      for (size_t slot = 0; slot < index->slot_keys_.size(); ++slot) {
+        index->slot_bitmaps_->TrueBitIndices(slot, index->num_stripes_,
+                                             &stripe_ids);
+        StripeSet& stripes = value_to_stripes[index->slot_keys_[slot]];
+        for (const uint32_t stripe_id : stripe_ids)
+          stripes.Add(stripe_offset + stripe_id, &arena);
+      }
+      stripe_offset += index->num_stripes_;
+    }
+  }
+  return CreateFromStripeSets(value_to_stripes, num_stripes,
+                              /*keep_slot_keys=*/true);
+}
+
+void CuckooIndexBuilder::AddStripe(absl::Span<const long> stripe) {
+  const uint32_t stripe_id = num_stripes_++;
+  for (const long value : stripe)
+    value_to_stripes_[value].Add(stripe_id, &arena_);
+}
+
+IndexStructurePtr CuckooIndexBuilder::Finish() {
+  return factory_.CreateFromStripeSets(value_to_stripes_, num_stripes_);
 }
 
 std::string CuckooIndexFactory::index_name() const {
-  return absl::StrCat("CuckooIndex:", cuckoo_alg_, ":", max_load_factor_, ":",
-                      scan_rate_);
+  std::string name = absl::StrCat("CuckooIndex:", cuckoo_alg_, ":",
+                                  max_load_factor_, ":", scan_rate_);
+  if (hashing_scheme_ != HashingScheme::SEEDED_CITY64)
+    absl::StrAppend(&name, ":hashing", static_cast<int32_t>(hashing_scheme_));
+  if (slot_bitmap_encoding_ != SlotBitmapEncoding::RLE) {
+    absl::StrAppend(&name, ":bitmaps",
+                    static_cast<int32_t>(slot_bitmap_encoding_));
+  }
+  return name;
 }
 
 }  // namespace ci
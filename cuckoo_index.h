@@ -19,27 +19,161 @@
 #ifndef CUCKOO_INDEX_CUCKOO_INDEX_H_
 #define CUCKOO_INDEX_CUCKOO_INDEX_H_
 
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
-#include "common/rle_bitmap.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/mapped_file.h"
+#include "common/memoized.h"
+#include "common/stripe_set.h"
 #include "cuckoo_utils.h"
 #include "fingerprint_store.h"
 #include "index_structure.h"
+#include "roaring.hh"
+#include "slot_bitmaps.h"
 
 namespace ci {
 
 class CuckooIndex : public IndexStructure {
  public:
+  // Opens a CuckooIndex from bytes previously returned by Encode(). Lookups are
+  // answered directly on the encoded fingerprint blocks and the encoded global
+  // slot bitmap, i.e., `data` is *not* copied and its lifetime must be longer
+  // than the lifetime of the returned index. For `fingerprint_directory` > 0,
+  // builds a fingerprint lookup directory with one entry per that many buckets
+  // (see FingerprintStore::InitDirectory(..)). For `cache_line_fingerprints`,
+  // additionally lays out the fingerprints in cache lines (see
+  // FingerprintStore::InitCacheLines()).
+  static std::unique_ptr<CuckooIndex> Open(absl::string_view data,
+                                           size_t fingerprint_directory = 0,
+                                           bool cache_line_fingerprints = false);
+
+  // Like Open(..), but memory-maps the file at `path`. The mapping is owned by
+  // the returned index.
+  static std::unique_ptr<CuckooIndex> OpenFile(
+      const std::string& path, size_t fingerprint_directory = 0,
+      bool cache_line_fingerprints = false);
+
+  // Opens a CuckooIndex from bytes previously returned by
+  // EncodeCompressed(..). Like Open(..), doesn't copy `data`. The fingerprints
+  // and the slot bitmaps are decompressed on demand, only the chunks touched
+  // by lookups, and each keeps up to `max_cached_chunks` decompressed chunks in
+  // an LRU cache. Opened compressed indexes can't be re-encoded.
+  static std::unique_ptr<CuckooIndex> OpenCompressed(
+      absl::string_view data, size_t max_cached_chunks);
+
+  // Like OpenCompressed(..), but memory-maps the file at `path`. The mapping
+  // is owned by the returned index.
+  static std::unique_ptr<CuckooIndex> OpenCompressedFile(
+      const std::string& path, size_t max_cached_chunks);
+
   bool StripeContains(size_t stripe_id, long value) const override;
 
-  Bitmap64 GetQualifyingStripes(long value, size_t num_stripes) const override;
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override;
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override;
+
+  // A lookup finds the stripe bitmap of all stripes at once, so this ANDs it
+  // into the `candidates` (unless the value isn't found at all), only decoding
+  // the range of the bitmap that has candidates.
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override;
+
+  // Returns the share of stripes set in the stripe bitmap of `value` (0 if the
+  // value isn't found at all).
+  double EstimateSelectivity(long value) const override;
+
+  // Hashes all `values` up front and then resolves them in small groups: the
+  // candidate buckets of the next group are prefetched while resolving the
+  // current one, and for each group, the empty-slot and prefix bits of all
+  // candidate buckets are loaded before any fingerprint is compared, so that
+  // their cache misses overlap instead of being serialized by the per-lookup
+  // control flow.
+  std::vector<Bitmap64> GetQualifyingStripesBatch(
+      absl::Span<const long> values, size_t num_stripes) const override;
+
+  // Looks up all `values`, dedupes the slots they map to and ORs the slots'
+  // stripe bitmaps (for RLE in a single forward pass over the encoding).
+  Bitmap64 GetQualifyingStripesForAny(absl::Span<const long> values,
+                                      size_t num_stripes) const override;
 
   std::string name() const override { return name_; }
 
   // Returns the in-memory size of the index structure.
-  size_t byte_size() const override { return byte_size_; }
+  size_t byte_size() const override {
+    if (!encoded_.empty()) return encoded_.size();
+    return byte_size_.Get([this]() { return Encode().size(); });
+  }
+
+  // Splits byte_size() into the fingerprints, the block bitmaps and the
+  // empty-slots bitmap of the FingerprintStore, the prefix-bits bitmap, the slot
+  // bitmaps (e.g., the global slot bitmap for RLE) and the rest (headers and
+  // length prefixes). Encodes the index, so only call it for stats.
+  std::vector<ByteSizeComponent> byte_size_breakdown() const override;
+
+  // Returns the in-memory size of the compressed index structure. Compresses
+  // the encoding on first use, since this is only needed for stats and would
+  // otherwise slow down building and opening indexes.
+  size_t compressed_byte_size() const override {
+    return compressed_byte_size_.Get([this]() {
+      return encoded_.empty() ? Compress(Encode()).size()
+                              : Compress(encoded_).size();
+    });
+  }
+
+  // Same as GetQualifyingStripes(..), but returns the stripes as Roaring bitmap
+  // for combining them with other Roaring bitmaps. Doesn't convert the slot
+  // bitmap for SlotBitmapEncoding::ROARING.
+  Roaring GetQualifyingStripesRoaring(long value) const;
+
+  // Returns the on-disk format of the index which can be passed to Open(..).
+  std::string Encode() const;
+
+  // Same as Encode(), but splits the fingerprint blocks and the slot bitmaps
+  // into chunks of about `chunk_size` (uncompressed) bytes which are
+  // compressed independently. Can be passed to OpenCompressed(..).
+  std::string EncodeCompressed(size_t chunk_size) const;
 
-  // Returns the in-memory size of the compressed index structure.
-  size_t compressed_byte_size() const override { return compressed_byte_size_; }
+  // Returns the chunks of the fingerprints for indexes opened with
+  // OpenCompressed(..), nullptr otherwise.
+  const FingerprintChunks* fingerprint_chunks() const {
+    return fingerprint_store_->fingerprint_chunks();
+  }
+
+  // Returns the slot bitmaps for indexes opened with OpenCompressed(..),
+  // nullptr otherwise.
+  const CompressedSlotBitmaps* compressed_slot_bitmaps() const {
+    return compressed_
+               ? static_cast<const CompressedSlotBitmaps*>(slot_bitmaps_.get())
+               : nullptr;
+  }
+
+  // Returns the keys of the active slots (in the order of their slot bitmaps),
+  // which are needed for merging indexes (see CuckooIndexFactory::Merge(..)).
+  // Only kept for indexes created with CreateMergeable(..) or Merge(..) or
+  // given a sidecar with DecodeSlotKeys(..), empty otherwise.
+  const std::vector<long>& slot_keys() const { return slot_keys_; }
+
+  // Returns the slot keys as sidecar to the encoding, i.e., they aren't part
+  // of Encode() (nor of byte_size()).
+  std::string EncodeSlotKeys() const;
+
+  // Sets the slot keys from a sidecar previously returned by EncodeSlotKeys(),
+  // e.g., for merging an opened index.
+  void DecodeSlotKeys(absl::string_view data);
+
+  // Returns how the slot bitmaps are stored (never ADAPTIVE).
+  SlotBitmapEncoding slot_bitmap_encoding() const {
+    return slot_bitmaps_->encoding();
+  }
 
   size_t active_slots() const {
     size_t active_slots = 0;
@@ -55,31 +189,90 @@ class CuckooIndex : public IndexStructure {
   CuckooIndex(std::string name, size_t num_stripes, size_t slots_per_bucket,
               std::unique_ptr<FingerprintStore> fingerprint_store,
               Bitmap64Ptr use_prefix_bits_bitmap,
-              RleBitmapPtr global_slot_bitmap, size_t byte_size,
-              size_t compressed_byte_size)
+              SlotBitmapsPtr slot_bitmaps, HashingScheme hashing_scheme)
       : name_(name),
         num_stripes_(num_stripes),
         num_buckets_(fingerprint_store->num_slots() / slots_per_bucket),
         slots_per_bucket_(slots_per_bucket),
         fingerprint_store_(std::move(fingerprint_store)),
         use_prefix_bits_bitmap_(std::move(use_prefix_bits_bitmap)),
-        global_slot_bitmap_(std::move(global_slot_bitmap)),
-        byte_size_(byte_size),
-        compressed_byte_size_(compressed_byte_size) {
+        slot_bitmaps_(std::move(slot_bitmaps)),
+        hashing_scheme_(hashing_scheme),
+        lookup_fns_(GetLookupFns(slots_per_bucket,
+                                 use_prefix_bits_bitmap_ != nullptr)) {
     assert(fingerprint_store_->num_slots() % slots_per_bucket_ == 0);
   }
 
+  // The lookup paths specialized on the number of slots per bucket
+  // (`kSlotsPerBucket`, 0 for other than 1, 2, 4 or 8 slots, i.e., the runtime
+  // value) and on whether there is a prefix-bits bitmap (`kHasPrefixBits`).
+  // Chosen once on construction, so lookups don't branch on these per slot.
+  struct LookupFns {
+    bool (CuckooIndex::*find_non_empty_slot)(long value,
+                                             size_t* actual_slot) const;
+    std::vector<Bitmap64> (CuckooIndex::*get_qualifying_stripes_batch)(
+        absl::Span<const long> values, size_t num_stripes) const;
+  };
+  static LookupFns GetLookupFns(size_t slots_per_bucket,
+                                bool has_prefix_bits_bitmap);
+  template <size_t kSlotsPerBucket>
+  static LookupFns GetLookupFns(bool has_prefix_bits_bitmap);
+
+  // Implements Open(..) and OpenCompressed(..).
+  static std::unique_ptr<CuckooIndex> Decode(absl::string_view data,
+                                             size_t fingerprint_directory,
+                                             bool cache_line_fingerprints,
+                                             bool compressed,
+                                             size_t max_cached_chunks);
+
+  void CheckNotCompressed() const {
+    if (compressed_) {
+      std::cerr << "Can't re-encode an index opened with OpenCompressed(..)."
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Looks up `value` in its primary and secondary bucket. In case it is found,
+  // sets `actual_slot` to its slot among the non-empty slots (i.e., its index
+  // in `slot_bitmaps_`) and returns true.
+  bool FindNonEmptySlot(long value, size_t* actual_slot) const {
+    return (this->*lookup_fns_.find_non_empty_slot)(value, actual_slot);
+  }
+
+  // The specializations of FindNonEmptySlot(..) and
+  // GetQualifyingStripesBatch(..), see LookupFns.
+  template <size_t kSlotsPerBucket, bool kHasPrefixBits>
+  bool FindNonEmptySlotImpl(long value, size_t* actual_slot) const;
+  template <size_t kSlotsPerBucket, bool kHasPrefixBits>
+  std::vector<Bitmap64> GetQualifyingStripesBatchImpl(
+      absl::Span<const long> values, size_t num_stripes) const;
+
   // Returns true if the given bucket contains the fingerprint (taking only
-  // the relevant bits into account). In case it does, `slot` is set to the
-  // slot which contains it (one of the `slots_per_bucket_` possible ones).
-  bool BucketContains(size_t bucket, uint64_t fingerprint, size_t* slot) const;
+  // the relevant bits into account, prefix bits iff `use_prefix_bits`). In
+  // case it does, `slot` is set to the slot which contains it (one of the
+  // `slots_per_bucket_` possible ones).
+  template <size_t kSlotsPerBucket>
+  bool BucketContains(size_t bucket, uint64_t fingerprint,
+                      bool use_prefix_bits, size_t* slot) const;
 
+  // Returns true if the bucket doesn't hold any value.
+  template <size_t kSlotsPerBucket>
+  bool IsBucketEmpty(size_t bucket) const {
+    return fingerprint_store_->IsBucketEmpty<kSlotsPerBucket>(bucket);
+  }
+
+  template <bool kHasPrefixBits>
+  bool UsePrefixBits(size_t bucket) const {
+    return kHasPrefixBits && use_prefix_bits_bitmap_->Get(bucket);
+  }
+
+  template <size_t kSlotsPerBucket>
   size_t GetNthNonEmptyBitmapSlot(size_t n) const {
     // Inactive slots are empty and their corresponding bitmaps are skipped in
-    // the `global_slot_bitmap_`, so we need to compute the actual slot by
+    // the `slot_bitmaps_`, so we need to compute the actual slot by
     // subtracting the number of skipped (empty) slots before `slot`.
-    return n -
-           fingerprint_store_->EmptySlotsBitmap().GetOnesCountBeforeLimit(n);
+    return fingerprint_store_->GetNumActiveSlotsBefore<kSlotsPerBucket>(n);
   }
 
   const std::string name_;
@@ -91,43 +284,99 @@ class CuckooIndex : public IndexStructure {
   // Indicates for every bucket whether prefix or suffix bits of hash
   // fingerprints were used.
   const Bitmap64Ptr use_prefix_bits_bitmap_;
-  // Concatenated slot bitmaps for *active* slots.
-  const RleBitmapPtr global_slot_bitmap_;
-
-  // The sizes of the encoded data-structures.
-  // TODO: after fine-tuning the encodings, actually store the encoded
-  // data-structures and add methods which serialize / deserialize for testing
-  // purposes. As follow-up also do the lookups based on these data-structures
-  // instead of the expanded Fingerprints and Bitmaps above.
-  const size_t byte_size_;
-  const size_t compressed_byte_size_;
+  // Stripe bitmaps of the *active* slots.
+  const SlotBitmapsPtr slot_bitmaps_;
+  // How values are mapped to buckets and fingerprints (see HashingScheme).
+  const HashingScheme hashing_scheme_;
+  const LookupFns lookup_fns_;
+  // The keys of the active slots, if kept (see slot_keys()).
+  std::vector<long> slot_keys_;
+
+  // The sizes of the encoded data-structures, computed on first use.
+  Memoized<size_t> byte_size_;
+  Memoized<size_t> compressed_byte_size_;
+
+  // Only set for opened indexes: the encoding referenced by the members above
+  // and, for OpenFile(..), the mapping holding it.
+  absl::string_view encoded_;
+  MappedFilePtr mapped_file_;
+  // Whether opened with OpenCompressed(..).
+  bool compressed_ = false;
 };
 
 // How the distribution of values to their primary / secondary bucket is chosen:
 // "Classically" by kicking out existing values (KICKING), using a biased coin
 // toss during the kicking procedure to increase the ratio of primary-bucket
-// placements (SKEWED_KICKING), or by finding an optimal solution via a
-// weighted-matching algorithm (MATCHING).
-enum class CuckooAlgorithm { KICKING, SKEWED_KICKING, MATCHING };
+// placements (SKEWED_KICKING), or by computing a maximum bipartite matching
+// between values and bucket slots (MATCHING). MATCHING finds a placement
+// whenever one exists, i.e., it only uses more buckets than the max load factor
+// requires if there's no placement for those.
+// BFS_KICKING kicks along the shortest eviction path found by a bounded
+// breadth-first search instead of a random walk.
+enum class CuckooAlgorithm { KICKING, SKEWED_KICKING, MATCHING, BFS_KICKING };
 
 class CuckooIndexFactory : public IndexStructureFactory {
  public:
   explicit CuckooIndexFactory(CuckooAlgorithm cuckoo_alg,
                               double max_load_factor, double scan_rate,
                               size_t slots_per_bucket,
-                              bool prefix_bits_optimization)
+                              bool prefix_bits_optimization,
+                              size_t fingerprint_directory = 0,
+                              HashingScheme hashing_scheme =
+                                  HashingScheme::SEEDED_CITY64,
+                              size_t num_threads = 1,
+                              SlotBitmapEncoding slot_bitmap_encoding =
+                                  SlotBitmapEncoding::RLE,
+                              bool cache_line_fingerprints = false)
       : cuckoo_alg_(cuckoo_alg),
         max_load_factor_(max_load_factor),
         scan_rate_(scan_rate),
         slots_per_bucket_(slots_per_bucket),
-        prefix_bits_optimization_(prefix_bits_optimization) {}
+        prefix_bits_optimization_(prefix_bits_optimization),
+        fingerprint_directory_(fingerprint_directory),
+        hashing_scheme_(hashing_scheme),
+        num_threads_(num_threads),
+        slot_bitmap_encoding_(slot_bitmap_encoding),
+        cache_line_fingerprints_(cache_line_fingerprints) {}
 
   std::unique_ptr<IndexStructure> Create(
       const Column& column, size_t num_rows_per_stripe) const override;
 
+  // Same as Create(..), but the index keeps the keys of its slots (see
+  // CuckooIndex::slot_keys()), so that it can be merged. Costs 8 bytes per
+  // distinct value.
+  std::unique_ptr<CuckooIndex> CreateMergeable(
+      const Column& column, size_t num_rows_per_stripe) const;
+
+  // Returns the index of the stripes of `lhs`, followed by the ones of `rhs`,
+  // i.e., the stripe ids of `rhs` are offset by the number of stripes of
+  // `lhs`. Both indexes need their slot keys (see CreateMergeable(..) and
+  // CuckooIndex::DecodeSlotKeys(..)), and so does the merged index.
+  //
+  // This is a rebuild from the slot keys and bitmaps of both indexes rather
+  // than an incremental merge: fingerprints can't be recomputed without the
+  // keys, and the bucket of every value changes with the number of buckets.
+  // I.e., all values are distributed anew and get fingerprints for the
+  // `scan_rate` w.r.t. the merged stripes. Still, the cost is proportional to
+  // the size of the indexes rather than to the number of rows.
+  std::unique_ptr<CuckooIndex> Merge(const CuckooIndex& lhs,
+                                     const CuckooIndex& rhs) const;
+
+  IndexStructureBuilderPtr CreateBuilder() const override;
+
   std::string index_name() const override;
 
  private:
+  friend class CuckooIndexBuilder;
+  friend class PartitionedCuckooIndexFactory;
+
+  // Creates the index from the sets of stripes (out of `num_stripes`) of all
+  // distinct values. If `keep_slot_keys` is set, the index keeps the keys of
+  // its slots (see CreateMergeable(..)).
+  std::unique_ptr<CuckooIndex> CreateFromStripeSets(
+      const absl::flat_hash_map<long, StripeSet>& value_to_stripes,
+      size_t num_stripes, bool keep_slot_keys = false) const;
+
   const CuckooAlgorithm cuckoo_alg_;
   const double max_load_factor_;
   const double scan_rate_;
@@ -136,6 +385,47 @@ class CuckooIndexFactory : public IndexStructureFactory {
   // on a bucket basis (depending on which of the two requires fewer bits to
   // make fingerprints collision free).
   const bool prefix_bits_optimization_;
+  // If > 0, the created indexes build a fingerprint lookup directory with one
+  // entry per `fingerprint_directory` buckets. Trades memory for faster
+  // lookups; 1 is the fastest setting. Doesn't change the encoded size.
+  const size_t fingerprint_directory_;
+  // How values are mapped to buckets and fingerprints. Other schemes than the
+  // default SEEDED_CITY64 hash each value only once.
+  const HashingScheme hashing_scheme_;
+  // Number of threads used to collect the stripe bitmaps of the values and to
+  // create the slots. Only affects the build time, not the created index.
+  const size_t num_threads_;
+  // How the slot bitmaps are stored. ADAPTIVE chooses the encoding per index
+  // from the density and clustering of its slot bitmaps.
+  const SlotBitmapEncoding slot_bitmap_encoding_;
+  // If set, the created indexes additionally lay out their fingerprints in
+  // cache lines, so that probing a bucket reads a single line (see
+  // FingerprintStore::InitCacheLines()). Trades memory for faster lookups.
+  // Doesn't change the encoded size.
+  const bool cache_line_fingerprints_;
+};
+
+// Builds a CuckooIndex stripe by stripe. Accumulates the ids of the stripes
+// each distinct value occurs in (rather than the rows), and creates the same
+// index as CuckooIndexFactory::Create(..) would for the concatenated stripes.
+class CuckooIndexBuilder : public IndexStructureBuilder {
+ public:
+  explicit CuckooIndexBuilder(const CuckooIndexFactory& factory)
+      : factory_(factory),
+        num_stripes_(0),
+        arena_(StripeSetArena::kUnknownNumStripes) {}
+
+  void AddStripe(absl::Span<const long> stripe) override;
+
+  IndexStructurePtr Finish() override;
+
+ private:
+  const CuckooIndexFactory& factory_;
+  size_t num_stripes_;
+  // The total number of stripes is only known in Finish(), so the sets keep
+  // the stripe ids (and never switch to bitmaps).
+  StripeSetArena arena_;
+  absl::flat_hash_map<long, StripeSet> value_to_stripes_;
 };
 
 }  // namespace ci
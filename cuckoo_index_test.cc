@@ -18,9 +18,16 @@
 
 #include "cuckoo_index.h"
 
+#include <cstdio>
+#include <fstream>
 #include <limits>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/strings/str_cat.h"
+#include "common/profiling.h"
 #include "cuckoo_utils.h"
 #include "data.h"
 #include "gmock/gmock.h"
@@ -47,15 +54,26 @@ ColumnPtr FillColumn(size_t num_rows, size_t num_values) {
   return Column::IntColumn("long-column", std::move(data));
 }
 
-// Checks that positive lookups are exact (for all values in the column).
+// Checks that positive lookups are exact (for all values in the column). Also
+// checks the variants writing to re-used buffers.
 void CheckPositiveLookups(const Column& column, const IndexStructure* index) {
   const size_t num_stripes = column.num_rows() / kNumRowsPerStripe;
+  Bitmap64 buffer;
+  std::vector<uint32_t> stripe_ids;
   for (const long value : column.distinct_values()) {
     const Bitmap64 result = index->GetQualifyingStripes(value, num_stripes);
+    index->FillQualifyingStripes(value, num_stripes, &buffer);
+    index->FillQualifyingStripeIds(value, num_stripes, &stripe_ids);
+    ASSERT_EQ(buffer.bits(), num_stripes);
+    std::vector<uint32_t> expected_stripe_ids;
     for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
-      EXPECT_EQ(column.StripeContains(kNumRowsPerStripe, stripe_id, value),
-                result.Get(stripe_id));
+      const bool expected =
+          column.StripeContains(kNumRowsPerStripe, stripe_id, value);
+      EXPECT_EQ(expected, result.Get(stripe_id));
+      EXPECT_EQ(expected, buffer.Get(stripe_id));
+      if (expected) expected_stripe_ids.push_back(stripe_id);
     }
+    EXPECT_EQ(stripe_ids, expected_stripe_ids);
   }
 }
 
@@ -122,6 +140,94 @@ void NegativeLookups(const size_t num_values,
   }
 }
 
+// Checks that an index opened from the encoding of a newly created index
+// returns the same results as the latter.
+void CheckOpenedIndex(const size_t num_values,
+                      const bool prefix_bits_optimization) {
+  const ColumnPtr column = FillColumn(kNumRows, num_values);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         prefix_bits_optimization)
+          .Create(*column, kNumRowsPerStripe);
+  const CuckooIndex& cuckoo_index = static_cast<const CuckooIndex&>(*index);
+  const std::string encoded = cuckoo_index.Encode();
+  EXPECT_EQ(encoded.size(), index->byte_size());
+  EXPECT_EQ(Compress(encoded).size(), index->compressed_byte_size());
+
+  const std::unique_ptr<CuckooIndex> opened = CuckooIndex::Open(encoded);
+  EXPECT_EQ(opened->name(), index->name());
+  EXPECT_EQ(opened->byte_size(), index->byte_size());
+  EXPECT_EQ(opened->compressed_byte_size(), index->compressed_byte_size());
+  EXPECT_EQ(opened->active_slots(), cuckoo_index.active_slots());
+  EXPECT_EQ(opened->Encode(), encoded);
+  CheckPositiveLookups(*column, opened.get());
+
+  // Negative lookups need to hit the same false-positive stripes.
+  const long start = column->max() + 1;
+  for (long value = start; value < start + kNumNegativeLookups; ++value) {
+    ASSERT_EQ(opened->GetQualifyingStripes(value, num_stripes).ToString(),
+              index->GetQualifyingStripes(value, num_stripes).ToString());
+  }
+}
+
+// Checks that GetQualifyingStripesBatch(..) agrees with GetQualifyingStripes(..)
+// for a mix of positive and negative lookups.
+void CheckBatchLookups(const size_t num_values,
+                       const bool prefix_bits_optimization) {
+  const ColumnPtr column = FillColumn(kNumRows, num_values);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         prefix_bits_optimization)
+          .Create(*column, kNumRowsPerStripe);
+
+  std::vector<long> values = column->distinct_values();
+  for (long value = column->max() + 1; value < column->max() + 1000; ++value)
+    values.push_back(value);
+  const std::vector<Bitmap64> results =
+      index->GetQualifyingStripesBatch(values, num_stripes);
+  ASSERT_EQ(results.size(), values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    ASSERT_EQ(results[i].ToString(),
+              index->GetQualifyingStripes(values[i], num_stripes).ToString());
+  }
+}
+
+// Checks that IN-list lookups return the union of the individual lookups.
+void CheckInListLookups(const size_t num_values,
+                        const bool prefix_bits_optimization) {
+  const ColumnPtr column = FillColumn(kNumRows, num_values);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         prefix_bits_optimization)
+          .Create(*column, kNumRowsPerStripe);
+
+  // In-lists with positive and negative values (and duplicates) in no
+  // particular order.
+  std::vector<long> values;
+  for (size_t i = 0; i < 64; ++i) {
+    values.push_back((i * 7919) % (2 * num_values));
+    Bitmap64 expected(/*size=*/num_stripes);
+    for (const long value : values)
+      expected |= index->GetQualifyingStripes(value, num_stripes);
+    ASSERT_EQ(index->GetQualifyingStripesForAny(values, num_stripes).ToString(),
+              expected.ToString());
+  }
+  EXPECT_TRUE(index->GetQualifyingStripesForAny(column->distinct_values(),
+                                                num_stripes)
+                  .IsAllOnes());
+  EXPECT_TRUE(
+      index->GetQualifyingStripesForAny({}, num_stripes).IsAllZeroes());
+}
+
 // *** The actual tests: ***
 
 TEST(CuckooIndexTest, PositiveLookupsSingleValue) {
@@ -172,6 +278,412 @@ TEST(CuckooIndexTest, NegativeLookupsAllUniques) {
 // NegativeLookups([>num_values=<]kNumRows, [>prefix_bits_optimization=<]true);
 // }
 
+TEST(CuckooIndexTest, OpenEncodedIndexSingleValue) {
+  CheckOpenedIndex(/*num_values=*/1, /*prefix_bits_optimization=*/false);
+}
+
+TEST(CuckooIndexTest, OpenEncodedIndexFewValues) {
+  CheckOpenedIndex(/*num_values=*/30, /*prefix_bits_optimization=*/false);
+}
+
+TEST(CuckooIndexTest, OpenEncodedIndexAllUniques) {
+  CheckOpenedIndex(/*num_values=*/kNumRows, /*prefix_bits_optimization=*/false);
+}
+
+TEST(CuckooIndexTest, OpenEncodedIndexAllUniquesWithPrefixBitsOptimization) {
+  CheckOpenedIndex(/*num_values=*/kNumRows, /*prefix_bits_optimization=*/true);
+}
+
+TEST(CuckooIndexTest, FingerprintDirectory) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  for (const size_t fingerprint_directory : {1, 16}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                           kMaxLoadFactor2SlotsPerBucket,
+                           /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                           /*prefix_bits_optimization=*/true,
+                           fingerprint_directory)
+            .Create(*column, kNumRowsPerStripe);
+    CheckPositiveLookups(*column, index.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+  }
+}
+
+TEST(CuckooIndexTest, CacheLineFingerprints) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  for (const size_t slots_per_bucket : {1, 2}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(
+            CuckooAlgorithm::KICKING,
+            slots_per_bucket == 1 ? kMaxLoadFactor1SlotsPerBucket
+                                  : kMaxLoadFactor2SlotsPerBucket,
+            /*scan_rate=*/0.1, slots_per_bucket,
+            /*prefix_bits_optimization=*/true, /*fingerprint_directory=*/0,
+            HashingScheme::SEEDED_CITY64, /*num_threads=*/1,
+            SlotBitmapEncoding::RLE, /*cache_line_fingerprints=*/true)
+            .Create(*column, kNumRowsPerStripe);
+    CheckPositiveLookups(*column, index.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+
+    // The cache lines aren't encoded, but can be laid out when opening.
+    const std::string encoded =
+        static_cast<const CuckooIndex*>(index.get())->Encode();
+    const std::unique_ptr<CuckooIndex> opened = CuckooIndex::Open(
+        encoded, /*fingerprint_directory=*/0, /*cache_line_fingerprints=*/true);
+    CheckPositiveLookups(*column, opened.get());
+    EXPECT_EQ(opened->byte_size(), index->byte_size());
+  }
+}
+
+TEST(CuckooIndexTest, LookupCounters) {
+  if (!kLookupCountersEnabled)
+    GTEST_SKIP() << "built without CUCKOO_INDEX_LOOKUP_COUNTERS";
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor1SlotsPerBucket, /*scan_rate=*/0.1,
+                         /*slots_per_bucket=*/1,
+                         /*prefix_bits_optimization=*/false)
+          .Create(*column, kNumRowsPerStripe);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+
+  LookupCounters::Reset();
+  for (const long value : column->distinct_values())
+    index->GetQualifyingStripes(value, num_stripes);
+  const LookupCounterValues values = LookupCounters::GetSnapshot();
+  auto get = [&values](LookupCounter counter) {
+    return values[static_cast<size_t>(counter)];
+  };
+  // Every value is found in one of its buckets, probing one or both.
+  const int64_t num_values = column->distinct_values().size();
+  EXPECT_EQ(get(LookupCounter::PrimaryBucketHits) +
+                get(LookupCounter::SecondaryBucketHits),
+            num_values);
+  EXPECT_EQ(get(LookupCounter::BucketsProbed),
+            num_values + get(LookupCounter::SecondaryBucketHits));
+  EXPECT_GT(get(LookupCounter::BytesDecoded), 0);
+}
+
+TEST(CuckooIndexTest, ByteSizeBreakdown) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::SKEWED_KICKING,
+                         kMaxLoadFactor1SlotsPerBucket, /*scan_rate=*/0.1,
+                         /*slots_per_bucket=*/1,
+                         /*prefix_bits_optimization=*/true)
+          .Create(*column, kNumRowsPerStripe);
+
+  size_t byte_size = 0;
+  for (const ByteSizeComponent& component : index->byte_size_breakdown()) {
+    if (component.name != "other") {
+      EXPECT_GT(component.byte_size, 0);
+    }
+    byte_size += component.byte_size;
+  }
+  EXPECT_EQ(byte_size, index->byte_size());
+}
+
+TEST(CuckooIndexTest, LookupsWithLargerBuckets) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  for (const auto& [slots_per_bucket, max_load_factor] :
+       std::vector<std::pair<size_t, double>>{
+           {1, kMaxLoadFactor1SlotsPerBucket},
+           {4, kMaxLoadFactor4SlotsPerBucket},
+           {8, kMaxLoadFactor8SlotsPerBucket}}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(CuckooAlgorithm::KICKING, max_load_factor,
+                           /*scan_rate=*/0.1, slots_per_bucket,
+                           /*prefix_bits_optimization=*/true)
+            .Create(*column, kNumRowsPerStripe);
+    CheckPositiveLookups(*column, index.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+
+    const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+    const std::vector<long> values = {column->distinct_values()[0],
+                                      column->max() + 1,
+                                      column->distinct_values()[1]};
+    const std::vector<Bitmap64> results =
+        index->GetQualifyingStripesBatch(values, num_stripes);
+    ASSERT_EQ(results.size(), values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_EQ(results[i].ToString(),
+                index->GetQualifyingStripes(values[i], num_stripes).ToString());
+    }
+  }
+}
+
+TEST(CuckooIndexTest, HashingSchemes) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  for (const HashingScheme hashing_scheme :
+       {HashingScheme::SEEDED_CITY64, HashingScheme::SINGLE_HASH_FASTRANGE,
+        HashingScheme::PARTIAL_KEY}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                           kMaxLoadFactor2SlotsPerBucket,
+                           /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                           /*prefix_bits_optimization=*/true,
+                           /*fingerprint_directory=*/0, hashing_scheme)
+            .Create(*column, kNumRowsPerStripe);
+    CheckPositiveLookups(*column, index.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+
+    // The hashing scheme is part of the encoding.
+    const std::string encoded =
+        static_cast<const CuckooIndex*>(index.get())->Encode();
+    const std::unique_ptr<CuckooIndex> opened = CuckooIndex::Open(encoded);
+    CheckPositiveLookups(*column, opened.get());
+  }
+}
+
+TEST(CuckooIndexTest, SlotBitmapEncodings) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/30);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+  for (const HashingScheme hashing_scheme :
+       {HashingScheme::SEEDED_CITY64, HashingScheme::PARTIAL_KEY}) {
+    for (const SlotBitmapEncoding encoding :
+         {SlotBitmapEncoding::RLE, SlotBitmapEncoding::DENSE,
+          SlotBitmapEncoding::ROARING, SlotBitmapEncoding::ADAPTIVE}) {
+      const IndexStructurePtr index =
+          CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                             kMaxLoadFactor2SlotsPerBucket,
+                             /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                             /*prefix_bits_optimization=*/false,
+                             /*fingerprint_directory=*/0, hashing_scheme,
+                             /*num_threads=*/1, encoding)
+              .Create(*column, kNumRowsPerStripe);
+      const auto& cuckoo_index = static_cast<const CuckooIndex&>(*index);
+      if (encoding != SlotBitmapEncoding::ADAPTIVE) {
+        EXPECT_EQ(cuckoo_index.slot_bitmap_encoding(), encoding);
+      }
+      CheckPositiveLookups(*column, index.get());
+
+      // The encoding of the slot bitmaps is part of the index encoding.
+      const std::unique_ptr<CuckooIndex> opened =
+          CuckooIndex::Open(cuckoo_index.Encode());
+      EXPECT_EQ(opened->slot_bitmap_encoding(),
+                cuckoo_index.slot_bitmap_encoding());
+      CheckPositiveLookups(*column, opened.get());
+
+      for (long value = 0; value < 60; ++value) {
+        const Bitmap64 expected = index->GetQualifyingStripes(value,
+                                                              num_stripes);
+        ASSERT_EQ(opened->GetQualifyingStripes(value, num_stripes).ToString(),
+                  expected.ToString());
+        const Roaring roaring = opened->GetQualifyingStripesRoaring(value);
+        ASSERT_EQ(roaring.cardinality(), expected.GetOnesCount());
+        for (const size_t stripe_id : expected.TrueBitIndices())
+          ASSERT_TRUE(roaring.contains(stripe_id));
+        const std::vector<long> in_list = {value, value + 1, value + 30};
+        Bitmap64 expected_any(/*size=*/num_stripes);
+        for (const long v : in_list)
+          expected_any |= index->GetQualifyingStripes(v, num_stripes);
+        ASSERT_EQ(
+            opened->GetQualifyingStripesForAny(in_list, num_stripes).ToString(),
+            expected_any.ToString());
+      }
+    }
+  }
+}
+
+TEST(CuckooIndexTest, OpenCompressed) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows / 10);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe;
+  for (const SlotBitmapEncoding encoding :
+       {SlotBitmapEncoding::RLE, SlotBitmapEncoding::DENSE,
+        SlotBitmapEncoding::ROARING}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                           kMaxLoadFactor2SlotsPerBucket,
+                           /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                           /*prefix_bits_optimization=*/true,
+                           /*fingerprint_directory=*/0,
+                           HashingScheme::SEEDED_CITY64,
+                           /*num_threads=*/1, encoding)
+            .Create(*column, kNumRowsPerStripe);
+    const auto& cuckoo_index = static_cast<const CuckooIndex&>(*index);
+    const std::string encoded =
+        cuckoo_index.EncodeCompressed(/*chunk_size=*/64);
+    const std::unique_ptr<CuckooIndex> opened =
+        CuckooIndex::OpenCompressed(encoded, /*max_cached_chunks=*/4);
+    EXPECT_EQ(opened->byte_size(), encoded.size());
+    EXPECT_EQ(opened->slot_bitmap_encoding(), encoding);
+    ASSERT_NE(opened->fingerprint_chunks(), nullptr);
+    ASSERT_NE(opened->compressed_slot_bitmaps(), nullptr);
+    EXPECT_EQ(cuckoo_index.fingerprint_chunks(), nullptr);
+    EXPECT_EQ(cuckoo_index.compressed_slot_bitmaps(), nullptr);
+
+    // A single lookup only decompresses the chunks it touches.
+    opened->GetQualifyingStripes(column->distinct_values()[0], num_stripes);
+    EXPECT_LE(opened->fingerprint_chunks()->misses(), 4);
+    EXPECT_EQ(opened->compressed_slot_bitmaps()->num_decompressed_chunks(), 1);
+    EXPECT_GT(opened->fingerprint_chunks()->num_chunks(), 4);
+
+    CheckPositiveLookups(*column, opened.get());
+    for (long value = column->max() + 1; value < column->max() + 1000;
+         ++value) {
+      ASSERT_EQ(opened->GetQualifyingStripes(value, num_stripes).ToString(),
+                index->GetQualifyingStripes(value, num_stripes).ToString());
+    }
+    const std::vector<long> in_list = {1, 2, 3, column->max() + 1};
+    EXPECT_EQ(opened->GetQualifyingStripesForAny(in_list, num_stripes)
+                  .ToString(),
+              index->GetQualifyingStripesForAny(in_list, num_stripes)
+                  .ToString());
+  }
+}
+
+TEST(CuckooIndexTest, MatchingAlgorithm) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  for (const size_t slots_per_bucket : {1, 2, 4}) {
+    const IndexStructurePtr index =
+        CuckooIndexFactory(CuckooAlgorithm::MATCHING,
+                           kMaxLoadFactor1SlotsPerBucket, /*scan_rate=*/0.1,
+                           slots_per_bucket,
+                           /*prefix_bits_optimization=*/true)
+            .Create(*column, kNumRowsPerStripe);
+    CheckPositiveLookups(*column, index.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+  }
+}
+
+TEST(CuckooIndexTest, BfsKicking) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/kNumRows);
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::BFS_KICKING,
+                         kMaxLoadFactor2SlotsPerBucket, /*scan_rate=*/0.1,
+                         /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/true)
+          .Create(*column, kNumRowsPerStripe);
+  CheckPositiveLookups(*column, index.get());
+  EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+}
+
+TEST(CuckooIndexTest, StreamingBuilder) {
+  for (const size_t num_values : {size_t{1}, size_t{30}, kNumRows}) {
+    const ColumnPtr column = FillColumn(kNumRows, num_values);
+    const CuckooIndexFactory factory(CuckooAlgorithm::SKEWED_KICKING,
+                                     kMaxLoadFactor2SlotsPerBucket,
+                                     /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                                     /*prefix_bits_optimization=*/true);
+    const IndexStructurePtr index = factory.Create(*column, kNumRowsPerStripe);
+
+    const IndexStructureBuilderPtr builder = factory.CreateBuilder();
+    const absl::Span<const long> data = absl::MakeConstSpan(column->data());
+    for (size_t i = 0; i < data.size(); i += kNumRowsPerStripe)
+      builder->AddStripe(data.subspan(i, kNumRowsPerStripe));
+    const IndexStructurePtr built = builder->Finish();
+
+    // Both paths create the same index.
+    EXPECT_EQ(static_cast<const CuckooIndex*>(built.get())->Encode(),
+              static_cast<const CuckooIndex*>(index.get())->Encode());
+    CheckPositiveLookups(*column, built.get());
+    EXPECT_LE(ScanRateNegativeLookups(*column, built.get()), 0.101);
+  }
+}
+
+TEST(CuckooIndexTest, MultiThreadedBuild) {
+  // Few values occur in many stripes (i.e., in the maps of several threads),
+  // all uniques only in a single one.
+  for (const size_t num_values : {size_t{30}, kNumRows}) {
+    const ColumnPtr column = FillColumn(kNumRows, num_values);
+    std::string single_threaded_encoding;
+    for (const size_t num_threads : {1, 2, 3, 64}) {
+      const IndexStructurePtr index =
+          CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                             kMaxLoadFactor2SlotsPerBucket,
+                             /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                             /*prefix_bits_optimization=*/true,
+                             /*fingerprint_directory=*/0,
+                             HashingScheme::SEEDED_CITY64, num_threads)
+              .Create(*column, kNumRowsPerStripe);
+      // The number of threads doesn't change the created index.
+      const std::string encoding =
+          static_cast<const CuckooIndex*>(index.get())->Encode();
+      if (num_threads == 1) {
+        single_threaded_encoding = encoding;
+        continue;
+      }
+      EXPECT_EQ(encoding, single_threaded_encoding) << num_threads;
+      CheckPositiveLookups(*column, index.get());
+      EXPECT_LE(ScanRateNegativeLookups(*column, index.get()), 0.101);
+    }
+  }
+}
+
+TEST(CuckooIndexTest, BatchLookupsFewValues) {
+  CheckBatchLookups(/*num_values=*/30, /*prefix_bits_optimization=*/false);
+}
+
+TEST(CuckooIndexTest, BatchLookupsAllUniquesWithPrefixBitsOptimization) {
+  CheckBatchLookups(/*num_values=*/kNumRows, /*prefix_bits_optimization=*/true);
+}
+
+TEST(CuckooIndexTest, InListLookupsFewValues) {
+  CheckInListLookups(/*num_values=*/30, /*prefix_bits_optimization=*/false);
+}
+
+TEST(CuckooIndexTest, InListLookupsAllUniquesWithPrefixBitsOptimization) {
+  CheckInListLookups(/*num_values=*/kNumRows,
+                     /*prefix_bits_optimization=*/true);
+}
+
+TEST(CuckooIndexTest, PrefixLookups) {
+  // Lookups for the first `num_stripes` stripes return bitmaps of that size,
+  // whether the value is found or not.
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/10);
+  const size_t num_stripes = column->num_rows() / kNumRowsPerStripe / 2;
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/false)
+          .Create(*column, kNumRowsPerStripe);
+
+  std::vector<long> values = column->distinct_values();
+  values.push_back(column->max() + 1);
+  Bitmap64 buffer;
+  std::vector<uint32_t> stripe_ids;
+  for (const long value : values) {
+    const Bitmap64 result = index->GetQualifyingStripes(value, num_stripes);
+    ASSERT_EQ(result.bits(), num_stripes);
+    index->FillQualifyingStripes(value, num_stripes, &buffer);
+    ASSERT_EQ(buffer.bits(), num_stripes);
+    index->FillQualifyingStripeIds(value, num_stripes, &stripe_ids);
+    for (const uint32_t stripe_id : stripe_ids)
+      EXPECT_TRUE(result.Get(stripe_id));
+    EXPECT_EQ(stripe_ids.size(), result.GetOnesCount());
+  }
+  for (const Bitmap64& result :
+       index->GetQualifyingStripesBatch(values, num_stripes))
+    EXPECT_EQ(result.bits(), num_stripes);
+  EXPECT_EQ(index->GetQualifyingStripesForAny(values, num_stripes).bits(),
+            num_stripes);
+}
+
+TEST(CuckooIndexTest, OpenFile) {
+  const ColumnPtr column = FillColumn(kNumRows, /*num_values=*/30);
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/false)
+          .Create(*column, kNumRowsPerStripe);
+  const std::string path = ::testing::TempDir() + "/cuckoo_index_open_file";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << static_cast<const CuckooIndex&>(*index).Encode();
+  }
+
+  const std::unique_ptr<CuckooIndex> opened = CuckooIndex::OpenFile(path);
+  EXPECT_EQ(opened->byte_size(), index->byte_size());
+  CheckPositiveLookups(*column, opened.get());
+
+  const std::unique_ptr<CuckooIndex> opened_with_directory =
+      CuckooIndex::OpenFile(path, /*fingerprint_directory=*/1);
+  CheckPositiveLookups(*column, opened_with_directory.get());
+  std::remove(path.c_str());
+}
+
 TEST(CuckooIndexTest, LastRowDropped) {
   // The last row will be dropped, since only stripes with `kNumRowsPerStripe`
   // (= 3) rows are created.
@@ -185,4 +697,75 @@ TEST(CuckooIndexTest, LastRowDropped) {
   EXPECT_EQ(reinterpret_cast<const CuckooIndex&>(*index).active_slots(), 3);
 }
 
+TEST(CuckooIndexTest, Merge) {
+  // The second half of the rows shares some values with the first one.
+  std::vector<long> lhs_data, rhs_data, data;
+  for (size_t row = 0; row < kNumRows / 2; ++row) {
+    lhs_data.push_back(row / 5);
+    rhs_data.push_back(row / 5 + 20);
+  }
+  data = lhs_data;
+  data.insert(data.end(), rhs_data.begin(), rhs_data.end());
+  const ColumnPtr lhs_column = Column::IntColumn("lhs", lhs_data);
+  const ColumnPtr rhs_column = Column::IntColumn("rhs", rhs_data);
+  const ColumnPtr column = Column::IntColumn("merged", data);
+
+  const CuckooIndexFactory factory(
+      CuckooAlgorithm::SKEWED_KICKING, kMaxLoadFactor2SlotsPerBucket,
+      /*scan_rate=*/0.1, /*slots_per_bucket=*/2,
+      /*prefix_bits_optimization=*/false, /*fingerprint_directory=*/0,
+      HashingScheme::SEEDED_CITY64, /*num_threads=*/1);
+  IndexStructurePtr lhs = factory.CreateMergeable(*lhs_column,
+                                                  kNumRowsPerStripe);
+  IndexStructurePtr rhs = factory.CreateMergeable(*rhs_column,
+                                                  kNumRowsPerStripe);
+  // Plainly created indexes don't keep their slot keys.
+  EXPECT_TRUE(static_cast<const CuckooIndex&>(
+                  *factory.Create(*lhs_column, kNumRowsPerStripe))
+                  .slot_keys()
+                  .empty());
+  const CuckooIndex& lhs_index = static_cast<const CuckooIndex&>(*lhs);
+  EXPECT_EQ(lhs_index.slot_keys().size(), lhs_column->num_distinct_values());
+
+  // Merging opened indexes needs the sidecar of their slot keys.
+  const std::string encoded_rhs =
+      static_cast<const CuckooIndex&>(*rhs).Encode();
+  const std::unique_ptr<CuckooIndex> opened_rhs =
+      CuckooIndex::Open(encoded_rhs);
+  EXPECT_TRUE(opened_rhs->slot_keys().empty());
+  opened_rhs->DecodeSlotKeys(
+      static_cast<const CuckooIndex&>(*rhs).EncodeSlotKeys());
+
+  const std::unique_ptr<CuckooIndex> merged =
+      factory.Merge(lhs_index, *opened_rhs);
+  EXPECT_EQ(merged->active_slots(), column->num_distinct_values());
+  EXPECT_EQ(merged->slot_keys().size(), column->num_distinct_values());
+  CheckPositiveLookups(*column, merged.get());
+  EXPECT_LE(ScanRateNegativeLookups(*column, merged.get()), 0.101);
+}
+
+TEST(CuckooIndexTest, HashedStrings) {
+  std::vector<std::string> data;
+  for (size_t i = 0; i < kNumRows; ++i)
+    data.push_back(absl::StrCat("company-", i / 10));
+  const Column column("company_name", DataType::STRING, data,
+                      StringEncoding::HASH);
+  const IndexStructurePtr index =
+      CuckooIndexFactory(CuckooAlgorithm::SKEWED_KICKING,
+                         kMaxLoadFactor2SlotsPerBucket,
+                         /*scan_rate=*/0.01, /*slots_per_bucket=*/2,
+                         /*prefix_bits_optimization=*/false)
+          .Create(column, kNumRowsPerStripe);
+  CheckPositiveLookups(column, index.get());
+
+  // Strings are looked up without the column, i.e., without a dictionary.
+  const size_t num_stripes = kNumRows / kNumRowsPerStripe;
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    const std::string str = data[stripe_id * kNumRowsPerStripe];
+    EXPECT_TRUE(index->StripeContainsString(stripe_id, str));
+    EXPECT_TRUE(
+        index->GetQualifyingStripesForString(str, num_stripes).Get(stripe_id));
+  }
+}
+
 }  // namespace ci
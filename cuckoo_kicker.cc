@@ -19,12 +19,31 @@
 #include "cuckoo_kicker.h"
 
 #include <cstdlib>
+#include <vector>
 
+#include "absl/container/flat_hash_set.h"
+#include "common/profiling.h"
 #include "cuckoo_utils.h"
 
 namespace ci {
 
 constexpr size_t CuckooKicker::kDefaultMaxKicks;
+constexpr size_t CuckooKicker::kDefaultMaxBfsDepth;
+
+bool CuckooKicker::InsertValues(absl::Span<const CuckooValue> values) {
+  const size_t total_kicks_before = total_kicks_;
+  bool success = true;
+  for (const CuckooValue& value : values) {
+    if (!InsertValueWithKicking(value)) {
+      success = false;
+      break;
+    }
+    ++successful_inserts_;
+  }
+  Profiler::GetThreadInstance().Add(Counter::NumKicks,
+                                    total_kicks_ - total_kicks_before);
+  return success;
+}
 
 size_t CuckooKicker::GetNumSecondaryItems(const size_t bucket_idx) const {
   const Bucket& bucket = buckets_[bucket_idx];
@@ -172,16 +191,91 @@ bool CuckooKicker::InsertValueWithKicking(const CuckooValue& value) {
   if (secondary_bucket->InsertValue(value)) return true;
 
   // Both buckets are full. Try to insert with kicking.
+  if (strategy_ == KickingStrategy::BREADTH_FIRST)
+    return InsertValueWithBfs(value);
+
   CuckooValue in_flight_value = value;
   for (size_t num_kicks = 0; num_kicks <= max_kicks_; ++num_kicks) {
     if (InsertValueWithKick(&in_flight_value)) {
       if (num_kicks > max_kicks_observed_) max_kicks_observed_ = num_kicks;
+      total_kicks_ += num_kicks + 1;
       return true;
     }
   }
 
   // Exceeded `max_kicks_` kicks. Insertion failed.
+  total_kicks_ += max_kicks_ + 1;
   return false;
 }
 
+bool CuckooKicker::InsertValueWithBfs(const CuckooValue& value) {
+  constexpr size_t kNoParent = SIZE_MAX;
+  // A visited bucket, reached by moving the value in slot `slot` of the
+  // `parent` node's bucket to it.
+  struct Node {
+    size_t bucket_idx;
+    size_t parent;
+    size_t slot;
+    size_t depth;
+  };
+  std::vector<Node> nodes = {{value.primary_bucket, kNoParent, 0, 0}};
+  absl::flat_hash_set<size_t> visited = {value.primary_bucket};
+  if (visited.insert(value.secondary_bucket).second)
+    nodes.push_back({value.secondary_bucket, kNoParent, 0, 0});
+
+  size_t free_node = kNoParent;
+  for (size_t pos = 0; pos < nodes.size() && free_node == kNoParent; ++pos) {
+    // Nodes are visited in order of their depth.
+    if (nodes[pos].depth >= max_bfs_depth_) break;
+    const size_t bucket_idx = nodes[pos].bucket_idx;
+    const Bucket& bucket = buckets_[bucket_idx];
+    // With skew kicking, expand values residing in their secondary bucket
+    // first, so they are preferably moved back to their primary bucket.
+    for (size_t pass = skew_kicking_ ? 0 : 1; pass < 2; ++pass) {
+      for (size_t i = 0; i < bucket.slots_.size(); ++i) {
+        const CuckooValue& victim = bucket.slots_[i];
+        const bool in_primary = victim.primary_bucket == bucket_idx;
+        if (pass == 0 && in_primary) continue;
+        const size_t alternative_bucket_idx =
+            in_primary ? victim.secondary_bucket : victim.primary_bucket;
+        if (!visited.insert(alternative_bucket_idx).second) continue;
+        nodes.push_back(
+            {alternative_bucket_idx, pos, i, nodes[pos].depth + 1});
+        if (buckets_[alternative_bucket_idx].slots_.size() <
+            slots_per_bucket_) {
+          free_node = nodes.size() - 1;
+          break;
+        }
+      }
+      if (free_node != kNoParent) break;
+    }
+    // Stop searching after visiting `max_kicks_` buckets.
+    if (nodes.size() > max_kicks_) break;
+  }
+  if (free_node == kNoParent) return false;
+
+  // Apply the path, starting at the free bucket: each value moves to the next
+  // bucket on the path, the vacated slot in the first bucket takes `value`.
+  CuckooValue* vacated_slot = nullptr;
+  size_t num_kicks = 0;
+  for (size_t idx = free_node; nodes[idx].parent != kNoParent;
+       idx = nodes[idx].parent, ++num_kicks) {
+    CuckooValue& moved =
+        buckets_[nodes[nodes[idx].parent].bucket_idx].slots_[nodes[idx].slot];
+    if (vacated_slot == nullptr) {
+      const bool inserted = buckets_[nodes[idx].bucket_idx].InsertValue(moved);
+      assert(inserted);
+      (void)inserted;
+    } else {
+      *vacated_slot = moved;
+    }
+    vacated_slot = &moved;
+  }
+  *vacated_slot = value;
+
+  if (num_kicks > max_kicks_observed_) max_kicks_observed_ = num_kicks;
+  total_kicks_ += num_kicks;
+  return true;
+}
+
 }  // namespace ci
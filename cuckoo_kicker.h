@@ -41,10 +41,19 @@ static const absl::flat_hash_map<size_t, double> GetSkewFactorMap() {
       {8, kKickSkewFactor8SlotsPerBucket}};
 }
 
+// How CuckooKicker makes room for a value whose buckets are both full: by a
+// random walk, kicking a random victim to its alternative bucket until one has
+// a free slot (RANDOM_WALK), or by a breadth-first search for the shortest
+// such eviction path, which is then applied at once (BREADTH_FIRST).
+enum class KickingStrategy { RANDOM_WALK, BREADTH_FIRST };
+
 // Distributes values to `buckets` using the kicking algorithm.
 class CuckooKicker {
  public:
+  // With BREADTH_FIRST, bounds the number of buckets visited per insertion.
   static constexpr size_t kDefaultMaxKicks = 50000;
+  // With BREADTH_FIRST, bounds the length of eviction paths.
+  static constexpr size_t kDefaultMaxBfsDepth = 250;
 
   // Setting `skew_kicking` may lead to a smaller index (since items in
   // secondary buckets may affect the minimum fingerprint lengths of the
@@ -52,30 +61,36 @@ class CuckooKicker {
   // lookups are more likely to find a match in their primary bucket. On the
   // contrary, users should be aware that this increases build time and may lead
   // to build failures.
+  //
+  // With BREADTH_FIRST, a failed insertion leaves `buckets` unchanged (rather
+  // than dropping the last in-flight value) and `skew_kicking` makes the
+  // search expand values residing in their secondary bucket first.
   CuckooKicker(size_t slots_per_bucket, absl::Span<Bucket> buckets,
-               bool skew_kicking = false, size_t max_kicks = kDefaultMaxKicks)
+               bool skew_kicking = false, size_t max_kicks = kDefaultMaxKicks,
+               KickingStrategy strategy = KickingStrategy::RANDOM_WALK,
+               size_t max_bfs_depth = kDefaultMaxBfsDepth)
       : gen_(absl::SeedSeq({42})),
         slots_per_bucket_(slots_per_bucket),
         buckets_(buckets),
         skew_kicking_(skew_kicking),
         kick_skew_factor_(GetSkewFactorMap().at(slots_per_bucket)),
         max_kicks_(max_kicks),
+        strategy_(strategy),
+        max_bfs_depth_(max_bfs_depth),
         max_kicks_observed_(0),
+        total_kicks_(0),
         successful_inserts_(0) {}
 
   // Returns false if `values` couldn't be distributed to `buckets` with
   // kicking.
-  bool InsertValues(absl::Span<const CuckooValue> values) {
-    for (const CuckooValue& value : values) {
-      if (!InsertValueWithKicking(value)) return false;
-      ++successful_inserts_;
-    }
-    return true;
-  }
+  // Also adds the number of kicks to the Counter::NumKicks of the thread's
+  // Profiler.
+  bool InsertValues(absl::Span<const CuckooValue> values);
 
   void PrintStats() {
     std::cout << "slots per bucket: " << slots_per_bucket_ << std::endl;
     std::cout << "max kicks observed: " << max_kicks_observed_ << std::endl;
+    std::cout << "total kicks: " << total_kicks_ << std::endl;
     std::cout << "successful inserts: " << successful_inserts_ << std::endl;
     std::cout << "load factor: "
               << static_cast<double>(successful_inserts_) /
@@ -137,6 +152,11 @@ class CuckooKicker {
   // `kNumMaxKicks` kicks).
   bool InsertValueWithKicking(const CuckooValue& value);
 
+  // Same as above, but searches for the shortest eviction path (of at most
+  // `max_bfs_depth_` kicks) breadth-first. Returns false without modifying
+  // `buckets_` if there's none.
+  bool InsertValueWithBfs(const CuckooValue& value);
+
   absl::BitGen gen_;
   const size_t slots_per_bucket_;
   absl::Span<Bucket> buckets_;
@@ -149,10 +169,14 @@ class CuckooKicker {
   const double kick_skew_factor_;
   // Maximum number of kicks allowed before an insertion fails.
   const size_t max_kicks_;
+  const KickingStrategy strategy_;
+  const size_t max_bfs_depth_;
 
   // ** Statistics.
   // Maximum number of kicks observed.
   size_t max_kicks_observed_;
+  // Number of kicks of all insertions.
+  size_t total_kicks_;
   // Number of successfully inserted items.
   size_t successful_inserts_;
 };
@@ -62,8 +62,9 @@ bool LookupValuesInBuckets(const std::vector<Bucket>& buckets,
 // Starts with the minimum number of buckets required for `kSlotsPerBucket`
 // slots and `values.size()`. If construction fails, increases the number of
 // buckets and retries (one additional bucket at a time).
-std::vector<Bucket> DistributeValuesByKicking(const std::vector<long>& values,
-                                              const bool skew_kicking) {
+std::vector<Bucket> DistributeValuesByKicking(
+    const std::vector<long>& values, const bool skew_kicking,
+    const KickingStrategy strategy = KickingStrategy::RANDOM_WALK) {
   size_t num_buckets = GetMinNumBuckets(kNumValues, kSlotsPerBucket);
 
   for (size_t i = 0; i < kMaxNumRetries; ++i) {
@@ -72,7 +73,8 @@ std::vector<Bucket> DistributeValuesByKicking(const std::vector<long>& values,
     cuckoo_values.reserve(values.size());
     for (const long value : values)
       cuckoo_values.push_back(CuckooValue(value, num_buckets));
-    CuckooKicker kicker(kSlotsPerBucket, absl::MakeSpan(buckets), skew_kicking);
+    CuckooKicker kicker(kSlotsPerBucket, absl::MakeSpan(buckets), skew_kicking,
+                        CuckooKicker::kDefaultMaxKicks, strategy);
     if (kicker.InsertValues(cuckoo_values)) return buckets;
     ++num_buckets;
   }
@@ -107,6 +109,41 @@ TEST(CuckooKickerTest, InsertValuesWithSkewedKicking) {
   ASSERT_GT(in_primary_ratio, 0.6);
 }
 
+TEST(CuckooKickerTest, InsertValuesWithBfs) {
+  const std::vector<long> values = CreateValues(kNumValues);
+
+  for (const bool skew_kicking : {false, true}) {
+    const std::vector<Bucket> buckets = DistributeValuesByKicking(
+        values, skew_kicking, KickingStrategy::BREADTH_FIRST);
+
+    double in_primary_ratio;
+    ASSERT_TRUE(LookupValuesInBuckets(buckets, values, &in_primary_ratio));
+    ASSERT_GT(in_primary_ratio, 0.0);
+  }
+}
+
+TEST(CuckooKickerTest, FailedBfsInsertKeepsValues) {
+  // Far too few buckets: the insertion fails eventually.
+  const size_t num_buckets = kNumValues / kSlotsPerBucket / 2;
+  std::vector<Bucket> buckets(num_buckets, Bucket(kSlotsPerBucket));
+  std::vector<CuckooValue> cuckoo_values;
+  for (const long value : CreateValues(kNumValues))
+    cuckoo_values.push_back(CuckooValue(value, num_buckets));
+  CuckooKicker kicker(kSlotsPerBucket, absl::MakeSpan(buckets),
+                      /*skew_kicking=*/false, CuckooKicker::kDefaultMaxKicks,
+                      KickingStrategy::BREADTH_FIRST);
+  ASSERT_FALSE(kicker.InsertValues(cuckoo_values));
+
+  // All values before the failed one are still in one of their buckets.
+  size_t num_stored = 0;
+  for (const Bucket& bucket : buckets) num_stored += bucket.slots_.size();
+  ASSERT_LT(num_stored, kNumValues);
+  for (size_t i = 0; i < num_stored; ++i) {
+    bool in_primary;
+    EXPECT_TRUE(LookupValueInBuckets(buckets, cuckoo_values[i], &in_primary));
+  }
+}
+
 TEST(CuckooKickerTest, CheckForDeterministicBehavior) {
   const std::vector<long> values = CreateValues(kNumValues);
 
@@ -0,0 +1,177 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: cuckoo_matcher.cc
+// -----------------------------------------------------------------------------
+
+#include "cuckoo_matcher.h"
+
+#include <cassert>
+#include <iostream>
+
+namespace ci {
+
+constexpr uint32_t CuckooMatcher::kUnmatched;
+
+bool CuckooMatcher::InsertValues(absl::Span<const CuckooValue> values) {
+  assert(values.size() < kUnmatched);
+  values_ = &values;
+  value_bucket_.assign(values.size(), kUnmatched);
+  bucket_values_.assign(buckets_.size(), std::vector<uint32_t>());
+  num_matched_ = 0;
+  num_phases_ = 0;
+
+  // Greedy initialization: primary bucket first, then secondary bucket.
+  std::vector<uint32_t> unmatched;
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    for (size_t choice = 0; choice < 2; ++choice) {
+      const size_t bucket_idx = GetBucket(i, choice);
+      if (!IsFull(bucket_idx)) {
+        value_bucket_[i] = bucket_idx;
+        bucket_values_[bucket_idx].push_back(i);
+        ++num_matched_;
+        break;
+      }
+    }
+    if (value_bucket_[i] == kUnmatched) unmatched.push_back(i);
+  }
+
+  // Hopcroft-Karp phases: augment along vertex-disjoint shortest paths until
+  // there are no augmenting paths left.
+  while (!unmatched.empty() && ComputeLayers()) {
+    ++num_phases_;
+    std::vector<uint32_t> still_unmatched;
+    for (const uint32_t root : unmatched) {
+      if (Augment(root)) {
+        ++num_matched_;
+      } else {
+        still_unmatched.push_back(root);
+      }
+    }
+    if (still_unmatched.size() == unmatched.size()) break;
+    unmatched.swap(still_unmatched);
+  }
+
+  const bool success = num_matched_ == values.size();
+  if (success) {
+    for (size_t bucket_idx = 0; bucket_idx < buckets_.size(); ++bucket_idx) {
+      for (const uint32_t value_idx : bucket_values_[bucket_idx]) {
+        const bool inserted = buckets_[bucket_idx].InsertValue(values[value_idx]);
+        assert(inserted);
+        (void)inserted;
+      }
+    }
+  }
+
+  values_ = nullptr;
+  value_bucket_ = std::vector<uint32_t>();
+  bucket_values_ = std::vector<std::vector<uint32_t>>();
+  layer_ = std::vector<uint32_t>();
+  return success;
+}
+
+bool CuckooMatcher::ComputeLayers() {
+  layer_.assign(values_->size(), kUnmatched);
+  std::vector<uint32_t> queue;
+  for (uint32_t i = 0; i < values_->size(); ++i) {
+    if (value_bucket_[i] == kUnmatched) {
+      layer_[i] = 0;
+      queue.push_back(i);
+    }
+  }
+
+  bool found_free_slot = false;
+  for (size_t pos = 0; pos < queue.size(); ++pos) {
+    const uint32_t value_idx = queue[pos];
+    for (size_t choice = 0; choice < 2; ++choice) {
+      const size_t bucket_idx = GetBucket(value_idx, choice);
+      if (!IsFull(bucket_idx)) {
+        found_free_slot = true;
+        continue;
+      }
+      for (const uint32_t other : bucket_values_[bucket_idx]) {
+        if (layer_[other] != kUnmatched) continue;
+        layer_[other] = layer_[value_idx] + 1;
+        queue.push_back(other);
+      }
+    }
+  }
+  return found_free_slot;
+}
+
+bool CuckooMatcher::Augment(uint32_t root) {
+  struct Frame {
+    uint32_t value_idx;
+    // The bucket choice (0 or 1) and the member of that bucket explored next.
+    size_t choice;
+    size_t member;
+  };
+  std::vector<Frame> path = {{root, 0, 0}};
+
+  while (!path.empty()) {
+    Frame& frame = path.back();
+    if (frame.choice == 2) {
+      // Dead end: no need to visit it again in this phase.
+      layer_[frame.value_idx] = kUnmatched;
+      path.pop_back();
+      if (!path.empty()) ++path.back().member;
+      continue;
+    }
+
+    const size_t bucket_idx = GetBucket(frame.value_idx, frame.choice);
+    if (!IsFull(bucket_idx)) {
+      // Found a free slot: every value on the path moves to the bucket of its
+      // frame, replacing the value of the next frame.
+      bucket_values_[bucket_idx].push_back(frame.value_idx);
+      value_bucket_[frame.value_idx] = bucket_idx;
+      for (size_t i = path.size() - 1; i-- > 0;) {
+        const size_t prev_bucket_idx =
+            GetBucket(path[i].value_idx, path[i].choice);
+        bucket_values_[prev_bucket_idx][path[i].member] = path[i].value_idx;
+        value_bucket_[path[i].value_idx] = prev_bucket_idx;
+      }
+      for (const Frame& f : path) layer_[f.value_idx] = kUnmatched;
+      return true;
+    }
+
+    const std::vector<uint32_t>& members = bucket_values_[bucket_idx];
+    for (; frame.member < members.size(); ++frame.member) {
+      const uint32_t other = members[frame.member];
+      if (layer_[other] != kUnmatched &&
+          layer_[other] == layer_[frame.value_idx] + 1)
+        break;
+    }
+    if (frame.member == members.size()) {
+      ++frame.choice;
+      frame.member = 0;
+      continue;
+    }
+    // Note: invalidates `frame`.
+    path.push_back({members[frame.member], 0, 0});
+  }
+  return false;
+}
+
+void CuckooMatcher::PrintStats() const {
+  std::cout << "slots per bucket: " << slots_per_bucket_ << std::endl;
+  std::cout << "matching phases: " << num_phases_ << std::endl;
+  std::cout << "matched values: " << num_matched_ << std::endl;
+  std::cout << "load factor: "
+            << static_cast<double>(num_matched_) /
+                   (buckets_.size() * slots_per_bucket_)
+            << std::endl;
+}
+
+}  // namespace ci
@@ -0,0 +1,96 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: cuckoo_matcher.h
+// -----------------------------------------------------------------------------
+
+#ifndef CUCKOO_INDEX_CUCKOO_MATCHER_H_
+#define CUCKOO_INDEX_CUCKOO_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "cuckoo_utils.h"
+
+namespace ci {
+
+// Distributes values to `buckets` by computing a maximum bipartite matching
+// between values and bucket slots (Hopcroft-Karp, with buckets of capacity
+// `slots_per_bucket`). Unlike kicking, this finds a placement whenever one
+// exists and runs in O(E * sqrt(V)) time, i.e., it never gives up early.
+// Values start out in their primary bucket (if it has a free slot), so most
+// values still reside in their primary bucket.
+class CuckooMatcher {
+ public:
+  CuckooMatcher(size_t slots_per_bucket, absl::Span<Bucket> buckets)
+      : slots_per_bucket_(slots_per_bucket),
+        buckets_(buckets),
+        num_matched_(0) {}
+
+  // Returns false if `values` can't be distributed to `buckets`, i.e., if the
+  // maximum matching doesn't cover all values. In that case, `buckets` are
+  // left untouched.
+  bool InsertValues(absl::Span<const CuckooValue> values);
+
+  void PrintStats() const;
+
+  // Number of values placed by the last InsertValues(..) call.
+  size_t num_matched() const { return num_matched_; }
+
+ private:
+  static constexpr uint32_t kUnmatched = UINT32_MAX;
+
+  // Returns the `choice`-th (0: primary, 1: secondary) bucket of `value_idx`.
+  size_t GetBucket(uint32_t value_idx, size_t choice) const {
+    return choice == 0 ? (*values_)[value_idx].primary_bucket
+                       : (*values_)[value_idx].secondary_bucket;
+  }
+
+  bool IsFull(size_t bucket_idx) const {
+    return bucket_values_[bucket_idx].size() >= slots_per_bucket_;
+  }
+
+  // Computes the layers of the alternating BFS forest rooted at all unmatched
+  // values. Returns true if a bucket with a free slot is reachable, i.e., if
+  // there's an augmenting path.
+  bool ComputeLayers();
+
+  // Searches an augmenting path from the unmatched `root` along the layers
+  // computed by ComputeLayers() and applies it. Iterative, since paths may get
+  // long close to the maximum load factor.
+  bool Augment(uint32_t root);
+
+  const size_t slots_per_bucket_;
+  absl::Span<Bucket> buckets_;
+
+  // ** State of the current InsertValues(..) call.
+  const absl::Span<const CuckooValue>* values_ = nullptr;
+  // The bucket each value is assigned to (or kUnmatched).
+  std::vector<uint32_t> value_bucket_;
+  // The values assigned to each bucket (up to `slots_per_bucket_`).
+  std::vector<std::vector<uint32_t>> bucket_values_;
+  // BFS layer of each value (or kUnmatched if unreachable).
+  std::vector<uint32_t> layer_;
+
+  // ** Statistics.
+  size_t num_matched_;
+  size_t num_phases_ = 0;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_CUCKOO_MATCHER_H_
@@ -0,0 +1,134 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: cuckoo_matcher_test.cc
+// -----------------------------------------------------------------------------
+
+#include "cuckoo_matcher.h"
+
+#include <cmath>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "cuckoo_kicker.h"
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+
+namespace ci {
+
+constexpr size_t kNumValues = 1e5;
+
+// **** Helper methods ****
+
+std::vector<CuckooValue> CreateCuckooValues(const size_t num_values,
+                                            const size_t num_buckets) {
+  std::vector<CuckooValue> values;
+  values.reserve(num_values);
+  for (size_t i = 0; i < num_values; ++i)
+    values.push_back(CuckooValue(i, num_buckets));
+  return values;
+}
+
+// Returns a value with the given buckets.
+CuckooValue CreateCuckooValue(long value, size_t primary_bucket,
+                              size_t secondary_bucket) {
+  CuckooValue cuckoo_value(value, /*num_buckets=*/1);
+  cuckoo_value.primary_bucket = primary_bucket;
+  cuckoo_value.secondary_bucket = secondary_bucket;
+  return cuckoo_value;
+}
+
+// Returns true if all `values` could be found in `buckets`. Sets
+// `in_primary_ratio` according to the ratio of items residing in primary
+// buckets.
+bool LookupValuesInBuckets(const std::vector<Bucket>& buckets,
+                           const std::vector<CuckooValue>& values,
+                           double* in_primary_ratio) {
+  size_t num_in_primary = 0;
+  for (const CuckooValue& value : values) {
+    bool in_primary_flag;
+    if (!LookupValueInBuckets(buckets, value, &in_primary_flag)) return false;
+    num_in_primary += in_primary_flag;
+  }
+  *in_primary_ratio = static_cast<double>(num_in_primary) / values.size();
+  return true;
+}
+
+// **** Test cases ****
+
+TEST(CuckooMatcherTest, FindsAugmentingPaths) {
+  // Greedily placing the values leaves value 1 without a slot, it can only be
+  // placed by moving values 0 and 2 to their secondary buckets.
+  const std::vector<CuckooValue> values = {CreateCuckooValue(0, 0, 1),
+                                           CreateCuckooValue(1, 0, 0),
+                                           CreateCuckooValue(2, 1, 2)};
+  std::vector<Bucket> buckets(3, Bucket(/*num_slots=*/1));
+  CuckooMatcher matcher(/*slots_per_bucket=*/1, absl::MakeSpan(buckets));
+  ASSERT_TRUE(matcher.InsertValues(values));
+  EXPECT_EQ(matcher.num_matched(), 3);
+  EXPECT_EQ(buckets[0].slots_[0].orig_value, 1);
+  EXPECT_EQ(buckets[1].slots_[0].orig_value, 0);
+  EXPECT_EQ(buckets[2].slots_[0].orig_value, 2);
+}
+
+TEST(CuckooMatcherTest, FailsWithoutPlacement) {
+  // Three values competing for two buckets with a single slot each.
+  const std::vector<CuckooValue> values = {CreateCuckooValue(0, 0, 1),
+                                           CreateCuckooValue(1, 1, 0),
+                                           CreateCuckooValue(2, 0, 1)};
+  std::vector<Bucket> buckets(3, Bucket(/*num_slots=*/1));
+  CuckooMatcher matcher(/*slots_per_bucket=*/1, absl::MakeSpan(buckets));
+  EXPECT_FALSE(matcher.InsertValues(values));
+  EXPECT_EQ(matcher.num_matched(), 2);
+  // Buckets are left untouched.
+  for (const Bucket& bucket : buckets) EXPECT_TRUE(bucket.slots_.empty());
+}
+
+TEST(CuckooMatcherTest, InsertValuesAtHighLoadFactors) {
+  for (const auto& [slots_per_bucket, load_factor] :
+       std::vector<std::pair<size_t, double>>{{2, 0.88}, {4, 0.97},
+                                              {8, 0.99}}) {
+    const size_t num_buckets = static_cast<size_t>(
+        std::ceil(kNumValues / (slots_per_bucket * load_factor)));
+    const std::vector<CuckooValue> values =
+        CreateCuckooValues(kNumValues, num_buckets);
+    std::vector<Bucket> buckets(num_buckets, Bucket(slots_per_bucket));
+    CuckooMatcher matcher(slots_per_bucket, absl::MakeSpan(buckets));
+    ASSERT_TRUE(matcher.InsertValues(values));
+
+    double in_primary_ratio;
+    ASSERT_TRUE(LookupValuesInBuckets(buckets, values, &in_primary_ratio));
+    EXPECT_GT(in_primary_ratio, 0.6);
+  }
+}
+
+TEST(CuckooMatcherTest, SucceedsWheneverKickingSucceeds) {
+  constexpr size_t kSlotsPerBucket = 2;
+  for (size_t num_buckets = GetMinNumBuckets(kNumValues, kSlotsPerBucket);;
+       ++num_buckets) {
+    const std::vector<CuckooValue> values =
+        CreateCuckooValues(kNumValues, num_buckets);
+    std::vector<Bucket> buckets(num_buckets, Bucket(kSlotsPerBucket));
+    CuckooKicker kicker(kSlotsPerBucket, absl::MakeSpan(buckets));
+    if (!kicker.InsertValues(values)) continue;
+
+    std::vector<Bucket> matched_buckets(num_buckets, Bucket(kSlotsPerBucket));
+    CuckooMatcher matcher(kSlotsPerBucket, absl::MakeSpan(matched_buckets));
+    EXPECT_TRUE(matcher.InsertValues(values));
+    break;
+  }
+}
+
+}  // namespace ci
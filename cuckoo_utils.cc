@@ -27,6 +27,7 @@
 #include "absl/container/flat_hash_set.h"
 #include "common/bit_packing.h"
 #include "common/byte_coding.h"
+#include "common/profiling.h"
 
 namespace ci {
 
@@ -184,34 +185,16 @@ void FillKicked(absl::Span<const CuckooValue> values,
 
 size_t GetRank(const Bitmap64& bitmap, const size_t idx) {
   assert(idx <= bitmap.bits());
+  CUCKOO_INDEX_COUNT_LOOKUP(RankCalls, 1);
   return bitmap.GetOnesCountBeforeLimit(/*limit=*/idx);
 }
 
-namespace {
-// Helper function that implements SelectOne() or SelectZero() depending on
-// whether `count_ones` is set.
-bool Select(const Bitmap64& bitmap, const size_t ith, const bool count_ones,
-            size_t* pos) {
-  size_t count = 0;
-  for (size_t i = 0; i < bitmap.bits(); ++i) {
-    if (bitmap.Get(i) == count_ones) {
-      if (count == ith) {
-        *pos = i;
-        return true;
-      }
-      ++count;
-    }
-  }
-  return false;
-}
-}  // namespace
-
 bool SelectOne(const Bitmap64& bitmap, const size_t ith, size_t* pos) {
-  return Select(bitmap, ith, /*count_ones=*/true, pos);
+  return bitmap.SelectOne(ith, pos);
 }
 
 bool SelectZero(const Bitmap64& bitmap, const size_t ith, size_t* pos) {
-  return Select(bitmap, ith, /*count_ones=*/false, pos);
+  return bitmap.SelectZero(ith, pos);
 }
 
 Bitmap64Ptr GetEmptyBucketsBitmap(const Bitmap64& empty_slots_bitmap,
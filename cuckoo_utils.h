@@ -19,6 +19,14 @@
 #ifndef CUCKOO_INDEX_CUCKOO_UTILS_H_
 #define CUCKOO_INDEX_CUCKOO_UTILS_H_
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cassert>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <string>
@@ -91,6 +99,38 @@ inline uint64_t GetFingerprintPrefix(const uint64_t fingerprint,
   return num_bits >= 64 ? fingerprint : fingerprint >> (64 - num_bits);
 }
 
+// Returns a mask with bit `i` set iff `fingerprints[i]` == `probe`, for the
+// first `num_fingerprints` (at most 32) entries. Compares 4 (AVX2) or 2 (NEON)
+// fingerprints per instruction if available, falls back to a branch-free
+// scalar loop otherwise.
+inline uint32_t GetFingerprintMatchMask(const uint64_t* fingerprints,
+                                        const size_t num_fingerprints,
+                                        const uint64_t probe) {
+  uint32_t mask = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i probe_vec = _mm256_set1_epi64x(probe);
+  for (; i + 4 <= num_fingerprints; i += 4) {
+    const __m256i fps = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(fingerprints + i));
+    const __m256i eq = _mm256_cmpeq_epi64(fps, probe_vec);
+    mask |= static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(eq)))
+            << i;
+  }
+#elif defined(__ARM_NEON)
+  const uint64x2_t probe_vec = vdupq_n_u64(probe);
+  for (; i + 2 <= num_fingerprints; i += 2) {
+    const uint64x2_t eq = vceqq_u64(vld1q_u64(fingerprints + i), probe_vec);
+    mask |= static_cast<uint32_t>((vgetq_lane_u64(eq, 0) & 1) |
+                                  ((vgetq_lane_u64(eq, 1) & 1) << 1))
+            << i;
+  }
+#endif
+  for (; i < num_fingerprints; ++i)
+    mask |= static_cast<uint32_t>(fingerprints[i] == probe) << i;
+  return mask;
+}
+
 // Determines the minimum number of bits to make `fingerprints` collision free.
 // Uses either prefix or suffix bits (depending on `use_prefix_bits`).
 size_t GetMinCollisionFreeFingerprintLength(
@@ -109,13 +149,77 @@ bool CheckWhetherAllBucketsOnlyContainSameSizeFingerprints(
     const std::vector<Fingerprint>& fingerprints,
     const size_t slots_per_bucket);
 
+// How CuckooValue derives the two buckets and the fingerprint of a value:
+// - SEEDED_CITY64: three seeded CityHash64 hashes reduced with modulo. This is
+//   the original scheme, needed to open indexes encoded before the others
+//   existed.
+// - SINGLE_HASH_FASTRANGE: a single CityHash64 (the same fingerprint as
+//   above), extended by two cheap mixes to the bucket hashes which are mapped
+//   to buckets by multiply-shift range reduction.
+// - PARTIAL_KEY: same as above, but the secondary bucket is derived from the
+//   primary bucket and the fingerprint's prefix (see GetAlternateBucket(..)),
+//   i.e., values can be moved between their buckets without the original
+//   value.
+enum class HashingScheme { SEEDED_CITY64, SINGLE_HASH_FASTRANGE, PARTIAL_KEY };
+
+// Maps `hash` to [0, `n`) using its high bits, without a division (Lemire's
+// "fastrange").
+inline size_t FastRange(const uint64_t hash, const size_t n) {
+  return static_cast<size_t>(
+      (static_cast<unsigned __int128>(hash) * static_cast<uint64_t>(n)) >> 64);
+}
+
+// Bijective 64-bit mixer (the finalizer of SplitMix64).
+inline uint64_t Mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Number of prefix bits of a fingerprint that the secondary bucket of
+// HashingScheme::PARTIAL_KEY is derived from (see GetAlternateBucket(..)).
+constexpr size_t kPartialKeyNumBits = 16;
+
+// Returns the other bucket of a value with the given `fingerprint` that is
+// stored in `bucket`, for HashingScheme::PARTIAL_KEY. Only depends on the
+// kPartialKeyNumBits prefix bits of `fingerprint`, i.e., values can be moved
+// between their buckets knowing only that prefix (e.g., as stored with
+// prefix bits). This is an involution, i.e.,
+// GetAlternateBucket(GetAlternateBucket(b, fp, n), fp, n) == b, which also
+// holds for `num_buckets` that are not a power of two.
+inline size_t GetAlternateBucket(const size_t bucket, const uint64_t fingerprint,
+                                 const size_t num_buckets) {
+  assert(bucket < num_buckets);
+  const size_t mixed = FastRange(
+      Mix64(GetFingerprintPrefix(fingerprint, kPartialKeyNumBits)),
+      num_buckets);
+  return mixed >= bucket ? mixed - bucket : mixed + num_buckets - bucket;
+}
+
 // Representation of a value as its two buckets and fingerprint.
 struct CuckooValue {
-  CuckooValue(long value, size_t num_buckets) {
+  CuckooValue(long value, size_t num_buckets,
+              HashingScheme hashing_scheme = HashingScheme::SEEDED_CITY64) {
     orig_value = value;
 
-    // *** POSSIBLY CHOOSE ANOTHER HASHING ALGORITHM ***
     auto value_data = reinterpret_cast<const char*>(&value);
+    if (hashing_scheme != HashingScheme::SEEDED_CITY64) {
+      // The bucket hashes are mixed from the fingerprint, using the seeds as
+      // (golden-ratio spread) salts.
+      constexpr uint64_t kGoldenRatio = 0x9e3779b97f4a7c15ULL;
+      fingerprint = absl::hash_internal::CityHash64WithSeed(
+          value_data, sizeof(value), kSeedFingerprint);
+      primary_bucket = FastRange(
+          Mix64(fingerprint + kSeedPrimaryBucket * kGoldenRatio), num_buckets);
+      secondary_bucket =
+          hashing_scheme == HashingScheme::PARTIAL_KEY
+              ? GetAlternateBucket(primary_bucket, fingerprint, num_buckets)
+              : FastRange(
+                    Mix64(fingerprint + kSeedSecondaryBucket * kGoldenRatio),
+                    num_buckets);
+      return;
+    }
+
     primary_bucket = absl::hash_internal::CityHash64WithSeed(
                          value_data, sizeof(value), kSeedPrimaryBucket) %
                      num_buckets;
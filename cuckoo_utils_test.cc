@@ -18,8 +18,11 @@
 
 #include "cuckoo_utils.h"
 
+#include <cstring>
 #include <string>
+#include <vector>
 
+#include "absl/memory/memory.h"
 #include "evaluation_utils.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -77,6 +80,26 @@ TEST(CuckooUtilsTest, GetFingerprintPrefix) {
   EXPECT_EQ(GetFingerprintPrefix(0b1011ULL << 60, /*num_bits=*/3), 0b101);
 }
 
+TEST(CuckooUtilsTest, GetFingerprintMatchMask) {
+  const std::vector<uint64_t> fingerprints = {3, 7, 3, 0, 1, 3, 7, 7};
+  EXPECT_EQ(GetFingerprintMatchMask(fingerprints.data(), /*num_fingerprints=*/8,
+                                    /*probe=*/3),
+            0b00100101);
+  EXPECT_EQ(GetFingerprintMatchMask(fingerprints.data(), /*num_fingerprints=*/8,
+                                    /*probe=*/7),
+            0b11000010);
+  EXPECT_EQ(GetFingerprintMatchMask(fingerprints.data(), /*num_fingerprints=*/8,
+                                    /*probe=*/42),
+            0b0);
+  // Only the first `num_fingerprints` entries are compared.
+  EXPECT_EQ(GetFingerprintMatchMask(fingerprints.data(), /*num_fingerprints=*/4,
+                                    /*probe=*/7),
+            0b0010);
+  EXPECT_EQ(GetFingerprintMatchMask(fingerprints.data(), /*num_fingerprints=*/2,
+                                    /*probe=*/3),
+            0b01);
+}
+
 TEST(CuckooUtilsTest, GetMinCollisionFreeFingerprintLength) {
   const std::vector<uint64_t> fingerprints = {0b1, 0b11, 0b111};
 
@@ -110,6 +133,48 @@ TEST(CuckooUtilsTest, CheckWhetherAllBucketsOnlyContainSameSizeFingerprints) {
       fingerprints, /*slots_per_bucket=*/4));
 }
 
+TEST(CuckooValueTest, HashingSchemes) {
+  for (const size_t num_buckets : {1, 7, 1000}) {
+    for (long value = -50; value < 50; ++value) {
+      const CuckooValue seeded(value, num_buckets,
+                               HashingScheme::SEEDED_CITY64);
+      const CuckooValue single(value, num_buckets,
+                               HashingScheme::SINGLE_HASH_FASTRANGE);
+      const CuckooValue partial(value, num_buckets,
+                                HashingScheme::PARTIAL_KEY);
+      // All schemes share the same fingerprint.
+      EXPECT_EQ(single.fingerprint, seeded.fingerprint);
+      EXPECT_EQ(partial.fingerprint, seeded.fingerprint);
+      for (const CuckooValue& v : {seeded, single, partial}) {
+        EXPECT_LT(v.primary_bucket, num_buckets);
+        EXPECT_LT(v.secondary_bucket, num_buckets);
+      }
+      EXPECT_EQ(partial.primary_bucket, single.primary_bucket);
+      // The buckets of PARTIAL_KEY can be derived from each other.
+      EXPECT_EQ(GetAlternateBucket(partial.primary_bucket, partial.fingerprint,
+                                   num_buckets),
+                partial.secondary_bucket);
+      EXPECT_EQ(GetAlternateBucket(partial.secondary_bucket,
+                                   partial.fingerprint, num_buckets),
+                partial.primary_bucket);
+      // Only the prefix of the fingerprint is needed.
+      EXPECT_EQ(GetAlternateBucket(
+                    partial.primary_bucket,
+                    partial.fingerprint &
+                        ~FingerprintSuffixMask(64 - kPartialKeyNumBits),
+                    num_buckets),
+                partial.secondary_bucket);
+    }
+  }
+}
+
+TEST(CuckooValueTest, FastRange) {
+  EXPECT_EQ(FastRange(0, 10), 0);
+  EXPECT_EQ(FastRange(~0ULL, 10), 9);
+  EXPECT_EQ(FastRange(1ULL << 63, 10), 5);
+  EXPECT_EQ(FastRange(~0ULL, 1), 0);
+}
+
 TEST(BucketTest, BucketInsertValue) {
   Bucket bucket(/*num_slots=*/1);
   // Insert should succeed, since `bucket` has capacity for another slot.
@@ -169,6 +234,20 @@ TEST(BitmapRank, GetRankWithRankLookupTable) {
   }
 }
 
+TEST(BitmapRank, CopyAssignmentDropsRankLookupTable) {
+  const size_t num_bits = kRankBlockSize * 2 + kRankBlockSize / 10;
+  Bitmap64 with_rank(num_bits, /*fill_value=*/true);
+  with_rank.InitRankLookupTable();
+  Bitmap64 with_other_rank(num_bits);
+  with_other_rank.InitRankLookupTable();
+
+  // The copied bits are ranked without the (since stale) table of the target.
+  with_other_rank = with_rank;
+  with_other_rank.Set(0, false);
+  EXPECT_EQ(with_other_rank.GetOnesCount(), num_bits - 1);
+  EXPECT_EQ(GetRank(with_other_rank, num_bits - 1), num_bits - 2);
+}
+
 TEST(BitmapSelect, SelectSingleBit) {
   size_t pos;
 
@@ -234,6 +313,40 @@ TEST(BitmapSelect, SelectRandomBitmap) {
   ASSERT_EQ(pos, 1);
 }
 
+TEST(BitmapSelect, SelectWithRankLookupTable) {
+  // Spans multiple select samples with sparse and dense regions.
+  const size_t num_bits = kSelectSampleRate * 6 + kRankBlockSize / 10;
+  std::vector<long> bits(num_bits);
+  for (size_t i = 0; i < num_bits; ++i)
+    bits[i] = (i < num_bits / 2) ? (i % 97 == 0) : (i % 5 != 0);
+  const Bitmap64 bitmap = CreateBitmap(bits);
+  Bitmap64 bitmap_with_rank = CreateBitmap(bits);
+  bitmap_with_rank.InitRankLookupTable();
+
+  size_t num_ones = 0;
+  size_t num_zeros = 0;
+  size_t pos;
+  for (size_t i = 0; i < num_bits; ++i) {
+    if (bits[i]) {
+      ASSERT_TRUE(SelectOne(bitmap, num_ones, &pos));
+      ASSERT_EQ(pos, i);
+      ASSERT_TRUE(SelectOne(bitmap_with_rank, num_ones, &pos));
+      ASSERT_EQ(pos, i);
+      ++num_ones;
+    } else {
+      ASSERT_TRUE(SelectZero(bitmap, num_zeros, &pos));
+      ASSERT_EQ(pos, i);
+      ASSERT_TRUE(SelectZero(bitmap_with_rank, num_zeros, &pos));
+      ASSERT_EQ(pos, i);
+      ++num_zeros;
+    }
+  }
+  ASSERT_FALSE(SelectOne(bitmap, num_ones, &pos));
+  ASSERT_FALSE(SelectOne(bitmap_with_rank, num_ones, &pos));
+  ASSERT_FALSE(SelectZero(bitmap, num_zeros, &pos));
+  ASSERT_FALSE(SelectZero(bitmap_with_rank, num_zeros, &pos));
+}
+
 TEST(EmptyBucketsBitmap, GetEmptyBucketsBitmap) {
   const Bitmap64 empty_slots_bitmap = CreateBitmap({0, 1, 1, 1});
 
@@ -272,4 +385,90 @@ TEST(BitmapSerialization, EncodeAndDecodeBitmap) {
   }
 }
 
+TEST(BitmapSerialization, DenseDecodeViewDoesNotCopy) {
+  // Not a multiple of 64 bits, so that the last word has unused bits.
+  const size_t num_bits = 1000;
+  std::vector<long> bits(num_bits);
+  for (size_t i = 0; i < num_bits; ++i) bits[i] = (i % 3 == 0);
+  const Bitmap64 bitmap = CreateBitmap(bits);
+
+  std::string encoded;
+  Bitmap64::DenseEncode(bitmap, &encoded);
+  const Bitmap64View view = Bitmap64::DenseDecodeView(encoded);
+
+  EXPECT_EQ(view.data(), encoded.data() + sizeof(uint32_t));
+  ASSERT_EQ(view.bits(), num_bits);
+  EXPECT_EQ(view.GetOnesCount(), bitmap.GetOnesCount());
+  for (size_t i = 0; i < num_bits; ++i) {
+    ASSERT_EQ(view.Get(i), bitmap.Get(i));
+    ASSERT_EQ(view.GetOnesCountBeforeLimit(i), GetRank(bitmap, i));
+  }
+  EXPECT_EQ(view.ToBitmap().ToString(), bitmap.ToString());
+}
+
+TEST(BitmapBulkOps, AndOrAndNot) {
+  // Spans several AVX2 vectors plus a partial word.
+  const size_t num_bits = 64 * 13 + 5;
+  std::vector<long> bits_a(num_bits);
+  std::vector<long> bits_b(num_bits);
+  for (size_t i = 0; i < num_bits; ++i) {
+    bits_a[i] = (i % 3 == 0);
+    bits_b[i] = (i % 5 == 0);
+  }
+  const Bitmap64 a = CreateBitmap(bits_a);
+  const Bitmap64 b = CreateBitmap(bits_b);
+
+  // Views on an unaligned copy of the words of `b`.
+  std::string buffer(1 + b.view().num_words() * sizeof(uint64_t), '\0');
+  std::memcpy(&buffer[1], b.view().data(), buffer.size() - 1);
+  const Bitmap64View unaligned_b(buffer.data() + 1, num_bits);
+
+  for (const Bitmap64View& other : {b.view(), unaligned_b}) {
+    Bitmap64 result_and = a;
+    result_and.And(other);
+    Bitmap64 result_or = a;
+    result_or.Or(other);
+    Bitmap64 result_and_not = a;
+    result_and_not.AndNot(other);
+    for (size_t i = 0; i < num_bits; ++i) {
+      ASSERT_EQ(result_and.Get(i), bits_a[i] && bits_b[i]);
+      ASSERT_EQ(result_or.Get(i), bits_a[i] || bits_b[i]);
+      ASSERT_EQ(result_and_not.Get(i), bits_a[i] && !bits_b[i]);
+    }
+  }
+}
+
+TEST(BitmapBulkOps, OrIgnoresBitsPastSize) {
+  const std::string words(2 * sizeof(uint64_t), '\xff');
+  Bitmap64 bitmap(70);
+  bitmap.Or(Bitmap64View(words.data(), 70));
+  EXPECT_TRUE(bitmap.IsAllOnes());
+  EXPECT_EQ(bitmap.GetOnesCount(), 70);
+  EXPECT_EQ(bitmap.GetWord(1), (1ULL << 6) - 1);
+}
+
+TEST(BitmapBulkOps, ForEachSetBit) {
+  const Bitmap64 bitmap = CreateBitmap({0, 1, 1, 0, 1});
+  std::vector<size_t> positions;
+  bitmap.ForEachSetBit([&](size_t pos) { positions.push_back(pos); });
+  EXPECT_THAT(positions, ::testing::ElementsAre(1, 2, 4));
+  EXPECT_EQ(bitmap.TrueBitIndices(), positions);
+  EXPECT_EQ(bitmap.ToString(), "10110");
+}
+
+TEST(BitmapBulkOps, GetGlobalBitmap) {
+  // Sizes not multiples of 64, so that bitmaps start within words.
+  std::vector<Bitmap64Ptr> bitmaps;
+  std::vector<long> expected;
+  for (const size_t num_bits : {70, 3, 0, 130, 64}) {
+    std::vector<long> bits(num_bits);
+    for (size_t i = 0; i < num_bits; ++i) bits[i] = (i % 7 != 1);
+    bitmaps.push_back(absl::make_unique<Bitmap64>(CreateBitmap(bits)));
+    bitmaps.push_back(nullptr);
+    expected.insert(expected.end(), bits.begin(), bits.end());
+  }
+  EXPECT_EQ(Bitmap64::GetGlobalBitmap(bitmaps).ToString(),
+            CreateBitmap(expected).ToString());
+}
+
 }  // namespace ci
@@ -16,8 +16,18 @@
 // File: data.cc
 // -----------------------------------------------------------------------------
 
+#include <cctype>
+#include <deque>
+#include <fstream>
 #include <random>
+#include <thread>
+#include <unordered_set>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/strip.h"
+#include "common/mapped_file.h"
 #include "data.h"
 
 namespace ci {
@@ -25,6 +35,456 @@ namespace ci {
 const long Column::kIntNullSentinel;
 const char* const Column::kStringNullSentinel;
 
+namespace {
+
+// The fields of the requested columns of a chunk of CSV lines.
+struct CsvChunk {
+  // Per requested column. Point into the mapped file, or into `unescaped` for
+  // quoted fields with escaped quotes.
+  std::vector<std::vector<absl::string_view>> fields;
+  std::deque<std::string> unescaped;
+  // Per requested column, whether all its fields in the chunk are digits (or
+  // NULL).
+  std::vector<bool> is_int;
+  // Index of the chunk's first row among all rows.
+  size_t first_row = 0;
+
+  size_t num_rows() const { return fields.empty() ? 0 : fields[0].size(); }
+};
+
+// Calls `fn(i)` for all `i` in [0, `n`), each on its own thread (for `n` > 1).
+template <typename Fn>
+void ForEachInParallel(size_t n, const Fn& fn) {
+  if (n == 1) {
+    fn(0);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(n);
+  for (size_t i = 0; i < n; ++i) threads.emplace_back([&, i]() { fn(i); });
+  for (std::thread& thread : threads) thread.join();
+}
+
+// Splits the CSV `line` (without line break) into `fields`. Unescaped quoted
+// fields are kept in `unescaped`.
+void SplitCsvLine(absl::string_view line, std::deque<std::string>* unescaped,
+                  std::vector<absl::string_view>* fields) {
+  fields->clear();
+  size_t pos = 0;
+  while (true) {
+    if (pos < line.size() && line[pos] == '"') {
+      // Quoted field, only copied if it contains escaped quotes.
+      const size_t begin = ++pos;
+      bool escaped = false;
+      while (pos < line.size()) {
+        if (line[pos] == '"') {
+          if (pos + 1 < line.size() && line[pos + 1] == '"') {
+            escaped = true;
+            pos += 2;
+            continue;
+          }
+          break;
+        }
+        ++pos;
+      }
+      const absl::string_view field = line.substr(begin, pos - begin);
+      if (escaped) {
+        std::string& copy = unescaped->emplace_back();
+        copy.reserve(field.size());
+        for (size_t i = 0; i < field.size(); ++i) {
+          copy.push_back(field[i]);
+          if (field[i] == '"') ++i;
+        }
+        fields->push_back(copy);
+      } else {
+        fields->push_back(field);
+      }
+      // Skip the closing quote.
+      ++pos;
+      pos = std::min(line.find(',', pos), line.size());
+    } else {
+      const size_t end = std::min(line.find(',', pos), line.size());
+      fields->push_back(line.substr(pos, end - pos));
+      pos = end;
+    }
+    if (pos >= line.size()) return;
+    // Skip the comma.
+    ++pos;
+  }
+}
+
+// Calls `fn(line)` for all non-empty lines of `data`, without their line
+// breaks ("\n" or "\r\n").
+template <typename Fn>
+void ForEachCsvLine(absl::string_view data, const Fn& fn) {
+  while (!data.empty()) {
+    const size_t end = std::min(data.find('\n'), data.size());
+    absl::string_view line = data.substr(0, end);
+    data.remove_prefix(std::min(end + 1, data.size()));
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (!line.empty()) fn(line);
+  }
+}
+
+bool IsIntField(absl::string_view field) {
+  if (field == Column::kStringNullSentinel) return true;
+  if (absl::ConsumePrefix(&field, "-") && field.empty()) return false;
+  return !field.empty() &&
+         std::all_of(field.begin(), field.end(),
+                     [](unsigned char c) { return std::isdigit(c); });
+}
+
+// Parses the requested columns of the lines in `data` into `chunk`.
+void ParseCsvChunk(absl::string_view data,
+                   const std::vector<CsvColumnInfo>& column_infos,
+                   CsvChunk* chunk) {
+  chunk->fields.resize(column_infos.size());
+  chunk->is_int.assign(column_infos.size(), true);
+  std::vector<absl::string_view> fields;
+  ForEachCsvLine(data, [&](absl::string_view line) {
+    SplitCsvLine(line, &chunk->unescaped, &fields);
+    for (size_t i = 0; i < column_infos.size(); ++i) {
+      const size_t index = column_infos[i].index;
+      if (index >= fields.size()) {
+        std::cerr << "Missing column '" << column_infos[i].name
+                  << "' in line: " << line << std::endl;
+        std::exit(EXIT_FAILURE);
+      }
+      chunk->fields[i].push_back(fields[index]);
+      if (chunk->is_int[i] && !IsIntField(fields[index]))
+        chunk->is_int[i] = false;
+    }
+  });
+}
+
+// Creates the column from field `column_idx` of all `chunks`.
+ColumnPtr CreateCsvColumn(const CsvColumnInfo& info, size_t column_idx,
+                          const std::vector<CsvChunk>& chunks, size_t num_rows,
+                          StringEncoding string_encoding) {
+  std::vector<long> data(num_rows);
+  if (info.type == DataType::long) {
+    ForEachInParallel(chunks.size(), [&](size_t chunk_idx) {
+      const CsvChunk& chunk = chunks[chunk_idx];
+      long* out = data.data() + chunk.first_row;
+      for (const absl::string_view field : chunk.fields[column_idx]) {
+        if (field == Column::kStringNullSentinel) {
+          *out++ = Column::kIntNullSentinel;
+        } else if (!absl::SimpleAtoi(field, out++)) {
+          std::cerr << "Integer out of range in column '" << info.name
+                    << "': " << field << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+      }
+    });
+    return Column::IntColumn(info.name, std::move(data));
+  }
+
+  // Keep the original strings, see Column::ValueAt(..).
+  std::vector<std::string> str_data(num_rows);
+  if (string_encoding == StringEncoding::HASH) {
+    ForEachInParallel(chunks.size(), [&](size_t chunk_idx) {
+      const CsvChunk& chunk = chunks[chunk_idx];
+      size_t row = chunk.first_row;
+      for (const absl::string_view field : chunk.fields[column_idx]) {
+        data[row] = field == Column::kStringNullSentinel
+                        ? Column::kIntNullSentinel
+                        : Column::HashStringKey(field);
+        str_data[row++] = std::string(field);
+      }
+    });
+    return Column::EncodedStringColumn(info.name, std::move(data),
+                                       std::move(str_data), string_encoding,
+                                       /*string_dict=*/{});
+  }
+
+  // Collect the distinct strings per chunk and merge them, see the `Column`
+  // constructor for the dictionary (NULL always gets the key 0).
+  std::vector<absl::flat_hash_set<absl::string_view>> chunk_strings(
+      chunks.size());
+  ForEachInParallel(chunks.size(), [&](size_t chunk_idx) {
+    for (const absl::string_view field : chunks[chunk_idx].fields[column_idx])
+      chunk_strings[chunk_idx].insert(field);
+  });
+  absl::flat_hash_set<absl::string_view> distinct_strings =
+      std::move(chunk_strings[0]);
+  for (size_t i = 1; i < chunk_strings.size(); ++i) {
+    distinct_strings.insert(chunk_strings[i].begin(), chunk_strings[i].end());
+    chunk_strings[i].clear();
+  }
+  distinct_strings.erase(Column::kStringNullSentinel);
+  std::vector<absl::string_view> sorted_strings(distinct_strings.begin(),
+                                                distinct_strings.end());
+  std::sort(sorted_strings.begin(), sorted_strings.end());
+  sorted_strings.insert(sorted_strings.begin(), Column::kStringNullSentinel);
+
+  absl::flat_hash_map<absl::string_view, long> keys;
+  keys.reserve(sorted_strings.size());
+  std::unordered_map<std::string, long> string_dict;
+  string_dict.reserve(sorted_strings.size());
+  for (size_t i = 0; i < sorted_strings.size(); ++i) {
+    keys[sorted_strings[i]] = i;
+    string_dict[std::string(sorted_strings[i])] = i;
+  }
+
+  ForEachInParallel(chunks.size(), [&](size_t chunk_idx) {
+    const CsvChunk& chunk = chunks[chunk_idx];
+    size_t row = chunk.first_row;
+    for (const absl::string_view field : chunk.fields[column_idx]) {
+      data[row] = keys.find(field)->second;
+      str_data[row++] = std::string(field);
+    }
+  });
+  return Column::EncodedStringColumn(info.name, std::move(data),
+                                     std::move(str_data), string_encoding,
+                                     std::move(string_dict));
+}
+
+}  // namespace
+
+std::unique_ptr<Table> Table::FromCsv(
+    const std::string& file_path, const std::vector<std::string> column_names,
+    StringEncoding string_encoding, size_t num_threads) {
+  const MappedFilePtr mapped_file = MappedFile::Open(file_path);
+  absl::string_view data = mapped_file->data();
+
+  // Split off the header.
+  const size_t header_end = std::min(data.find('\n'), data.size());
+  absl::string_view header = data.substr(0, header_end);
+  if (!header.empty() && header.back() == '\r') header.remove_suffix(1);
+  data.remove_prefix(std::min(header_end + 1, data.size()));
+  std::deque<std::string> unescaped_header;
+  std::vector<absl::string_view> present_column_names;
+  SplitCsvLine(header, &unescaped_header, &present_column_names);
+
+  // Make sure all the requested columns are present and map positions in
+  // `column_names` to column positions in the data.
+  std::vector<CsvColumnInfo> column_infos;
+  column_infos.reserve(column_names.size());
+  for (const std::string& column_name : column_names) {
+    auto pos = std::find(present_column_names.begin(),
+                         present_column_names.end(), column_name);
+
+    if (pos == present_column_names.end()) {
+      std::cerr << "Unknown column '" << column_name
+                << "'. Available columns: "
+                << absl::StrJoin(present_column_names, ",") << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    column_infos.emplace_back(
+        column_name, DataType::STRING,
+        static_cast<size_t>(std::distance(present_column_names.begin(), pos)));
+  }
+
+  // Split the lines into chunks (at line breaks) and parse them in parallel.
+  num_threads = std::max<size_t>(1, num_threads);
+  std::vector<size_t> boundaries(num_threads + 1, data.size());
+  boundaries[0] = 0;
+  for (size_t i = 1; i < num_threads; ++i) {
+    const size_t pos = std::max(boundaries[i - 1], i * data.size() / num_threads);
+    const size_t line_break = data.find('\n', pos);
+    boundaries[i] =
+        line_break == absl::string_view::npos ? data.size() : line_break + 1;
+  }
+  std::vector<CsvChunk> chunks(num_threads);
+  ForEachInParallel(num_threads, [&](size_t i) {
+    ParseCsvChunk(data.substr(boundaries[i], boundaries[i + 1] - boundaries[i]),
+                  column_infos, &chunks[i]);
+  });
+  size_t num_rows = 0;
+  for (CsvChunk& chunk : chunks) {
+    chunk.first_row = num_rows;
+    num_rows += chunk.num_rows();
+  }
+
+  // Columns whose fields all are integers become DataType::long columns.
+  for (size_t i = 0; i < column_infos.size(); ++i) {
+    if (std::all_of(chunks.begin(), chunks.end(),
+                    [i](const CsvChunk& chunk) { return chunk.is_int[i]; }))
+      column_infos[i].type = DataType::long;
+  }
+
+  // Create columns.
+  std::vector<std::unique_ptr<Column>> columns;
+  columns.reserve(column_infos.size());
+  for (size_t i = 0; i < column_infos.size(); ++i) {
+    columns.push_back(CreateCsvColumn(column_infos[i], i, chunks, num_rows,
+                                      string_encoding));
+  }
+
+  return std::unique_ptr<Table>(new Table("test_table", std::move(columns)));
+}
+
+namespace {
+
+// Identifies files written by Table::SaveBinary(..).
+constexpr absl::string_view kBinaryTableMagic = "CITABLE2";
+// The magic and the offset of the metadata.
+constexpr size_t kBinaryTablePreambleSize = 16;
+
+}  // namespace
+
+void Table::SaveBinary(const std::string& path,
+                       absl::string_view source) const {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Couldn't open " << path << " for writing." << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+  // ** Preamble.
+  uint64_t metadata_offset = kBinaryTablePreambleSize;
+  for (const ColumnPtr& column : columns_)
+    metadata_offset += column->num_rows() * sizeof(long);
+  file.write(kBinaryTableMagic.data(), kBinaryTableMagic.size());
+  file.write(reinterpret_cast<const char*>(&metadata_offset),
+             sizeof(metadata_offset));
+
+  // ** Values. The preamble keeps them 8-byte aligned.
+  for (const ColumnPtr& column : columns_) {
+    file.write(reinterpret_cast<const char*>(column->data().data()),
+               column->num_rows() * sizeof(long));
+  }
+
+  // ** Metadata.
+  ByteBuffer metadata;
+  PutString(name_, &metadata);
+  PutString(source, &metadata);
+  PutVarint32(columns_.size(), &metadata);
+  for (const ColumnPtr& column : columns_) {
+    PutString(column->name(), &metadata);
+    PutVarint32(static_cast<uint32_t>(column->type()), &metadata);
+    PutVarint32(static_cast<uint32_t>(column->string_encoding()), &metadata);
+    PutPrimitive<uint64_t>(column->num_rows(), &metadata);
+    PutPrimitive<int64_t>(column->min(), &metadata);
+    PutPrimitive<int64_t>(column->max(), &metadata);
+    PutPrimitive<uint64_t>(column->num_distinct_values(), &metadata);
+    const Column::Moments& moments = column->GetMoments();
+    PutPrimitive<double>(moments.mean, &metadata);
+    PutPrimitive<double>(moments.variance, &metadata);
+    PutPrimitive<double>(moments.skewness, &metadata);
+    PutPrimitive<double>(moments.kurtosis, &metadata);
+
+    if (column->type() != DataType::STRING) continue;
+    if (column->string_encoding() == StringEncoding::HASH) {
+      for (const std::string& str : column->str_data_) PutString(str, &metadata);
+      continue;
+    }
+    // Dictionary keys are dense, i.e., the strings are written in key order.
+    std::vector<absl::string_view> strings(column->string_dict_.size());
+    for (const auto& [str, key] : column->string_dict_) strings[key] = str;
+    PutVarint64(strings.size(), &metadata);
+    for (const absl::string_view str : strings) PutString(str, &metadata);
+  }
+  file.write(metadata.data(), metadata.pos());
+  if (!file) {
+    std::cerr << "Couldn't write " << path << "." << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+std::unique_ptr<Table> Table::OpenBinary(const std::string& path,
+                                         std::string* source) {
+  const std::shared_ptr<const MappedFile> mapped_file = MappedFile::Open(path);
+  const absl::string_view data = mapped_file->data();
+  if (data.size() < kBinaryTablePreambleSize ||
+      data.substr(0, kBinaryTableMagic.size()) != kBinaryTableMagic) {
+    std::cerr << path << " wasn't written by Table::SaveBinary(..)."
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = kBinaryTableMagic.size();
+  pos = GetPrimitive<uint64_t>(span, &pos);
+
+  const std::string name(GetString(span, &pos));
+  const absl::string_view saved_source = GetString(span, &pos);
+  if (source != nullptr) *source = std::string(saved_source);
+  const size_t num_columns = GetVarint32(span, &pos);
+  std::vector<ColumnPtr> columns;
+  columns.reserve(num_columns);
+  size_t values_offset = kBinaryTablePreambleSize;
+  for (size_t i = 0; i < num_columns; ++i) {
+    const std::string column_name(GetString(span, &pos));
+    const DataType type = static_cast<DataType>(GetVarint32(span, &pos));
+    const StringEncoding string_encoding =
+        static_cast<StringEncoding>(GetVarint32(span, &pos));
+    const size_t num_rows = GetPrimitive<uint64_t>(span, &pos);
+    const absl::Span<const long> values(
+        reinterpret_cast<const long*>(data.data() + values_offset), num_rows);
+    values_offset += num_rows * sizeof(long);
+    const long min = GetPrimitive<int64_t>(span, &pos);
+    const long max = GetPrimitive<int64_t>(span, &pos);
+    const size_t num_distinct_values = GetPrimitive<uint64_t>(span, &pos);
+    Column::Moments moments;
+    moments.mean = GetPrimitive<double>(span, &pos);
+    moments.variance = GetPrimitive<double>(span, &pos);
+    moments.skewness = GetPrimitive<double>(span, &pos);
+    moments.kurtosis = GetPrimitive<double>(span, &pos);
+
+    std::unordered_map<std::string, long> string_dict;
+    std::vector<std::string> str_data;
+    if (type == DataType::STRING) {
+      str_data.reserve(num_rows);
+      if (string_encoding == StringEncoding::HASH) {
+        for (size_t row = 0; row < num_rows; ++row)
+          str_data.emplace_back(GetString(span, &pos));
+      } else {
+        std::vector<std::string> strings(GetVarint64(span, &pos));
+        string_dict.reserve(strings.size());
+        for (size_t key = 0; key < strings.size(); ++key) {
+          strings[key] = std::string(GetString(span, &pos));
+          string_dict[strings[key]] = key;
+        }
+        for (const long key : values) str_data.push_back(strings[key]);
+      }
+    }
+
+    // Need to use new since we're calling a private c'tor.
+    ColumnPtr column(new Column(column_name, type, string_encoding, values,
+                                mapped_file, std::move(string_dict),
+                                std::move(str_data)));
+    column->min_max_.Set(std::make_pair(min, max));
+    column->num_distinct_values_.Set(num_distinct_values);
+    column->estimated_num_distinct_values_.Set(num_distinct_values);
+    column->moments_.Set(moments);
+    columns.push_back(std::move(column));
+  }
+  assert(pos == data.size());
+
+  return std::unique_ptr<Table>(new Table(name, std::move(columns)));
+}
+
+std::string CsvTableSource(const std::string& file_path,
+                           const std::vector<std::string>& column_names,
+                           StringEncoding string_encoding) {
+  return absl::StrCat(
+      "csv: ", file_path, " columns=", absl::StrJoin(column_names, ","),
+      " string_encoding=",
+      string_encoding == StringEncoding::HASH ? "HASH" : "DICTIONARY");
+}
+
+std::unique_ptr<Table> GetOrCreateCachedTable(
+    const std::string& cache_path, const std::string& source,
+    const std::function<std::unique_ptr<Table>()>& create) {
+  if (!cache_path.empty() && std::ifstream(cache_path).good()) {
+    std::cout << "Opening cached table " << cache_path << "..." << std::endl;
+    std::string cached_source;
+    std::unique_ptr<Table> table = Table::OpenBinary(cache_path, &cached_source);
+    if (cached_source != source) {
+      std::cerr << cache_path << " caches the table of '" << cached_source
+                << "' instead of '" << source << "'. Delete it to recreate it."
+                << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    return table;
+  }
+  std::unique_ptr<Table> table = create();
+  if (!cache_path.empty()) table->SaveBinary(cache_path, source);
+  return table;
+}
+
 std::unique_ptr<Table> GenerateUniformData(const size_t generate_num_values,
                                            const size_t num_unique_values) {
   std::mt19937 gen(42);
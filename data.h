@@ -23,23 +23,30 @@
 #include <cmath>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <memory>
 #include <numeric>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/hash/internal/city.h"
 #include "absl/memory/memory.h"
 #include "absl/random/random.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "boost/math/tools/univariate_statistics.hpp"
 #include "common/byte_coding.h"
+#include "common/hyper_log_log.h"
+#include "common/mapped_file.h"
+#include "common/memoized.h"
 #include "evaluation_utils.h"
-#include "single_include/csv.hpp"
 
 namespace ci {
 
@@ -56,6 +63,17 @@ inline std::string DataTypeName(DataType data_type) {
   return "UNKNOWN";
 }
 
+// How the values of STRING columns are mapped to the integer keys that are
+// indexed:
+// - DICTIONARY: order-preserving codes from a dictionary of all distinct
+//   strings of the column (see the `Column` constructor below). Lookups need
+//   the same dictionary to translate their strings.
+// - HASH: a 64-bit hash of the string itself (see Column::HashStringKey(..)),
+//   i.e., keys can be computed for each stripe or query on its own, without a
+//   dictionary. Range-based structures like ZoneMaps are useless on these
+//   keys though.
+enum class StringEncoding { DICTIONARY, HASH };
+
 class Column;
 using ColumnPtr = std::unique_ptr<Column>;
 
@@ -72,13 +90,47 @@ class Column {
     return ColumnPtr(new Column(name, DataType::long, std::move(data)));
   }
 
+  // Creates a STRING column from keys computed by the caller, e.g., by
+  // Table::FromCsv(..): `data` holds the keys of `str_data` w.r.t.
+  // `string_encoding`, and `string_dict` is the dictionary of DICTIONARY
+  // columns (empty for HASH).
+  static ColumnPtr EncodedStringColumn(
+      const std::string& name, std::vector<long> data,
+      std::vector<std::string> str_data, StringEncoding string_encoding,
+      std::unordered_map<std::string, long> string_dict) {
+    return ColumnPtr(new Column(name, std::move(data), std::move(str_data),
+                                string_encoding, std::move(string_dict)));
+  }
+
+  // Returns the key of `str` in STRING columns with StringEncoding::HASH.
+  // Never returns `kIntNullSentinel` (which is the key of NULL strings).
+  static long HashStringKey(absl::string_view str) {
+    const long key =
+        static_cast<long>(absl::hash_internal::CityHash64(str.data(), str.size()));
+    return key != kIntNullSentinel ? key : kIntNullSentinel + 1;
+  }
+
+  // `string_encoding` only applies to STRING columns.
   Column(const std::string& name, const DataType type,
-         const std::vector<std::string>& str_data)
-      : name_(name), type_(type), str_data_(str_data) {
+         const std::vector<std::string>& str_data,
+         StringEncoding string_encoding = StringEncoding::DICTIONARY)
+      : name_(name),
+        type_(type),
+        string_encoding_(string_encoding),
+        str_data_(str_data) {
     if (type == DataType::long) {
       // Convert string to long.
-      data_.reserve(str_data.size());
-      for (const std::string& str : str_data) data_.push_back(std::stoi(str));
+      owned_data_.reserve(str_data.size());
+      for (const std::string& str : str_data)
+        owned_data_.push_back(std::stoi(str));
+    } else if (type == DataType::STRING &&
+               string_encoding == StringEncoding::HASH) {
+      // Hash-encode strings, i.e., without building a dictionary.
+      owned_data_.reserve(str_data.size());
+      for (const std::string& str : str_data) {
+        owned_data_.push_back(str == kStringNullSentinel ? kIntNullSentinel
+                                                         : HashStringKey(str));
+      }
     } else if (type == DataType::STRING) {
       // Dict-encode strings. Essentially, encode strings as dense integers in
       // an order-preserving way. Also called order-preserving minimal perfect
@@ -94,7 +146,7 @@ class Column {
       //
       // We make sure that NULL values get an ID of 0 – that way we can detect
       // and ignore them when building some data structures, e.g. ZoneMaps.
-      data_.reserve(str_data.size());
+      owned_data_.reserve(str_data.size());
       absl::flat_hash_set<std::string> distinct_strings(str_data.begin(),
                                                         str_data.end());
       distinct_strings.erase(kStringNullSentinel);
@@ -114,43 +166,30 @@ class Column {
           std::cerr << "Error during dict encoding." << std::endl;
           exit(EXIT_FAILURE);
         }
-        data_.push_back(it->second);
+        owned_data_.push_back(it->second);
       }
     } else {
       std::cerr << "Unsupported data type." << std::endl;
       exit(EXIT_FAILURE);
     }
-
-    // Initialize `distinct_values_`.
-    distinct_values_ = std::unordered_set<long>(data_.begin(), data_.end());
-
-    // Set `min_` and `max_`.
-    const auto min_max = std::minmax_element(begin(data_), end(data_));
-    min_ = *min_max.first;
-    max_ = *min_max.second;
-
-    // Compute standard moments.
-    mean_ = boost::math::tools::mean(data_);
-    variance_ = boost::math::tools::variance(data_);
-    skewness_ = boost::math::tools::skewness(data_);
-    kurtosis_ = boost::math::tools::kurtosis(data_);
-
-    PrintStats();
+    data_ = owned_data_;
   }
 
+  // Computes all stats (if not done before), so only call it when they are
+  // actually needed.
   void PrintStats() const {
+    const Moments& moments = GetMoments();
     std::cout << "column: " << name_ << " (" << DataTypeName(type_)
-              << "), min: " << min_ << ", max: " << max_
+              << "), min: " << min() << ", max: " << max()
               << ", #rows: " << num_rows()
               << ", cardinality: " << num_distinct_values()
-              << ", mean: " << mean_ << ", variance: " << variance_
-              << ", skewness: " << skewness_ << ", kurtosis: " << kurtosis_
-              << std::endl;
+              << ", mean: " << moments.mean
+              << ", variance: " << moments.variance
+              << ", skewness: " << moments.skewness
+              << ", kurtosis: " << moments.kurtosis << std::endl;
   }
 
-  bool Contains(long value) const {
-    return distinct_values_.find(value) != distinct_values_.end();
-  }
+  bool Contains(long value) const { return GetDistinctSet().contains(value); }
 
   bool StripeContains(std::size_t num_rows_per_stripe, std::size_t stripe_id,
                       long value) const {
@@ -173,20 +212,36 @@ class Column {
   // position.
   void Reorder(absl::Span<const size_t> indexes) {
     assert(data_.size() == indexes.size());
+    // Mapped columns (see Table::OpenBinary(..)) get their own copy here.
     std::vector<long> new_data(data_.size());
     for (size_t i = 0; i < data_.size(); ++i) {
       new_data[i] = data_[indexes[i]];
     }
-    data_.swap(new_data);
+    owned_data_.swap(new_data);
+    data_ = owned_data_;
+    // Keep the original strings in the same order.
+    if (!str_data_.empty()) {
+      std::vector<std::string> new_str_data(str_data_.size());
+      for (size_t i = 0; i < str_data_.size(); ++i) {
+        new_str_data[i] = std::move(str_data_[indexes[i]]);
+      }
+      str_data_.swap(new_str_data);
+    }
   }
 
   std::string name() const { return name_; }
   DataType type() const { return type_; }
-  const std::vector<long>& data() const { return data_; }
+  StringEncoding string_encoding() const { return string_encoding_; }
+  // Points into the mapped file for columns of Table::OpenBinary(..).
+  absl::Span<const long> data() const { return data_; }
   long operator[](std::size_t idx) const { return data_[idx]; }
 
   // Returns the original value (not an encoded ID) at the given position.
   std::string ValueAt(std::size_t idx) const {
+    // Hash keys can't be reversed, but the original strings are kept.
+    if (type_ == DataType::STRING && string_encoding_ == StringEncoding::HASH)
+      return str_data_[idx];
+
     // For long column just return the value.
     if (string_dict_.empty()) return absl::StrCat(data_[idx]);
 
@@ -197,13 +252,34 @@ class Column {
         ->first;
   }
 
-  std::vector<long> distinct_values() const {
-    return std::vector<long>(distinct_values_.begin(), distinct_values_.end());
+  // The stats below are computed on first use and then cached. They don't
+  // depend on the order of the rows, i.e., Reorder(..) keeps them.
+
+  // Returns the distinct values in no particular order.
+  const std::vector<long>& distinct_values() const {
+    return distinct_values_.Get([this]() {
+      const absl::flat_hash_set<long>& set = GetDistinctSet();
+      return std::vector<long>(set.begin(), set.end());
+    });
   }
   std::size_t num_rows() const { return data_.size(); }
-  std::size_t num_distinct_values() const { return distinct_values_.size(); }
-  long min() const { return min_; }
-  long max() const { return max_; }
+  std::size_t num_distinct_values() const {
+    return num_distinct_values_.Get(
+        [this]() { return GetDistinctSet().size(); });
+  }
+
+  // Estimates num_distinct_values() with a HyperLogLog sketch, i.e., in a
+  // single pass and without materializing the distinct values.
+  std::size_t EstimateNumDistinctValues() const {
+    return estimated_num_distinct_values_.Get([this]() -> size_t {
+      HyperLogLog sketch;
+      for (const long value : data_) sketch.Add(HashValue(value));
+      return std::llround(sketch.Estimate());
+    });
+  }
+
+  long min() const { return GetMinMax().first; }
+  long max() const { return GetMinMax().second; }
   std::size_t compressed_size_bytes(size_t num_rows_per_stripe) const {
     const size_t num_stripes = data_.size() / num_rows_per_stripe;
     size_t compressed_size = 0;
@@ -231,40 +307,104 @@ class Column {
   }
 
  private:
+  friend class Table;
+
   Column(const std::string& name, const DataType type, std::vector<long> data)
-      : name_(name), type_(type), data_(std::move(data)) {
+      : name_(name),
+        type_(type),
+        string_encoding_(StringEncoding::DICTIONARY),
+        owned_data_(std::move(data)),
+        data_(owned_data_) {
     assert(type <= DataType::long);
-    // Initialize `distinct_values_`.
-    distinct_values_ = std::unordered_set<long>(data_.begin(), data_.end());
+  }
+
+  Column(const std::string& name, std::vector<long> data,
+         std::vector<std::string> str_data, StringEncoding string_encoding,
+         std::unordered_map<std::string, long> string_dict)
+      : name_(name),
+        type_(DataType::STRING),
+        string_encoding_(string_encoding),
+        owned_data_(std::move(data)),
+        data_(owned_data_),
+        string_dict_(std::move(string_dict)),
+        str_data_(std::move(str_data)) {
+    assert(data_.size() == str_data_.size());
+  }
 
-    // Set `min_` and `max_`.
-    const auto min_max = std::minmax_element(begin(data_), end(data_));
-    min_ = *min_max.first;
-    max_ = *min_max.second;
+  // Used by Table::OpenBinary(..): `data` points into `mapped_file`.
+  Column(const std::string& name, const DataType type,
+         StringEncoding string_encoding, absl::Span<const long> data,
+         std::shared_ptr<const MappedFile> mapped_file,
+         std::unordered_map<std::string, long> string_dict,
+         std::vector<std::string> str_data)
+      : name_(name),
+        type_(type),
+        string_encoding_(string_encoding),
+        mapped_file_(std::move(mapped_file)),
+        data_(data),
+        string_dict_(std::move(string_dict)),
+        str_data_(std::move(str_data)) {}
 
-    // Compute standard moments.
-    mean_ = boost::math::tools::mean(data_);
-    variance_ = boost::math::tools::variance(data_);
-    skewness_ = boost::math::tools::skewness(data_);
-    kurtosis_ = boost::math::tools::kurtosis(data_);
+  // Standard moments: mean, variance, skewness, and excess kurtosis.
+  // https://www.gnu.org/software/gsl/doc/html/statistics.html
+  struct Moments {
+    double mean, variance, skewness, kurtosis;
+  };
+
+  // Finalizer of MurmurHash3, mixing all bits of `value`.
+  static uint64_t HashValue(long value) {
+    uint64_t hash = static_cast<uint64_t>(value);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
 
-    PrintStats();
+  const absl::flat_hash_set<long>& GetDistinctSet() const {
+    return distinct_set_.Get([this]() {
+      return absl::flat_hash_set<long>(data_.begin(), data_.end());
+    });
+  }
+
+  const std::pair<long, long>& GetMinMax() const {
+    return min_max_.Get([this]() {
+      const auto min_max = std::minmax_element(data_.begin(), data_.end());
+      return std::make_pair(*min_max.first, *min_max.second);
+    });
+  }
+
+  const Moments& GetMoments() const {
+    return moments_.Get([this]() {
+      return Moments{boost::math::tools::mean(data_),
+                     boost::math::tools::variance(data_),
+                     boost::math::tools::skewness(data_),
+                     boost::math::tools::kurtosis(data_)};
+    });
   }
 
   std::string name_;
   DataType type_;
-  std::vector<long> data_;
-  std::unordered_set<long> distinct_values_;
-  // Used to map strings to ints in an order-preserving way.
+  StringEncoding string_encoding_;
+  // The values are owned by `owned_data_`, or by `mapped_file_` for columns of
+  // Table::OpenBinary(..).
+  std::vector<long> owned_data_;
+  std::shared_ptr<const MappedFile> mapped_file_;
+  absl::Span<const long> data_;
+  // Used to map strings to ints in an order-preserving way. Empty for
+  // StringEncoding::HASH.
   std::unordered_map<std::string, long> string_dict_;
   // The original vector of strings if given to the c'tor.
-  const std::vector<std::string> str_data_;
-
-  // Stats.
-  long min_, max_;
-  // Standard moments: mean, variance, skewness, and excess kurtosis.
-  // https://www.gnu.org/software/gsl/doc/html/statistics.html
-  double mean_, variance_, skewness_, kurtosis_;
+  std::vector<std::string> str_data_;
+
+  // Stats, computed on first use.
+  Memoized<absl::flat_hash_set<long>> distinct_set_;
+  Memoized<std::vector<long>> distinct_values_;
+  Memoized<size_t> num_distinct_values_;
+  Memoized<size_t> estimated_num_distinct_values_;
+  Memoized<std::pair<long, long>> min_max_;
+  Memoized<Moments> moments_;
 };
 
 // Used for parsing a column from a CSV file.
@@ -281,76 +421,36 @@ struct CsvColumnInfo {
 
 class Table {
  public:
+  // Loads the columns `column_names` of the CSV file at `file_path` (with a
+  // header line). Columns whose fields all are digits (or NULL) become long
+  // columns, all others STRING columns with `string_encoding`. Memory-maps the
+  // file and splits it into `num_threads` chunks of lines, which are parsed in
+  // parallel directly from the mapping. Fields may be quoted ("..", quotes
+  // escaped as ""), but must not contain line breaks.
   static std::unique_ptr<Table> FromCsv(
       const std::string& file_path,
-      const std::vector<std::string> column_names) {
-    csv::CSVReader reader(file_path);
-
-    // Make sure all the requested columns are present and map positions in
-    // `column_names` to column positions in the data.
-    std::vector<std::string> present_column_names = reader.get_col_names();
-    std::vector<CsvColumnInfo> column_infos;
-    column_infos.reserve(column_names.size());
-    for (const std::string& column_name : column_names) {
-      auto pos = std::find(present_column_names.begin(),
-                           present_column_names.end(), column_name);
-
-      if (pos == present_column_names.end()) {
-        std::cerr << "Unknown column '" << column_name
-                  << "'. Available columns: "
-                  << absl::StrJoin(present_column_names, ",") << std::endl;
-        std::exit(EXIT_FAILURE);
-      }
-
-      // Create ColumnInfo`
-      column_infos.push_back(
-          CsvColumnInfo{.name = column_name,
-                        .type = DataType::STRING,
-                        .index = static_cast<size_t>(
-                            std::distance(present_column_names.begin(), pos))});
-    }
-
-    std::vector<std::vector<std::string>> csv_data(column_names.size());
-    for (csv::CSVRow& row : reader) {
-      for (size_t i = 0; i < column_names.size(); ++i) {
-        csv_data[i].push_back(row[column_infos[i].index].get<std::string>());
-      }
-    }
-
-    for (size_t i = 0; i < csv_data.size(); ++i) {
-      bool is_column_int = true;
-      for (const std::string& value : csv_data[i]) {
-        if (value != Column::kStringNullSentinel &&
-            !std::all_of(value.begin(), value.end(),
-                         [](unsigned char c) { return std::isdigit(c); })) {
-          is_column_int = false;
-          break;
-        }
-      }
-
-      if (is_column_int) {
-        // If the column is an integer column, change its type to
-        // DataType::long and convert all sentinel values.
-        column_infos[i].type = DataType::long;
-        for (std::string& value : csv_data[i]) {
-          if (value == Column::kStringNullSentinel) {
-            value = absl::StrCat(Column::kIntNullSentinel);
-          }
-        }
-      }
-    }
-
-    // Create columns.
-    std::vector<std::unique_ptr<Column>> columns;
-    columns.reserve(column_infos.size());
-    for (size_t i = 0; i < column_infos.size(); ++i) {
-      const CsvColumnInfo& info = column_infos[i];
-      columns.push_back(
-          absl::make_unique<Column>(info.name, info.type, csv_data[i]));
-    }
-
-    return std::unique_ptr<Table>(new Table("test_table", std::move(columns)));
-  }
+      const std::vector<std::string> column_names,
+      StringEncoding string_encoding = StringEncoding::DICTIONARY,
+      size_t num_threads = 1);
+
+  // Writes the table to `path` in a columnar binary format (which may change
+  // between versions, i.e., it's only meant as a cache):
+  //   8 bytes magic "CITABLE2"
+  //   uint64 offset of the metadata
+  //   the values of all columns, one array of little-endian longs per column
+  //   metadata: table name, `source`, number of columns and, per column, its
+  //   name, type, string encoding, number of rows, stats and strings (the
+  //   dictionary in key order for DICTIONARY columns, all rows for HASH ones)
+  // Computes all stats (if not done before) to store them. `source` describes
+  // where the table came from (see GetOrCreateCachedTable(..)).
+  void SaveBinary(const std::string& path, absl::string_view source = "") const;
+
+  // Opens a table written by SaveBinary(..). Memory-maps the file, i.e., the
+  // values aren't copied (see Column::data()) and the stats aren't recomputed.
+  // The strings are copied. The columns keep the mapping alive. Sets `source`
+  // (if given) to the one passed to SaveBinary(..).
+  static std::unique_ptr<Table> OpenBinary(const std::string& path,
+                                           std::string* source = nullptr);
 
   static std::unique_ptr<Table> Create(
       const std::string& name, std::vector<std::unique_ptr<Column>> columns) {
@@ -373,7 +473,9 @@ class Table {
     exit(EXIT_FAILURE);
   }
 
-  const std::vector<std::unique_ptr<Column>>& GetColumns() { return columns_; }
+  const std::vector<std::unique_ptr<Column>>& GetColumns() const {
+    return columns_;
+  }
 
   void PrintHeader() const {
     for (size_t i = 0; i < columns_.size(); ++i) {
@@ -407,7 +509,8 @@ class Table {
     std::vector<std::pair<size_t, size_t>> cardinality_and_index;
     cardinality_and_index.reserve(columns_.size());
     for (size_t i = 0; i < columns_.size(); ++i) {
-      cardinality_and_index.emplace_back(columns_[i]->num_distinct_values(), i);
+      cardinality_and_index.emplace_back(
+          columns_[i]->EstimateNumDistinctValues(), i);
     }
     std::sort(cardinality_and_index.begin(), cardinality_and_index.end());
 
@@ -468,6 +571,22 @@ class Table {
 std::unique_ptr<Table> GenerateUniformData(const size_t generate_num_values,
                                            const size_t num_unique_values);
 
+// Describes the table of `column_names` of the CSV file at `file_path` (see
+// Table::FromCsv(..)), e.g., as `source` of GetOrCreateCachedTable(..).
+std::string CsvTableSource(const std::string& file_path,
+                           const std::vector<std::string>& column_names,
+                           StringEncoding string_encoding);
+
+// Returns the table created by `create()`, using the file at `cache_path` (if
+// not empty) as a cache of it: opens the table from the file if it exists (see
+// Table::OpenBinary(..)), otherwise saves the created table to it. `source`
+// describes what `create()` creates the table from (e.g., the CSV file and
+// columns or the parameters of the generator) and is stored with the table.
+// Exits if the cached table was created from a different `source`.
+std::unique_ptr<Table> GetOrCreateCachedTable(
+    const std::string& cache_path, const std::string& source,
+    const std::function<std::unique_ptr<Table>()>& create);
+
 }  // namespace ci
 
 #endif  // CUCKOO_INDEX_DATA_H_
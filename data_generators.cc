@@ -0,0 +1,303 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: data_generators.cc
+// -----------------------------------------------------------------------------
+
+#include "data_generators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "cuckoo_utils.h"
+
+namespace ci {
+namespace {
+
+constexpr std::pair<DataDistribution, absl::string_view> kDistributionNames[] =
+    {{DataDistribution::UNIFORM, "UNIFORM"},
+     {DataDistribution::ZIPF, "ZIPF"},
+     {DataDistribution::CLUSTERED, "CLUSTERED"},
+     {DataDistribution::SORTED_RUNS, "SORTED_RUNS"},
+     {DataDistribution::NEAR_UNIQUE, "NEAR_UNIQUE"}};
+
+// Returns log1p(x) / x, accurate for `x` close to 0.
+double Log1pOverX(double x) {
+  if (std::abs(x) > 1e-8) return std::log1p(x) / x;
+  return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+// Returns expm1(x) / x, accurate for `x` close to 0.
+double Expm1OverX(double x) {
+  if (std::abs(x) > 1e-8) return std::expm1(x) / x;
+  return 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+}
+
+// The (unnormalized) density of the Zipf distribution with exponent `s` and
+// an integral and its inverse (see DrawZipfRank(..)).
+double ZipfH(double x, double s) { return std::exp(-s * std::log(x)); }
+
+double ZipfHIntegral(double x, double s) {
+  const double log_x = std::log(x);
+  return Expm1OverX((1.0 - s) * log_x) * log_x;
+}
+
+double ZipfHIntegralInverse(double x, double s) {
+  // Clamp to -1 to avoid NaNs from rounding errors.
+  const double t = std::max(-1.0, x * (1.0 - s));
+  return std::exp(Log1pOverX(t) * x);
+}
+
+// Runs `fn(begin, end)` for `num_threads` contiguous ranges of [0, `n`), each
+// on its own thread (for `num_threads` > 1).
+template <typename Fn>
+void ForEachRangeInParallel(size_t n, size_t num_threads, const Fn& fn) {
+  num_threads = std::max<size_t>(1, std::min(num_threads, n));
+  if (num_threads == 1) {
+    fn(/*begin=*/0, /*end=*/n);
+    return;
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      fn(/*begin=*/i * n / num_threads, /*end=*/(i + 1) * n / num_threads);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+}  // namespace
+
+absl::string_view DataDistributionToString(DataDistribution distribution) {
+  for (const auto& [value, name] : kDistributionNames) {
+    if (value == distribution) return name;
+  }
+  return "UNKNOWN";
+}
+
+bool ParseDataDistribution(absl::string_view name,
+                           DataDistribution* distribution) {
+  for (const auto& [value, value_name] : kDistributionNames) {
+    if (value_name == name) {
+      *distribution = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+DataGenerator::DataGenerator(const DataGeneratorOptions& options)
+    : options_(options),
+      seed_(Mix64(options.seed)),
+      num_ranks_(options.num_unique_values) {
+  if (options_.num_rows == 0 || options_.num_unique_values == 0) {
+    std::cerr << "A generated column needs at least one row and value."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // The smallest power of 4 (i.e., two halves of equal size) >= `num_rows`.
+  size_t num_bits = 2;
+  while (num_bits < 64 && (uint64_t{1} << num_bits) < options_.num_rows)
+    num_bits += 2;
+  feistel_half_bits_ = num_bits / 2;
+  for (size_t i = 0; i < 4; ++i) feistel_keys_[i] = Mix64(seed_ + i + 1);
+
+  switch (options_.distribution) {
+    case DataDistribution::UNIFORM:
+    case DataDistribution::SORTED_RUNS:
+    case DataDistribution::NEAR_UNIQUE:
+      break;
+    case DataDistribution::ZIPF: {
+      if (options_.zipf_exponent <= 0.0) {
+        std::cerr << "The Zipf exponent needs to be > 0." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      const double s = options_.zipf_exponent;
+      zipf_h_integral_x1_ = ZipfHIntegral(1.5, s) - 1.0;
+      zipf_h_integral_n_ = ZipfHIntegral(num_ranks_ + 0.5, s);
+      zipf_s_ = 2.0 - ZipfHIntegralInverse(
+                          ZipfHIntegral(2.5, s) - ZipfH(2.0, s), s);
+      break;
+    }
+    case DataDistribution::CLUSTERED: {
+      if (options_.cluster_size == 0) {
+        std::cerr << "The cluster size needs to be > 0." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      const uint64_t num_clusters =
+          (options_.num_rows + options_.cluster_size - 1) /
+          options_.cluster_size;
+      ranks_per_cluster_ = (num_ranks_ + num_clusters - 1) / num_clusters;
+      break;
+    }
+  }
+  if (options_.distribution == DataDistribution::SORTED_RUNS &&
+      options_.run_length == 0) {
+    std::cerr << "The run length needs to be > 0." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+std::string DataGenerator::name() const {
+  std::string prefix =
+      absl::AsciiStrToLower(DataDistributionToString(options_.distribution));
+  if (options_.distribution == DataDistribution::ZIPF)
+    absl::StrAppend(&prefix, options_.zipf_exponent);
+  return absl::StrCat(prefix, "_", options_.num_rows / 1000, "K_val_",
+                      options_.num_unique_values, "_uniq");
+}
+
+long DataGenerator::GetValue(size_t row) const {
+  return GetValueOfRank(GetRank(row));
+}
+
+long DataGenerator::GetAbsentValue(size_t i) const {
+  return GetValueOfRank(num_ranks_ + i);
+}
+
+void DataGenerator::Fill(size_t begin_row, absl::Span<long> values) const {
+  for (size_t i = 0; i < values.size(); ++i)
+    values[i] = GetValue(begin_row + i);
+}
+
+std::vector<long> DataGenerator::Generate(size_t num_threads) const {
+  std::vector<long> values(options_.num_rows);
+  ForEachRangeInParallel(options_.num_rows, num_threads,
+                         [&](size_t begin, size_t end) {
+                           Fill(begin, absl::MakeSpan(values).subspan(
+                                           begin, end - begin));
+                         });
+  return values;
+}
+
+std::unique_ptr<Table> DataGenerator::GenerateTable(size_t num_threads) const {
+  std::vector<std::unique_ptr<Column>> columns;
+  columns.push_back(Column::IntColumn(name(), Generate(num_threads)));
+  return Table::Create(/*name=*/"", std::move(columns));
+}
+
+void DataGenerator::ForEachStripe(
+    size_t num_rows_per_stripe, size_t num_threads,
+    const std::function<void(size_t stripe_id, absl::Span<const long> stripe)>&
+        fn) const {
+  const size_t num_stripes = options_.num_rows / num_rows_per_stripe;
+  num_threads = std::max<size_t>(1, num_threads);
+  std::vector<long> stripes(std::min(num_threads, num_stripes) *
+                            num_rows_per_stripe);
+  for (size_t begin = 0; begin < num_stripes; begin += num_threads) {
+    const size_t end = std::min(num_stripes, begin + num_threads);
+    ForEachRangeInParallel(
+        end - begin, num_threads, [&](size_t begin_idx, size_t end_idx) {
+          for (size_t i = begin_idx; i < end_idx; ++i) {
+            Fill((begin + i) * num_rows_per_stripe,
+                 absl::MakeSpan(stripes).subspan(i * num_rows_per_stripe,
+                                                 num_rows_per_stripe));
+          }
+        });
+    for (size_t i = 0; i < end - begin; ++i) {
+      fn(begin + i, absl::MakeConstSpan(stripes).subspan(
+                        i * num_rows_per_stripe, num_rows_per_stripe));
+    }
+  }
+}
+
+uint64_t DataGenerator::GetRank(size_t row) const {
+  switch (options_.distribution) {
+    case DataDistribution::UNIFORM:
+      // Every rank occurs every `num_ranks_` permuted rows.
+      return PermuteRow(row) % num_ranks_;
+    case DataDistribution::ZIPF:
+      return DrawZipfRank(row);
+    case DataDistribution::CLUSTERED: {
+      const uint64_t cluster = row / options_.cluster_size;
+      return (cluster * ranks_per_cluster_ +
+              FastRange(GetRandomBits(row, 0), ranks_per_cluster_)) %
+             num_ranks_;
+    }
+    case DataDistribution::SORTED_RUNS: {
+      const uint64_t run = row / options_.run_length;
+      const uint64_t i = row - run * options_.run_length;
+      // Shift the sample of each run randomly, by less than its spacing to
+      // keep it sorted.
+      const uint64_t spacing =
+          std::max<uint64_t>(1, num_ranks_ / options_.run_length);
+      const uint64_t offset = FastRange(Mix64(seed_ ^ run), spacing);
+      const uint64_t sample = static_cast<uint64_t>(
+          static_cast<unsigned __int128>(i) * num_ranks_ /
+          options_.run_length);
+      return std::min<uint64_t>(num_ranks_ - 1, sample + offset);
+    }
+    case DataDistribution::NEAR_UNIQUE: {
+      // The rows permuted to the first `num_ranks_` ranks hold every value
+      // once, all others repeat a random value.
+      const uint64_t rank = PermuteRow(row);
+      if (rank < num_ranks_) return rank;
+      return FastRange(GetRandomBits(row, 0), num_ranks_);
+    }
+  }
+  return 0;
+}
+
+long DataGenerator::GetValueOfRank(uint64_t rank) const {
+  // Skip Column::kIntNullSentinel (0). Mix64(..) is a bijection that only maps
+  // 0 to 0, and the seeded offset is < 2^62, i.e., only ranks >= 2^62 - 1
+  // (which are never used) could be mapped to 0.
+  static_assert(Column::kIntNullSentinel == 0, "");
+  if (options_.distribution == DataDistribution::SORTED_RUNS)
+    return static_cast<long>(rank + 1);
+  return static_cast<long>(Mix64(rank + 1 + (seed_ >> 2)));
+}
+
+uint64_t DataGenerator::GetRandomBits(size_t row, uint64_t i) const {
+  return Mix64(seed_ ^ Mix64(row * 4 + i + 1));
+}
+
+uint64_t DataGenerator::PermuteRow(uint64_t row) const {
+  const uint64_t half_mask = (uint64_t{1} << feistel_half_bits_) - 1;
+  do {
+    uint64_t left = row >> feistel_half_bits_;
+    uint64_t right = row & half_mask;
+    for (const uint64_t key : feistel_keys_) {
+      const uint64_t next_right = left ^ (Mix64(right ^ key) & half_mask);
+      left = right;
+      right = next_right;
+    }
+    row = (left << feistel_half_bits_) | right;
+  } while (row >= options_.num_rows);
+  return row;
+}
+
+uint64_t DataGenerator::DrawZipfRank(size_t row) const {
+  const double s = options_.zipf_exponent;
+  for (uint64_t i = 0;; ++i) {
+    const double u =
+        zipf_h_integral_n_ +
+        GetRandomDouble(row, i) * (zipf_h_integral_x1_ - zipf_h_integral_n_);
+    const double x = ZipfHIntegralInverse(u, s);
+    const uint64_t k = std::min<uint64_t>(
+        num_ranks_, std::max<uint64_t>(1, static_cast<uint64_t>(x + 0.5)));
+    if (k - x <= zipf_s_ || u >= ZipfHIntegral(k + 0.5, s) - ZipfH(k, s))
+      return k - 1;
+  }
+}
+
+}  // namespace ci
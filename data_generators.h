@@ -0,0 +1,170 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: data_generators.h
+// -----------------------------------------------------------------------------
+//
+// Seeded generators of synthetic integer columns with the value distributions
+// of production workloads. Every row's value is a pure function of the seed and
+// the row number, i.e., a generator keeps no per-value state: rows can be
+// generated in any order, by any number of threads and streamed stripe by
+// stripe into an IndexStructureBuilder without materializing the column (e.g.,
+// for billions of rows).
+//
+// Values are derived from a "rank" in [0, number of distinct values) that is
+// drawn from the distribution. Different ranks map to different values, which
+// are scattered over the whole `long` domain (except for SORTED_RUNS, where
+// the order of the values is the order of the ranks). Values never collide with
+// Column::kIntNullSentinel.
+
+#ifndef CUCKOO_INDEX_DATA_GENERATORS_H_
+#define CUCKOO_INDEX_DATA_GENERATORS_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "data.h"
+
+namespace ci {
+
+enum class DataDistribution {
+  // Every distinct value occurs equally often (up to one occurrence) at
+  // random rows. The cardinality is exact if there are at least as many rows.
+  UNIFORM,
+  // The rank `r` occurs with a probability proportional to
+  // 1 / (r + 1)^zipf_exponent.
+  ZIPF,
+  // Consecutive rows (clusters of `cluster_size` rows) are drawn uniformly
+  // from a window of consecutive ranks. The windows of the clusters tile the
+  // ranks, i.e., each value only occurs in one or two clusters (like time or
+  // id columns of tables loaded in batches).
+  CLUSTERED,
+  // Runs of `run_length` rows, each holding an evenly spaced sample of all
+  // distinct values in ascending order (like a table concatenated from sorted
+  // files).
+  SORTED_RUNS,
+  // `num_unique_values` random rows hold a value each, all other rows repeat
+  // a random one of these values (like keys with few duplicates, for
+  // `num_unique_values` close to `num_rows`).
+  NEAR_UNIQUE,
+};
+
+// Returns the name of `distribution`, e.g., "ZIPF".
+absl::string_view DataDistributionToString(DataDistribution distribution);
+
+// Parses a name returned by DataDistributionToString(..). Returns false if
+// `name` isn't a distribution.
+bool ParseDataDistribution(absl::string_view name,
+                           DataDistribution* distribution);
+
+struct DataGeneratorOptions {
+  DataDistribution distribution = DataDistribution::UNIFORM;
+  size_t num_rows = 0;
+  // The number of distinct values (exact for UNIFORM and NEAR_UNIQUE if
+  // there are at least as many rows, an upper bound otherwise).
+  size_t num_unique_values = 0;
+  // Only for ZIPF, needs to be > 0.
+  double zipf_exponent = 1.0;
+  // Only for CLUSTERED.
+  size_t cluster_size = 1 << 16;
+  // Only for SORTED_RUNS.
+  size_t run_length = 1 << 16;
+  uint64_t seed = 42;
+};
+
+class DataGenerator {
+ public:
+  explicit DataGenerator(const DataGeneratorOptions& options);
+
+  const DataGeneratorOptions& options() const { return options_; }
+
+  // Returns a name describing the options, e.g., "zipf1_1000K_val_1000_uniq".
+  std::string name() const;
+
+  // Returns the value of row `row`.
+  long GetValue(size_t row) const;
+
+  // Returns the `i`-th of (practically) infinitely many values that don't
+  // occur in any row, e.g., to benchmark negative lookups.
+  long GetAbsentValue(size_t i) const;
+
+  // Writes the values of rows [`begin_row`, `begin_row + values.size()`) to
+  // `values`.
+  void Fill(size_t begin_row, absl::Span<long> values) const;
+
+  // Returns the values of all rows, generated by `num_threads` threads.
+  std::vector<long> Generate(size_t num_threads) const;
+
+  // Returns a table with a single column of all rows, named name().
+  std::unique_ptr<Table> GenerateTable(size_t num_threads) const;
+
+  // Calls `fn(stripe_id, stripe)` for the values of all full stripes of
+  // `num_rows_per_stripe` rows, in stripe order. Generates the next
+  // `num_threads` stripes at once, i.e., only holds that many stripes in
+  // memory.
+  void ForEachStripe(
+      size_t num_rows_per_stripe, size_t num_threads,
+      const std::function<void(size_t stripe_id,
+                               absl::Span<const long> stripe)>& fn) const;
+
+ private:
+  // Returns the rank of row `row`.
+  uint64_t GetRank(size_t row) const;
+
+  // Maps `rank` to its value.
+  long GetValueOfRank(uint64_t rank) const;
+
+  // Returns the `i`-th random 64 bits of row `row`.
+  uint64_t GetRandomBits(size_t row, uint64_t i) const;
+
+  // Returns the `i`-th random double in [0, 1) of row `row`.
+  double GetRandomDouble(size_t row, uint64_t i) const {
+    return (GetRandomBits(row, i) >> 11) * 0x1.0p-53;
+  }
+
+  // A pseudo-random permutation of [0, num_rows): a Feistel network on the
+  // next larger power of 4, cycle-walking over values >= num_rows.
+  uint64_t PermuteRow(uint64_t row) const;
+
+  // Draws a rank in [0, num_unique_values) with the rejection-inversion method
+  // of Hörmann and Derflinger, using the random numbers of row `row`.
+  uint64_t DrawZipfRank(size_t row) const;
+
+  const DataGeneratorOptions options_;
+  const uint64_t seed_;
+  // The number of possible ranks, i.e., ranks >= this are never drawn.
+  const uint64_t num_ranks_;
+
+  // See PermuteRow(..).
+  size_t feistel_half_bits_ = 0;
+  uint64_t feistel_keys_[4] = {};
+
+  // See DrawZipfRank(..).
+  double zipf_h_integral_x1_ = 0.0;
+  double zipf_h_integral_n_ = 0.0;
+  double zipf_s_ = 0.0;
+
+  // For CLUSTERED, the number of ranks of a cluster.
+  uint64_t ranks_per_cluster_ = 1;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_DATA_GENERATORS_H_
@@ -0,0 +1,164 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: data_generators_test.cc
+// -----------------------------------------------------------------------------
+
+#include "data_generators.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "gtest/gtest.h"
+
+namespace ci {
+
+constexpr size_t kNumRows = 100000;
+
+constexpr DataDistribution kDistributions[] = {
+    DataDistribution::UNIFORM, DataDistribution::ZIPF,
+    DataDistribution::CLUSTERED, DataDistribution::SORTED_RUNS,
+    DataDistribution::NEAR_UNIQUE};
+
+DataGenerator CreateGenerator(DataDistribution distribution,
+                              size_t num_unique_values) {
+  DataGeneratorOptions options;
+  options.distribution = distribution;
+  options.num_rows = kNumRows;
+  options.num_unique_values = num_unique_values;
+  options.cluster_size = 1000;
+  options.run_length = 1000;
+  return DataGenerator(options);
+}
+
+absl::flat_hash_map<long, size_t> CountValues(absl::Span<const long> values) {
+  absl::flat_hash_map<long, size_t> counts;
+  for (const long value : values) ++counts[value];
+  return counts;
+}
+
+TEST(DataGeneratorTest, ParseDataDistribution) {
+  for (const DataDistribution distribution : kDistributions) {
+    DataDistribution parsed;
+    ASSERT_TRUE(ParseDataDistribution(DataDistributionToString(distribution),
+                                      &parsed));
+    EXPECT_EQ(parsed, distribution);
+  }
+  DataDistribution parsed;
+  EXPECT_FALSE(ParseDataDistribution("GAUSSIAN", &parsed));
+}
+
+TEST(DataGeneratorTest, IndependentOfThreadsAndStreaming) {
+  for (const DataDistribution distribution : kDistributions) {
+    const DataGenerator generator =
+        CreateGenerator(distribution, /*num_unique_values=*/5000);
+    const std::vector<long> values = generator.Generate(/*num_threads=*/1);
+    ASSERT_EQ(values.size(), kNumRows);
+    EXPECT_EQ(generator.Generate(/*num_threads=*/4), values);
+    EXPECT_EQ(values[12345], generator.GetValue(12345));
+
+    std::vector<long> streamed;
+    size_t next_stripe_id = 0;
+    generator.ForEachStripe(
+        /*num_rows_per_stripe=*/3000, /*num_threads=*/3,
+        [&](size_t stripe_id, absl::Span<const long> stripe) {
+          EXPECT_EQ(stripe_id, next_stripe_id++);
+          EXPECT_EQ(stripe.size(), 3000);
+          streamed.insert(streamed.end(), stripe.begin(), stripe.end());
+        });
+    // Only full stripes.
+    EXPECT_EQ(next_stripe_id, kNumRows / 3000);
+    EXPECT_TRUE(std::equal(streamed.begin(), streamed.end(), values.begin()));
+
+    // Other seeds give other values.
+    DataGeneratorOptions options = generator.options();
+    options.seed = 7;
+    EXPECT_NE(DataGenerator(options).Generate(/*num_threads=*/1), values);
+  }
+}
+
+TEST(DataGeneratorTest, NoNullsAndNoAbsentValues) {
+  for (const DataDistribution distribution : kDistributions) {
+    const DataGenerator generator =
+        CreateGenerator(distribution, /*num_unique_values=*/5000);
+    const absl::flat_hash_map<long, size_t> counts =
+        CountValues(generator.Generate(/*num_threads=*/1));
+    EXPECT_FALSE(counts.contains(Column::kIntNullSentinel));
+    EXPECT_LE(counts.size(), 5000);
+    for (size_t i = 0; i < 1000; ++i)
+      ASSERT_FALSE(counts.contains(generator.GetAbsentValue(i)));
+  }
+}
+
+TEST(DataGeneratorTest, UniformHasExactCardinality) {
+  const DataGenerator generator =
+      CreateGenerator(DataDistribution::UNIFORM, /*num_unique_values=*/3000);
+  const absl::flat_hash_map<long, size_t> counts =
+      CountValues(generator.Generate(/*num_threads=*/1));
+  EXPECT_EQ(counts.size(), 3000);
+  for (const auto& [value, count] : counts) {
+    ASSERT_GE(count, kNumRows / 3000);
+    ASSERT_LE(count, kNumRows / 3000 + 1);
+  }
+}
+
+TEST(DataGeneratorTest, NearUniqueHasExactCardinality) {
+  const DataGenerator generator = CreateGenerator(
+      DataDistribution::NEAR_UNIQUE, /*num_unique_values=*/kNumRows * 9 / 10);
+  EXPECT_EQ(CountValues(generator.Generate(/*num_threads=*/1)).size(),
+            kNumRows * 9 / 10);
+}
+
+TEST(DataGeneratorTest, ZipfIsSkewed) {
+  const DataGenerator generator =
+      CreateGenerator(DataDistribution::ZIPF, /*num_unique_values=*/10000);
+  const absl::flat_hash_map<long, size_t> counts =
+      CountValues(generator.Generate(/*num_threads=*/1));
+  std::vector<size_t> frequencies;
+  for (const auto& [value, count] : counts) frequencies.push_back(count);
+  std::sort(frequencies.rbegin(), frequencies.rend());
+  // With exponent 1, the most frequent value occurs about twice as often as the
+  // second one and makes about 1 / H(10000) ~ 10% of the rows.
+  EXPECT_NEAR(static_cast<double>(frequencies[0]) / frequencies[1], 2.0, 0.2);
+  EXPECT_NEAR(static_cast<double>(frequencies[0]) / kNumRows, 0.1023, 0.01);
+}
+
+TEST(DataGeneratorTest, ClusteredValuesAreLocal) {
+  const DataGenerator generator =
+      CreateGenerator(DataDistribution::CLUSTERED, /*num_unique_values=*/5000);
+  const std::vector<long> values = generator.Generate(/*num_threads=*/1);
+  absl::flat_hash_map<long, absl::flat_hash_set<size_t>> clusters;
+  for (size_t row = 0; row < values.size(); ++row)
+    clusters[values[row]].insert(row / 1000);
+  // 100 clusters of 1000 rows share 5000 values, i.e., 50 values per cluster.
+  EXPECT_GT(clusters.size(), 4900);
+  for (const auto& [value, value_clusters] : clusters)
+    ASSERT_LE(value_clusters.size(), 2);
+}
+
+TEST(DataGeneratorTest, SortedRunsAreSorted) {
+  const DataGenerator generator = CreateGenerator(
+      DataDistribution::SORTED_RUNS, /*num_unique_values=*/5000);
+  const std::vector<long> values = generator.Generate(/*num_threads=*/1);
+  for (size_t begin = 0; begin < values.size(); begin += 1000) {
+    ASSERT_TRUE(std::is_sorted(values.begin() + begin,
+                               values.begin() + begin + 1000));
+  }
+  EXPECT_FALSE(std::is_sorted(values.begin(), values.begin() + 2000));
+}
+
+}  // namespace ci
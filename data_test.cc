@@ -18,6 +18,8 @@
 
 #include "data.h"
 
+#include <cstdio>
+#include <fstream>
 #include <string>
 #include <vector>
 
@@ -62,6 +64,31 @@ TEST(ColumnTest, ValueAtReturnsValuesForStringColumns) {
   EXPECT_THAT(actual_values, ElementsAreArray(expected_values));
 }
 
+TEST(ColumnTest, HashEncodedStrings) {
+  const std::vector<std::string> values = {"US", "CH", "NULL", "US"};
+  Column column("column_name", DataType::STRING, values,
+                StringEncoding::HASH);
+  EXPECT_EQ(column.string_encoding(), StringEncoding::HASH);
+  EXPECT_EQ(column[0], Column::HashStringKey("US"));
+  EXPECT_EQ(column[1], Column::HashStringKey("CH"));
+  EXPECT_EQ(column[2], Column::kIntNullSentinel);
+  EXPECT_EQ(column[3], column[0]);
+  EXPECT_NE(column[0], column[1]);
+  EXPECT_EQ(column.num_distinct_values(), 3);
+  for (size_t i = 0; i < values.size(); ++i)
+    EXPECT_EQ(column.ValueAt(i), values[i]);
+
+  // The strings are reordered with their keys.
+  const std::vector<size_t> indexes = {2, 1, 3, 0};
+  column.Reorder(indexes);
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(column.ValueAt(i), values[indexes[i]]);
+    EXPECT_EQ(column[i], values[indexes[i]] == Column::kStringNullSentinel
+                             ? Column::kIntNullSentinel
+                             : Column::HashStringKey(values[indexes[i]]));
+  }
+}
+
 TEST(ColumnTest, CompressInts) {
   auto column =
       absl::make_unique<Column>("column_name", DataType::long,
@@ -106,6 +133,85 @@ TEST(ColumnTest, Reorder) {
   }
 }
 
+TEST(ColumnTest, Stats) {
+  std::vector<long> values;
+  for (long i = 0; i < 10000; ++i) values.push_back(i % 1000 - 500);
+  const ColumnPtr column = Column::IntColumn("column_name", values);
+  EXPECT_EQ(column->min(), -500);
+  EXPECT_EQ(column->max(), 499);
+  EXPECT_EQ(column->num_distinct_values(), 1000);
+  EXPECT_NEAR(column->EstimateNumDistinctValues(), 1000, 50);
+  EXPECT_TRUE(column->Contains(-500));
+  EXPECT_FALSE(column->Contains(500));
+  // The distinct values are cached rather than copied for every call.
+  EXPECT_EQ(&column->distinct_values(), &column->distinct_values());
+  EXPECT_EQ(column->distinct_values().size(), 1000);
+}
+
+TEST(DataTest, SaveAndOpenBinary) {
+  std::vector<std::unique_ptr<Column>> columns;
+  columns.push_back(absl::make_unique<Column>(
+      "customer_id", DataType::long,
+      std::vector<std::string>({"42", "13", "1", "42"})));
+  columns.push_back(absl::make_unique<Column>(
+      "country", DataType::STRING,
+      std::vector<std::string>({"US", "CH", "NULL", "CH"})));
+  columns.push_back(absl::make_unique<Column>(
+      "city", DataType::STRING,
+      std::vector<std::string>({"Zurich", "NULL", "Boston", "Zurich"}),
+      StringEncoding::HASH));
+  const std::unique_ptr<Table> table = Table::Create("test", std::move(columns));
+  const std::string path = ::testing::TempDir() + "/data_test_binary_table";
+  table->SaveBinary(path);
+
+  const std::unique_ptr<Table> opened = Table::OpenBinary(path);
+  ASSERT_EQ(opened->GetColumns().size(), table->GetColumns().size());
+  for (size_t i = 0; i < table->GetColumns().size(); ++i) {
+    const Column& expected = *table->GetColumns()[i];
+    const Column& column = *opened->GetColumns()[i];
+    EXPECT_EQ(column.name(), expected.name());
+    EXPECT_EQ(column.type(), expected.type());
+    EXPECT_EQ(column.string_encoding(), expected.string_encoding());
+    EXPECT_THAT(column.data(), ElementsAreArray(expected.data()));
+    EXPECT_EQ(column.min(), expected.min());
+    EXPECT_EQ(column.max(), expected.max());
+    EXPECT_EQ(column.num_distinct_values(), expected.num_distinct_values());
+    EXPECT_EQ(column.compressed_size_bytes(/*num_rows_per_stripe=*/2),
+              expected.compressed_size_bytes(/*num_rows_per_stripe=*/2));
+    for (size_t row = 0; row < column.num_rows(); ++row)
+      EXPECT_EQ(column.ValueAt(row), expected.ValueAt(row));
+  }
+  EXPECT_EQ(opened->ToCsvString(), table->ToCsvString());
+
+  // Mapped columns can still be reordered.
+  table->SortWithCardinalityKey();
+  opened->SortWithCardinalityKey();
+  EXPECT_EQ(opened->ToCsvString(), table->ToCsvString());
+}
+
+TEST(DataTest, GetOrCreateCachedTable) {
+  const std::string path = ::testing::TempDir() + "/data_test_cached_table";
+  std::remove(path.c_str());
+  size_t num_created = 0;
+  const auto create = [&num_created]() {
+    ++num_created;
+    return GenerateUniformData(/*generate_num_values=*/100,
+                               /*num_unique_values=*/10);
+  };
+
+  const std::unique_ptr<Table> table =
+      GetOrCreateCachedTable(path, /*source=*/"uniform", create);
+  const std::unique_ptr<Table> cached =
+      GetOrCreateCachedTable(path, /*source=*/"uniform", create);
+  EXPECT_EQ(num_created, 1);
+  EXPECT_EQ(cached->ToCsvString(), table->ToCsvString());
+
+  // A table cached for a different source isn't reused.
+  EXPECT_DEATH(GetOrCreateCachedTable(path, /*source=*/"other", create),
+               "caches the table of 'uniform'");
+  std::remove(path.c_str());
+}
+
 TEST(DataTest, SortWithCardinalityKey) {
   std::vector<std::unique_ptr<Column>> columns;
   columns.push_back(absl::make_unique<Column>(
@@ -133,5 +239,74 @@ TEST(DataTest, SortWithCardinalityKey) {
             "42,US\n");
 }
 
+TEST(DataTest, FromCsv) {
+  const std::string path = ::testing::TempDir() + "/data_test_from_csv.csv";
+  std::vector<std::string> countries;
+  std::vector<std::string> customer_ids;
+  {
+    std::ofstream file(path);
+    file << "customer_id,ignored,country\r\n";
+    for (size_t i = 0; i < 100; ++i) {
+      customer_ids.push_back(i % 7 == 0 ? "NULL" : std::to_string(i % 13));
+      countries.push_back(i % 5 == 0 ? "NULL" : "C\"" + std::to_string(i % 3));
+      file << customer_ids.back() << ",\"a,b\","
+           << (i % 5 == 0 ? "NULL" : "\"C\"\"" + std::to_string(i % 3) + "\"")
+           << "\r\n";
+    }
+  }
+  // Convert the sentinels like the `Column` constructor expects them.
+  for (std::string& customer_id : customer_ids) {
+    if (customer_id == Column::kStringNullSentinel) customer_id = "0";
+  }
+  const Column expected_customer_ids("customer_id", DataType::long,
+                                     customer_ids);
+  const Column expected_countries("country", DataType::STRING, countries);
+
+  // Chunks are parsed in parallel, with more threads than lines for 200.
+  for (const size_t num_threads : {1, 3, 200}) {
+    const std::unique_ptr<Table> table = Table::FromCsv(
+        path, {"country", "customer_id"}, StringEncoding::DICTIONARY,
+        num_threads);
+    const Column& country = table->GetColumn("country");
+    const Column& customer_id = table->GetColumn("customer_id");
+    EXPECT_EQ(country.type(), DataType::STRING);
+    EXPECT_EQ(customer_id.type(), DataType::long);
+    EXPECT_THAT(country.data(), ElementsAreArray(expected_countries.data()));
+    EXPECT_THAT(customer_id.data(),
+                ElementsAreArray(expected_customer_ids.data()));
+    EXPECT_EQ(country.ValueAt(1), "C\"1");
+  }
+
+  const std::unique_ptr<Table> hashed = Table::FromCsv(
+      path, {"country"}, StringEncoding::HASH, /*num_threads=*/2);
+  const Column expected_hashed("country", DataType::STRING, countries,
+                               StringEncoding::HASH);
+  EXPECT_THAT(hashed->GetColumn("country").data(),
+              ElementsAreArray(expected_hashed.data()));
+}
+
+TEST(DataTest, FromCsvWithNegativeInts) {
+  const std::string path =
+      ::testing::TempDir() + "/data_test_from_csv_negative.csv";
+  {
+    std::ofstream file(path);
+    file << "delta,sign\n";
+    file << "-12,-\n";
+    file << "7,+\n";
+    file << "NULL,-\n";
+    file << "-1,+\n";
+  }
+  const std::unique_ptr<Table> table =
+      Table::FromCsv(path, {"delta", "sign"}, StringEncoding::DICTIONARY,
+                     /*num_threads=*/1);
+  const Column& delta = table->GetColumn("delta");
+  EXPECT_EQ(delta.type(), DataType::long);
+  EXPECT_THAT(delta.data(), ElementsAreArray(Column("delta", DataType::long,
+                                                    {"-12", "7", "0", "-1"})
+                                                 .data()));
+  // A lone '-' isn't a number.
+  EXPECT_EQ(table->GetColumn("sign").type(), DataType::STRING);
+}
+
 }  // namespace
 }  // namespace ci
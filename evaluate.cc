@@ -27,6 +27,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "composite_index.h"
 #include "cuckoo_index.h"
 #include "cuckoo_utils.h"
 #include "data.h"
@@ -58,6 +59,18 @@ ABSL_FLAG(std::string, sorting, "NONE",
           "Sorting to apply to the data. Supported values: 'NONE', "
           "'BY_CARDINALITY' (sorts lexicographically, starting with columns "
           "with the lowest cardinality), 'RANDOM'");
+ABSL_FLAG(bool, hash_strings, false,
+          "Whether to index hashes of the strings of STRING columns instead of "
+          "dictionary codes (see ci::StringEncoding).");
+ABSL_FLAG(long, num_load_threads, 1,
+          "Number of threads used to parse the input CSV file.");
+ABSL_FLAG(long, num_lookup_threads, 1,
+          "Number of threads probing the lookups of a test case.");
+ABSL_FLAG(std::string, table_cache_path, "",
+          "Path of a binary copy of the table, which is opened instead of "
+          "loading or generating the table again (see "
+          "ci::GetOrCreateCachedTable(..)). Rows are sorted after loading, "
+          "i.e., the cache holds the unsorted table.");
 
 namespace {
 static constexpr absl::string_view kNoSorting = "NONE";
@@ -92,24 +105,39 @@ long main(long argc, char* argv[]) {
   const size_t num_lookups = absl::GetFlag(FLAGS_num_lookups);
   const std::vector<std::string> test_cases = absl::GetFlag(FLAGS_test_cases);
   const std::string sorting = absl::GetFlag(FLAGS_sorting);
+  const ci::StringEncoding string_encoding =
+      absl::GetFlag(FLAGS_hash_strings) ? ci::StringEncoding::HASH
+                                        : ci::StringEncoding::DICTIONARY;
 
   // Define data.
-  std::unique_ptr<ci::Table> table;
-  if (input_csv_path.empty() || columns_to_test.empty()) {
-    std::cerr
-        << "[WARNING] --input_csv_path or --columns_to_test not specified, "
-           "generating synthetic data."
-        << std::endl;
-    std::cout << "Generating " << generate_num_values << " values ("
-              << static_cast<double>(num_unique_values) / generate_num_values *
-                     100
-              << "% unique)..." << std::endl;
-    table = ci::GenerateUniformData(generate_num_values, num_unique_values);
-  } else {
-    std::cout << "Loading data from file " << input_csv_path << "..."
+  const bool load_csv = !input_csv_path.empty() && !columns_to_test.empty();
+  const std::string source =
+      load_csv ? ci::CsvTableSource(input_csv_path, columns_to_test,
+                                    string_encoding)
+               : absl::StrCat("uniform: generate_num_values=",
+                              generate_num_values,
+                              " num_unique_values=", num_unique_values);
+  const std::unique_ptr<ci::Table> table = ci::GetOrCreateCachedTable(
+      absl::GetFlag(FLAGS_table_cache_path), source, [&]() {
+        if (!load_csv) {
+          std::cerr
+              << "[WARNING] --input_csv_path or --columns_to_test not "
+                 "specified, generating synthetic data."
               << std::endl;
-    table = ci::Table::FromCsv(input_csv_path, columns_to_test);
-  }
+          std::cout << "Generating " << generate_num_values << " values ("
+                    << static_cast<double>(num_unique_values) /
+                           generate_num_values * 100
+                    << "% unique)..." << std::endl;
+          return ci::GenerateUniformData(generate_num_values,
+                                         num_unique_values);
+        }
+        std::cout << "Loading data from file " << input_csv_path << "..."
+                  << std::endl;
+        return ci::Table::FromCsv(input_csv_path, columns_to_test,
+                                  string_encoding,
+                                  absl::GetFlag(FLAGS_num_load_threads));
+      });
+  table->PrintColumns();
 
   // Potentially sort the data.
   if (!IsValidSorting(sorting)) {
@@ -151,9 +179,18 @@ long main(long argc, char* argv[]) {
               /*prefix_bits_optimization=*/false)));
   index_factories.push_back(absl::make_unique<ci::PerStripeXorFactory>());
   index_factories.push_back(absl::make_unique<ci::ZoneMapFactory>());
+  // Zone map as a pre-filter of the Cuckoo index.
+  std::vector<std::unique_ptr<ci::IndexStructureFactory>> composite_factories;
+  composite_factories.push_back(absl::make_unique<ci::ZoneMapFactory>());
+  composite_factories.push_back(absl::make_unique<ci::CuckooIndexFactory>(
+      ci::CuckooAlgorithm::SKEWED_KICKING, ci::kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.01, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false));
+  index_factories.push_back(absl::make_unique<ci::CompositeIndexFactory>(
+      std::move(composite_factories)));
 
   // Evaluate competitors.
-  ci::Evaluator evaluator;
+  ci::Evaluator evaluator(absl::GetFlag(FLAGS_num_lookup_threads));
   std::vector<ci::EvaluationResults> results = evaluator.RunExperiments(
       std::move(index_factories), table, num_rows_per_stripe_to_test,
       num_lookups, test_cases);
@@ -18,12 +18,18 @@
 
 #include "evaluator.h"
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
 #include <ostream>
+#include <thread>
+#include <utility>
 
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
 #include "absl/strings/str_format.h"
+#include "common/bitmap.h"
+#include "common/stripe_set.h"
 #include "data.h"
 #include "evaluation.pb.h"
 #include "index_structure.h"
@@ -31,8 +37,21 @@
 namespace ci {
 
 using ci::EvaluationResults;
+using ci::PruningStats;
 using TestCase = ci::EvaluationResults::TestCase;
 
+Evaluator::GroundTruth::GroundTruth(const Column& column,
+                                    std::size_t num_rows_per_stripe)
+    : num_stripes(column.num_rows() / num_rows_per_stripe),
+      arena(num_stripes) {
+  // Like the index structures, ignores the rows of the last partial stripe.
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    const size_t end_row = (stripe_id + 1) * num_rows_per_stripe;
+    for (size_t row = stripe_id * num_rows_per_stripe; row < end_row; ++row)
+      stripe_sets[column[row]].Add(stripe_id, &arena);
+  }
+}
+
 std::vector<EvaluationResults> Evaluator::RunExperiments(
     std::vector<std::unique_ptr<IndexStructureFactory>>
         index_structure_factories,
@@ -53,6 +72,7 @@ std::vector<EvaluationResults> Evaluator::RunExperiments(
       base_result.set_num_stripes(column->num_rows() / num_rows_per_stripe);
       base_result.set_column_compressed_size_bytes(
           column->compressed_size_bytes(num_rows_per_stripe));
+      const GroundTruth truth(*column, num_rows_per_stripe);
 
       for (const std::unique_ptr<IndexStructureFactory>& factory :
            index_structure_factories) {
@@ -64,23 +84,33 @@ std::vector<EvaluationResults> Evaluator::RunExperiments(
         result.set_index_compressed_size_bytes(index->compressed_byte_size());
         *result.mutable_bitmap_stats() = index->bitmap_stats();
 
+        // Adds the pruning stats of the children of composite indexes
+        // collected while running `test_case`.
+        auto add_test_case = [&](TestCase test_case) {
+          for (const PruningStats& stats : index->pruning_stats())
+            *test_case.add_pruning_stats() = stats;
+          index->ResetPruningStats();
+          *result.add_test_cases() = std::move(test_case);
+        };
+
+        index->ResetPruningStats();
         for (const std::string& test_case : test_cases) {
           if (test_case == "positive_uniform") {
-            *result.add_test_cases() = DoPositiveUniformLookups(
-                *column, *index, num_rows_per_stripe, num_lookups);
+            add_test_case(DoPositiveUniformLookups(*column, truth, *index,
+                                                   num_lookups));
           } else if (test_case == "positive_distinct") {
-            *result.add_test_cases() = DoPositiveDistinctLookups(
-                *column, *index, num_rows_per_stripe, num_lookups);
+            add_test_case(DoPositiveDistinctLookups(*column, truth, *index,
+                                                    num_lookups));
           } else if (test_case == "positive_zipf") {
-            *result.add_test_cases() = DoPositiveZipfLookups(
-                *column, *index, num_rows_per_stripe, num_lookups);
+            add_test_case(
+                DoPositiveZipfLookups(*column, truth, *index, num_lookups));
           } else if (test_case == "negative") {
-            *result.add_test_cases() = DoNegativeLookups(
-                *column, *index, num_rows_per_stripe, num_lookups);
+            add_test_case(
+                DoNegativeLookups(*column, truth, *index, num_lookups));
           } else if (test_case == "mixed") {
             for (double hit_rate = 0.0; hit_rate <= 1.0; hit_rate += 0.1) {
-              *result.add_test_cases() = DoMixedLookups(
-                  *column, *index, num_rows_per_stripe, num_lookups, hit_rate);
+              add_test_case(DoMixedLookups(*column, truth, *index,
+                                           num_lookups, hit_rate));
             }
           } else {
             std::cerr << "Test case " << test_case << " does not exist."
@@ -98,45 +128,36 @@ std::vector<EvaluationResults> Evaluator::RunExperiments(
 }
 
 TestCase Evaluator::DoPositiveUniformLookups(const Column& column,
+                                             const GroundTruth& truth,
                                              const IndexStructure& index,
-                                             std::size_t num_rows_per_stripe,
                                              std::size_t num_lookups) {
   std::mt19937 gen(42);
-  const std::size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  std::size_t num_false_positive_stripes = 0;
-  std::size_t num_true_negative_stripes = 0;
   // Remove NULLs from the possible lookup values.
-  std::vector<long> column_data = column.data();
+  std::vector<long> column_data(column.data().begin(), column.data().end());
   column_data.erase(std::remove(column_data.begin(), column_data.end(),
                                 Column::kIntNullSentinel),
                     column_data.end());
 
   std::uniform_int_distribution<std::size_t> row_offset_d(
       0, column_data.size() - 1);
+  std::vector<long> values;
+  values.reserve(num_lookups);
   for (size_t i = 0; i < num_lookups; ++i) {
     // Draw value from random row offset.
-    const long value = column_data[row_offset_d(gen)];
-    ProbeAllStripes(column, index, value, num_rows_per_stripe, num_stripes,
-                    &num_true_negative_stripes, &num_false_positive_stripes);
+    values.push_back(column_data[row_offset_d(gen)]);
   }
 
   TestCase test_case;
   test_case.set_name("positive_uniform");
-  test_case.set_num_lookups(num_lookups);
-  test_case.set_num_false_positives(num_false_positive_stripes);
-  test_case.set_num_true_negatives(num_true_negative_stripes);
-
+  ProbeAllStripes(truth, index, values, &test_case);
   return test_case;
 }
 
 TestCase Evaluator::DoPositiveDistinctLookups(const Column& column,
+                                              const GroundTruth& truth,
                                               const IndexStructure& index,
-                                              std::size_t num_rows_per_stripe,
                                               std::size_t num_lookups) {
   std::mt19937 gen(42);
-  const std::size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  std::size_t num_false_positive_stripes = 0;
-  std::size_t num_true_negative_stripes = 0;
   std::vector<long> distinct_values = column.distinct_values();
   // Remove NULLs from the lookup.
   distinct_values.erase(
@@ -145,36 +166,32 @@ TestCase Evaluator::DoPositiveDistinctLookups(const Column& column,
       distinct_values.end());
   std::uniform_int_distribution<std::size_t> distinct_values_offset_d(
       0, distinct_values.size() - 1);
+  std::vector<long> values;
+  values.reserve(num_lookups);
   for (size_t i = 0; i < num_lookups; ++i) {
     // Draw value from random offset.
-    const long value = distinct_values[distinct_values_offset_d(gen)];
-    ProbeAllStripes(column, index, value, num_rows_per_stripe, num_stripes,
-                    &num_true_negative_stripes, &num_false_positive_stripes);
+    values.push_back(distinct_values[distinct_values_offset_d(gen)]);
   }
 
   TestCase test_case;
   test_case.set_name("positive_distinct");
-  test_case.set_num_lookups(num_lookups);
-  test_case.set_num_false_positives(num_false_positive_stripes);
-  test_case.set_num_true_negatives(num_true_negative_stripes);
-
+  ProbeAllStripes(truth, index, values, &test_case);
   return test_case;
 }
 
 TestCase Evaluator::DoPositiveZipfLookups(const Column& column,
+                                          const GroundTruth& truth,
                                           const IndexStructure& index,
-                                          std::size_t num_rows_per_stripe,
                                           std::size_t num_lookups) {
   std::mt19937 gen(42);
-  const std::size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  std::size_t num_false_positive_stripes = 0;
-  std::size_t num_true_negative_stripes = 0;
   std::vector<long> distinct_values = column.distinct_values();
   // Remove NULLs from the lookup.
   distinct_values.erase(
       std::remove(distinct_values.begin(), distinct_values.end(),
                   Column::kIntNullSentinel),
       distinct_values.end());
+  std::vector<long> values;
+  values.reserve(num_lookups);
   for (size_t i = 0; i < num_lookups; ++i) {
     // Draw value from random (Zipf distributed) offset.
     // absl::Zipf is used with its default parameters q = 2.0 and v = 1.0.
@@ -182,58 +199,45 @@ TestCase Evaluator::DoPositiveZipfLookups(const Column& column,
     // implementations (e.g., numpy.random.zipf).
     const size_t offset =
         absl::Zipf(gen, distinct_values.size() - 1, /*q=*/2.0);
-    const long value = distinct_values[offset];
-    ProbeAllStripes(column, index, value, num_rows_per_stripe, num_stripes,
-                    &num_true_negative_stripes, &num_false_positive_stripes);
+    values.push_back(distinct_values[offset]);
   }
 
   TestCase test_case;
   test_case.set_name("positive_zipf");
-  test_case.set_num_lookups(num_lookups);
-  test_case.set_num_false_positives(num_false_positive_stripes);
-  test_case.set_num_true_negatives(num_true_negative_stripes);
-
+  ProbeAllStripes(truth, index, values, &test_case);
   return test_case;
 }
 
 TestCase Evaluator::DoNegativeLookups(const Column& column,
+                                      const GroundTruth& truth,
                                       const IndexStructure& index,
-                                      std::size_t num_rows_per_stripe,
                                       std::size_t num_lookups) {
   std::mt19937 gen(42);
-  const std::size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  std::size_t num_false_positive_stripes = 0;
-  std::size_t num_true_negative_stripes = 0;
   std::uniform_int_distribution<long> value_d(std::numeric_limits<long>::min(),
                                              std::numeric_limits<long>::max());
+  std::vector<long> values;
+  values.reserve(num_lookups);
   for (size_t i = 0; i < num_lookups; ++i) {
     // Draw random value that is not present in the column.
     long value = value_d(gen);
     while (column.Contains(value)) {
       value = value_d(gen);
     }
-    ProbeAllStripes(column, index, value, num_rows_per_stripe, num_stripes,
-                    &num_true_negative_stripes, &num_false_positive_stripes);
+    values.push_back(value);
   }
 
   TestCase test_case;
   test_case.set_name("negative");
-  test_case.set_num_lookups(num_lookups);
-  test_case.set_num_false_positives(num_false_positive_stripes);
-  test_case.set_num_true_negatives(num_true_negative_stripes);
-
+  ProbeAllStripes(truth, index, values, &test_case);
   return test_case;
 }
 
 TestCase Evaluator::DoMixedLookups(const Column& column,
+                                   const GroundTruth& truth,
                                    const IndexStructure& index,
-                                   std::size_t num_rows_per_stripe,
                                    std::size_t num_lookups, double hit_rate) {
   absl::BitGen bitgen;
   std::mt19937 gen(42);
-  const std::size_t num_stripes = column.num_rows() / num_rows_per_stripe;
-  std::size_t num_false_positive_stripes = 0;
-  std::size_t num_true_negative_stripes = 0;
   std::vector<long> distinct_values = column.distinct_values();
   // Remove NULLs from the lookup.
   distinct_values.erase(
@@ -244,6 +248,8 @@ TestCase Evaluator::DoMixedLookups(const Column& column,
       0, distinct_values.size() - 1);
   std::uniform_int_distribution<long> value_d(std::numeric_limits<long>::min(),
                                              std::numeric_limits<long>::max());
+  std::vector<long> values;
+  values.reserve(num_lookups);
   for (size_t i = 0; i < num_lookups; ++i) {
     long value;
     // Positive or negative lookup?
@@ -258,38 +264,76 @@ TestCase Evaluator::DoMixedLookups(const Column& column,
         value = value_d(gen);
       }
     }
-    ProbeAllStripes(column, index, value, num_rows_per_stripe, num_stripes,
-                    &num_true_negative_stripes, &num_false_positive_stripes);
+    values.push_back(value);
   }
 
   TestCase test_case;
   test_case.set_name(absl::StrFormat("mixed/%.1f", hit_rate));
-  test_case.set_num_lookups(num_lookups);
-  test_case.set_num_false_positives(num_false_positive_stripes);
-  test_case.set_num_true_negatives(num_true_negative_stripes);
-
+  ProbeAllStripes(truth, index, values, &test_case);
   return test_case;
 }
 
-void Evaluator::ProbeAllStripes(const Column& column,
-                                const IndexStructure& index, long value,
-                                std::size_t num_rows_per_stripe,
-                                std::size_t num_stripes,
-                                std::size_t* num_true_negative_stripes,
-                                std::size_t* num_false_positive_stripes) {
-  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
-    // Get expected result (ground truth).
-    const bool expected =
-        column.StripeContains(num_rows_per_stripe, stripe_id, value);
-    if (!expected) ++(*num_true_negative_stripes);
-    if (index.StripeContains(stripe_id, value) != expected) {
-      if (expected) {
-        std::cerr << index.name() << " returned a false negative." << std::endl;
-        exit(EXIT_FAILURE);
+void Evaluator::ProbeAllStripes(const GroundTruth& truth,
+                                const IndexStructure& index,
+                                absl::Span<const long> values,
+                                TestCase* test_case) const {
+  const size_t num_batches =
+      (values.size() + kLookupBatchSize - 1) / kLookupBatchSize;
+  const size_t num_threads =
+      std::max<size_t>(1, std::min(num_threads_, num_batches));
+  std::vector<size_t> num_true_negative_stripes(num_threads, 0);
+  std::vector<size_t> num_false_positive_stripes(num_threads, 0);
+
+  // Threads take the next batch until all are done.
+  std::atomic<size_t> next_batch{0};
+  auto work = [&](size_t thread_idx) {
+    for (size_t batch = next_batch++; batch < num_batches;
+         batch = next_batch++) {
+      const absl::Span<const long> batch_values =
+          values.subspan(batch * kLookupBatchSize, kLookupBatchSize);
+      const std::vector<Bitmap64> results =
+          index.GetQualifyingStripesBatch(batch_values, truth.num_stripes);
+      for (size_t i = 0; i < batch_values.size(); ++i) {
+        // Get expected result (ground truth).
+        size_t num_expected = 0;
+        const auto it = truth.stripe_sets.find(batch_values[i]);
+        if (it != truth.stripe_sets.end()) {
+          it->second.ForEach([&](uint32_t stripe_id) {
+            if (!results[i].Get(stripe_id)) {
+              std::cerr << index.name() << " returned a false negative."
+                        << std::endl;
+              exit(EXIT_FAILURE);
+            }
+          });
+          num_expected = it->second.size();
+        }
+        num_true_negative_stripes[thread_idx] +=
+            truth.num_stripes - num_expected;
+        num_false_positive_stripes[thread_idx] +=
+            results[i].GetOnesCount() - num_expected;
       }
-      ++(*num_false_positive_stripes);
     }
+  };
+
+  if (num_threads == 1) {
+    work(/*thread_idx=*/0);
+  } else {
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i)
+      threads.emplace_back([&work, i]() { work(i); });
+    for (std::thread& thread : threads) thread.join();
+  }
+
+  size_t num_true_negatives = 0;
+  size_t num_false_positives = 0;
+  for (size_t i = 0; i < num_threads; ++i) {
+    num_true_negatives += num_true_negative_stripes[i];
+    num_false_positives += num_false_positive_stripes[i];
   }
+  test_case->set_num_lookups(values.size());
+  test_case->set_num_false_positives(num_false_positives);
+  test_case->set_num_true_negatives(num_true_negatives);
 }
 
 }  // namespace ci
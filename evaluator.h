@@ -19,8 +19,13 @@
 #ifndef CUCKOO_INDEX_EVALUATOR_H
 #define CUCKOO_INDEX_EVALUATOR_H
 
+#include <cstddef>
 #include <random>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "common/stripe_set.h"
 #include "data.h"
 #include "evaluation.pb.h"
 #include "index_structure.h"
@@ -29,6 +34,10 @@ namespace ci {
 
 class Evaluator {
  public:
+  // The lookups of a test case are spread over `num_threads` threads (in
+  // batches, see ProbeAllStripes(..)).
+  explicit Evaluator(size_t num_threads = 1) : num_threads_(num_threads) {}
+
   // Runs experiments for the given parameters and returns their results.
   //
   // Selected experiments `test_cases` (e.g. positive uniform look-ups) are run
@@ -42,12 +51,27 @@ class Evaluator {
       size_t num_lookups, const std::vector<std::string>& test_cases);
 
  private:
+  // Number of lookups passed to IndexStructure::GetQualifyingStripesBatch(..)
+  // at once, i.e., the unit of work of a thread.
+  static constexpr size_t kLookupBatchSize = 256;
+
+  // The stripes each value of a column occurs in, i.e., the expected results
+  // of lookups. Built once per (column, num_rows_per_stripe) and shared by all
+  // index structures and test cases.
+  struct GroundTruth {
+    GroundTruth(const Column& column, std::size_t num_rows_per_stripe);
+
+    std::size_t num_stripes;
+    StripeSetArena arena;
+    absl::flat_hash_map<long, StripeSet> stripe_sets;
+  };
+
   // Performs positive lookups with values drawn from random row offsets. This
   // assumes that positive lookup values follow the same distribution than
   // stored values, i.e., frequent values are queried frequently.
   ci::EvaluationResults::TestCase DoPositiveUniformLookups(
-      const Column& column, const IndexStructure& index_structure,
-      std::size_t num_rows_per_stripe, std::size_t num_lookups);
+      const Column& column, const GroundTruth& truth,
+      const IndexStructure& index_structure, std::size_t num_lookups);
 
   // Performs positive lookups with a subset of all distinct values (chosen
   // uniformly at random). This means, e.g., that lookup values that only occur
@@ -55,14 +79,14 @@ class Evaluator {
   // occur in all stripes, on the other hand, cannot cause any false positive
   // stripes.
   ci::EvaluationResults::TestCase DoPositiveDistinctLookups(
-      const Column& column, const IndexStructure& index,
-      std::size_t num_rows_per_stripe, std::size_t num_lookups);
+      const Column& column, const GroundTruth& truth,
+      const IndexStructure& index, std::size_t num_lookups);
 
   // Performs positive lookups with a subset of all distinct values (chosen
   // based on a Zipf distribution).
   ci::EvaluationResults::TestCase DoPositiveZipfLookups(
-      const Column& column, const IndexStructure& index,
-      std::size_t num_rows_per_stripe, std::size_t num_lookups);
+      const Column& column, const GroundTruth& truth,
+      const IndexStructure& index, std::size_t num_lookups);
 
   // Performs negative lookups with random values not present the `column`.
   // Note that in this test case, ZoneMaps will be 100% effective for
@@ -78,8 +102,8 @@ class Evaluator {
   // generation here that only ensures that a lookup key doesn't occur in any
   // stripe.
   ci::EvaluationResults::TestCase DoNegativeLookups(
-      const Column& column, const IndexStructure& index,
-      std::size_t num_rows_per_stripe, std::size_t num_lookups);
+      const Column& column, const GroundTruth& truth,
+      const IndexStructure& index, std::size_t num_lookups);
 
   // Performs lookups with a mix between positive (chosen from distinct
   // values like in DoPositiveDistinctLookups) and negative lookup keys.
@@ -87,19 +111,18 @@ class Evaluator {
   // 10% of the lookup keys are positive, i.e., are at least present in one
   // stripe).
   ci::EvaluationResults::TestCase DoMixedLookups(
-      const Column& column, const IndexStructure& index,
-      std::size_t num_rows_per_stripe, std::size_t num_lookups,
-      double hit_rate);
-
-  // Probes all stripes for the given `column` and `index`, and updates
-  // `num_true_negative_stripes` (ground truth true negatives) and
-  // `num_false_positive_stripes` (number of times the `index` did not prune
-  // a stripe even though it could have).
-  void ProbeAllStripes(const Column& column, const IndexStructure& index,
-                       long value, std::size_t num_rows_per_stripe,
-                       std::size_t num_stripes,
-                       std::size_t* num_true_negative_stripes,
-                       std::size_t* num_false_positive_stripes);
+      const Column& column, const GroundTruth& truth,
+      const IndexStructure& index, std::size_t num_lookups, double hit_rate);
+
+  // Probes all stripes of `index` for each of the `values`, and fills
+  // `test_case` with the number of lookups, `num_true_negatives` (ground truth true
+  // negatives) and `num_false_positives` (number of times the `index` did not
+  // prune a stripe even though it could have). Exits on false negatives.
+  void ProbeAllStripes(const GroundTruth& truth, const IndexStructure& index,
+                       absl::Span<const long> values,
+                       ci::EvaluationResults::TestCase* test_case) const;
+
+  const size_t num_threads_;
 };
 
 }  // namespace ci
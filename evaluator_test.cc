@@ -0,0 +1,112 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: zone_map_test.h
+// -----------------------------------------------------------------------------
+
+#include "evaluator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "data.h"
+#include "gtest/gtest.h"
+#include "per_stripe_bloom.h"
+#include "zone_map.h"
+
+namespace ci {
+namespace {
+
+constexpr size_t kNumRowsPerStripe = 100;
+constexpr size_t kNumStripes = 20;
+constexpr size_t kNumLookups = 1000;
+
+// Returns a table with a single, sorted column of `kNumStripes` stripes, in
+// which each stripe holds `kNumRowsPerStripe` / 4 distinct values.
+std::unique_ptr<Table> CreateSortedTable() {
+  std::vector<long> data;
+  for (size_t row = 0; row < kNumStripes * kNumRowsPerStripe; ++row)
+    data.push_back(row / 4 + 1);
+  std::vector<std::unique_ptr<Column>> columns;
+  columns.push_back(Column::IntColumn("sorted", std::move(data)));
+  return Table::Create("test", std::move(columns));
+}
+
+std::vector<EvaluationResults> RunExperiments(
+    const std::unique_ptr<Table>& table, size_t num_threads,
+    const std::vector<std::string>& test_cases) {
+  std::vector<std::unique_ptr<IndexStructureFactory>> factories;
+  factories.push_back(absl::make_unique<ZoneMapFactory>());
+  factories.push_back(
+      absl::make_unique<PerStripeBloomFactory>(/*num_bits_per_key=*/2));
+  return Evaluator(num_threads)
+      .RunExperiments(std::move(factories), table, {kNumRowsPerStripe},
+                      kNumLookups, test_cases);
+}
+
+TEST(EvaluatorTest, CountsTrueNegativesAndFalsePositives) {
+  const std::unique_ptr<Table> table = CreateSortedTable();
+  const std::vector<EvaluationResults> results = RunExperiments(
+      table, /*num_threads=*/1, {"positive_distinct", "negative"});
+  ASSERT_EQ(results.size(), 2);
+
+  // Each value occurs in a single stripe, which ZoneMaps prune perfectly.
+  const EvaluationResults& zone_map = results[0];
+  EXPECT_EQ(zone_map.index_structure(), "ZoneMap");
+  ASSERT_EQ(zone_map.test_cases_size(), 2);
+  for (const EvaluationResults::TestCase& test_case : zone_map.test_cases()) {
+    EXPECT_EQ(test_case.num_lookups(), kNumLookups);
+    EXPECT_EQ(test_case.num_false_positives(), 0);
+  }
+  EXPECT_EQ(zone_map.test_cases(0).num_true_negatives(),
+            kNumLookups * (kNumStripes - 1));
+  EXPECT_EQ(zone_map.test_cases(1).num_true_negatives(),
+            kNumLookups * kNumStripes);
+
+  // A Bloom filter with 2 bits per key has plenty of false positives.
+  const EvaluationResults& bloom = results[1];
+  EXPECT_GT(bloom.test_cases(0).num_false_positives(), 0);
+  EXPECT_GT(bloom.test_cases(1).num_false_positives(), 0);
+}
+
+TEST(EvaluatorTest, ResultsDontDependOnNumThreads) {
+  const std::unique_ptr<Table> table = CreateSortedTable();
+  const std::vector<std::string> test_cases = {
+      "positive_uniform", "positive_distinct", "positive_zipf", "negative"};
+  const std::vector<EvaluationResults> expected =
+      RunExperiments(table, /*num_threads=*/1, test_cases);
+  const std::vector<EvaluationResults> results =
+      RunExperiments(table, /*num_threads=*/4, test_cases);
+
+  ASSERT_EQ(results.size(), expected.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    ASSERT_EQ(results[i].test_cases_size(), expected[i].test_cases_size());
+    for (int j = 0; j < results[i].test_cases_size(); ++j) {
+      const EvaluationResults::TestCase& test_case = results[i].test_cases(j);
+      const EvaluationResults::TestCase& expected_test_case =
+          expected[i].test_cases(j);
+      EXPECT_EQ(test_case.name(), expected_test_case.name());
+      EXPECT_EQ(test_case.num_false_positives(),
+                expected_test_case.num_false_positives());
+      EXPECT_EQ(test_case.num_true_negatives(),
+                expected_test_case.num_true_negatives());
+    }
+  }
+}
+
+}  // namespace
+}  // namespace ci
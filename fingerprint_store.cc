@@ -18,10 +18,14 @@
 
 #include "fingerprint_store.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "common/bitmap.h"
+#include "common/profiling.h"
 #include "common/rle_bitmap.h"
 #include "cuckoo_utils.h"
 
@@ -58,14 +62,266 @@ Block::Block(const size_t num_bits, const std::vector<uint64_t>& fingerprints)
 
   // Copy the serialized encoding to the string `data_`.
   data_ = std::string(result.data(), result.pos());
+  encoded_ = data_;
 
   // Set BitPackedReader.
   fingerprints_ =
       BitPackedReader<uint64_t>(bit_width, data_.data() + fingerprints_pos);
 }
 
-void FingerprintStore::Decode(const std::string& data) {
-  // TODO: Make method return FingerprintStore + implement decode.
+std::unique_ptr<Block> Block::Decode(absl::string_view data,
+                                     const size_t num_fingerprints,
+                                     size_t* num_bytes) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  const uint32_t num_bits = GetVarint32(span, &pos);
+  const uint32_t bit_width = GetVarint32(span, &pos);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  std::unique_ptr<Block> block =
+      absl::WrapUnique(new Block(num_bits, num_fingerprints));
+  block->fingerprints_ = BitPackedReader<uint64_t>(bit_width, span.data() + pos);
+  pos += BitPackingBytesRequired(num_fingerprints * bit_width) +
+         internal::kSlopBytes;
+  assert(pos <= data.size());
+  block->encoded_ = data.substr(0, pos);
+  *num_bytes = pos;
+  return block;
+}
+
+std::unique_ptr<Block> Block::DecodeChunked(absl::string_view data,
+                                            const size_t num_fingerprints,
+                                            const FingerprintChunks* chunks,
+                                            const size_t first_chunk,
+                                            size_t* num_bytes) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  const uint32_t num_bits = GetVarint32(span, &pos);
+  const uint32_t bit_width = GetVarint32(span, &pos);
+  const uint32_t num_fingerprints_per_chunk = GetVarint32(span, &pos);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  std::unique_ptr<Block> block =
+      absl::WrapUnique(new Block(num_bits, num_fingerprints));
+  block->chunks_ = chunks;
+  block->first_chunk_ = first_chunk;
+  block->num_fingerprints_per_chunk_ = num_fingerprints_per_chunk;
+  block->bit_width_ = bit_width;
+  assert(first_chunk + block->num_chunks() <= chunks->num_chunks());
+  *num_bytes = pos;
+  return block;
+}
+
+std::string Block::EncodeChunks(const size_t chunk_size,
+                                std::vector<std::string>* chunks) const {
+  assert(chunks_ == nullptr);
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(encoded_.data(), encoded_.size());
+  size_t pos = 0;
+  GetVarint32(span, &pos);  // Skip `num_bits_`.
+  const uint32_t bit_width = GetVarint32(span, &pos);
+  const char* packed = encoded_.data() + pos;
+
+  const size_t num_fingerprints_per_chunk = std::max<size_t>(
+      8, chunk_size * CHAR_BIT / std::max<uint32_t>(bit_width, 1) / 8 * 8);
+  for (size_t first = 0; first < num_fingerprints_;
+       first += num_fingerprints_per_chunk) {
+    const size_t num_chunk_fingerprints =
+        std::min(num_fingerprints_per_chunk, num_fingerprints_ - first);
+    std::string chunk(packed + first * bit_width / CHAR_BIT,
+                      BitPackingBytesRequired(num_chunk_fingerprints *
+                                              bit_width));
+    // Slop bytes to read whole words at the last fingerprint, as in blocks.
+    chunk.append(internal::kSlopBytes, '\0');
+    chunks->push_back(std::move(chunk));
+  }
+
+  ByteBuffer header;
+  PutVarint32(num_bits_, &header);
+  PutVarint32(bit_width, &header);
+  PutVarint32(num_fingerprints_per_chunk, &header);
+  return std::string(header.data(), header.pos());
+}
+
+uint64_t Block::GetFromChunk(const size_t idx) const {
+  const std::shared_ptr<const std::string> chunk =
+      chunks_->Get(first_chunk_ + idx / num_fingerprints_per_chunk_);
+  return BitPackedReader<uint64_t>(bit_width_, chunk->data())
+      .Get(idx % num_fingerprints_per_chunk_);
+}
+
+template <typename Fn>
+void FingerprintStore::ForEachBucketBlock(const Fn& fn) const {
+  // Every bucket is stored in exactly one block. A bucket only has a bit in
+  // block bitmap `i` if it isn't stored in any of the blocks before `i`. Keep
+  // track of the current position in each compacted block bitmap.
+  std::vector<size_t> idx_in_compacted_bitmap(block_bitmaps_.size(), 0);
+  const size_t num_buckets = num_slots_ / slots_per_bucket_;
+  for (size_t bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+    size_t block_idx = 0;
+    while (!block_bitmaps_[block_idx]->Get(
+        idx_in_compacted_bitmap[block_idx]++)) {
+      ++block_idx;
+      assert(block_idx < block_bitmaps_.size());
+    }
+    fn(bucket_idx, block_idx);
+  }
+}
+
+namespace {
+
+// Decodes a bitmap written by FingerprintStore::Encode(..), either with
+// RleBitmap or with Bitmap64::DenseEncode(..).
+Bitmap64Ptr DecodeBitmap(absl::string_view encoded, const bool use_rle) {
+  if (use_rle) {
+    const RleBitmapPtr rle_bitmap = RleBitmap::Decode(encoded);
+    Bitmap64Ptr bitmap = absl::make_unique<Bitmap64>(
+        rle_bitmap->Extract(/*offset=*/0, /*size=*/rle_bitmap->size()));
+    bitmap->InitRankLookupTable();
+    return bitmap;
+  }
+  // Dense encodings already contain the rank lookup table.
+  return absl::make_unique<Bitmap64>(Bitmap64::DenseDecode(encoded));
+}
+
+// Returns the `num_bits` (<= 64) bits of `words` starting at bit `pos`.
+uint64_t ReadBits(const uint64_t* words, const size_t pos,
+                  const size_t num_bits) {
+  const size_t shift = pos % 64;
+  uint64_t bits = words[pos / 64] >> shift;
+  if (shift + num_bits > 64) bits |= words[pos / 64 + 1] << (64 - shift);
+  return num_bits == 64 ? bits : bits & ((uint64_t{1} << num_bits) - 1);
+}
+
+// Writes the lower `num_bits` (<= 64) bits of `value` to the (still unset)
+// bits of `words` starting at bit `pos`.
+void WriteBits(const uint64_t value, const size_t num_bits, const size_t pos,
+               uint64_t* words) {
+  const size_t shift = pos % 64;
+  words[pos / 64] |= value << shift;
+  if (shift + num_bits > 64) words[pos / 64 + 1] |= value >> (64 - shift);
+}
+
+}  // namespace
+
+std::unique_ptr<FingerprintStore> FingerprintStore::DecodeBitmaps(
+    absl::Span<const char> span, size_t* pos_ptr,
+    std::vector<size_t>* num_fingerprints) {
+  size_t& pos = *pos_ptr;
+
+  // ** Header.
+  const uint32_t num_blocks = GetVarint32(span, &pos);
+  assert(num_blocks > 0);
+  const size_t slots_per_bucket = GetVarint32(span, &pos);
+  const bool use_rle_to_encode_block_bitmaps = GetVarint32(span, &pos) != 0;
+  const size_t num_slots = GetVarint32(span, &pos);
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  std::unique_ptr<FingerprintStore> store = absl::WrapUnique(
+      new FingerprintStore(num_slots, slots_per_bucket,
+                           use_rle_to_encode_block_bitmaps));
+
+  // ** Bitmaps.
+  store->empty_slots_bitmap_ =
+      DecodeBitmap(GetString(span, &pos), use_rle_to_encode_block_bitmaps);
+  assert(store->empty_slots_bitmap_->bits() == num_slots);
+  store->num_stored_fingerprints_ =
+      store->empty_slots_bitmap_->GetZeroesCount();
+
+  // The bitmap of the "empty buckets block" (always the first block) is not
+  // encoded, re-construct it from `empty_slots_bitmap_`.
+  Bitmap64Ptr empty_buckets_bitmap =
+      GetEmptyBucketsBitmap(*store->empty_slots_bitmap_, slots_per_bucket);
+  empty_buckets_bitmap->InitRankLookupTable();
+  store->block_bitmaps_.push_back(std::move(empty_buckets_bitmap));
+
+  // Split the global bitmap into the remaining (compacted) block bitmaps.
+  std::vector<size_t> block_bitmap_sizes(num_blocks - 1);
+  for (size_t& size : block_bitmap_sizes) size = GetVarint32(span, &pos);
+  const Bitmap64Ptr global_bitmap =
+      DecodeBitmap(GetString(span, &pos), use_rle_to_encode_block_bitmaps);
+  size_t base_index = 0;
+  for (const size_t size : block_bitmap_sizes) {
+    Bitmap64Ptr block_bitmap = absl::make_unique<Bitmap64>(size);
+    for (size_t i = 0; i < size; ++i)
+      block_bitmap->Set(i, global_bitmap->Get(base_index + i));
+    block_bitmap->InitRankLookupTable();
+    store->block_bitmaps_.push_back(std::move(block_bitmap));
+    base_index += size;
+  }
+  assert(base_index == global_bitmap->bits());
+
+  // Count the fingerprints per block (needed to find the block boundaries).
+  num_fingerprints->assign(num_blocks, 0);
+  store->ForEachBucketBlock([&](size_t bucket_idx, size_t block_idx) {
+    (*num_fingerprints)[block_idx] += store->GetNumItemsInBucket(bucket_idx);
+  });
+  return store;
+}
+
+std::unique_ptr<FingerprintStore> FingerprintStore::Decode(
+    absl::string_view data) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  std::vector<size_t> num_fingerprints;
+  std::unique_ptr<FingerprintStore> store =
+      DecodeBitmaps(span, &pos, &num_fingerprints);
+  const size_t num_blocks = num_fingerprints.size();
+
+  // ** Blocks.
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    size_t num_bytes;
+    store->blocks_.push_back(Block::Decode(data.substr(pos),
+                                           num_fingerprints[block_idx],
+                                           &num_bytes));
+    pos += num_bytes;
+  }
+  assert(store->blocks_[0]->num_bits() == kEmptyBucketsBlockMarker);
+  assert(pos == data.size());
+
+  return store;
+}
+
+std::unique_ptr<FingerprintStore> FingerprintStore::DecodeCompressed(
+    absl::string_view data, size_t max_cached_chunks) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  std::vector<size_t> num_fingerprints;
+  std::unique_ptr<FingerprintStore> store =
+      DecodeBitmaps(span, &pos, &num_fingerprints);
+
+  // ** Blocks. The chunks follow the headers of all blocks, so skip over the
+  // headers first.
+  size_t chunks_pos = pos;
+  for (size_t block_idx = 0; block_idx < num_fingerprints.size();
+       ++block_idx) {
+    for (size_t i = 0; i < 3; ++i) GetVarint32(span, &chunks_pos);
+  }
+  store->fingerprint_chunks_ = absl::make_unique<FingerprintChunks>(
+      data.substr(chunks_pos), max_cached_chunks,
+      [](std::string uncompressed) {
+        return std::make_shared<const std::string>(std::move(uncompressed));
+      });
+
+  size_t first_chunk = 0;
+  for (size_t block_idx = 0; block_idx < num_fingerprints.size();
+       ++block_idx) {
+    size_t num_bytes;
+    store->blocks_.push_back(Block::DecodeChunked(
+        data.substr(pos), num_fingerprints[block_idx],
+        store->fingerprint_chunks_.get(), first_chunk, &num_bytes));
+    pos += num_bytes;
+    first_chunk += store->blocks_.back()->num_chunks();
+  }
+  assert(pos == chunks_pos);
+  assert(first_chunk == store->fingerprint_chunks_->num_chunks());
+  assert(store->blocks_[0]->num_bits() == kEmptyBucketsBlockMarker);
+
+  return store;
 }
 
 FingerprintStore::FingerprintStore(const std::vector<Fingerprint>& fingerprints,
@@ -128,12 +384,20 @@ FingerprintStore::FingerprintStore(const std::vector<Fingerprint>& fingerprints,
     // `empty_slots_bitmap_`. The effect of this is that the empty block bitmap
     // will not be "compacted" in CreateAndCompactBlockBitmaps() below (the
     // first block bitmap is never compacted).
-    if (length == kEmptyBucketsBlockMarker) return true;
-    if (other_length == kEmptyBucketsBlockMarker) return false;
+    if (length == kEmptyBucketsBlockMarker ||
+        other_length == kEmptyBucketsBlockMarker) {
+      return other_length != kEmptyBucketsBlockMarker;
+    }
 
-    // Order other blocks based on decreasing cardinality.
-    return blocks[length].block_bitmap->GetOnesCount() >
-           blocks[other_length].block_bitmap->GetOnesCount();
+    // Order other blocks based on decreasing cardinality. Ties are broken by
+    // the length, so that the order doesn't depend on the iteration order of
+    // `blocks`.
+    const size_t cardinality = blocks[length].block_bitmap->GetOnesCount();
+    const size_t other_cardinality =
+        blocks[other_length].block_bitmap->GetOnesCount();
+    if (cardinality != other_cardinality)
+      return cardinality > other_cardinality;
+    return length < other_length;
   };
   std::sort(lengths.begin(), lengths.end(), comparator);
 
@@ -144,64 +408,300 @@ FingerprintStore::FingerprintStore(const std::vector<Fingerprint>& fingerprints,
   }
 
   CreateAndCompactBlockBitmaps(lengths, &blocks);
-
-  PrintStats();
 }
 
 Fingerprint FingerprintStore::GetFingerprint(const size_t slot_idx) const {
   assert(slot_idx < empty_slots_bitmap_->bits());
 
+  if (!cache_lines_.empty()) {
+    const size_t bucket_idx = slot_idx / slots_per_bucket_;
+    const size_t i = slot_idx - bucket_idx * slots_per_bucket_;
+    size_t pos;
+    const uint64_t* words = LocateBucketInCacheLines(bucket_idx, &pos);
+    if (((ReadBits(words, pos, slots_per_bucket_) >> i) & 1) == 0)
+      return Fingerprint{/*active=*/false, /*num_bits=*/0, /*fingerprint=*/0};
+    pos += slots_per_bucket_;
+    const size_t num_bits = ReadBits(words, pos, kNumBitsBits);
+    pos += kNumBitsBits + i * fingerprint_bits_;
+    return Fingerprint{/*active=*/true, num_bits,
+                       /*fingerprint=*/ReadBits(words, pos, fingerprint_bits_)};
+  }
+
   if (empty_slots_bitmap_->Get(slot_idx)) {
     // Slot is empty. Return dummy.
-    return Fingerprint{.active = false};
+    return Fingerprint{/*active=*/false, /*num_bits=*/0, /*fingerprint=*/0};
   }
 
   const size_t bucket_idx = slot_idx / slots_per_bucket_;
+  size_t block_idx;
+  size_t idx_in_block = LocateBucket(bucket_idx, &block_idx);
+  // Add the non-empty slots in bucket `bucket_idx` before `slot_idx`.
+  for (size_t i = bucket_idx * slots_per_bucket_; i < slot_idx; ++i)
+    idx_in_block += !empty_slots_bitmap_->Get(i);
+
+  const BlockPtr& block = blocks_[block_idx];
+  return Fingerprint{/*active=*/true, block->num_bits(),
+                     /*fingerprint=*/block->Get(idx_in_block)};
+}
+
+template <size_t kSlotsPerBucket>
+uint32_t FingerprintStore::GetBucketFingerprints(const size_t bucket_idx,
+                                                 uint64_t* fingerprints,
+                                                 size_t* num_bits) const {
+  assert(kSlotsPerBucket == 0 || kSlotsPerBucket == slots_per_bucket_);
+  const size_t slots_per_bucket =
+      kSlotsPerBucket == 0 ? slots_per_bucket_ : kSlotsPerBucket;
+  assert(slots_per_bucket <= 32);
+  if (!cache_lines_.empty()) {
+    size_t pos;
+    const uint64_t* words = LocateBucketInCacheLines(bucket_idx, &pos);
+    const uint32_t active_mask = ReadBits(words, pos, slots_per_bucket);
+    pos += slots_per_bucket;
+    *num_bits = ReadBits(words, pos, kNumBitsBits);
+    pos += kNumBitsBits;
+    // Empty slots are stored as 0.
+    for (size_t i = 0; i < slots_per_bucket; ++i) {
+      fingerprints[i] = ReadBits(words, pos, fingerprint_bits_);
+      pos += fingerprint_bits_;
+    }
+    return active_mask;
+  }
+
+  const size_t first_slot = bucket_idx * slots_per_bucket;
+  uint32_t active_mask = 0;
+  for (size_t i = 0; i < slots_per_bucket; ++i) {
+    fingerprints[i] = 0;
+    if (!empty_slots_bitmap_->Get(first_slot + i)) active_mask |= 1u << i;
+  }
+  *num_bits = 0;
+  if (active_mask == 0) return 0;
+
+  // All fingerprints of a bucket are stored consecutively in the same block.
+  size_t block_idx;
+  size_t idx_in_block = LocateBucket(bucket_idx, &block_idx);
+  const BlockPtr& block = blocks_[block_idx];
+  *num_bits = block->num_bits();
+  for (size_t i = 0; i < slots_per_bucket; ++i) {
+    if (active_mask & (1u << i)) fingerprints[i] = block->Get(idx_in_block++);
+  }
+  return active_mask;
+}
+
+size_t FingerprintStore::LocateBucket(const size_t bucket_idx,
+                                      size_t* block_idx) const {
+  if (!bucket_block_ids_.empty()) {
+    *block_idx = bucket_block_ids_[bucket_idx];
+    const size_t entry_idx = bucket_idx / directory_sampling_;
+    size_t idx_in_block =
+        directory_offsets_[entry_idx * blocks_.size() + *block_idx];
+
+    // Add the fingerprints of the buckets between the directory entry and
+    // `bucket_idx` that are stored in the same block.
+    for (size_t i = entry_idx * directory_sampling_; i < bucket_idx; ++i) {
+      if (bucket_block_ids_[i] == *block_idx)
+        idx_in_block += GetNumItemsInBucket(i);
+    }
+    return idx_in_block;
+  }
 
   // Search blocks for fingerprint.
   size_t idx_in_compacted_bitmap = bucket_idx;
-  for (size_t block_idx = 0; block_idx < blocks_.size(); ++block_idx) {
-    const Bitmap64Ptr& block_bitmap = block_bitmaps_[block_idx];
-    const BlockPtr& block = blocks_[block_idx];
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    const Bitmap64Ptr& block_bitmap = block_bitmaps_[i];
+    CUCKOO_INDEX_COUNT_LOOKUP(FingerprintBlocksWalked, 1);
 
-    if (block_idx > 0) {
+    if (i > 0) {
       // Map `bucket_idx` to index in compacted block bitmap. Re-use
       // `idx_in_compacted_bitmap` across loop iterations, i.e., only map it
       // from one block bitmap to the next.
       idx_in_compacted_bitmap -=
-          GetRank(*(block_bitmaps_[block_idx - 1]), idx_in_compacted_bitmap);
+          GetRank(*(block_bitmaps_[i - 1]), idx_in_compacted_bitmap);
     }
 
-    // Fingerprint can't be part of "empty buckets block" (this case is already
-    // taken care of by checking `empty_slots_bitmap_` above).
-    if (block->num_bits() == kEmptyBucketsBlockMarker) continue;
+    // Fingerprints can't be part of "empty buckets block" (callers only pass
+    // non-empty buckets).
+    if (blocks_[i]->num_bits() == kEmptyBucketsBlockMarker) continue;
 
     if (block_bitmap->Get(idx_in_compacted_bitmap)) {
-      // Block `block_idx` contains fingerprints of bucket `bucket_idx`.
-
-      const size_t idx_in_block = GetIndexOfFingerprintInBlock(
-          block_idx, idx_in_compacted_bitmap, slot_idx);
-
-      return Fingerprint{/*active=*/true, block->num_bits(),
-                         /*fingerprint=*/block->Get(idx_in_block)};
+      // Block `i` contains fingerprints of bucket `bucket_idx`.
+      *block_idx = i;
+      return GetIndexOfFingerprintInBlock(i, idx_in_compacted_bitmap,
+                                          bucket_idx * slots_per_bucket_);
     }
   }
 
   // Unreachable.
-  std::cerr << "Couldn't find block for slot_idx " << slot_idx;
+  std::cerr << "Couldn't find block for bucket_idx " << bucket_idx;
   std::exit(1);
 }
 
-std::string FingerprintStore::Encode(bool bitmaps_only) const {
+void FingerprintStore::InitDirectory(const size_t num_buckets_per_entry) {
+  assert(num_buckets_per_entry > 0);
+  // Block ids are stored as uint8_t. There is at most one block per
+  // fingerprint length (plus the "empty buckets block").
+  assert(blocks_.size() <= std::numeric_limits<uint8_t>::max());
+  const size_t num_blocks = blocks_.size();
+  const size_t num_buckets = num_slots_ / slots_per_bucket_;
+  const size_t num_entries =
+      (num_buckets + num_buckets_per_entry - 1) / num_buckets_per_entry;
+  directory_sampling_ = num_buckets_per_entry;
+  bucket_block_ids_.resize(num_buckets);
+  directory_offsets_.resize(num_entries * num_blocks);
+
+  // The number of fingerprints stored in each block before the current bucket.
+  std::vector<uint32_t> num_fingerprints(num_blocks, 0);
+  ForEachBucketBlock([&](size_t bucket_idx, size_t block_idx) {
+    if (bucket_idx % num_buckets_per_entry == 0) {
+      std::copy(num_fingerprints.begin(), num_fingerprints.end(),
+                directory_offsets_.begin() +
+                    (bucket_idx / num_buckets_per_entry) * num_blocks);
+    }
+    bucket_block_ids_[bucket_idx] = block_idx;
+    num_fingerprints[block_idx] += GetNumItemsInBucket(bucket_idx);
+  });
+}
+
+void FingerprintStore::InitCacheLines() {
+  assert(slots_per_bucket_ <= 32);
+  constexpr size_t kBitsPerLine = sizeof(CacheLine) * CHAR_BIT;
+  const size_t num_buckets = num_slots_ / slots_per_bucket_;
+
+  // Pad all fingerprints to the largest length, so that the position of a
+  // bucket only depends on its index.
+  size_t fingerprint_bits = 0;
+  for (const BlockPtr& block : blocks_) {
+    if (block->num_bits() != kEmptyBucketsBlockMarker)
+      fingerprint_bits = std::max(fingerprint_bits, block->num_bits());
+  }
+  const size_t bucket_bits =
+      slots_per_bucket_ + kNumBitsBits + slots_per_bucket_ * fingerprint_bits;
+  // Fit as many buckets as possible into a single line, or a single bucket
+  // into as few lines as possible.
+  const size_t buckets_per_group = std::max<size_t>(
+      1, (kBitsPerLine - kNumActiveSlotsBits) / bucket_bits);
+  const size_t lines_per_group =
+      (kNumActiveSlotsBits + buckets_per_group * bucket_bits + kBitsPerLine -
+       1) /
+      kBitsPerLine;
+  const size_t num_groups =
+      (num_buckets + buckets_per_group - 1) / buckets_per_group;
+  assert(num_stored_fingerprints_ <= std::numeric_limits<uint32_t>::max());
+
+  // Fill the lines from the blocks before switching the lookups over to them.
+  std::vector<CacheLine> cache_lines(num_groups * lines_per_group, CacheLine{});
+  uint64_t fingerprints[32];
+  size_t num_active_slots = 0;
+  for (size_t bucket_idx = 0; bucket_idx < num_buckets; ++bucket_idx) {
+    const size_t group_idx = bucket_idx / buckets_per_group;
+    uint64_t* words =
+        reinterpret_cast<uint64_t*>(&cache_lines[group_idx * lines_per_group]);
+    const size_t idx_in_group = bucket_idx - group_idx * buckets_per_group;
+    if (idx_in_group == 0)
+      WriteBits(num_active_slots, kNumActiveSlotsBits, /*pos=*/0, words);
+
+    size_t num_bits;
+    const uint32_t active_mask =
+        GetBucketFingerprints(bucket_idx, fingerprints, &num_bits);
+    size_t pos = kNumActiveSlotsBits + idx_in_group * bucket_bits;
+    WriteBits(active_mask, slots_per_bucket_, pos, words);
+    pos += slots_per_bucket_;
+    WriteBits(num_bits, kNumBitsBits, pos, words);
+    pos += kNumBitsBits;
+    for (size_t i = 0; i < slots_per_bucket_; ++i) {
+      WriteBits(fingerprints[i], fingerprint_bits, pos, words);
+      pos += fingerprint_bits;
+    }
+    num_active_slots += __builtin_popcount(active_mask);
+  }
+
+  cache_lines_ = std::move(cache_lines);
+  buckets_per_group_ = buckets_per_group;
+  lines_per_group_ = lines_per_group;
+  bucket_bits_ = bucket_bits;
+  fingerprint_bits_ = fingerprint_bits;
+}
+
+template <size_t kSlotsPerBucket>
+bool FingerprintStore::IsBucketEmpty(const size_t bucket_idx) const {
+  assert(kSlotsPerBucket == 0 || kSlotsPerBucket == slots_per_bucket_);
+  if (kSlotsPerBucket == 0 && cache_lines_.empty())
+    return GetNumItemsInBucket(bucket_idx) == 0;
+  const size_t slots_per_bucket =
+      kSlotsPerBucket == 0 ? slots_per_bucket_ : kSlotsPerBucket;
+  if (cache_lines_.empty()) {
+    const size_t first_slot_idx = bucket_idx * slots_per_bucket;
+    for (size_t i = 0; i < slots_per_bucket; ++i) {
+      if (!empty_slots_bitmap_->Get(first_slot_idx + i)) return false;
+    }
+    return true;
+  }
+  size_t pos;
+  const uint64_t* words = LocateBucketInCacheLines(bucket_idx, &pos);
+  return ReadBits(words, pos, slots_per_bucket) == 0;
+}
+
+template <size_t kSlotsPerBucket>
+size_t FingerprintStore::GetNumActiveSlotsBefore(const size_t slot_idx) const {
+  assert(kSlotsPerBucket == 0 || kSlotsPerBucket == slots_per_bucket_);
+  if (cache_lines_.empty())
+    return slot_idx - empty_slots_bitmap_->GetOnesCountBeforeLimit(slot_idx);
+
+  const size_t slots_per_bucket =
+      kSlotsPerBucket == 0 ? slots_per_bucket_ : kSlotsPerBucket;
+  const size_t bucket_idx = slot_idx / slots_per_bucket;
+  size_t pos;
+  const uint64_t* words = LocateBucketInCacheLines(bucket_idx, &pos);
+  size_t num_active_slots = ReadBits(words, /*pos=*/0, kNumActiveSlotsBits);
+  // Add the non-empty slots of the buckets before `bucket_idx` in the group.
+  for (size_t bucket_pos = kNumActiveSlotsBits; bucket_pos < pos;
+       bucket_pos += bucket_bits_) {
+    num_active_slots +=
+        __builtin_popcountll(ReadBits(words, bucket_pos, slots_per_bucket));
+  }
+  const size_t i = slot_idx - bucket_idx * slots_per_bucket;
+  const uint64_t active_mask = ReadBits(words, pos, slots_per_bucket);
+  return num_active_slots +
+         __builtin_popcountll(active_mask & ((uint64_t{1} << i) - 1));
+}
+
+// The specializations used by CuckooIndex (see CuckooIndex::LookupFns).
+#define CUCKOO_INDEX_INSTANTIATE_LOOKUPS(k)                                  \
+  template uint32_t FingerprintStore::GetBucketFingerprints<k>(             \
+      const size_t bucket_idx, uint64_t* fingerprints, size_t* num_bits)    \
+      const;                                                                \
+  template bool FingerprintStore::IsBucketEmpty<k>(const size_t bucket_idx) \
+      const;                                                                \
+  template size_t FingerprintStore::GetNumActiveSlotsBefore<k>(             \
+      const size_t slot_idx) const;
+CUCKOO_INDEX_INSTANTIATE_LOOKUPS(0)
+CUCKOO_INDEX_INSTANTIATE_LOOKUPS(1)
+CUCKOO_INDEX_INSTANTIATE_LOOKUPS(2)
+CUCKOO_INDEX_INSTANTIATE_LOOKUPS(4)
+CUCKOO_INDEX_INSTANTIATE_LOOKUPS(8)
+#undef CUCKOO_INDEX_INSTANTIATE_LOOKUPS
+
+std::string FingerprintStore::Encode(bool bitmaps_only,
+                                     EncodedSizes* sizes) const {
+  if (fingerprint_chunks_ != nullptr && !bitmaps_only) {
+    std::cerr << "Can't re-encode the fingerprints of a compressed store."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  EncodedSizes encoded_sizes;
   ByteBuffer result;
 
   // Encode number of blocks.
   const uint32_t num_blocks = blocks_.size();
   PutVarint32(num_blocks, &result);
 
+  // Encode the parameters needed by Decode(..).
+  PutVarint32(slots_per_bucket_, &result);
+  PutVarint32(use_rle_to_encode_block_bitmaps_ ? 1 : 0, &result);
+
   // ** Bitmaps.
 
   // Encode num bits of `empty_slots_bitmap_`.
+  const size_t before_empty_slots_bitmap = result.pos();
   PutVarint32(empty_slots_bitmap_->bits(), &result);
   // Encode `empty_slots_bitmap_`.
   if (use_rle_to_encode_block_bitmaps_) {
@@ -212,6 +712,7 @@ std::string FingerprintStore::Encode(bool bitmaps_only) const {
     Bitmap64::DenseEncode(*empty_slots_bitmap_, &bitmap_encoded);
     PutString(bitmap_encoded, &result);
   }
+  encoded_sizes.empty_slots_bitmap = result.pos() - before_empty_slots_bitmap;
 
   // Encode block bitmaps, except "empty buckets block" which can be
   // re-constructed from `empty_slots_bitmap_` using
@@ -227,6 +728,7 @@ std::string FingerprintStore::Encode(bool bitmaps_only) const {
   }
 
   // Encode num bits of block bitmaps.
+  const size_t before_block_bitmaps = result.pos();
   for (size_t i = 0; i < block_bitmaps_without_empty_block.size(); ++i)
     PutVarint32(block_bitmaps_without_empty_block[i]->bits(), &result);
 
@@ -241,13 +743,32 @@ std::string FingerprintStore::Encode(bool bitmaps_only) const {
     Bitmap64::DenseEncode(global_bitmap, &bitmap_encoded);
     PutString(bitmap_encoded, &result);
   }
+  encoded_sizes.block_bitmaps = result.pos() - before_block_bitmaps;
 
   std::string encoded(result.data(), result.pos());
   if (!bitmaps_only) {
     // Encode blocks.
     for (const BlockPtr& block : blocks_)
       absl::StrAppend(&encoded, block->GetData());
+    encoded_sizes.fingerprints = encoded.size() - result.pos();
   }
+  if (sizes != nullptr) *sizes = encoded_sizes;
+  return encoded;
+}
+
+std::string FingerprintStore::EncodeCompressed(size_t chunk_size,
+                                               EncodedSizes* sizes) const {
+  EncodedSizes encoded_sizes;
+  std::string encoded = Encode(/*bitmaps_only=*/true, &encoded_sizes);
+  const size_t before_blocks = encoded.size();
+
+  std::vector<std::string> chunks;
+  for (const BlockPtr& block : blocks_)
+    absl::StrAppend(&encoded, block->EncodeChunks(chunk_size, &chunks));
+  absl::StrAppend(&encoded, EncodeCompressedChunks(chunks));
+  encoded_sizes.fingerprints = encoded.size() - before_blocks;
+
+  if (sizes != nullptr) *sizes = encoded_sizes;
   return encoded;
 }
 
@@ -23,13 +23,23 @@
 #include <climits>
 #include <cstdlib>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/memoized.h"
+#include "compressed_chunks.h"
 #include "cuckoo_utils.h"
 #include "evaluation_utils.h"
 
 namespace ci {
 
+// The decompressed chunks of the fingerprints of compressed stores (see
+// FingerprintStore::EncodeCompressed(..)).
+using FingerprintChunks = ChunkCache<std::string>;
+
 // Stores fingerprints with a fixed number of bits (`num_bits`). The maximum bit
 // width of `fingerprints` has to be at most `num_bits` bits.
 class Block {
@@ -37,6 +47,21 @@ class Block {
   explicit Block(const size_t num_bits,
                  const std::vector<uint64_t>& fingerprints);
 
+  // Decodes a block holding `num_fingerprints` fingerprints from the front of
+  // `data` (as written by GetData()) and sets `num_bytes` to the size of its
+  // encoding. Does *not* copy `data`, i.e., its lifetime must be longer than
+  // the lifetime of the returned block.
+  static std::unique_ptr<Block> Decode(absl::string_view data,
+                                       const size_t num_fingerprints,
+                                       size_t* num_bytes);
+
+  // Like Decode(..), but for the header written by EncodeChunks(..): the
+  // fingerprints are read from `chunks`, starting at chunk `first_chunk`.
+  static std::unique_ptr<Block> DecodeChunked(
+      absl::string_view data, const size_t num_fingerprints,
+      const FingerprintChunks* chunks, const size_t first_chunk,
+      size_t* num_bytes);
+
   // Forbid copying and moving.
   Block(const Block&) = delete;
   Block& operator=(const Block&) = delete;
@@ -48,18 +73,51 @@ class Block {
   // Returns the fingerprint bits stored at `idx`.
   uint64_t Get(const size_t idx) const {
     assert(idx < num_fingerprints_);
+    if (chunks_ != nullptr) return GetFromChunk(idx);
     return fingerprints_.Get(idx);
   }
 
-  const std::string& GetData() const { return data_; }
+  // Empty for chunked blocks.
+  absl::string_view GetData() const { return encoded_; }
+
+  // Splits the fingerprints into chunks of about `chunk_size` bytes, appends
+  // them to `chunks` and returns the header for DecodeChunked(..). Chunks hold
+  // a multiple of 8 fingerprints, so that they start at byte boundaries.
+  // Requires a non-chunked block.
+  std::string EncodeChunks(const size_t chunk_size,
+                           std::vector<std::string>* chunks) const;
+
+  // Returns the number of chunks of a chunked block (0 otherwise).
+  size_t num_chunks() const {
+    if (chunks_ == nullptr) return 0;
+    return (num_fingerprints_ + num_fingerprints_per_chunk_ - 1) /
+           num_fingerprints_per_chunk_;
+  }
 
  private:
+  Block(const size_t num_bits, const size_t num_fingerprints)
+      : num_bits_(num_bits), num_fingerprints_(num_fingerprints) {}
+
+  // Reads fingerprint `idx` from its (cached) chunk.
+  uint64_t GetFromChunk(const size_t idx) const;
+
   // The number of bits of fingerprints stored in this block.
   const size_t num_bits_;
   const size_t num_fingerprints_;
 
+  // Owned encoding (empty for decoded blocks).
   std::string data_;
+  // Points either to `data_` or to the external bytes passed to Decode(..).
+  absl::string_view encoded_;
   BitPackedReader<uint64_t> fingerprints_;
+
+  // Only set for chunked blocks: fingerprint `i` is number
+  // `i % num_fingerprints_per_chunk_` of chunk
+  // `first_chunk_ + i / num_fingerprints_per_chunk_` of `chunks_`.
+  const FingerprintChunks* chunks_ = nullptr;
+  size_t first_chunk_ = 0;
+  size_t num_fingerprints_per_chunk_ = 0;
+  uint32_t bit_width_ = 0;
 };
 
 // Stores variable-sized fingerprints in different blocks, each block storing
@@ -90,6 +148,11 @@ class Block {
 // Specifically, we encode all block bitmaps back-to-back as a single RLE
 // bitmap.
 //
+// The store is encoded as a header (number of blocks, slots per bucket, whether
+// block bitmaps are RLE-encoded), followed by the `empty_slots_bitmap_`, the
+// sizes of the block bitmaps, the block bitmaps themselves (except the first
+// one, see below) and finally the individual blocks.
+//
 // Individual blocks are stored as follows:
 //
 // uint32_t num_bits       -- number of bits of fingerprints in this block
@@ -109,8 +172,17 @@ class FingerprintStore {
   };
 
  public:
-  // Decodes FingerprintStore from bytes.
-  static void Decode(const std::string& data);
+  // Decodes a FingerprintStore from bytes previously returned by Encode(). The
+  // fingerprint blocks are *not* copied, i.e., the lifetime of `data` must be
+  // longer than the lifetime of the returned FingerprintStore.
+  static std::unique_ptr<FingerprintStore> Decode(absl::string_view data);
+
+  // Decodes a FingerprintStore from bytes previously returned by
+  // EncodeCompressed(..). Like Decode(..), doesn't copy `data`. Fingerprints
+  // are read from their decompressed chunks, of which the
+  // `max_cached_chunks` most recently used ones are cached.
+  static std::unique_ptr<FingerprintStore> DecodeCompressed(
+      absl::string_view data, size_t max_cached_chunks);
 
   // The fingerprints passed here have a 1:1 correspondence to the slots in the
   // Cuckoo table. Individual fingerprints can be `inactive`, which means that
@@ -122,21 +194,136 @@ class FingerprintStore {
   // Returns fingerprint stored in slot `slot_idx`.
   Fingerprint GetFingerprint(const size_t slot_idx) const;
 
+  // Fetches all fingerprints of bucket `bucket_idx` with a single block lookup.
+  // Writes `slots_per_bucket` values to `fingerprints` (0 for empty slots) and
+  // the bucket's fingerprint length to `num_bits`. Returns a mask with bit `i`
+  // set iff slot `i` of the bucket is non-empty. Requires `slots_per_bucket`
+  // <= 32.
+  //
+  // The lookup paths (GetBucketFingerprints(..), IsBucketEmpty(..) and
+  // GetNumActiveSlotsBefore(..)) can be specialized on `kSlotsPerBucket`, which
+  // must then be equal to slots_per_bucket() and be 1, 2, 4 or 8. This unrolls
+  // the loops over the slots of a bucket and turns divisions by the number of
+  // slots into shifts. The default 0 uses the runtime slots_per_bucket().
+  template <size_t kSlotsPerBucket = 0>
+  uint32_t GetBucketFingerprints(const size_t bucket_idx,
+                                 uint64_t* fingerprints,
+                                 size_t* num_bits) const;
+
+  // Builds a lookup directory which lets GetFingerprint(..) find the block and
+  // in-block offset of a bucket without walking the compacted block bitmaps.
+  // Every `num_buckets_per_entry`-th bucket stores the offsets into all blocks,
+  // in addition every bucket stores its block id. Lookups then scan at most
+  // `num_buckets_per_entry - 1` block ids, i.e., 1 gives the fastest lookups
+  // (two memory accesses) and larger values trade lookup speed for memory.
+  // The directory is a runtime structure only and is not part of Encode().
+  void InitDirectory(const size_t num_buckets_per_entry);
+
+  // Returns the in-memory size of the directory (0 if there is none).
+  size_t directory_byte_size() const {
+    return bucket_block_ids_.size() * sizeof(uint8_t) +
+           directory_offsets_.size() * sizeof(uint32_t);
+  }
+
+  // Additionally lays out the fingerprints query-optimized: consecutive
+  // buckets are packed into 64-byte aligned cache lines, each bucket with its
+  // occupancy mask, its fingerprint length and its fingerprints (padded to the
+  // largest length of the store). Every group of buckets also stores the
+  // number of non-empty slots before it. Probing a bucket (GetFingerprint(..),
+  // GetBucketFingerprints(..), IsBucketEmpty(..) and
+  // GetNumActiveSlotsBefore(..)) then reads a single cache line instead of
+  // the empty slots bitmap, the block bitmaps and a block. Buckets too large
+  // for a single line span consecutive lines. Like the directory, the lines
+  // are a runtime structure only and are not part of Encode(). Requires
+  // `slots_per_bucket` <= 32.
+  void InitCacheLines();
+
+  // Returns the in-memory size of the cache lines (0 if there are none).
+  size_t cache_lines_byte_size() const {
+    return cache_lines_.size() * sizeof(CacheLine);
+  }
+
+  // Returns true if none of the slots of bucket `bucket_idx` is non-empty.
+  template <size_t kSlotsPerBucket = 0>
+  bool IsBucketEmpty(const size_t bucket_idx) const;
+
+  // Returns the number of non-empty slots before slot `slot_idx`.
+  template <size_t kSlotsPerBucket = 0>
+  size_t GetNumActiveSlotsBefore(const size_t slot_idx) const;
+
+  // Prefetches the memory probing bucket `bucket_idx` reads whose address only
+  // depends on `bucket_idx`: its cache line (and the first line of its group,
+  // see InitCacheLines()), otherwise its empty slots bits and its directory
+  // entries (see InitDirectory(..)). Without cache lines, the offset of the
+  // fingerprints is only known after reading the directory, i.e., they aren't
+  // prefetched.
+  void PrefetchBucket(const size_t bucket_idx) const {
+    if (!cache_lines_.empty()) {
+      const size_t group_idx = bucket_idx / buckets_per_group_;
+      const size_t bit_offset =
+          kNumActiveSlotsBits +
+          (bucket_idx - group_idx * buckets_per_group_) * bucket_bits_;
+      const CacheLine* group = &cache_lines_[group_idx * lines_per_group_];
+      __builtin_prefetch(group);
+      __builtin_prefetch(group + bit_offset / (sizeof(CacheLine) * CHAR_BIT));
+      return;
+    }
+    empty_slots_bitmap_->Prefetch(bucket_idx * slots_per_bucket_);
+    if (!bucket_block_ids_.empty()) {
+      __builtin_prefetch(&bucket_block_ids_[bucket_idx]);
+      __builtin_prefetch(
+          &directory_offsets_[bucket_idx / directory_sampling_ *
+                              blocks_.size()]);
+    }
+  }
+
+  // The sizes of the parts of an encoding (the rest is the header).
+  struct EncodedSizes {
+    size_t empty_slots_bitmap = 0;
+    // The global bitmap of the block bitmaps and their sizes.
+    size_t block_bitmaps = 0;
+    // The bit-packed fingerprints of all blocks.
+    size_t fingerprints = 0;
+  };
+
   // Encodes FingerprintStore as bytes. For `bitmaps_only` = true, only the
-  // bitmaps will be encoded. This is only used for printing stats.
-  std::string Encode(bool bitmaps_only = false) const;
+  // bitmaps will be encoded. This is only used for printing stats. If given,
+  // sets `sizes` to the sizes of the encoded parts.
+  std::string Encode(bool bitmaps_only = false,
+                     EncodedSizes* sizes = nullptr) const;
+
+  // Same as Encode(), but splits the fingerprints of each block into chunks
+  // of about `chunk_size` bytes that are compressed independently (see
+  // compressed_chunks.h), i.e., lookups on the decoded store only decompress
+  // the chunks of the buckets they probe. The bitmaps are the ones of
+  // Encode(), each block is stored as its header (see
+  // Block::EncodeChunks(..)), followed by the chunks of all blocks.
+  std::string EncodeCompressed(size_t chunk_size,
+                               EncodedSizes* sizes = nullptr) const;
+
+  // Returns the fingerprint chunks of stores decoded with
+  // DecodeCompressed(..), nullptr otherwise.
+  const FingerprintChunks* fingerprint_chunks() const {
+    return fingerprint_chunks_.get();
+  }
 
   size_t num_slots() const { return num_slots_; }
 
+  size_t slots_per_bucket() const { return slots_per_bucket_; }
+
   // Returns the bitmap indicating empty slots;
   const Bitmap64& EmptySlotsBitmap() const { return *empty_slots_bitmap_; }
 
+  // The sizes are computed on first use (each requires encoding the store)
+  // and then memoized. The store doesn't change after construction.
   size_t GetSizeInBytes(bool bitmaps_only) const {
-    return Encode(bitmaps_only).size();
+    return encoded_sizes_[bitmaps_only].Get(
+        [&]() { return Encode(bitmaps_only).size(); });
   }
 
   size_t GetZstdCompressedSizeInBytes(bool bitmaps_only) const {
-    return Compress(Encode(bitmaps_only)).size();
+    return compressed_sizes_[bitmaps_only].Get(
+        [&]() { return Compress(Encode(bitmaps_only)).size(); });
   }
 
   double GetBitsPerFingerprint(bool bitmaps_only) const {
@@ -152,9 +339,42 @@ class FingerprintStore {
 
   size_t GetNumBlocks() const { return blocks_.size(); }
 
+  // Prints the blocks and the size stats. Encodes and compresses the store
+  // (once), so only call it when the stats are actually needed.
   void PrintStats() const;
 
  private:
+  // Decodes the header and the bitmaps of an encoding (the common prefix of
+  // Encode() and EncodeCompressed(..)), advances `pos` past them and sets
+  // `num_fingerprints` to the number of fingerprints of each block.
+  static std::unique_ptr<FingerprintStore> DecodeBitmaps(
+      absl::Span<const char> data, size_t* pos,
+      std::vector<size_t>* num_fingerprints);
+
+  // Used by Decode(..), which fills in the remaining members.
+  FingerprintStore(const size_t num_slots, const size_t slots_per_bucket,
+                   const bool use_rle_to_encode_block_bitmaps)
+      : num_slots_(num_slots),
+        num_stored_fingerprints_(0),
+        slots_per_bucket_(slots_per_bucket),
+        use_rle_to_encode_block_bitmaps_(use_rle_to_encode_block_bitmaps) {}
+
+  struct alignas(64) CacheLine {
+    uint64_t words[8];
+  };
+
+  // Returns the words of the cache line(s) of the bucket group holding
+  // `bucket_idx` and sets `bit_offset` to the first bit of the bucket in them.
+  const uint64_t* LocateBucketInCacheLines(const size_t bucket_idx,
+                                           size_t* bit_offset) const {
+    const size_t group_idx = bucket_idx / buckets_per_group_;
+    *bit_offset = kNumActiveSlotsBits +
+                  (bucket_idx - group_idx * buckets_per_group_) * bucket_bits_;
+    // The lines of a group are contiguous, so their words are as well.
+    return reinterpret_cast<const uint64_t*>(
+        &cache_lines_[group_idx * lines_per_group_]);
+  }
+
   // Returns the bucket index that the bit `bit_idx` in block bitmap `block_idx`
   // corresponds to.
   size_t GetBucketIndex(const size_t block_idx, const size_t bit_idx) const;
@@ -162,6 +382,17 @@ class FingerprintStore {
   // Returns the number of non-empty slots in bucket `bucket_idx`.
   size_t GetNumItemsInBucket(const size_t bucket_idx) const;
 
+  // Calls `fn(bucket_idx, block_idx)` for all buckets in increasing order,
+  // where `block_idx` is the block storing the bucket's fingerprints. Walks the
+  // compacted block bitmaps only once for all buckets.
+  template <typename Fn>
+  void ForEachBucketBlock(const Fn& fn) const;
+
+  // Returns the index of the first fingerprint of the non-empty bucket
+  // `bucket_idx` in the block storing it and sets `block_idx` to that block.
+  // Uses the directory if there is one.
+  size_t LocateBucket(const size_t bucket_idx, size_t* block_idx) const;
+
   // Returns the index of fingerprint `slot_idx` in block `block_idx` (the
   // offset to the fingerprint bits in the bitpacked storage).
   // `idx_in_compacted_bitmap` is the index of the fingerprint in the compacted
@@ -190,12 +421,38 @@ class FingerprintStore {
   // TODO: Replace with a single RLE bitmap.
   std::vector<Bitmap64Ptr> block_bitmaps_;
   std::vector<BlockPtr> blocks_;
+  // Only set for stores decoded with DecodeCompressed(..).
+  std::unique_ptr<FingerprintChunks> fingerprint_chunks_;
 
   const size_t num_slots_;
   size_t num_stored_fingerprints_;
 
   size_t slots_per_bucket_;
   bool use_rle_to_encode_block_bitmaps_;
+
+  // The optional lookup directory, see InitDirectory(..). The offsets of entry
+  // `i` start at `directory_offsets_[i * blocks_.size()]`.
+  size_t directory_sampling_ = 0;
+  std::vector<uint8_t> bucket_block_ids_;
+  std::vector<uint32_t> directory_offsets_;
+
+  // The optional query-optimized layout, see InitCacheLines(). A group of
+  // `buckets_per_group_` buckets occupies `lines_per_group_` lines:
+  //   uint32 number of non-empty slots before the group
+  //   per bucket: `slots_per_bucket_` bits occupancy mask, 7 bits fingerprint
+  //   length, `slots_per_bucket_` fingerprints of `fingerprint_bits_` bits
+  static constexpr size_t kNumActiveSlotsBits = 32;
+  static constexpr size_t kNumBitsBits = 7;
+  std::vector<CacheLine> cache_lines_;
+  size_t buckets_per_group_ = 0;
+  size_t lines_per_group_ = 0;
+  size_t bucket_bits_ = 0;
+  size_t fingerprint_bits_ = 0;
+
+  // Memoized results of GetSizeInBytes(..) and GetZstdCompressedSizeInBytes(..),
+  // indexed by `bitmaps_only`.
+  Memoized<size_t> encoded_sizes_[2];
+  Memoized<size_t> compressed_sizes_[2];
 };
 
 }  // namespace ci
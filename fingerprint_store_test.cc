@@ -18,6 +18,7 @@
 
 #include "fingerprint_store.h"
 
+#include <memory>
 #include <string>
 
 #include "absl/types/span.h"
@@ -68,8 +69,41 @@ std::vector<Fingerprint> CreateRandomFingerprints(const size_t n,
 
 // **** Test cases ****
 
+// Checks that GetFingerprint(..) returns `fingerprints` for all slots.
+void CheckFingerprints(const FingerprintStore& store,
+                       const std::vector<Fingerprint>& fingerprints) {
+  ASSERT_EQ(store.num_slots(), fingerprints.size());
+  for (size_t i = 0; i < fingerprints.size(); ++i) {
+    const Fingerprint fp = store.GetFingerprint(i);
+    ASSERT_EQ(fp.active, fingerprints[i].active);
+    if (fp.active) {
+      ASSERT_EQ(fp.num_bits, fingerprints[i].num_bits);
+      ASSERT_EQ(fp.fingerprint, fingerprints[i].fingerprint);
+    }
+  }
+
+  // Check whole-bucket lookups.
+  const size_t slots_per_bucket = store.slots_per_bucket();
+  std::vector<uint64_t> bucket_fingerprints(slots_per_bucket);
+  for (size_t bucket = 0; bucket < store.num_slots() / slots_per_bucket;
+       ++bucket) {
+    size_t num_bits;
+    const uint32_t active_mask = store.GetBucketFingerprints(
+        bucket, bucket_fingerprints.data(), &num_bits);
+    for (size_t i = 0; i < slots_per_bucket; ++i) {
+      const Fingerprint& expected = fingerprints[bucket * slots_per_bucket + i];
+      ASSERT_EQ((active_mask >> i) & 1, expected.active);
+      if (expected.active) {
+        ASSERT_EQ(num_bits, expected.num_bits);
+        ASSERT_EQ(bucket_fingerprints[i], expected.fingerprint);
+      }
+    }
+  }
+}
+
 // Creates fingerprints with different `lengths`, stores them in a
-// FingerprintStore, and calls GetFingerprint(..) on each of them.
+// FingerprintStore, and calls GetFingerprint(..) on each of them. Does the same
+// for a FingerprintStore decoded from the encoding of the first one.
 void CreateStoreAndGetFingerprints(const std::vector<size_t>& lengths,
                                    const size_t slots_per_bucket,
                                    const bool use_rle_to_encode_block_bitmaps) {
@@ -77,14 +111,45 @@ void CreateStoreAndGetFingerprints(const std::vector<size_t>& lengths,
       CreateRandomFingerprints(kNumFingerprints, slots_per_bucket, lengths);
   const FingerprintStore store(fingerprints, slots_per_bucket,
                                use_rle_to_encode_block_bitmaps);
+  CheckFingerprints(store, fingerprints);
+
+  const std::string encoded = store.Encode();
+  const std::unique_ptr<FingerprintStore> decoded =
+      FingerprintStore::Decode(encoded);
+  CheckFingerprints(*decoded, fingerprints);
+  EXPECT_EQ(decoded->GetNumBlocks(), store.GetNumBlocks());
+  EXPECT_EQ(decoded->Encode(), encoded);
+  // The memoized sizes agree with the encoding (also when asked twice).
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(store.GetSizeInBytes(/*bitmaps_only=*/false), encoded.size());
+    EXPECT_EQ(store.GetZstdCompressedSizeInBytes(/*bitmaps_only=*/false),
+              Compress(encoded).size());
+    EXPECT_EQ(decoded->GetSizeInBytes(/*bitmaps_only=*/true),
+              store.Encode(/*bitmaps_only=*/true).size());
+  }
+
+  // Check lookups with directories of different granularity.
+  for (const size_t num_buckets_per_entry : {1, 7, 64}) {
+    decoded->InitDirectory(num_buckets_per_entry);
+    EXPECT_GT(decoded->directory_byte_size(), 0);
+    CheckFingerprints(*decoded, fingerprints);
+  }
+  EXPECT_EQ(decoded->Encode(), encoded);
+
+  // Check lookups on the cache lines.
+  decoded->InitCacheLines();
+  EXPECT_GT(decoded->cache_lines_byte_size(), 0);
+  CheckFingerprints(*decoded, fingerprints);
+  size_t num_active_slots = 0;
   for (size_t i = 0; i < fingerprints.size(); ++i) {
-    const Fingerprint fp = store.GetFingerprint(i);
-    ASSERT_EQ(fp.active, fingerprints[i].active);
-    if (fp.active) {
-      ASSERT_EQ(fp.num_bits, fingerprints[i].num_bits);
-      ASSERT_EQ(fp.fingerprint, fingerprints[i].fingerprint);
-    }
+    ASSERT_EQ(decoded->GetNumActiveSlotsBefore(i), num_active_slots);
+    num_active_slots += fingerprints[i].active;
   }
+  for (size_t bucket = 0; bucket < store.num_slots() / slots_per_bucket;
+       ++bucket) {
+    ASSERT_EQ(decoded->IsBucketEmpty(bucket), store.IsBucketEmpty(bucket));
+  }
+  EXPECT_EQ(decoded->Encode(), encoded);
 }
 
 TEST(FingerprintStore, GetFingerprintReturnsCorrectFingerprintSingleBlock) {
@@ -128,4 +193,19 @@ TEST(FingerprintStore,
                                 /*use_rle_to_encode_block_bitmaps=*/false);
 }
 
+TEST(FingerprintStore,
+     GetFingerprintReturnsCorrectFingerprintEightSlotsPerBucket) {
+  CreateStoreAndGetFingerprints(/*lengths=*/{1, 2, 4, 8, 16},
+                                /*slots_per_bucket=*/8,
+                                /*use_rle_to_encode_block_bitmaps=*/false);
+}
+
+// A bucket of 20 slots with 24-bit fingerprints spans two cache lines.
+TEST(FingerprintStore,
+     GetFingerprintReturnsCorrectFingerprintBucketsLargerThanCacheLine) {
+  CreateStoreAndGetFingerprints(/*lengths=*/{16, 24},
+                                /*slots_per_bucket=*/20,
+                                /*use_rle_to_encode_block_bitmaps=*/false);
+}
+
 }  // namespace ci
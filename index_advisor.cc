@@ -0,0 +1,417 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: index_advisor.cc
+// -----------------------------------------------------------------------------
+
+#include "index_advisor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "cuckoo_index.h"
+#include "evaluation_utils.h"
+#include "per_stripe_bloom.h"
+#include "per_stripe_xor.h"
+#include "zone_map.h"
+
+namespace ci {
+namespace {
+
+// The CuckooIndex configurations (with the max load factors of their numbers
+// of slots per bucket) and the scan rates they are tried with.
+struct CuckooConfig {
+  CuckooAlgorithm cuckoo_alg;
+  double max_load_factor;
+  size_t slots_per_bucket;
+};
+
+constexpr CuckooConfig kCuckooConfigs[] = {
+    {CuckooAlgorithm::SKEWED_KICKING, kMaxLoadFactor1SlotsPerBucket, 1},
+    {CuckooAlgorithm::KICKING, kMaxLoadFactor2SlotsPerBucket, 2},
+    {CuckooAlgorithm::KICKING, kMaxLoadFactor4SlotsPerBucket, 4},
+    {CuckooAlgorithm::KICKING, kMaxLoadFactor8SlotsPerBucket, 8}};
+
+constexpr double kCuckooScanRates[] = {0.001, 0.01, 0.1};
+
+constexpr size_t kBloomNumBitsPerKey[] = {4, 6, 8, 10, 12, 16};
+
+// The share of false positives of an Xor filter with 8-bit fingerprints.
+constexpr double kXorFalsePositiveRate = 1.0 / 256;
+
+// Returns the number of bits needed to store values in [0, `max_value`].
+size_t BitWidth(uint64_t max_value) {
+  size_t width = 0;
+  while (width < 64 && (max_value >> width) != 0) ++width;
+  return width;
+}
+
+}  // namespace
+
+IndexAdvisorFactory::IndexAdvisorFactory(const IndexAdvisorOptions& options)
+    : options_(options) {
+  if (options_.num_candidates_to_benchmark == 0) {
+    std::cerr << "At least one candidate needs to be benchmarked." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (options_.positive_lookup_fraction < 0.0 ||
+      options_.positive_lookup_fraction > 1.0) {
+    std::cerr << "`positive_lookup_fraction` needs to be in [0, 1]."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+ColumnProfile IndexAdvisorFactory::ProfileColumn(
+    const Column& column, size_t num_rows_per_stripe) const {
+  ColumnProfile profile;
+  profile.num_rows_per_stripe = num_rows_per_stripe;
+  profile.num_stripes = column.num_rows() / num_rows_per_stripe;
+  if (profile.num_stripes == 0) {
+    std::cerr << "The column needs at least one full stripe." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const std::vector<long>& distinct_values = column.distinct_values();
+  profile.num_distinct_values = distinct_values.size();
+
+  std::mt19937 gen(42);
+  std::sample(distinct_values.begin(), distinct_values.end(),
+              std::back_inserter(profile.sampled_values),
+              options_.num_sampled_values, gen);
+  absl::flat_hash_map<long, size_t> sample_ids;
+  sample_ids.reserve(profile.sampled_values.size());
+  for (size_t i = 0; i < profile.sampled_values.size(); ++i) {
+    sample_ids[profile.sampled_values[i]] = i;
+    profile.sampled_stripes.emplace_back(profile.num_stripes);
+  }
+
+  // A single pass over the full stripes.
+  std::vector<long> minimums, maximums;
+  minimums.reserve(profile.num_stripes);
+  maximums.reserve(profile.num_stripes);
+  profile.num_stripe_values.reserve(profile.num_stripes);
+  absl::flat_hash_set<long> stripe_values;
+  const absl::Span<const long> data = column.data();
+  for (size_t stripe_id = 0; stripe_id < profile.num_stripes; ++stripe_id) {
+    stripe_values.clear();
+    long minimum = std::numeric_limits<long>::max();
+    long maximum = std::numeric_limits<long>::min();
+    for (const long value : data.subspan(stripe_id * num_rows_per_stripe,
+                                         num_rows_per_stripe)) {
+      if (!stripe_values.insert(value).second) continue;
+      minimum = std::min(minimum, value);
+      maximum = std::max(maximum, value);
+      const auto it = sample_ids.find(value);
+      if (it != sample_ids.end())
+        profile.sampled_stripes[it->second].Set(stripe_id, true);
+    }
+    profile.num_stripe_values.push_back(stripe_values.size());
+    minimums.push_back(minimum);
+    maximums.push_back(maximum);
+  }
+
+  // Density and clustering over all sampled bitmaps, i.e., weighted by their
+  // numbers of set bits.
+  size_t num_ones = 0;
+  double num_one_fills = 0.0;
+  double zone_map_positive_scan_rate = 0.0;
+  for (size_t i = 0; i < profile.sampled_values.size(); ++i) {
+    const Bitmap64& stripes = profile.sampled_stripes[i];
+    const size_t num_value_stripes = stripes.GetOnesCount();
+    if (num_value_stripes > 0) {
+      num_ones += num_value_stripes;
+      num_one_fills += num_value_stripes / GetBitmapClustering(stripes);
+    }
+    if (num_value_stripes == profile.num_stripes) continue;
+    const long value = profile.sampled_values[i];
+    size_t num_zone_stripes = 0;
+    for (size_t stripe_id = 0; stripe_id < profile.num_stripes; ++stripe_id)
+      num_zone_stripes +=
+          value >= minimums[stripe_id] && value <= maximums[stripe_id];
+    zone_map_positive_scan_rate +=
+        static_cast<double>(num_zone_stripes - num_value_stripes) /
+        (profile.num_stripes - num_value_stripes);
+  }
+  if (!profile.sampled_values.empty()) {
+    profile.density = static_cast<double>(num_ones) /
+                      (profile.sampled_values.size() * profile.num_stripes);
+    profile.clustering = num_one_fills > 0.0 ? num_ones / num_one_fills : 0.0;
+    profile.zone_map_positive_scan_rate =
+        zone_map_positive_scan_rate / profile.sampled_values.size();
+  }
+
+  // Random (negative) values fall into a zone with the probability of its
+  // share of the domain of `long`.
+  long double zone_map_negative_scan_rate = 0.0;
+  for (size_t stripe_id = 0; stripe_id < profile.num_stripes; ++stripe_id) {
+    zone_map_negative_scan_rate +=
+        (static_cast<long double>(maximums[stripe_id]) - minimums[stripe_id] +
+         1) /
+        0x1.0p64L;
+  }
+  profile.zone_map_negative_scan_rate = static_cast<double>(
+      zone_map_negative_scan_rate / profile.num_stripes);
+
+  const long min = *std::min_element(minimums.begin(), minimums.end());
+  const long max = *std::max_element(maximums.begin(), maximums.end());
+  profile.zone_map_offset_bit_width =
+      BitWidth(static_cast<uint64_t>(max) - static_cast<uint64_t>(min));
+  return profile;
+}
+
+std::vector<IndexCandidate> IndexAdvisorFactory::GetCandidates(
+    const ColumnProfile& profile) const {
+  std::vector<IndexCandidate> candidates;
+  auto add_candidate = [&](std::string kind,
+                           std::unique_ptr<IndexStructureFactory> factory,
+                           double byte_size, double scan_rate) {
+    IndexCandidate candidate;
+    candidate.kind = std::move(kind);
+    candidate.factory = std::move(factory);
+    candidate.estimated_byte_size = static_cast<size_t>(std::ceil(byte_size));
+    candidate.estimated_scan_rate = std::min(1.0, scan_rate);
+    candidates.push_back(std::move(candidate));
+  };
+
+  const double num_stripes = profile.num_stripes;
+  const double num_values = profile.num_distinct_values;
+
+  // CuckooIndex: a lookup compares fingerprints of two buckets and returns
+  // the stripes of every matching slot, i.e., with `f` fingerprint bits a
+  // scan rate of 2 * slots_per_bucket * load_factor * 2^-f * density (`f` is
+  // fractional since the fingerprint lengths vary between blocks). Every
+  // slot additionally stores a bit of the empty slots bitmap, and every value
+  // a stripe bitmap. The bitmaps are RLE-encoded, i.e., cost the run lengths
+  // of each 1-fill and the 0-fill before it (plus a few bits for the
+  // bit-packing of the run lengths).
+  const double num_one_fills =
+      profile.clustering > 0.0
+          ? profile.density * num_stripes / profile.clustering
+          : 0.0;
+  double bitmap_bits = 0.0;
+  if (num_one_fills > 0.0) {
+    const double zero_fill_length =
+        (1.0 - profile.density) * num_stripes / num_one_fills;
+    bitmap_bits = num_one_fills * (std::log2(1 + zero_fill_length) +
+                                   std::log2(1 + profile.clustering) + 3);
+  }
+  for (const CuckooConfig& config : kCuckooConfigs) {
+    const double num_matching_slots =
+        2 * config.slots_per_bucket * config.max_load_factor;
+    for (const double scan_rate : kCuckooScanRates) {
+      const double num_fingerprint_bits =
+          profile.density > 0.0
+              ? std::max(0.0, std::log2(num_matching_slots *
+                                        profile.density / scan_rate))
+              : 0.0;
+      const double num_slots = num_values / config.max_load_factor;
+      add_candidate(
+          "CuckooIndex",
+          absl::make_unique<CuckooIndexFactory>(
+              config.cuckoo_alg, config.max_load_factor, scan_rate,
+              config.slots_per_bucket, /*prefix_bits_optimization=*/false,
+              /*fingerprint_directory=*/0, HashingScheme::SEEDED_CITY64,
+              /*num_threads=*/1),
+          (num_slots * (num_fingerprint_bits + 1) + num_values * bitmap_bits) /
+              8,
+          num_matching_slots * profile.density *
+              std::exp2(-num_fingerprint_bits));
+    }
+  }
+
+  // PerStripeBloom: the exact size given the distinct values per stripe, and
+  // the false positive rate of the optimal number of hash functions.
+  for (const size_t num_bits_per_key : kBloomNumBitsPerKey) {
+    size_t byte_size = 0;
+    for (const size_t n : profile.num_stripe_values)
+      byte_size += PerStripeBloom::GetFilterByteSize(n, num_bits_per_key);
+    add_candidate("PerStripeBloom",
+                  absl::make_unique<PerStripeBloomFactory>(num_bits_per_key),
+                  byte_size, std::pow(0.6185, num_bits_per_key));
+  }
+
+  // PerStripeXor: ~1.23 fingerprints per distinct value plus the directory
+  // (see per_stripe_xor.h).
+  double xor_byte_size = sizeof(uint32_t);
+  for (const size_t n : profile.num_stripe_values)
+    xor_byte_size += 2 * sizeof(uint32_t) + 1.23 * n + 32;
+  add_candidate("PerStripeXor", absl::make_unique<PerStripeXorFactory>(),
+                xor_byte_size, kXorFalsePositiveRate);
+
+  // ZoneMap: the profiled scan rates of the lookup mix.
+  const double zone_map_scan_rate =
+      options_.positive_lookup_fraction * profile.zone_map_positive_scan_rate +
+      (1.0 - options_.positive_lookup_fraction) *
+          profile.zone_map_negative_scan_rate;
+  add_candidate("ZoneMap", absl::make_unique<ZoneMapFactory>(),
+                2 * sizeof(long) * num_stripes, zone_map_scan_rate);
+  add_candidate(
+      "ZoneMap", absl::make_unique<ZoneMapFactory>(/*compact=*/true),
+      std::ceil(2 * num_stripes * profile.zone_map_offset_bit_width / 8) +
+          sizeof(long),
+      zone_map_scan_rate);
+
+  // Without benchmarks, the cost of a candidate is dominated by the stripes it
+  // returns falsely. Prefer smaller candidates among equally good ones.
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const IndexCandidate& lhs, const IndexCandidate& rhs) {
+                     if (lhs.estimated_scan_rate != rhs.estimated_scan_rate)
+                       return lhs.estimated_scan_rate < rhs.estimated_scan_rate;
+                     return lhs.estimated_byte_size < rhs.estimated_byte_size;
+                   });
+  return candidates;
+}
+
+IndexStructurePtr IndexAdvisorFactory::Advise(
+    const Column& column, size_t num_rows_per_stripe,
+    std::vector<IndexMeasurement>* measurements) const {
+  const ColumnProfile profile = ProfileColumn(column, num_rows_per_stripe);
+  std::vector<IndexCandidate> candidates = GetCandidates(profile);
+
+  // Benchmark the best candidate of each kind (estimated to fit the budget).
+  std::vector<const IndexCandidate*> selected;
+  absl::flat_hash_set<std::string> selected_kinds;
+  for (const IndexCandidate& candidate : candidates) {
+    if (selected.size() == options_.num_candidates_to_benchmark) break;
+    if (candidate.estimated_byte_size > options_.max_byte_size) continue;
+    if (selected_kinds.insert(candidate.kind).second)
+      selected.push_back(&candidate);
+  }
+  if (selected.empty()) {
+    selected.push_back(&*std::min_element(
+        candidates.begin(), candidates.end(),
+        [](const IndexCandidate& lhs, const IndexCandidate& rhs) {
+          return lhs.estimated_byte_size < rhs.estimated_byte_size;
+        }));
+  }
+
+  // The same lookups for all candidates: sampled distinct values and random
+  // values that are not present in the column (as in Evaluator).
+  std::mt19937 gen(42);
+  const size_t num_positive_lookups =
+      profile.sampled_values.empty()
+          ? 0
+          : static_cast<size_t>(std::round(options_.num_lookups *
+                                           options_.positive_lookup_fraction));
+  std::vector<size_t> positive_sample_ids;
+  positive_sample_ids.reserve(num_positive_lookups);
+  std::uniform_int_distribution<size_t> sample_id_d(
+      0, std::max<size_t>(1, profile.sampled_values.size()) - 1);
+  for (size_t i = 0; i < num_positive_lookups; ++i)
+    positive_sample_ids.push_back(sample_id_d(gen));
+  std::uniform_int_distribution<long> value_d(std::numeric_limits<long>::min(),
+                                             std::numeric_limits<long>::max());
+  std::vector<long> negative_values;
+  negative_values.reserve(options_.num_lookups - num_positive_lookups);
+  for (size_t i = num_positive_lookups; i < options_.num_lookups; ++i) {
+    long value = value_d(gen);
+    while (column.Contains(value)) value = value_d(gen);
+    negative_values.push_back(value);
+  }
+
+  IndexStructurePtr best_index;
+  double min_cost_ns = std::numeric_limits<double>::max();
+  IndexStructurePtr smallest_index;
+  for (const IndexCandidate* candidate : selected) {
+    IndexStructurePtr index =
+        candidate->factory->Create(column, num_rows_per_stripe);
+    const IndexMeasurement measurement =
+        Measure(*index, profile, positive_sample_ids, negative_values);
+    if (measurements != nullptr) measurements->push_back(measurement);
+    if (measurement.byte_size <= options_.max_byte_size) {
+      if (measurement.cost_ns < min_cost_ns) {
+        min_cost_ns = measurement.cost_ns;
+        best_index = std::move(index);
+      }
+    } else if (smallest_index == nullptr ||
+               index->byte_size() < smallest_index->byte_size()) {
+      smallest_index = std::move(index);
+    }
+  }
+  if (best_index != nullptr) return best_index;
+
+  std::cerr << "WARNING: No index fits the budget of " << options_.max_byte_size
+            << " bytes, returning " << smallest_index->name() << " ("
+            << smallest_index->byte_size() << " bytes)." << std::endl;
+  return smallest_index;
+}
+
+IndexMeasurement IndexAdvisorFactory::Measure(
+    const IndexStructure& index, const ColumnProfile& profile,
+    absl::Span<const size_t> positive_sample_ids,
+    absl::Span<const long> negative_values) const {
+  const size_t num_stripes = profile.num_stripes;
+  size_t num_false_positives = 0;
+  size_t num_true_negatives = 0;
+  Bitmap64 result;
+  auto lookup_all = [&]() {
+    for (const size_t sample_id : positive_sample_ids) {
+      index.FillQualifyingStripes(profile.sampled_values[sample_id],
+                                  num_stripes, &result);
+      const size_t num_expected =
+          profile.sampled_stripes[sample_id].GetOnesCount();
+      num_false_positives += result.GetOnesCount() - num_expected;
+      num_true_negatives += num_stripes - num_expected;
+    }
+    for (const long value : negative_values) {
+      index.FillQualifyingStripes(value, num_stripes, &result);
+      num_false_positives += result.GetOnesCount();
+      num_true_negatives += num_stripes;
+    }
+  };
+
+  // Warm up (e.g., lazily decoded parts of the index), then measure.
+  lookup_all();
+  num_false_positives = 0;
+  num_true_negatives = 0;
+  const auto start = std::chrono::steady_clock::now();
+  lookup_all();
+  const auto end = std::chrono::steady_clock::now();
+
+  IndexMeasurement measurement;
+  measurement.index_name = index.name();
+  measurement.byte_size = index.byte_size();
+  const size_t num_lookups =
+      std::max<size_t>(1, positive_sample_ids.size() + negative_values.size());
+  measurement.lookup_ns =
+      std::chrono::duration<double, std::nano>(end - start).count() /
+      num_lookups;
+  measurement.scan_rate =
+      num_true_negatives == 0
+          ? 0.0
+          : static_cast<double>(num_false_positives) / num_true_negatives;
+  measurement.cost_ns =
+      measurement.lookup_ns + static_cast<double>(num_false_positives) /
+                                  num_lookups * profile.num_rows_per_stripe *
+                                  options_.scan_ns_per_row;
+  return measurement;
+}
+
+std::string IndexAdvisorFactory::index_name() const {
+  return absl::StrCat("IndexAdvisor/", options_.max_byte_size);
+}
+
+}  // namespace ci
@@ -0,0 +1,150 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: index_advisor.h
+// -----------------------------------------------------------------------------
+//
+// Picks the index structure (and its configuration) with the lowest expected
+// lookup latency that fits a per-column byte budget:
+// 1. Profiles the column: the number of distinct values per stripe, the ranges
+//    of the stripes and the density and clustering (see evaluation_utils.h) of
+//    the stripe bitmaps of a sample of distinct values.
+// 2. Estimates the size and scan rate of every candidate (CuckooIndex,
+//    PerStripeXor, PerStripeBloom and ZoneMap configurations) from the profile
+//    and discards the ones estimated to exceed the budget.
+// 3. Builds the most promising candidates and micro-benchmarks their lookups
+//    in process. The cost of a lookup is its latency plus the time to scan the
+//    stripes it returns falsely (see IndexAdvisorOptions::scan_ns_per_row).
+
+#ifndef CUCKOO_INDEX_INDEX_ADVISOR_H_
+#define CUCKOO_INDEX_INDEX_ADVISOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "common/bitmap.h"
+#include "data.h"
+#include "index_structure.h"
+
+namespace ci {
+
+struct IndexAdvisorOptions {
+  // The budget for IndexStructure::byte_size() of the returned index.
+  size_t max_byte_size = 0;
+  // The number of candidates (of different kinds of index structures) that are
+  // built and benchmarked.
+  size_t num_candidates_to_benchmark = 3;
+  // The number of lookups per benchmarked candidate.
+  size_t num_lookups = 1000;
+  // The share of lookups of values that are present in the column.
+  double positive_lookup_fraction = 0.5;
+  // The cost of scanning a row of a stripe that was returned falsely.
+  double scan_ns_per_row = 1.0;
+  // The number of distinct values whose stripe bitmaps are profiled.
+  size_t num_sampled_values = 256;
+};
+
+// The statistics of a column the candidates' estimates are based on.
+struct ColumnProfile {
+  size_t num_rows_per_stripe = 0;
+  // Only full stripes are indexed.
+  size_t num_stripes = 0;
+  size_t num_distinct_values = 0;
+  // The number of distinct values of every stripe.
+  std::vector<size_t> num_stripe_values;
+  // The average density and clustering of the stripe bitmaps of the sampled
+  // distinct values.
+  double density = 0.0;
+  double clustering = 0.0;
+  // The share of stripes not containing a value whose zone still does, for
+  // the sampled (positive) and for random (negative) values.
+  double zone_map_positive_scan_rate = 0.0;
+  double zone_map_negative_scan_rate = 0.0;
+  // The bit-width of the offsets of a compact ZoneMap.
+  size_t zone_map_offset_bit_width = 0;
+  // The sampled distinct values and their stripe bitmaps (the ground truth of
+  // positive lookups).
+  std::vector<long> sampled_values;
+  std::vector<Bitmap64> sampled_stripes;
+};
+
+// A candidate index structure with its estimated size and scan rate (the share
+// of the stripes not containing a value that a lookup returns).
+struct IndexCandidate {
+  // E.g., "CuckooIndex" or "PerStripeBloom". Only the best candidate of each
+  // kind is benchmarked.
+  std::string kind;
+  std::unique_ptr<IndexStructureFactory> factory;
+  size_t estimated_byte_size = 0;
+  double estimated_scan_rate = 0.0;
+};
+
+// The benchmark results of a built candidate.
+struct IndexMeasurement {
+  std::string index_name;
+  size_t byte_size = 0;
+  // Average over the lookup mix (see IndexAdvisorOptions).
+  double lookup_ns = 0.0;
+  double scan_rate = 0.0;
+  // `lookup_ns` plus the time to scan the falsely returned stripes.
+  double cost_ns = 0.0;
+};
+
+class IndexAdvisorFactory : public IndexStructureFactory {
+ public:
+  explicit IndexAdvisorFactory(const IndexAdvisorOptions& options);
+
+  // Returns the benchmarked candidate with the lowest cost that fits the
+  // budget. If no candidate fits, returns the smallest one built (with a
+  // warning).
+  IndexStructurePtr Create(const Column& column,
+                           size_t num_rows_per_stripe) const override {
+    return Advise(column, num_rows_per_stripe, /*measurements=*/nullptr);
+  }
+
+  // Same as Create(..), but also returns the results of all benchmarked
+  // candidates in `measurements` (if not nullptr).
+  IndexStructurePtr Advise(const Column& column, size_t num_rows_per_stripe,
+                           std::vector<IndexMeasurement>* measurements) const;
+
+  // Returns the profile of `column` (see ColumnProfile).
+  ColumnProfile ProfileColumn(const Column& column,
+                              size_t num_rows_per_stripe) const;
+
+  // Returns all candidates with their estimates for a column with `profile`,
+  // ordered by their estimated cost (ignoring the budget).
+  std::vector<IndexCandidate> GetCandidates(
+      const ColumnProfile& profile) const;
+
+  std::string index_name() const override;
+
+ private:
+  // Measures the lookups of `index` for the sampled values of `profile` with
+  // ids `positive_sample_ids` and for `negative_values` (which are absent).
+  IndexMeasurement Measure(const IndexStructure& index,
+                           const ColumnProfile& profile,
+                           absl::Span<const size_t> positive_sample_ids,
+                           absl::Span<const long> negative_values) const;
+
+  const IndexAdvisorOptions options_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_INDEX_ADVISOR_H_
@@ -0,0 +1,161 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: index_advisor_test.cc
+// -----------------------------------------------------------------------------
+
+#include "index_advisor.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "data_generators.h"
+#include "gtest/gtest.h"
+
+namespace ci {
+
+constexpr size_t kNumRows = 100000;
+constexpr size_t kNumRowsPerStripe = 1000;
+constexpr size_t kNumStripes = kNumRows / kNumRowsPerStripe;
+
+ColumnPtr CreateColumn(DataDistribution distribution,
+                       size_t num_unique_values) {
+  DataGeneratorOptions options;
+  options.distribution = distribution;
+  options.num_rows = kNumRows;
+  options.num_unique_values = num_unique_values;
+  options.cluster_size = kNumRowsPerStripe;
+  options.run_length = kNumRowsPerStripe;
+  const DataGenerator generator(options);
+  return Column::IntColumn(generator.name(), generator.Generate(1));
+}
+
+IndexAdvisorOptions CreateOptions(size_t max_byte_size) {
+  IndexAdvisorOptions options;
+  options.max_byte_size = max_byte_size;
+  options.num_lookups = 200;
+  return options;
+}
+
+TEST(IndexAdvisorTest, ProfileColumn) {
+  const IndexAdvisorFactory factory(CreateOptions(/*max_byte_size=*/1 << 20));
+  const ColumnPtr uniform = CreateColumn(DataDistribution::UNIFORM, 1000);
+  const ColumnProfile uniform_profile =
+      factory.ProfileColumn(*uniform, kNumRowsPerStripe);
+  EXPECT_EQ(uniform_profile.num_stripes, kNumStripes);
+  EXPECT_EQ(uniform_profile.num_distinct_values, 1000);
+  EXPECT_EQ(uniform_profile.num_stripe_values.size(), kNumStripes);
+  EXPECT_EQ(uniform_profile.sampled_values.size(), 256);
+  ASSERT_EQ(uniform_profile.sampled_stripes.size(), 256);
+  for (size_t i = 0; i < 256; ++i) {
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+      ASSERT_EQ(uniform_profile.sampled_stripes[i].Get(stripe_id),
+                uniform->StripeContains(kNumRowsPerStripe, stripe_id,
+                                        uniform_profile.sampled_values[i]));
+    }
+  }
+  // Each value occurs 100 times at random rows, i.e., in ~1 - 1/e of the
+  // stripes. The values are scattered over the domain, so zones span most of
+  // it.
+  EXPECT_NEAR(uniform_profile.density, 0.63, 0.05);
+  EXPECT_GT(uniform_profile.zone_map_positive_scan_rate, 0.9);
+  EXPECT_GT(uniform_profile.zone_map_negative_scan_rate, 0.9);
+
+  // Each value occurs in one or two (consecutive) stripes.
+  const ColumnPtr clustered = CreateColumn(DataDistribution::CLUSTERED, 5000);
+  const ColumnProfile clustered_profile =
+      factory.ProfileColumn(*clustered, kNumRowsPerStripe);
+  EXPECT_LT(clustered_profile.density, 0.03);
+  EXPECT_GE(clustered_profile.clustering, 1.0);
+
+  // Sorted runs cover the whole (small) domain in every stripe.
+  const ColumnPtr sorted = CreateColumn(DataDistribution::SORTED_RUNS, 5000);
+  const ColumnProfile sorted_profile =
+      factory.ProfileColumn(*sorted, kNumRowsPerStripe);
+  EXPECT_LT(sorted_profile.zone_map_negative_scan_rate, 1e-6);
+  EXPECT_EQ(sorted_profile.zone_map_offset_bit_width, 13);
+}
+
+TEST(IndexAdvisorTest, CandidatesAreOrderedAndEstimated) {
+  const IndexAdvisorFactory factory(CreateOptions(/*max_byte_size=*/1 << 20));
+  const ColumnPtr column = CreateColumn(DataDistribution::CLUSTERED, 5000);
+  const ColumnProfile profile =
+      factory.ProfileColumn(*column, kNumRowsPerStripe);
+  const std::vector<IndexCandidate> candidates = factory.GetCandidates(profile);
+  ASSERT_FALSE(candidates.empty());
+  for (size_t i = 1; i < candidates.size(); ++i) {
+    ASSERT_LE(candidates[i - 1].estimated_scan_rate,
+              candidates[i].estimated_scan_rate);
+  }
+  for (const IndexCandidate& candidate : candidates) {
+    // The size estimates of per-stripe filters and zone maps are close, the
+    // ones of the CuckooIndex depend on how well its bitmaps compress.
+    const double max_error = candidate.kind == "CuckooIndex" ? 0.3 : 0.1;
+    const IndexStructurePtr index =
+        candidate.factory->Create(*column, kNumRowsPerStripe);
+    EXPECT_NEAR(candidate.estimated_byte_size, index->byte_size(),
+                max_error * index->byte_size())
+        << index->name();
+  }
+}
+
+TEST(IndexAdvisorTest, PicksCheapestIndexWithinBudget) {
+  for (const size_t max_byte_size : {4000, 8000, 16000, 64000}) {
+    const IndexAdvisorFactory factory(CreateOptions(max_byte_size));
+    const ColumnPtr column = CreateColumn(DataDistribution::CLUSTERED, 5000);
+    std::vector<IndexMeasurement> measurements;
+    const IndexStructurePtr index =
+        factory.Advise(*column, kNumRowsPerStripe, &measurements);
+    ASSERT_NE(index, nullptr);
+    EXPECT_LE(index->byte_size(), max_byte_size);
+    ASSERT_FALSE(measurements.empty());
+    EXPECT_LE(measurements.size(), 3);
+
+    const IndexMeasurement* best = nullptr;
+    for (const IndexMeasurement& measurement : measurements) {
+      if (measurement.byte_size > max_byte_size) continue;
+      if (best == nullptr || measurement.cost_ns < best->cost_ns)
+        best = &measurement;
+    }
+    ASSERT_NE(best, nullptr);
+    EXPECT_EQ(index->name(), best->index_name);
+  }
+}
+
+TEST(IndexAdvisorTest, SmallBudgetPicksZoneMap) {
+  // Only the zones (16 bytes per stripe) fit.
+  const IndexAdvisorFactory factory(CreateOptions(/*max_byte_size=*/2000));
+  const ColumnPtr column = CreateColumn(DataDistribution::UNIFORM, 1000);
+  const IndexStructurePtr index = factory.Create(*column, kNumRowsPerStripe);
+  EXPECT_TRUE(absl::StartsWith(index->name(), "ZoneMap")) << index->name();
+}
+
+TEST(IndexAdvisorTest, ReturnsSmallestIndexIfNothingFits) {
+  const IndexAdvisorFactory factory(CreateOptions(/*max_byte_size=*/1));
+  // The offsets of the zones only need 13 bits.
+  const ColumnPtr column = CreateColumn(DataDistribution::SORTED_RUNS, 5000);
+  const IndexStructurePtr index = factory.Create(*column, kNumRowsPerStripe);
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->name(), "ZoneMap/compact");
+}
+
+TEST(IndexAdvisorTest, IndexName) {
+  EXPECT_EQ(IndexAdvisorFactory(CreateOptions(/*max_byte_size=*/1024))
+                .index_name(),
+            "IndexAdvisor/1024");
+}
+
+}  // namespace ci
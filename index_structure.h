@@ -19,15 +19,30 @@
 #ifndef CUCKOO_INDEX_INDEX_STRUCTURE_H_
 #define CUCKOO_INDEX_INDEX_STRUCTURE_H_
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "data.h"
 #include "evaluation.pb.h"
 
 namespace ci {
 
+// A part of an index structure and its in-memory size (see
+// IndexStructure::byte_size_breakdown()).
+struct ByteSizeComponent {
+  std::string name;
+  size_t byte_size;
+};
+
 // Class representing an index structure, e.g. based on a Bloom filter.
 class IndexStructure {
  public:
@@ -42,12 +57,94 @@ class IndexStructure {
   // Note: classes extending IndexStructure can override this method when they
   // can provide an optimized approach here (see CuckooIndex for an example).
   virtual Bitmap64 GetQualifyingStripes(long value, size_t num_stripes) const {
+    Bitmap64 result;
+    FillQualifyingStripes(value, num_stripes, &result);
+    return result;
+  }
+
+  // Same as GetQualifyingStripes(..), but writes the result to the
+  // caller-owned `result` (which is reset first). Re-using `result` across
+  // calls avoids allocating a bitmap per lookup.
+  virtual void FillQualifyingStripes(long value, size_t num_stripes,
+                                     Bitmap64* result) const {
     // Default implementation for per-stripe index structures.
-    Bitmap64 result(/*size=*/num_stripes);
+    result->Reset(num_stripes);
     for (size_t stripe_id = 0; stripe_id < static_cast<size_t>(num_stripes);
          ++stripe_id) {
       if (StripeContains(stripe_id, value))
-        result.Set(stripe_id, true);
+        result->Set(stripe_id, true);
+    }
+  }
+
+  // Same as above, but returns the sorted ids of qualifying stripes in the
+  // caller-owned `stripe_ids` (which is cleared first). Prefer this for
+  // sparse results.
+  virtual void FillQualifyingStripeIds(long value, size_t num_stripes,
+                                       std::vector<uint32_t>* stripe_ids) const {
+    stripe_ids->clear();
+    for (size_t stripe_id = 0; stripe_id < static_cast<size_t>(num_stripes);
+         ++stripe_id) {
+      if (StripeContains(stripe_id, value)) stripe_ids->push_back(stripe_id);
+    }
+  }
+
+  // Unsets the stripes in `candidates` that don't qualify for the given
+  // `value`, i.e., only probes the stripes that are set. Used for chaining
+  // index structures (see CompositeIndex).
+  // Note: classes extending IndexStructure can override this method when they
+  // can't restrict a lookup to some stripes (see CuckooIndex) or can check
+  // many stripes at once (see ZoneMap).
+  virtual void FilterQualifyingStripes(long value,
+                                       Bitmap64* candidates) const {
+    candidates->RetainIf(
+        [&](size_t stripe_id) { return StripeContains(stripe_id, value); });
+  }
+
+  // Variants of StripeContains(..) and GetQualifyingStripes(..) for strings of
+  // STRING columns with StringEncoding::HASH, i.e., the strings are hashed on
+  // their own and don't need to be translated with a dictionary.
+  bool StripeContainsString(size_t stripe_id, absl::string_view str) const {
+    return StripeContains(stripe_id, Column::HashStringKey(str));
+  }
+
+  Bitmap64 GetQualifyingStripesForString(absl::string_view str,
+                                         size_t num_stripes) const {
+    return GetQualifyingStripes(Column::HashStringKey(str), num_stripes);
+  }
+
+  // Returns the estimated fraction of stripes qualifying for `value`, e.g., for
+  // ordering conjunctive predicates (see PredicateEvaluator). Should be cheap
+  // compared to a lookup, so the default is 1 (i.e., unknown).
+  // Note: classes extending IndexStructure can override this method when they
+  // know the number of qualifying stripes up front (see CuckooIndex).
+  virtual double EstimateSelectivity(long /*value*/) const { return 1.0; }
+
+  // Batched version of GetQualifyingStripes(..): returns one bitmap per value
+  // in `values` (in the same order).
+  // Note: classes extending IndexStructure can override this method when they
+  // can overlap the memory accesses of multiple lookups (see CuckooIndex).
+  virtual std::vector<Bitmap64> GetQualifyingStripesBatch(
+      absl::Span<const long> values, size_t num_stripes) const {
+    std::vector<Bitmap64> results;
+    results.reserve(values.size());
+    for (const long value : values)
+      results.push_back(GetQualifyingStripes(value, num_stripes));
+    return results;
+  }
+
+  // Returns a bitmap indicating possibly qualifying stripes for any of the
+  // given `values`, i.e., for an IN-list predicate. Stops early once all
+  // stripes qualify.
+  // Note: classes extending IndexStructure can override this method when they
+  // can combine the lookups (see CuckooIndex).
+  virtual Bitmap64 GetQualifyingStripesForAny(absl::Span<const long> values,
+                                              size_t num_stripes) const {
+    Bitmap64 result(/*size=*/num_stripes);
+    Bitmap64 value_result;
+    for (const long value : values) {
+      if (result.IsAllOnes()) break;
+      FillQualifyingStripes(value, num_stripes, &value_result);
+      result |= value_result;
     }
     return result;
   }
@@ -61,13 +158,58 @@ class IndexStructure {
   // Returns the in-memory size of the compressed index structure.
   virtual size_t compressed_byte_size() const = 0;
 
+  // Returns byte_size() split up into the index structure's components (which
+  // sum up to byte_size()), e.g., for finding out what dominates an index.
+  // Note: classes extending IndexStructure can override this method when they
+  // consist of several parts (see CuckooIndex).
+  virtual std::vector<ByteSizeComponent> byte_size_breakdown() const {
+    return {{"total", byte_size()}};
+  }
+
   // Returns statistics about internal data structures using bitmaps. Should
   // be implemented only by CLT-based index structures.
   virtual ci::BitmapStats bitmap_stats() { return ci::BitmapStats(); }
+
+  // Returns how many stripes each child pruned since the last call to
+  // ResetPruningStats(). Should be implemented only by index structures
+  // chaining others (see CompositeIndex).
+  virtual std::vector<ci::PruningStats> pruning_stats() const { return {}; }
+
+  virtual void ResetPruningStats() const {}
+
+ protected:
+  // Exits if a lookup asks for more stripes than the `num_indexed_stripes` of
+  // the index structure.
+  static void CheckNumStripes(size_t num_stripes, size_t num_indexed_stripes) {
+    if (num_stripes > num_indexed_stripes) {
+      std::cerr << "`num_stripes` is out of bounds." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
 };
 
 using IndexStructurePtr = std::unique_ptr<IndexStructure>;
 
+// Builds an index structure one stripe at a time, e.g., for writers that can't
+// hold a whole column in memory.
+class IndexStructureBuilder {
+ public:
+  IndexStructureBuilder() {}
+  virtual ~IndexStructureBuilder() {}
+
+  // Adds the values of the next stripe. Unlike for IndexStructureFactory::
+  // Create(..), which drops the rows of a trailing partial stripe, stripes may
+  // differ in size (e.g., the last one of a streaming writer is usually
+  // shorter), and every added stripe is indexed.
+  virtual void AddStripe(absl::Span<const long> stripe) = 0;
+
+  // Returns the index structure over all added stripes. May only be called
+  // once.
+  virtual IndexStructurePtr Finish() = 0;
+};
+
+using IndexStructureBuilderPtr = std::unique_ptr<IndexStructureBuilder>;
+
 class IndexStructureFactory {
  public:
   IndexStructureFactory() {}
@@ -77,10 +219,62 @@ class IndexStructureFactory {
   virtual IndexStructurePtr Create(const Column& column,
                                    size_t num_rows_per_stripe) const = 0;
 
+  // Returns a builder creating the same index structure as Create(..) from
+  // stripes of (all) the same size. Shorter stripes (see
+  // IndexStructureBuilder::AddStripe(..)) are indexed as well. The factory must
+  // outlive the builder.
+  //
+  // The default implementation buffers all rows and calls Create(..) in
+  // Finish(). Index structures that can be built incrementally override this
+  // to only keep per-stripe or per-value state.
+  virtual IndexStructureBuilderPtr CreateBuilder() const;
+
   // Returns the name of the index that can be created using the factory.
   virtual std::string index_name() const = 0;
 };
 
+// The builder returned by the default IndexStructureFactory::CreateBuilder().
+// Since Create(..) needs stripes of the same size, Finish() pads the stripes
+// shorter than the longest one by repeating their values, which doesn't change
+// the set of values of any stripe.
+class BufferingIndexStructureBuilder : public IndexStructureBuilder {
+ public:
+  explicit BufferingIndexStructureBuilder(const IndexStructureFactory& factory)
+      : factory_(factory), num_rows_per_stripe_(0) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    if (stripe.empty()) {
+      std::cerr << "Can't buffer an empty stripe." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    num_rows_per_stripe_ = std::max(num_rows_per_stripe_, stripe.size());
+    stripes_.emplace_back(stripe.begin(), stripe.end());
+  }
+
+  IndexStructurePtr Finish() override {
+    std::vector<long> data;
+    data.reserve(stripes_.size() * num_rows_per_stripe_);
+    for (const std::vector<long>& stripe : stripes_) {
+      for (size_t row = 0; row < num_rows_per_stripe_; ++row)
+        data.push_back(stripe[row % stripe.size()]);
+    }
+    stripes_.clear();
+    const ColumnPtr column =
+        Column::IntColumn(factory_.index_name(), std::move(data));
+    return factory_.Create(*column, std::max<size_t>(1, num_rows_per_stripe_));
+  }
+
+ private:
+  const IndexStructureFactory& factory_;
+  // The size of the longest stripe.
+  size_t num_rows_per_stripe_;
+  std::vector<std::vector<long>> stripes_;
+};
+
+inline IndexStructureBuilderPtr IndexStructureFactory::CreateBuilder() const {
+  return absl::make_unique<BufferingIndexStructureBuilder>(*this);
+}
+
 }  // namespace ci
 
 #endif  // CUCKOO_INDEX_INDEX_STRUCTURE_H_
@@ -23,6 +23,14 @@
 // bazel run -c opt --cxxopt='-std=c++17' --dynamic_mode=off :lookup_benchmark
 // -- --input_csv_path='...' --columns_to_test='A,B,C'
 //
+// Add --record_latencies for per-lookup latency percentiles and
+// --perf_counters for hardware counters per lookup (both as user counters of
+// all benchmarks; the latencies of *BatchLookup are per
+// GetQualifyingStripesBatch(..) call), e.g., --record_latencies
+// --benchmark_filter=NegativeLookup --undefok=benchmark_filter.
+// Builds with --copt=-DCUCKOO_INDEX_LOOKUP_COUNTERS also report the lookup
+// counters of ci::LookupCounters per lookup.
+//
 // Example run:
 // Run on (80 X 3900 MHz CPU s)
 // CPU Caches:
@@ -59,15 +67,26 @@
 // PositiveDistinctLookup/Color/65536/PerStripeXor                  1383 ns
 // NegativeLookup/Color/65536/PerStripeXor                           895 ns
 
+#include <chrono>
 #include <cstdlib>
 #include <random>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
+#include "absl/random/zipf_distribution.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
 #include "benchmark/benchmark.h"
+#include "caching_index_structure.h"
+#include "common/latency_histogram.h"
+#include "common/perf_counters.h"
+#include "common/profiling.h"
 #include "cuckoo_index.h"
 #include "cuckoo_utils.h"
+#include "data_generators.h"
 #include "index_structure.h"
+#include "per_stripe_blocked_bloom.h"
 #include "per_stripe_bloom.h"
 #include "per_stripe_xor.h"
 
@@ -75,6 +94,12 @@ ABSL_FLAG(long, generate_num_values, 100000,
 "Number of values to generate (number of rows).");
 ABSL_FLAG(long, num_unique_values, 1000,
 "Number of unique values to generate (cardinality).");
+ABSL_FLAG(std::string, distribution, "",
+          "Distribution of the generated data: 'UNIFORM', 'ZIPF', 'CLUSTERED', "
+          "'SORTED_RUNS' or 'NEAR_UNIQUE' (see ci::DataDistribution). If "
+          "empty, uses ci::GenerateUniformData(..).");
+ABSL_FLAG(long, num_generate_threads, 1,
+          "Number of threads generating the data for --distribution.");
 ABSL_FLAG(std::string, input_csv_path, "", "Path to the input CSV file.");
 ABSL_FLAG(std::vector<std::string>, columns_to_test, {},
           "Comma-separated list of columns to tests, e.g. "
@@ -83,11 +108,32 @@ ABSL_FLAG(std::string, sorting, "NONE",
           "Sorting to apply to the data. Supported values: 'NONE', "
           "'BY_CARDINALITY' (sorts lexicographically, starting with columns "
           "with the lowest cardinality), 'RANDOM'");
+ABSL_FLAG(long, cache_capacity, 1024,
+          "Number of stripe bitmaps cached by the CachingIndexStructure in "
+          "the *ZipfLookup benchmarks.");
+ABSL_FLAG(long, num_load_threads, 1,
+          "Number of threads used to parse the input CSV file.");
+ABSL_FLAG(std::string, table_cache_path, "",
+          "Path of a binary copy of the table, which is opened instead of "
+          "loading or generating the table again (see "
+          "ci::GetOrCreateCachedTable(..)). Rows are sorted after loading, "
+          "i.e., the cache holds the unsorted table.");
+ABSL_FLAG(bool, record_latencies, false,
+          "Whether to time each GetQualifyingStripes(..) (or batch) call on its "
+          "own and report the p50, p90, p99 and p999 latencies. Adds the "
+          "overhead of reading the clock to the mean time.");
+ABSL_FLAG(bool, perf_counters, false,
+          "Whether to report the instructions, branch misses and last-level "
+          "cache misses per lookup, read from the hardware counters.");
 
 // To avoid drawing a random value for each single lookup, we look values up in
 // batches. To avoid caching effects, we use 1M values as the batch size.
 constexpr size_t kLookupBatchSize = 1'000'000;
 
+// The number of values passed to a single GetQualifyingStripesBatch(..) call in
+// the *BatchLookup benchmarks.
+constexpr size_t kNumValuesPerBatchCall = 256;
+
 constexpr absl::string_view kNoSorting = "NONE";
 constexpr absl::string_view kByCardinalitySorting = "BY_CARDINALITY";
 constexpr absl::string_view kRandomSorting = "RANDOM";
@@ -99,9 +145,87 @@ bool IsValidSorting(absl::string_view sorting) {
   return values->contains(sorting);
 }
 
+// Looks up all `values` in `index`. For `num_values_per_call` = 1, calls
+// GetQualifyingStripes(..) for each value, otherwise passes chunks of
+// `num_values_per_call` values to GetQualifyingStripesBatch(..).
+void RunLookups(const ci::IndexStructure& index,
+                const std::vector<long>& values, const long num_stripes,
+                const size_t num_values_per_call, benchmark::State& state) {
+  const absl::Span<const long> all_values = absl::MakeConstSpan(values);
+  auto lookup = [&](size_t i) {
+    if (num_values_per_call == 1) {
+      ::benchmark::DoNotOptimize(index.GetQualifyingStripes(values[i],
+                                                            num_stripes));
+    } else {
+      ::benchmark::DoNotOptimize(index.GetQualifyingStripesBatch(
+          all_values.subspan(i, num_values_per_call), num_stripes));
+    }
+  };
+
+  ci::PerfCountersPtr perf_counters;
+  if (absl::GetFlag(FLAGS_perf_counters)) {
+    perf_counters = ci::PerfCounters::Open();
+    if (perf_counters == nullptr) {
+      state.SkipWithError("Couldn't open perf counters.");
+      return;
+    }
+    perf_counters->Start();
+  }
+  if (ci::kLookupCountersEnabled) ci::LookupCounters::Reset();
+
+  if (absl::GetFlag(FLAGS_record_latencies)) {
+    ci::LatencyHistogram latencies;
+    while (state.KeepRunningBatch(values.size())) {
+      for (size_t i = 0; i < values.size(); i += num_values_per_call) {
+        const auto start = std::chrono::steady_clock::now();
+        lookup(i);
+        latencies.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+      }
+    }
+    for (const auto& [name, quantile] :
+         {std::make_pair("p50_ns", 0.5), std::make_pair("p90_ns", 0.9),
+          std::make_pair("p99_ns", 0.99), std::make_pair("p999_ns", 0.999)}) {
+      state.counters[name] = latencies.Quantile(quantile);
+    }
+    state.counters["max_ns"] = latencies.max();
+  } else {
+    while (state.KeepRunningBatch(values.size())) {
+      for (size_t i = 0; i < values.size(); i += num_values_per_call)
+        lookup(i);
+    }
+  }
+
+  if (perf_counters != nullptr) {
+    perf_counters->Stop();
+    for (const ci::PerfCounters::Event event :
+         {ci::PerfCounters::Event::INSTRUCTIONS,
+          ci::PerfCounters::Event::BRANCH_MISSES,
+          ci::PerfCounters::Event::LLC_MISSES}) {
+      // Per lookup, i.e., divided by the number of iterations.
+      state.counters[ci::PerfCounters::EventName(event)] = benchmark::Counter(
+          static_cast<double>(perf_counters->Get(event)),
+          benchmark::Counter::kAvgIterations);
+    }
+  }
+
+  if (ci::kLookupCountersEnabled) {
+    const ci::LookupCounterValues values = ci::LookupCounters::GetSnapshot();
+    for (size_t i = 0; i < ci::kNumLookupCounters; ++i) {
+      state.counters[ci::LookupCounters::Name(
+          static_cast<ci::LookupCounter>(i))] =
+          benchmark::Counter(static_cast<double>(values[i]),
+                             benchmark::Counter::kAvgIterations);
+    }
+  }
+}
+
 void BM_PositiveDistinctLookup(const ci::Column& column,
                                std::shared_ptr<ci::IndexStructure> index,
-                               const long num_stripes, benchmark::State& state) {
+                               const long num_stripes,
+                               const size_t num_values_per_call,
+                               benchmark::State& state) {
   std::mt19937 gen(42);
   std::vector<long> distinct_values = column.distinct_values();
   // Remove NULLs from the lookup.
@@ -118,17 +242,41 @@ void BM_PositiveDistinctLookup(const ci::Column& column,
     values.push_back(distinct_values[distinct_values_offset_d(gen)]);
   }
 
-  while (state.KeepRunningBatch(values.size())) {
-    for (size_t i = 0; i < values.size(); ++i) {
-      ::benchmark::DoNotOptimize(index->GetQualifyingStripes(values[i],
-                                                             num_stripes));
-    }
+  RunLookups(*index, values, num_stripes, num_values_per_call, state);
+}
+
+// Like BM_PositiveDistinctLookup(..), but draws the values from a Zipf
+// distribution, i.e., a few hot values make up most of the lookups.
+void BM_PositiveZipfLookup(const ci::Column& column,
+                           std::shared_ptr<ci::IndexStructure> index,
+                           const long num_stripes,
+                           const size_t num_values_per_call,
+                           benchmark::State& state) {
+  std::mt19937 gen(42);
+  std::vector<long> distinct_values = column.distinct_values();
+  // Remove NULLs from the lookup.
+  distinct_values.erase(
+      std::remove(distinct_values.begin(), distinct_values.end(),
+                  ci::Column::kIntNullSentinel),
+      distinct_values.end());
+  // Shuffle to not correlate the popularity of a value with its rank.
+  std::shuffle(distinct_values.begin(), distinct_values.end(), gen);
+
+  std::vector<long> values;
+  values.reserve(kLookupBatchSize);
+  for (size_t i = 0; i < kLookupBatchSize; ++i) {
+    values.push_back(distinct_values[absl::Zipf(
+        gen, distinct_values.size() - 1, /*q=*/2.0)]);
   }
+
+  RunLookups(*index, values, num_stripes, num_values_per_call, state);
 }
 
 void BM_NegativeLookup(const ci::Column& column,
                        std::shared_ptr<ci::IndexStructure> index,
-                       const long num_stripes, benchmark::State& state) {
+                       const long num_stripes,
+                       const size_t num_values_per_call,
+                       benchmark::State& state) {
   std::mt19937 gen(42);
   std::uniform_int_distribution<long> value_d(std::numeric_limits<long>::min(),
                                              std::numeric_limits<long>::max());
@@ -143,12 +291,7 @@ void BM_NegativeLookup(const ci::Column& column,
     values.push_back(value);
   }
 
-  while (state.KeepRunningBatch(values.size())) {
-    for (size_t i = 0; i < values.size(); ++i) {
-      ::benchmark::DoNotOptimize(index->GetQualifyingStripes(values[i],
-                                                             num_stripes));
-    }
-  }
+  RunLookups(*index, values, num_stripes, num_values_per_call, state);
 }
 
 long main(long argc, char* argv[]) {
@@ -161,20 +304,44 @@ long main(long argc, char* argv[]) {
       columns_to_test = absl::GetFlag(FLAGS_columns_to_test);
 
   // Define data.
-  std::unique_ptr<ci::Table> table;
-  if (input_csv_path.empty() || columns_to_test.empty()) {
-    std::cerr
-        << "[WARNING] --input_csv_path or --columns_to_test not specified, "
-           "generating synthetic data." << std::endl;
-    std::cout << "Generating " << generate_num_values << " values ("
-              << static_cast<double>(num_unique_values) / generate_num_values
-                  * 100 << "% unique)..." << std::endl;
-    table = ci::GenerateUniformData(generate_num_values, num_unique_values);
-  } else {
-    std::cout << "Loading data from file " << input_csv_path << "..."
-              << std::endl;
-    table = ci::Table::FromCsv(input_csv_path, columns_to_test);
-  }
+  const std::string distribution = absl::GetFlag(FLAGS_distribution);
+  const bool load_csv = !input_csv_path.empty() && !columns_to_test.empty();
+  const std::string source =
+      load_csv ? ci::CsvTableSource(input_csv_path, columns_to_test,
+                                    ci::StringEncoding::DICTIONARY)
+               : absl::StrCat("generated: distribution=", distribution,
+                              " generate_num_values=", generate_num_values,
+                              " num_unique_values=", num_unique_values);
+  const std::unique_ptr<ci::Table> table = ci::GetOrCreateCachedTable(
+      absl::GetFlag(FLAGS_table_cache_path), source,
+      [&]() -> std::unique_ptr<ci::Table> {
+        if (load_csv) {
+          std::cout << "Loading data from file " << input_csv_path << "..."
+                    << std::endl;
+          return ci::Table::FromCsv(input_csv_path, columns_to_test,
+                                    ci::StringEncoding::DICTIONARY,
+                                    absl::GetFlag(FLAGS_num_load_threads));
+        }
+        std::cerr << "[WARNING] --input_csv_path or --columns_to_test not "
+                     "specified, generating synthetic data." << std::endl;
+        std::cout << "Generating " << generate_num_values << " values ("
+                  << static_cast<double>(num_unique_values) /
+                         generate_num_values * 100
+                  << "% unique)..." << std::endl;
+        if (distribution.empty())
+          return ci::GenerateUniformData(generate_num_values,
+                                         num_unique_values);
+        ci::DataGeneratorOptions options;
+        if (!ci::ParseDataDistribution(distribution, &options.distribution)) {
+          std::cerr << "Invalid distribution: " << distribution << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        options.num_rows = generate_num_values;
+        options.num_unique_values = num_unique_values;
+        return ci::DataGenerator(options).GenerateTable(
+            absl::GetFlag(FLAGS_num_generate_threads));
+      });
+  table->PrintColumns();
 
   // Potentially sort the data.
   const std::string sorting = absl::GetFlag(FLAGS_sorting);
@@ -198,6 +365,9 @@ long main(long argc, char* argv[]) {
       /*prefix_bits_optimization=*/false));
   // index_factories.push_back(
   //     absl::make_unique<ci::PerStripeBloomFactory>(/*num_bits_per_key=*/10));
+  index_factories.push_back(
+      absl::make_unique<ci::PerStripeBlockedBloomFactory>(
+          /*num_bits_per_key=*/10));
   // index_factories.push_back(absl::make_unique<ci::PerStripeXorFactory>());
 
   // Set up the benchmarks.
@@ -208,34 +378,76 @@ long main(long argc, char* argv[]) {
         std::shared_ptr<ci::IndexStructure> index = absl::WrapUnique(
             factory->Create(*column, num_rows_per_stripe).release());
         const long num_stripes = column->num_rows() / num_rows_per_stripe;
-        std::cout << "num" << " num_rows_per_strip is :" << num_rows_per_stripe << " num_strips is :" << num_stripes << std::endl;
-        std::cout << "byte_size is :" << index->byte_size() << " compressed_byte_size is :" << index->compressed_byte_size() << std::endl;
-        for(long value=6224950; value<6224970; value++) {
-          std::cout << value << " _result is :" << index->GetQualifyingStripes(value, num_stripes).ToString() << std::endl;
-        }
-        // const std::string positive_distinct_lookup_benchmark_name =
-        //     absl::StrFormat(/*format=*/"PositiveDistinctLookup/%s/%d/%s",
-        //                     column->name(), num_rows_per_stripe, index->name());
-        // ::benchmark::RegisterBenchmark(
-        //     positive_distinct_lookup_benchmark_name.c_str(),
-        //     [&column, index, num_stripes](::benchmark::State& st) -> void {
-        //       BM_PositiveDistinctLookup(*column, index, num_stripes, st);
-        //     });
-
-        // const std::string negative_lookup_benchmark_name =
-        //     absl::StrFormat(/*format=*/"NegativeLookup/%s/%d/%s",
-        //                     column->name(), num_rows_per_stripe, index->name());
-        // ::benchmark::RegisterBenchmark(
-        //     negative_lookup_benchmark_name.c_str(),
-        //     [&column, index, num_stripes](::benchmark::State& st) -> void {
-        //       BM_NegativeLookup(*column, index, num_stripes, st);
-        //     });
+        const std::string positive_distinct_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"PositiveDistinctLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            positive_distinct_lookup_benchmark_name.c_str(),
+            [&column, index, num_stripes](::benchmark::State& st) -> void {
+              BM_PositiveDistinctLookup(*column, index, num_stripes,
+                                        /*num_values_per_call=*/1, st);
+            });
+
+        const std::string positive_distinct_batch_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"PositiveDistinctBatchLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            positive_distinct_batch_lookup_benchmark_name.c_str(),
+            [&column, index, num_stripes](::benchmark::State& st) -> void {
+              BM_PositiveDistinctLookup(*column, index, num_stripes,
+                                        kNumValuesPerBatchCall, st);
+            });
+
+        const std::string negative_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"NegativeLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            negative_lookup_benchmark_name.c_str(),
+            [&column, index, num_stripes](::benchmark::State& st) -> void {
+              BM_NegativeLookup(*column, index, num_stripes,
+                                /*num_values_per_call=*/1, st);
+            });
+
+        const std::string negative_batch_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"NegativeBatchLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            negative_batch_lookup_benchmark_name.c_str(),
+            [&column, index, num_stripes](::benchmark::State& st) -> void {
+              BM_NegativeLookup(*column, index, num_stripes,
+                                kNumValuesPerBatchCall, st);
+            });
+
+        const std::string positive_zipf_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"PositiveZipfLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe, index->name());
+        ::benchmark::RegisterBenchmark(
+            positive_zipf_lookup_benchmark_name.c_str(),
+            [&column, index, num_stripes](::benchmark::State& st) -> void {
+              BM_PositiveZipfLookup(*column, index, num_stripes,
+                                    /*num_values_per_call=*/1, st);
+            });
+
+        std::shared_ptr<ci::IndexStructure> cached_index =
+            std::make_shared<ci::CachingIndexStructure>(
+                factory->Create(*column, num_rows_per_stripe),
+                absl::GetFlag(FLAGS_cache_capacity));
+        const std::string cached_positive_zipf_lookup_benchmark_name =
+            absl::StrFormat(/*format=*/"PositiveZipfLookup/%s/%d/%s",
+                            column->name(), num_rows_per_stripe,
+                            cached_index->name());
+        ::benchmark::RegisterBenchmark(
+            cached_positive_zipf_lookup_benchmark_name.c_str(),
+            [&column, cached_index, num_stripes](::benchmark::State& st) {
+              BM_PositiveZipfLookup(*column, cached_index, num_stripes,
+                                    /*num_values_per_call=*/1, st);
+            });
       }
     }
   }
 
-  // ::benchmark::Initialize(&argc, argv);
-  // ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,221 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: partitioned_cuckoo_index.cc
+// -----------------------------------------------------------------------------
+
+#include "partitioned_cuckoo_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "common/byte_coding.h"
+#include "common/profiling.h"
+#include "common/stripe_set.h"
+
+namespace ci {
+
+std::unique_ptr<PartitionedCuckooIndex> PartitionedCuckooIndex::Open(
+    absl::string_view data, size_t fingerprint_directory) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  const std::string name(GetString(span, &pos));
+  const size_t num_stripes = GetVarint32(span, &pos);
+  const size_t num_partitions = GetVarint32(span, &pos);
+  std::vector<std::unique_ptr<CuckooIndex>> partitions(num_partitions);
+  for (size_t i = 0; i < num_partitions; ++i) {
+    const absl::string_view encoded_partition = GetString(span, &pos);
+    if (!encoded_partition.empty())
+      partitions[i] = CuckooIndex::Open(encoded_partition, fingerprint_directory);
+  }
+  assert(pos == data.size());
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  return absl::WrapUnique(
+      new PartitionedCuckooIndex(name, num_stripes, std::move(partitions)));
+}
+
+std::unique_ptr<PartitionedCuckooIndex> PartitionedCuckooIndex::OpenFile(
+    const std::string& path, size_t fingerprint_directory) {
+  MappedFilePtr mapped_file = MappedFile::Open(path);
+  std::unique_ptr<PartitionedCuckooIndex> index =
+      Open(mapped_file->data(), fingerprint_directory);
+  index->mapped_file_ = std::move(mapped_file);
+  return index;
+}
+
+bool PartitionedCuckooIndex::StripeContains(size_t stripe_id,
+                                            long value) const {
+  const CuckooIndex* index = GetPartitionIndex(value);
+  return index != nullptr && index->StripeContains(stripe_id, value);
+}
+
+void PartitionedCuckooIndex::FillQualifyingStripes(long value,
+                                                   size_t num_stripes,
+                                                   Bitmap64* result) const {
+  const CuckooIndex* index = GetPartitionIndex(value);
+  if (index == nullptr) {
+    result->Reset(num_stripes);
+    return;
+  }
+  index->FillQualifyingStripes(value, num_stripes, result);
+}
+
+void PartitionedCuckooIndex::FillQualifyingStripeIds(
+    long value, size_t num_stripes, std::vector<uint32_t>* stripe_ids) const {
+  const CuckooIndex* index = GetPartitionIndex(value);
+  if (index == nullptr) {
+    stripe_ids->clear();
+    return;
+  }
+  index->FillQualifyingStripeIds(value, num_stripes, stripe_ids);
+}
+
+void PartitionedCuckooIndex::FilterQualifyingStripes(
+    long value, Bitmap64* candidates) const {
+  const CuckooIndex* index = GetPartitionIndex(value);
+  if (index == nullptr) {
+    candidates->Reset(candidates->bits());
+    return;
+  }
+  index->FilterQualifyingStripes(value, candidates);
+}
+
+double PartitionedCuckooIndex::EstimateSelectivity(long value) const {
+  const CuckooIndex* index = GetPartitionIndex(value);
+  return index != nullptr ? index->EstimateSelectivity(value) : 0.0;
+}
+
+size_t PartitionedCuckooIndex::byte_size() const {
+  size_t byte_size = 0;
+  for (const std::unique_ptr<CuckooIndex>& index : partitions_) {
+    if (index != nullptr) byte_size += index->byte_size();
+  }
+  return byte_size;
+}
+
+size_t PartitionedCuckooIndex::compressed_byte_size() const {
+  size_t compressed_byte_size = 0;
+  for (const std::unique_ptr<CuckooIndex>& index : partitions_) {
+    if (index != nullptr) compressed_byte_size += index->compressed_byte_size();
+  }
+  return compressed_byte_size;
+}
+
+std::vector<ByteSizeComponent> PartitionedCuckooIndex::byte_size_breakdown()
+    const {
+  std::vector<ByteSizeComponent> breakdown;
+  for (const std::unique_ptr<CuckooIndex>& index : partitions_) {
+    if (index == nullptr) continue;
+    const std::vector<ByteSizeComponent> partition_breakdown =
+        index->byte_size_breakdown();
+    // All partitions have the same components.
+    if (breakdown.empty()) {
+      breakdown = partition_breakdown;
+      continue;
+    }
+    for (size_t i = 0; i < breakdown.size(); ++i)
+      breakdown[i].byte_size += partition_breakdown[i].byte_size;
+  }
+  return breakdown;
+}
+
+std::string PartitionedCuckooIndex::Encode() const {
+  ByteBuffer result;
+  PutString(name_, &result);
+  PutVarint32(num_stripes_, &result);
+  PutVarint32(partitions_.size(), &result);
+  for (const std::unique_ptr<CuckooIndex>& index : partitions_)
+    PutString(index != nullptr ? index->Encode() : std::string(), &result);
+  return std::string(result.data(), result.pos());
+}
+
+std::unique_ptr<IndexStructure> PartitionedCuckooIndexFactory::Create(
+    const Column& column, size_t num_rows_per_stripe) const {
+  // Workers write to distinct entries.
+  std::vector<std::unique_ptr<CuckooIndex>> partitions(num_partitions_);
+  std::atomic<size_t> next_partition{0};
+  auto work = [&]() {
+    for (size_t partition = next_partition++; partition < num_partitions_;
+         partition = next_partition++) {
+      partitions[partition] =
+          CreatePartition(column, num_rows_per_stripe, partition);
+    }
+  };
+
+  const size_t num_workers =
+      std::max<size_t>(1, std::min(num_threads_, num_partitions_));
+  if (num_workers == 1) {
+    work();
+  } else {
+    Profiler& caller_profiler = Profiler::GetThreadInstance();
+    absl::Mutex profiler_mutex;
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.emplace_back([&]() {
+        work();
+        // The calling thread is blocked in join() below.
+        absl::MutexLock lock(&profiler_mutex);
+        caller_profiler.Merge(Profiler::GetThreadInstance());
+      });
+    }
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  return absl::WrapUnique(new PartitionedCuckooIndex(
+      index_name(), /*num_stripes=*/column.num_rows() / num_rows_per_stripe,
+      std::move(partitions)));
+}
+
+std::unique_ptr<CuckooIndex> PartitionedCuckooIndexFactory::CreatePartition(
+    const Column& column, size_t num_rows_per_stripe, size_t partition) const {
+  // Round down the number of rows to the next multiple of
+  // `num_rows_per_stripe`, i.e., ignore the last stripe as elsewhere.
+  const size_t num_stripes = column.num_rows() / num_rows_per_stripe;
+  StripeSetArena arena(num_stripes);
+  absl::flat_hash_map<long, StripeSet> value_to_stripes;
+  {
+    ScopedProfile profile(Counter::ValueToStripeBitmaps);
+    for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+      const size_t end_row = (stripe + 1) * num_rows_per_stripe;
+      for (size_t row = stripe * num_rows_per_stripe; row < end_row; ++row) {
+        const long value = column[row];
+        if (PartitionedCuckooIndex::GetPartition(value, num_partitions_) ==
+            partition)
+          value_to_stripes[value].Add(stripe, &arena);
+      }
+    }
+  }
+  if (value_to_stripes.empty()) return nullptr;
+  return factory_.CreateFromStripeSets(value_to_stripes, num_stripes);
+}
+
+std::string PartitionedCuckooIndexFactory::index_name() const {
+  return absl::StrCat("PartitionedCuckooIndex:", num_partitions_, "/",
+                      factory_.index_name());
+}
+
+}  // namespace ci
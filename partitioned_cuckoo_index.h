@@ -0,0 +1,161 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: partitioned_cuckoo_index.h
+// -----------------------------------------------------------------------------
+//
+// A CuckooIndex split into independent partitions by the hash of the values,
+// for columns whose distinct values don't fit into a single build.
+
+#ifndef CUCKOO_INDEX_PARTITIONED_CUCKOO_INDEX_H_
+#define CUCKOO_INDEX_PARTITIONED_CUCKOO_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "common/mapped_file.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "data.h"
+#include "index_structure.h"
+
+namespace ci {
+
+// Routes each value by the high bits of its (mixed) hash to one of
+// `num_partitions()` sub-indexes, each a CuckooIndex over only the values of
+// its partition (and all stripes). A lookup only probes the sub-index of the
+// value's partition. Partitions without any value don't have a sub-index.
+//
+// The on-disk format (see Encode()) is the following:
+//   string name
+//   varint32 num_stripes
+//   varint32 num_partitions
+//   string encoding of each sub-index (see CuckooIndex::Encode(), empty for
+//   partitions without a sub-index)
+class PartitionedCuckooIndex : public IndexStructure {
+ public:
+  // Opens the index from bytes previously returned by Encode(). The
+  // sub-indexes are opened in place (see CuckooIndex::Open(..)), i.e., `data`
+  // is *not* copied and needs to outlive the returned index.
+  static std::unique_ptr<PartitionedCuckooIndex> Open(
+      absl::string_view data, size_t fingerprint_directory = 0);
+
+  // Like Open(..), but memory-maps the file at `path`. The mapping is owned by
+  // the returned index.
+  static std::unique_ptr<PartitionedCuckooIndex> OpenFile(
+      const std::string& path, size_t fingerprint_directory = 0);
+
+  // Returns the partition of `value` among `num_partitions`. Mixes the value
+  // independently from the hashes of CuckooValue, so that the buckets of the
+  // values of a partition are still uniformly distributed.
+  static size_t GetPartition(long value, size_t num_partitions) {
+    return FastRange(Mix64(static_cast<uint64_t>(value)), num_partitions);
+  }
+
+  bool StripeContains(size_t stripe_id, long value) const override;
+
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override;
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override;
+
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override;
+
+  double EstimateSelectivity(long value) const override;
+
+  std::string name() const override { return name_; }
+
+  size_t byte_size() const override;
+
+  size_t compressed_byte_size() const override;
+
+  // Sums up the components of all partitions.
+  std::vector<ByteSizeComponent> byte_size_breakdown() const override;
+
+  // Returns the on-disk format of the index which can be passed to Open(..).
+  std::string Encode() const;
+
+  size_t num_partitions() const { return partitions_.size(); }
+
+  // Returns the sub-index of `partition` (nullptr if it has no values).
+  const CuckooIndex* partition(size_t partition) const {
+    return partitions_[partition].get();
+  }
+
+ private:
+  friend class PartitionedCuckooIndexFactory;
+
+  PartitionedCuckooIndex(std::string name, size_t num_stripes,
+                         std::vector<std::unique_ptr<CuckooIndex>> partitions)
+      : name_(std::move(name)),
+        num_stripes_(num_stripes),
+        partitions_(std::move(partitions)) {}
+
+  // Returns the sub-index `value` would be in (nullptr if there is none).
+  const CuckooIndex* GetPartitionIndex(long value) const {
+    return partitions_[GetPartition(value, partitions_.size())].get();
+  }
+
+  const std::string name_;
+  const size_t num_stripes_;
+  const std::vector<std::unique_ptr<CuckooIndex>> partitions_;
+
+  // Only set for indexes opened with OpenFile(..).
+  MappedFilePtr mapped_file_;
+};
+
+// Creates a PartitionedCuckooIndex whose sub-indexes are created with the
+// given CuckooIndexFactory (which may use several threads of its own).
+//
+// The partitions are built on `num_threads` threads, each of which collects
+// the stripes of the values of one partition at a time (scanning the whole
+// column) and creates its sub-index, retrying with more buckets as needed
+// (see CuckooIndexFactory::Create(..)). The peak build memory is therefore
+// roughly `num_threads` / `num_partitions` of the one of a single CuckooIndex.
+class PartitionedCuckooIndexFactory : public IndexStructureFactory {
+ public:
+  PartitionedCuckooIndexFactory(const CuckooIndexFactory& factory,
+                                size_t num_partitions, size_t num_threads = 1)
+      : factory_(factory),
+        num_partitions_(num_partitions),
+        num_threads_(num_threads) {}
+
+  std::unique_ptr<IndexStructure> Create(
+      const Column& column, size_t num_rows_per_stripe) const override;
+
+  std::string index_name() const override;
+
+ private:
+  // Creates the sub-index of `partition` (nullptr if it has no values).
+  std::unique_ptr<CuckooIndex> CreatePartition(
+      const Column& column, size_t num_rows_per_stripe,
+      size_t partition) const;
+
+  const CuckooIndexFactory factory_;
+  const size_t num_partitions_;
+  const size_t num_threads_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_PARTITIONED_CUCKOO_INDEX_H_
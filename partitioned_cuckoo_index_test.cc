@@ -0,0 +1,149 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: partitioned_cuckoo_index_test.cc
+// -----------------------------------------------------------------------------
+
+#include "partitioned_cuckoo_index.h"
+
+#include <memory>
+#include <vector>
+
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+
+namespace ci {
+
+constexpr size_t kNumRows = 3000;
+constexpr size_t kNumRowsPerStripe = 10;
+constexpr size_t kNumStripes = kNumRows / kNumRowsPerStripe;
+
+// Returns a column with `num_values` distinct values (starting at 1), spread
+// over all stripes.
+ColumnPtr CreateColumn(size_t num_values) {
+  std::vector<long> data(kNumRows);
+  for (size_t row = 0; row < kNumRows; ++row)
+    data[row] = (row * 7) % num_values + 1;
+  return Column::IntColumn("column", std::move(data));
+}
+
+CuckooIndexFactory CreateCuckooIndexFactory() {
+  // The matching is deterministic, i.e., creates the same index each time.
+  return CuckooIndexFactory(CuckooAlgorithm::MATCHING,
+                            kMaxLoadFactor2SlotsPerBucket, /*scan_rate=*/0.01,
+                            /*slots_per_bucket=*/2,
+                            /*prefix_bits_optimization=*/false);
+}
+
+std::unique_ptr<PartitionedCuckooIndex> CreateIndex(const Column& column,
+                                                    size_t num_partitions,
+                                                    size_t num_threads) {
+  const PartitionedCuckooIndexFactory factory(CreateCuckooIndexFactory(),
+                                              num_partitions, num_threads);
+  IndexStructurePtr index = factory.Create(column, kNumRowsPerStripe);
+  return std::unique_ptr<PartitionedCuckooIndex>(
+      static_cast<PartitionedCuckooIndex*>(index.release()));
+}
+
+// Checks that positive lookups are exact (for all values in the column).
+void CheckPositiveLookups(const Column& column, const IndexStructure& index) {
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (const long value : column.distinct_values()) {
+    index.FillQualifyingStripes(value, kNumStripes, &result);
+    index.FillQualifyingStripeIds(value, kNumStripes, &stripe_ids);
+    std::vector<uint32_t> expected_stripe_ids;
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+      const bool expected =
+          column.StripeContains(kNumRowsPerStripe, stripe_id, value);
+      ASSERT_EQ(result.Get(stripe_id), expected);
+      ASSERT_EQ(index.StripeContains(stripe_id, value), expected);
+      if (expected) expected_stripe_ids.push_back(stripe_id);
+    }
+    ASSERT_EQ(stripe_ids, expected_stripe_ids);
+  }
+}
+
+TEST(PartitionedCuckooIndexTest, PositiveLookupsAreExact) {
+  const ColumnPtr column = CreateColumn(/*num_values=*/500);
+  for (const size_t num_partitions : {1, 4, 7}) {
+    const std::unique_ptr<PartitionedCuckooIndex> index =
+        CreateIndex(*column, num_partitions, /*num_threads=*/2);
+    ASSERT_EQ(index->num_partitions(), num_partitions);
+    CheckPositiveLookups(*column, *index);
+  }
+}
+
+TEST(PartitionedCuckooIndexTest, PartitionsOnlyHoldTheirValues) {
+  const ColumnPtr column = CreateColumn(/*num_values=*/500);
+  constexpr size_t kNumPartitions = 8;
+  const std::unique_ptr<PartitionedCuckooIndex> index =
+      CreateIndex(*column, kNumPartitions, /*num_threads=*/1);
+  std::vector<size_t> num_values(kNumPartitions, 0);
+  for (const long value : column->distinct_values())
+    ++num_values[PartitionedCuckooIndex::GetPartition(value, kNumPartitions)];
+  for (size_t partition = 0; partition < kNumPartitions; ++partition) {
+    ASSERT_NE(index->partition(partition), nullptr);
+    EXPECT_EQ(index->partition(partition)->active_slots(),
+              num_values[partition]);
+    // The values are spread roughly evenly.
+    EXPECT_GT(num_values[partition], 500 / kNumPartitions / 2);
+  }
+}
+
+TEST(PartitionedCuckooIndexTest, ParallelBuildIsSameAsSerialBuild) {
+  const ColumnPtr column = CreateColumn(/*num_values=*/500);
+  const std::unique_ptr<PartitionedCuckooIndex> serial =
+      CreateIndex(*column, /*num_partitions=*/6, /*num_threads=*/1);
+  const std::unique_ptr<PartitionedCuckooIndex> parallel =
+      CreateIndex(*column, /*num_partitions=*/6, /*num_threads=*/4);
+  EXPECT_EQ(parallel->name(), serial->name());
+  EXPECT_EQ(parallel->byte_size(), serial->byte_size());
+  for (long value = 0; value < 1000; ++value) {
+    ASSERT_EQ(parallel->GetQualifyingStripes(value, kNumStripes).ToString(),
+              serial->GetQualifyingStripes(value, kNumStripes).ToString());
+  }
+}
+
+TEST(PartitionedCuckooIndexTest, EncodeAndOpen) {
+  // Fewer values than partitions, i.e., some partitions are empty.
+  const ColumnPtr column = CreateColumn(/*num_values=*/5);
+  const std::unique_ptr<PartitionedCuckooIndex> index =
+      CreateIndex(*column, /*num_partitions=*/16, /*num_threads=*/3);
+  size_t num_empty_partitions = 0;
+  for (size_t partition = 0; partition < index->num_partitions(); ++partition)
+    num_empty_partitions += index->partition(partition) == nullptr;
+  EXPECT_GE(num_empty_partitions, 16 - 5);
+
+  const std::string encoded = index->Encode();
+  const std::unique_ptr<PartitionedCuckooIndex> opened =
+      PartitionedCuckooIndex::Open(encoded);
+  EXPECT_EQ(opened->name(), index->name());
+  EXPECT_EQ(opened->num_partitions(), index->num_partitions());
+  EXPECT_EQ(opened->byte_size(), index->byte_size());
+  EXPECT_EQ(opened->Encode(), encoded);
+  CheckPositiveLookups(*column, *opened);
+
+  // Values of empty partitions don't qualify any stripe.
+  for (long value = 100; value < 200; ++value) {
+    if (opened->partition(PartitionedCuckooIndex::GetPartition(
+            value, opened->num_partitions())) != nullptr)
+      continue;
+    EXPECT_TRUE(opened->GetQualifyingStripes(value, kNumStripes).IsAllZeroes());
+    EXPECT_EQ(opened->EstimateSelectivity(value), 0.0);
+  }
+}
+
+}  // namespace ci
@@ -0,0 +1,273 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: per_stripe_blocked_bloom.h
+// -----------------------------------------------------------------------------
+//
+// Per-stripe Bloom filters on the integer values themselves, i.e., without
+// formatting them as strings like `PerStripeBloom`. Each filter consists of
+// cache-line-sized blocks and a key only sets (and tests) bits in a single
+// block: one bit in each of the block's eight words ("split block" Bloom
+// filter). The filters of all stripes are stored in one contiguous array.
+
+#ifndef CI_PER_STRIPE_BLOCKED_BLOOM_H_
+#define CI_PER_STRIPE_BLOCKED_BLOOM_H_
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "common/memoized.h"
+#include "data.h"
+#include "evaluation_utils.h"
+#include "index_structure.h"
+
+namespace ci {
+
+class PerStripeBlockedBloom : public IndexStructure {
+ public:
+  // Number of words (and bits set per key) of a block.
+  static constexpr size_t kNumWordsPerBlock = 8;
+
+  PerStripeBlockedBloom(absl::Span<const long> data,
+                        std::size_t num_rows_per_stripe,
+                        std::size_t num_bits_per_key)
+      : PerStripeBlockedBloom(num_bits_per_key) {
+    const std::size_t num_stripes = data.size() / num_rows_per_stripe;
+    block_offsets_.reserve(num_stripes + 1);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      AddStripe(absl::MakeConstSpan(data).subspan(
+          num_rows_per_stripe * stripe_id, num_rows_per_stripe));
+    }
+  }
+
+  bool StripeContains(std::size_t stripe_id, long value) const override {
+    if (stripe_id >= num_stripes()) {
+      std::cerr << "`stripe_id` is out of bounds." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    const uint64_t hash = Hash(value);
+    return BlockContains(blocks_[GetBlockIndex(stripe_id, hash)], Probe(hash));
+  }
+
+  // Hashes `value` (and computes its bits within a block) once for all
+  // stripes.
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override {
+    CheckNumStripes(num_stripes, this->num_stripes());
+    result->Reset(num_stripes);
+    const uint64_t hash = Hash(value);
+    const Probe probe(hash);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      if (BlockContains(blocks_[GetBlockIndex(stripe_id, hash)], probe))
+        result->Set(stripe_id, true);
+    }
+  }
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override {
+    CheckNumStripes(num_stripes, this->num_stripes());
+    stripe_ids->clear();
+    const uint64_t hash = Hash(value);
+    const Probe probe(hash);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      if (BlockContains(blocks_[GetBlockIndex(stripe_id, hash)], probe))
+        stripe_ids->push_back(stripe_id);
+    }
+  }
+
+  // Hashes `value` once and only probes the filters of the candidates.
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override {
+    CheckNumStripes(candidates->bits(), this->num_stripes());
+    const uint64_t hash = Hash(value);
+    const Probe probe(hash);
+    candidates->RetainIf([&](size_t stripe_id) {
+      return BlockContains(blocks_[GetBlockIndex(stripe_id, hash)], probe);
+    });
+  }
+
+  std::string name() const override {
+    return std::string("PerStripeBlockedBloom/") +
+           std::to_string(num_bits_per_key_);
+  }
+
+  size_t byte_size() const override {
+    return blocks_.size() * sizeof(Block) +
+           block_offsets_.size() * sizeof(uint32_t);
+  }
+
+  // Compresses the blocks and their offsets on first use.
+  size_t compressed_byte_size() const override {
+    return compressed_byte_size_.Get([this]() {
+      std::string data(reinterpret_cast<const char*>(blocks_.data()),
+                       blocks_.size() * sizeof(Block));
+      data.append(reinterpret_cast<const char*>(block_offsets_.data()),
+                  block_offsets_.size() * sizeof(uint32_t));
+      return Compress(data).size();
+    });
+  }
+
+  std::size_t num_stripes() const { return block_offsets_.size() - 1; }
+
+ private:
+  friend class PerStripeBlockedBloomBuilder;
+
+  // Salts of the block bits of a key, taken from Apache Parquet's split block
+  // Bloom filter.
+  static constexpr uint32_t kSalts[kNumWordsPerBlock] = {
+      0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+      0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+  struct alignas(64) Block {
+    uint64_t words[kNumWordsPerBlock];
+  };
+
+  // The bits to set (or test) in a block, one per word.
+  struct alignas(32) Probe {
+    explicit Probe(uint64_t hash) {
+      // The lower half of the hash selects the bits, the upper one the block.
+      const uint32_t bits_hash = static_cast<uint32_t>(hash);
+      for (size_t i = 0; i < kNumWordsPerBlock; ++i)
+        mask[i] = 1ULL << ((bits_hash * kSalts[i]) >> 26);
+    }
+
+    uint64_t mask[kNumWordsPerBlock];
+  };
+
+  // Creates an empty index, stripes are added with AddStripe(..).
+  explicit PerStripeBlockedBloom(std::size_t num_bits_per_key)
+      : num_bits_per_key_(num_bits_per_key), block_offsets_({0}) {}
+
+  // Finalizer of MurmurHash3, mixing all bits of `value`.
+  static uint64_t Hash(long value) {
+    uint64_t hash = static_cast<uint64_t>(value);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  // Returns the index of the block of `hash` in the filter of `stripe_id`.
+  size_t GetBlockIndex(size_t stripe_id, uint64_t hash) const {
+    const uint64_t num_blocks =
+        block_offsets_[stripe_id + 1] - block_offsets_[stripe_id];
+    // Maps the upper half of the hash to [0, num_blocks) without a division.
+    return block_offsets_[stripe_id] + (((hash >> 32) * num_blocks) >> 32);
+  }
+
+  static bool BlockContains(const Block& block, const Probe& probe) {
+#if defined(__AVX2__)
+    const __m256i* words = reinterpret_cast<const __m256i*>(block.words);
+    const __m256i* mask = reinterpret_cast<const __m256i*>(probe.mask);
+    // testc(a, b) is 1 iff all bits of b are set in a.
+    return _mm256_testc_si256(_mm256_load_si256(words),
+                              _mm256_load_si256(mask)) &
+           _mm256_testc_si256(_mm256_load_si256(words + 1),
+                              _mm256_load_si256(mask + 1));
+#else
+    uint64_t missing = 0;
+    for (size_t i = 0; i < kNumWordsPerBlock; ++i)
+      missing |= probe.mask[i] & ~block.words[i];
+    return missing == 0;
+#endif
+  }
+
+  // Creates the filter for the next stripe.
+  void AddStripe(absl::Span<const long> stripe) {
+    absl::flat_hash_set<long> values;
+    values.reserve(stripe.size());
+    for (const long value : stripe) values.insert(value);
+
+    constexpr size_t kBitsPerBlock = kNumWordsPerBlock * 64;
+    const size_t num_blocks = std::max<size_t>(
+        1, (values.size() * num_bits_per_key_ + kBitsPerBlock - 1) /
+               kBitsPerBlock);
+    blocks_.resize(blocks_.size() + num_blocks, Block{});
+    block_offsets_.push_back(blocks_.size());
+
+    const size_t stripe_id = num_stripes() - 1;
+    for (const long value : values) {
+      const uint64_t hash = Hash(value);
+      const Probe probe(hash);
+      Block& block = blocks_[GetBlockIndex(stripe_id, hash)];
+      for (size_t i = 0; i < kNumWordsPerBlock; ++i)
+        block.words[i] |= probe.mask[i];
+    }
+  }
+
+  std::size_t num_bits_per_key_;
+  // The filters of all stripes. The one of stripe `i` consists of the blocks
+  // [block_offsets_[i], block_offsets_[i + 1]).
+  std::vector<Block> blocks_;
+  std::vector<uint32_t> block_offsets_;
+  Memoized<size_t> compressed_byte_size_;
+};
+
+// Builds a `PerStripeBlockedBloom` stripe by stripe, only keeping the filters.
+class PerStripeBlockedBloomBuilder : public IndexStructureBuilder {
+ public:
+  explicit PerStripeBlockedBloomBuilder(std::size_t num_bits_per_key)
+      // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+      : index_(absl::WrapUnique(new PerStripeBlockedBloom(num_bits_per_key))) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    index_->AddStripe(stripe);
+  }
+
+  IndexStructurePtr Finish() override { return std::move(index_); }
+
+ private:
+  std::unique_ptr<PerStripeBlockedBloom> index_;
+};
+
+class PerStripeBlockedBloomFactory : public IndexStructureFactory {
+ public:
+  explicit PerStripeBlockedBloomFactory(size_t num_bits_per_key)
+      : num_bits_per_key_(num_bits_per_key) {}
+  std::unique_ptr<IndexStructure> Create(
+      const Column& column, size_t num_rows_per_stripe) const override {
+    return absl::make_unique<PerStripeBlockedBloom>(
+        column.data(), num_rows_per_stripe, num_bits_per_key_);
+  }
+
+  IndexStructureBuilderPtr CreateBuilder() const override {
+    return absl::make_unique<PerStripeBlockedBloomBuilder>(num_bits_per_key_);
+  }
+
+  std::string index_name() const override {
+    return std::string("PerStripeBlockedBloom/") +
+           std::to_string(num_bits_per_key_);
+  }
+
+  const size_t num_bits_per_key_;
+};
+
+}  // namespace ci
+
+#endif  // CI_PER_STRIPE_BLOCKED_BLOOM_H_
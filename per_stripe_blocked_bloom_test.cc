@@ -0,0 +1,101 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: per_stripe_blocked_bloom_test.cc
+// -----------------------------------------------------------------------------
+
+#include "per_stripe_blocked_bloom.h"
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+TEST(PerStripeBlockedBloomTest, StripeContains) {
+  PerStripeBlockedBloom index(
+      /*data=*/{1, 2, 3, 4}, /*num_rows_per_stripe=*/2,
+      /*num_bits_per_key=*/10);
+
+  EXPECT_TRUE(index.StripeContains(/*stripe_id=*/0, /*value=*/1));
+  EXPECT_TRUE(index.StripeContains(/*stripe_id=*/0, /*value=*/2));
+  EXPECT_TRUE(index.StripeContains(/*stripe_id=*/1, /*value=*/3));
+  EXPECT_TRUE(index.StripeContains(/*stripe_id=*/1, /*value=*/4));
+}
+
+TEST(PerStripeBlockedBloomTest, NoFalseNegativesAndFewFalsePositives) {
+  constexpr size_t kNumRows = 100000;
+  constexpr size_t kNumRowsPerStripe = 1000;
+  std::mt19937_64 gen(42);
+  std::vector<long> data(kNumRows);
+  // Values in [0, 2^40), i.e., (almost certainly) distinct.
+  for (long& value : data) value = gen() >> 24;
+  const PerStripeBlockedBloom index(data, kNumRowsPerStripe,
+                                    /*num_bits_per_key=*/10);
+  const size_t num_stripes = kNumRows / kNumRowsPerStripe;
+  ASSERT_EQ(index.num_stripes(), num_stripes);
+
+  for (size_t row = 0; row < kNumRows; ++row)
+    ASSERT_TRUE(index.StripeContains(row / kNumRowsPerStripe, data[row]));
+
+  // Negative values aren't in the data.
+  size_t num_false_positives = 0;
+  constexpr size_t kNumProbes = 1000;
+  for (long value = -1; value >= -static_cast<long>(kNumProbes); --value)
+    num_false_positives +=
+        index.GetQualifyingStripes(value, num_stripes).GetOnesCount();
+  // One bit per word and 10 bits per key yield a false-positive rate < 2%.
+  EXPECT_LT(num_false_positives, 0.02 * kNumProbes * num_stripes);
+}
+
+TEST(PerStripeBlockedBloomTest,
+     FillQualifyingStripesAgreesWithStripeContains) {
+  PerStripeBlockedBloom index(
+      /*data=*/{1, 2, 3, 4, 1, 5}, /*num_rows_per_stripe=*/2,
+      /*num_bits_per_key=*/10);
+
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (long value = 0; value < 7; ++value) {
+    index.FillQualifyingStripes(value, /*num_stripes=*/3, &result);
+    index.FillQualifyingStripeIds(value, /*num_stripes=*/3, &stripe_ids);
+    ASSERT_EQ(result.bits(), 3);
+    std::vector<uint32_t> expected_stripe_ids;
+    for (size_t stripe_id = 0; stripe_id < 3; ++stripe_id) {
+      EXPECT_EQ(result.Get(stripe_id), index.StripeContains(stripe_id, value));
+      if (result.Get(stripe_id)) expected_stripe_ids.push_back(stripe_id);
+    }
+    EXPECT_EQ(stripe_ids, expected_stripe_ids);
+  }
+}
+
+TEST(PerStripeBlockedBloomTest, BuilderCreatesSameFilters) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5};
+  const PerStripeBlockedBloom index(data, /*num_rows_per_stripe=*/2,
+                                    /*num_bits_per_key=*/10);
+  const IndexStructureBuilderPtr builder =
+      PerStripeBlockedBloomFactory(/*num_bits_per_key=*/10).CreateBuilder();
+  for (size_t i = 0; i < data.size(); i += 2)
+    builder->AddStripe(absl::MakeConstSpan(data).subspan(i, 2));
+  const IndexStructurePtr built = builder->Finish();
+
+  EXPECT_EQ(built->byte_size(), index.byte_size());
+  for (long value = 0; value < 7; ++value) {
+    EXPECT_EQ(built->GetQualifyingStripes(value, /*num_stripes=*/3).ToString(),
+              index.GetQualifyingStripes(value, /*num_stripes=*/3).ToString());
+  }
+}
+
+}  // namespace ci
@@ -23,9 +23,15 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "common/memoized.h"
 #include "data.h"
 #include "evaluation_utils.h"
 #include "index_structure.h"
@@ -36,31 +42,51 @@ namespace ci {
 
 class PerStripeBloom : public IndexStructure {
  public:
-  PerStripeBloom(const std::vector<long>& data, std::size_t num_rows_per_stripe,
+  // The distinct values of each stripe. Kept as values rather than as the
+  // keys of LevelDB's Bloom filter (which only accepts leveldb::Slice), since
+  // the keys are only needed while building the filter of a stripe.
+  using StripeValues = std::vector<std::vector<long>>;
+
+  PerStripeBloom(absl::Span<const long> data, std::size_t num_rows_per_stripe,
                  std::size_t num_bits_per_key)
-      : num_bits_per_key_(num_bits_per_key),
-        policy_(leveldb::NewBloomFilterPolicy(num_bits_per_key_)) {
-    num_stripes_ = data.size() / num_rows_per_stripe;
-    // Pre-allocate `num_stripes_` strings to store filters.
-    filters_.resize(num_stripes_);
-    for (size_t stripe_id = 0; stripe_id < num_stripes_; ++stripe_id) {
-      const std::size_t stripe_begin = num_rows_per_stripe * stripe_id;
-      const std::size_t stripe_end = stripe_begin + num_rows_per_stripe;
-      const std::size_t num_values = stripe_end - stripe_begin;
-      // Collect values of current stripe. (LevelDB's Bloom filter only accepts
-      // leveldb::Slice.)
-      absl::flat_hash_set<std::string> string_values;
-      string_values.reserve(num_values);
-      for (size_t i = stripe_begin; i < stripe_end; ++i) {
-        string_values.insert(std::to_string(data[i]));
-      }
+      : PerStripeBloom(GetStripeValues(data, num_rows_per_stripe),
+                       num_bits_per_key) {}
+
+  // Creates the filters from values previously collected with
+  // GetStripeValues(..), e.g., to build filters with different numbers of
+  // bits per key without collecting the values again.
+  PerStripeBloom(const StripeValues& stripe_values,
+                 std::size_t num_bits_per_key)
+      : PerStripeBloom(num_bits_per_key) {
+    // Pre-allocate `num_stripes` strings to store filters.
+    filters_.reserve(stripe_values.size());
+    for (const std::vector<long>& values : stripe_values)
+      AddStripeValues(values);
+  }
 
-      // Create the filter for the current stripe.
-      const std::vector<leveldb::Slice> slices(string_values.begin(),
-                                               string_values.end());
-      policy_->CreateFilter(slices.data(), static_cast<long>(slices.size()),
-                            &filters_[stripe_id]);
+  // Returns the distinct values of each of the `data.size() /
+  // num_rows_per_stripe` stripes.
+  static StripeValues GetStripeValues(absl::Span<const long> data,
+                                      std::size_t num_rows_per_stripe) {
+    const std::size_t num_stripes = data.size() / num_rows_per_stripe;
+    StripeValues stripe_values;
+    stripe_values.reserve(num_stripes);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      stripe_values.push_back(GetDistinctValues(data.subspan(
+          num_rows_per_stripe * stripe_id, num_rows_per_stripe)));
     }
+    return stripe_values;
+  }
+
+  // Returns the size of a filter of `num_keys` keys with `num_bits_per_key`
+  // bits per key. Mirrors leveldb's BloomFilterPolicy::CreateFilter(..): the
+  // bits are rounded up to whole bytes (at least 64 bits), followed by one
+  // byte for the number of probes.
+  static std::size_t GetFilterByteSize(std::size_t num_keys,
+                                       std::size_t num_bits_per_key) {
+    const std::size_t num_bits =
+        std::max<std::size_t>(num_keys * num_bits_per_key, 64);
+    return (num_bits + 7) / 8 + 1;
   }
 
   bool StripeContains(std::size_t stripe_id, long value) const override {
@@ -73,34 +99,111 @@ class PerStripeBloom : public IndexStructure {
                                 filters_[stripe_id]);
   }
 
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override {
+    CheckNumStripes(num_stripes, num_stripes_);
+    result->Reset(num_stripes);
+    // Only convert `value` to a key once for all filters.
+    const std::string key = std::to_string(value);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      if (policy_->KeyMayMatch(key, filters_[stripe_id]))
+        result->Set(stripe_id, true);
+    }
+  }
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override {
+    CheckNumStripes(num_stripes, num_stripes_);
+    stripe_ids->clear();
+    const std::string key = std::to_string(value);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      if (policy_->KeyMayMatch(key, filters_[stripe_id]))
+        stripe_ids->push_back(stripe_id);
+    }
+  }
+
   std::string name() const override {
     return std::string("PerStripeBloom/") + std::to_string(num_bits_per_key_);
   }
 
   size_t byte_size() const override {
     std::size_t result = 0;
-    for (const std::string filter : filters_) {
+    for (const std::string& filter : filters_) {
       result += filter.size();
     }
     return result;
   }
 
+  // Compresses the concatenated filters on first use.
   size_t compressed_byte_size() const override {
-    std::string data;
-    for (const std::string& filter : filters_) {
-      absl::StrAppend(&data, filter);
-    }
+    return compressed_byte_size_.Get([this]() {
+      std::string data;
+      for (const std::string& filter : filters_) {
+        absl::StrAppend(&data, filter);
+      }
 
-    return Compress(data).size();
+      return Compress(data).size();
+    });
   }
 
   std::size_t num_stripes() { return num_stripes_; }
 
  private:
+  friend class PerStripeBloomBuilder;
+
+  // Creates an empty index, stripes are added with AddStripe(..).
+  explicit PerStripeBloom(std::size_t num_bits_per_key)
+      : num_stripes_(0),
+        num_bits_per_key_(num_bits_per_key),
+        policy_(leveldb::NewBloomFilterPolicy(num_bits_per_key_)) {}
+
+  // Returns the distinct values of `stripe`.
+  static std::vector<long> GetDistinctValues(absl::Span<const long> stripe) {
+    const absl::flat_hash_set<long> values(stripe.begin(), stripe.end());
+    return std::vector<long>(values.begin(), values.end());
+  }
+
+  // Creates the filter for the next stripe.
+  void AddStripe(absl::Span<const long> stripe) {
+    AddStripeValues(GetDistinctValues(stripe));
+  }
+
+  // Creates the filter of the next stripe's distinct `values`.
+  void AddStripeValues(absl::Span<const long> values) {
+    // Only the keys of the current stripe are materialized.
+    std::vector<std::string> keys;
+    keys.reserve(values.size());
+    for (const long value : values) keys.push_back(std::to_string(value));
+    const std::vector<leveldb::Slice> slices(keys.begin(), keys.end());
+    filters_.emplace_back();
+    policy_->CreateFilter(slices.data(), static_cast<long>(slices.size()),
+                          &filters_.back());
+    ++num_stripes_;
+  }
+
   std::size_t num_stripes_;
   std::size_t num_bits_per_key_;
   std::unique_ptr<const leveldb::FilterPolicy> policy_;
   std::vector<std::string> filters_;
+  Memoized<size_t> compressed_byte_size_;
+};
+
+// Builds a `PerStripeBloom` stripe by stripe, only keeping the filters.
+class PerStripeBloomBuilder : public IndexStructureBuilder {
+ public:
+  explicit PerStripeBloomBuilder(std::size_t num_bits_per_key)
+      // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+      : index_(absl::WrapUnique(new PerStripeBloom(num_bits_per_key))) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    index_->AddStripe(stripe);
+  }
+
+  IndexStructurePtr Finish() override { return std::move(index_); }
+
+ private:
+  std::unique_ptr<PerStripeBloom> index_;
 };
 
 class PerStripeBloomFactory : public IndexStructureFactory {
@@ -113,6 +216,10 @@ class PerStripeBloomFactory : public IndexStructureFactory {
                                              num_bits_per_key_);
   }
 
+  IndexStructureBuilderPtr CreateBuilder() const override {
+    return absl::make_unique<PerStripeBloomBuilder>(num_bits_per_key_);
+  }
+
   std::string index_name() const override {
     return std::string("PerStripeBloom/") + std::to_string(num_bits_per_key_);
   }
@@ -124,6 +231,14 @@ class PerStripeBloomFactory : public IndexStructureFactory {
 // factory in order to build a Bloom filter of a comparable compressed size.
 // This is useful, e.g. when trying to compare scan rates of filters with
 // roughly the same size.
+//
+// Instead of building a filter for every candidate number of bits per key,
+// predicts the compressed size from a model: the exact uncompressed size given
+// the distinct values per stripe (see GetFilterByteSize(..)) times a
+// compression ratio. The ratio is calibrated by building the filter the model
+// picks without compression, which is also the result unless the calibrated
+// model picks a different number of bits per key. I.e., this usually costs a
+// single Bloom build besides the other index (at most kMaxCalibrationRounds).
 class PerStripeBloomComparableSizeFactory : public IndexStructureFactory {
  public:
   explicit PerStripeBloomComparableSizeFactory(
@@ -131,41 +246,75 @@ class PerStripeBloomComparableSizeFactory : public IndexStructureFactory {
       : other_index_factory_(std::move(other_index_factory)) {}
   std::unique_ptr<IndexStructure> Create(
       const Column& column, size_t num_rows_per_stripe) const override {
-    constexpr size_t kMaxBitsPerKey = 30;
-
     IndexStructurePtr other_index =
         other_index_factory_->Create(column, num_rows_per_stripe);
     const size_t target_size = other_index->compressed_byte_size();
 
-    // Find the number of bits per key that minimizes the difference in size
-    // between the filters.
-    size_t argmin_num_bits_per_key;
+    // Collect the distinct values of all stripes only once for all
+    // candidates.
+    const PerStripeBloom::StripeValues stripe_values =
+        PerStripeBloom::GetStripeValues(column.data(), num_rows_per_stripe);
+    std::vector<size_t> num_keys;
+    num_keys.reserve(stripe_values.size());
+    for (const std::vector<long>& values : stripe_values)
+      num_keys.push_back(values.size());
+
+    // The compression ratio may depend on the number of bits per key (e.g.,
+    // the filters of stripes with the same values are identical, and small
+    // filters compress better), so re-calibrate a few times in case the
+    // calibrated model picks a filter that wasn't built yet.
+    constexpr size_t kMaxCalibrationRounds = 3;
+    std::unique_ptr<PerStripeBloom> best_index;
     size_t min_size_diff = std::numeric_limits<size_t>::max();
-    size_t min_bits = 1;
-    size_t max_bits = kMaxBitsPerKey;
-    while (min_bits <= max_bits) {
-      const size_t num_bits_per_key = (min_bits + max_bits) / 2;
-
-      auto bloom_index = absl::make_unique<PerStripeBloom>(
-          column.data(), num_rows_per_stripe, num_bits_per_key);
-      size_t abs_size_diff = target_size < bloom_index->compressed_byte_size()
-                                 ? bloom_index->compressed_byte_size() - target_size
-                                 : target_size - bloom_index->compressed_byte_size();
-
-      if (abs_size_diff < min_size_diff) {
-        min_size_diff = abs_size_diff;
-        argmin_num_bits_per_key = num_bits_per_key;
+    absl::flat_hash_set<size_t> built_num_bits_per_key;
+    size_t num_bits_per_key =
+        GetNumBitsPerKey(num_keys, target_size, /*compression_ratio=*/1.0);
+    for (size_t round = 0;
+         round < kMaxCalibrationRounds &&
+         built_num_bits_per_key.insert(num_bits_per_key).second;
+         ++round) {
+      auto bloom_index =
+          absl::make_unique<PerStripeBloom>(stripe_values, num_bits_per_key);
+      const size_t compressed_size = bloom_index->compressed_byte_size();
+      const size_t size_diff = target_size < compressed_size
+                                   ? compressed_size - target_size
+                                   : target_size - compressed_size;
+      const double compression_ratio =
+          bloom_index->byte_size() == 0
+              ? 1.0
+              : static_cast<double>(compressed_size) / bloom_index->byte_size();
+      if (size_diff < min_size_diff) {
+        min_size_diff = size_diff;
+        best_index = std::move(bloom_index);
       }
+      num_bits_per_key =
+          GetNumBitsPerKey(num_keys, target_size, compression_ratio);
+    }
+    return best_index;
+  }
 
-      if (target_size < bloom_index->compressed_byte_size()) {
-        max_bits = num_bits_per_key - 1;
-      } else {
-        min_bits = num_bits_per_key + 1;
+  // Returns the number of bits per key (in [1, kMaxBitsPerKey]) whose
+  // predicted compressed size is closest to `target_size`, given the number of
+  // distinct keys of each stripe. The prediction is the exact uncompressed
+  // size times `compression_ratio`.
+  static size_t GetNumBitsPerKey(absl::Span<const size_t> num_keys,
+                                 size_t target_size, double compression_ratio) {
+    constexpr size_t kMaxBitsPerKey = 30;
+    size_t argmin_num_bits_per_key = 1;
+    double min_size_diff = std::numeric_limits<double>::max();
+    for (size_t num_bits_per_key = 1; num_bits_per_key <= kMaxBitsPerKey;
+         ++num_bits_per_key) {
+      size_t byte_size = 0;
+      for (const size_t n : num_keys)
+        byte_size += PerStripeBloom::GetFilterByteSize(n, num_bits_per_key);
+      const double size_diff =
+          std::abs(byte_size * compression_ratio - target_size);
+      if (size_diff < min_size_diff) {
+        min_size_diff = size_diff;
+        argmin_num_bits_per_key = num_bits_per_key;
       }
     }
-
-    return absl::make_unique<PerStripeBloom>(column.data(), num_rows_per_stripe,
-                                             argmin_num_bits_per_key);
+    return argmin_num_bits_per_key;
   }
 
   std::string index_name() const override {
@@ -33,4 +33,90 @@ TEST(PerStripeBloomTest, StripeContains) {
   EXPECT_TRUE(per_stripe_bloom.StripeContains(/*stripe_id=*/1, /*value=*/4));
 }
 
+TEST(PerStripeBloomTest, FillQualifyingStripesAgreesWithStripeContains) {
+  PerStripeBloom index(
+      /*data=*/{1, 2, 3, 4}, /*num_rows_per_stripe=*/2,
+      /*num_bits_per_key=*/10);
+
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (long value = 0; value < 6; ++value) {
+    index.FillQualifyingStripes(value, /*num_stripes=*/2, &result);
+    index.FillQualifyingStripeIds(value, /*num_stripes=*/2, &stripe_ids);
+    ASSERT_EQ(result.bits(), 2);
+    std::vector<uint32_t> expected_stripe_ids;
+    for (size_t stripe_id = 0; stripe_id < 2; ++stripe_id) {
+      EXPECT_EQ(result.Get(stripe_id), index.StripeContains(stripe_id, value));
+      if (result.Get(stripe_id)) expected_stripe_ids.push_back(stripe_id);
+    }
+    EXPECT_EQ(stripe_ids, expected_stripe_ids);
+  }
+}
+
+TEST(PerStripeBloomTest, BuilderCreatesSameFilters) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5};
+  const PerStripeBloom index(data, /*num_rows_per_stripe=*/2,
+                             /*num_bits_per_key=*/10);
+  const IndexStructureBuilderPtr builder =
+      PerStripeBloomFactory(/*num_bits_per_key=*/10).CreateBuilder();
+  for (size_t i = 0; i < data.size(); i += 2)
+    builder->AddStripe(absl::MakeConstSpan(data).subspan(i, 2));
+  const IndexStructurePtr built = builder->Finish();
+
+  EXPECT_EQ(built->byte_size(), index.byte_size());
+  for (long value = 0; value < 7; ++value) {
+    EXPECT_EQ(built->GetQualifyingStripes(value, /*num_stripes=*/3).ToString(),
+              index.GetQualifyingStripes(value, /*num_stripes=*/3).ToString());
+  }
+}
+
+TEST(PerStripeBloomTest, GetFilterByteSizeMatchesFilters) {
+  std::vector<long> data;
+  for (long i = 0; i < 3000; ++i) data.push_back(i % 700);
+  const PerStripeBloom::StripeValues stripe_values =
+      PerStripeBloom::GetStripeValues(data, /*num_rows_per_stripe=*/1000);
+  ASSERT_EQ(stripe_values.size(), 3);
+
+  for (const size_t num_bits_per_key : {1, 5, 10, 30}) {
+    const PerStripeBloom index(stripe_values, num_bits_per_key);
+    size_t byte_size = 0;
+    for (const std::vector<long>& values : stripe_values) {
+      byte_size += PerStripeBloom::GetFilterByteSize(values.size(),
+                                                     num_bits_per_key);
+    }
+    EXPECT_EQ(index.byte_size(), byte_size);
+    EXPECT_EQ(index.byte_size(),
+              PerStripeBloom(data, /*num_rows_per_stripe=*/1000,
+                             num_bits_per_key)
+                  .byte_size());
+  }
+  // Small filters have at least 64 bits.
+  EXPECT_EQ(PerStripeBloom::GetFilterByteSize(/*num_keys=*/1,
+                                              /*num_bits_per_key=*/10),
+            9);
+}
+
+TEST(PerStripeBloomTest, ComparableSizeFactoryMatchesOtherBloomFilter) {
+  // Distinct values in all stripes, i.e., the filters barely compress.
+  std::vector<long> data;
+  for (long i = 0; i < 20000; ++i) data.push_back((i * 7919) % 20000);
+  ColumnPtr column = Column::IntColumn("column", data);
+  const PerStripeBloomComparableSizeFactory factory(
+      absl::make_unique<PerStripeBloomFactory>(/*num_bits_per_key=*/12));
+  IndexStructurePtr other = PerStripeBloomFactory(/*num_bits_per_key=*/12)
+                                .Create(*column, /*num_rows_per_stripe=*/1000);
+  IndexStructurePtr index =
+      factory.Create(*column, /*num_rows_per_stripe=*/1000);
+  EXPECT_EQ(index->name(), other->name());
+
+  // Stripes repeat every 5 stripes, i.e., the filters compress well.
+  for (long i = 0; i < 20000; ++i) data[i] = (i * 7919) % 5000;
+  column = Column::IntColumn("column", data);
+  other = PerStripeBloomFactory(/*num_bits_per_key=*/12)
+              .Create(*column, /*num_rows_per_stripe=*/1000);
+  index = factory.Create(*column, /*num_rows_per_stripe=*/1000);
+  EXPECT_NEAR(index->compressed_byte_size(), other->compressed_byte_size(),
+              0.1 * other->compressed_byte_size());
+}
+
 }  // namespace ci
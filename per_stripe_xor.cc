@@ -0,0 +1,254 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: per_stripe_xor.cc
+// -----------------------------------------------------------------------------
+
+#include "per_stripe_xor.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+
+namespace ci {
+namespace {
+
+// Number of stripes whose fingerprints are prefetched ahead of the probed one.
+constexpr size_t kPrefetchDistance = 8;
+
+// Number of block lengths tried for a stripe before giving up.
+constexpr size_t kMaxPopulateAttempts = 64;
+
+// Finalizer of MurmurHash3 (as used by xor_singleheader). It is a bijection,
+// so distinct values have distinct hashes.
+uint64_t Murmur64(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64_t RotateLeft(uint64_t n, unsigned int c) {
+  return (n << c) | (n >> (64 - c));
+}
+
+// Returns the block length of a filter for `num_keys` keys, i.e., a third of
+// the 1.23 * `num_keys` + 32 fingerprints of the original Xor filter.
+uint32_t GetBlockLength(size_t num_keys) {
+  const size_t capacity = 32 + (123 * num_keys + 99) / 100;
+  return static_cast<uint32_t>((capacity + 2) / 3);
+}
+
+}  // namespace
+
+PerStripeXor::Probe::Probe(long value) {
+  const uint64_t hash = Murmur64(static_cast<uint64_t>(value));
+  r0 = static_cast<uint32_t>(hash);
+  r1 = static_cast<uint32_t>(RotateLeft(hash, 21));
+  r2 = static_cast<uint32_t>(RotateLeft(hash, 42));
+  fingerprint = static_cast<uint8_t>(hash ^ (hash >> 32));
+}
+
+PerStripeXor::PerStripeXor(absl::Span<const long> data,
+                           std::size_t num_rows_per_stripe)
+    : PerStripeXor() {
+  const std::size_t num_stripes = data.size() / num_rows_per_stripe;
+  stripe_filters_.reserve(num_stripes);
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    AddStripe(absl::MakeConstSpan(data).subspan(
+        num_rows_per_stripe * stripe_id, num_rows_per_stripe));
+  }
+  Finish();
+}
+
+std::unique_ptr<PerStripeXor> PerStripeXor::Open(absl::string_view data) {
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  std::unique_ptr<PerStripeXor> index = absl::WrapUnique(new PerStripeXor());
+  index->Init(data);
+  return index;
+}
+
+std::unique_ptr<PerStripeXor> PerStripeXor::OpenFile(const std::string& path) {
+  MappedFilePtr mapped_file = MappedFile::Open(path);
+  std::unique_ptr<PerStripeXor> index = Open(mapped_file->data());
+  index->mapped_file_ = std::move(mapped_file);
+  return index;
+}
+
+void PerStripeXor::FillQualifyingStripes(long value, size_t num_stripes,
+                                         Bitmap64* result) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  result->Reset(num_stripes);
+  const Probe probe(value);
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    if (stripe_id + kPrefetchDistance < num_stripes)
+      PrefetchFilter(GetFilter(stripe_id + kPrefetchDistance), probe);
+    if (FilterContains(GetFilter(stripe_id), probe))
+      result->Set(stripe_id, true);
+  }
+}
+
+void PerStripeXor::FillQualifyingStripeIds(
+    long value, size_t num_stripes, std::vector<uint32_t>* stripe_ids) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  stripe_ids->clear();
+  const Probe probe(value);
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    if (stripe_id + kPrefetchDistance < num_stripes)
+      PrefetchFilter(GetFilter(stripe_id + kPrefetchDistance), probe);
+    if (FilterContains(GetFilter(stripe_id), probe))
+      stripe_ids->push_back(stripe_id);
+  }
+}
+
+void PerStripeXor::AddStripe(absl::Span<const long> stripe) {
+  absl::flat_hash_set<long> values;
+  values.reserve(stripe.size());
+  for (const long value : stripe) values.insert(value);
+  std::vector<Probe> probes;
+  probes.reserve(values.size());
+  for (const long value : values) probes.emplace_back(value);
+
+  // Stripes without values get a filter of zero fingerprints, which only
+  // matches with the false positive probability.
+  uint32_t block_length = probes.empty() ? 1 : GetBlockLength(probes.size());
+  const size_t offset = stripe_fingerprints_.size();
+  for (size_t attempt = 0;; ++attempt, ++block_length) {
+    if (attempt == kMaxPopulateAttempts) {
+      std::cerr << "Couldn't populate Xor filter." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (offset + 3 * size_t{block_length} >
+        std::numeric_limits<uint32_t>::max()) {
+      std::cerr << "Xor filters exceed 4 GiB." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    stripe_fingerprints_.resize(offset + 3 * block_length);
+    if (PopulateFilter(probes, block_length,
+                       stripe_fingerprints_.data() + offset))
+      break;
+  }
+  stripe_filters_.push_back({static_cast<uint32_t>(offset), block_length});
+}
+
+void PerStripeXor::Finish() {
+  const uint32_t num_stripes = stripe_filters_.size();
+  data_.reserve(sizeof(num_stripes) +
+                stripe_filters_.size() * sizeof(StripeFilter) +
+                stripe_fingerprints_.size());
+  data_.append(reinterpret_cast<const char*>(&num_stripes),
+               sizeof(num_stripes));
+  data_.append(reinterpret_cast<const char*>(stripe_filters_.data()),
+               stripe_filters_.size() * sizeof(StripeFilter));
+  data_.append(reinterpret_cast<const char*>(stripe_fingerprints_.data()),
+               stripe_fingerprints_.size());
+  // Free the build state.
+  std::vector<StripeFilter>().swap(stripe_filters_);
+  std::vector<uint8_t>().swap(stripe_fingerprints_);
+  Init(data_);
+}
+
+void PerStripeXor::Init(absl::string_view encoded) {
+  uint32_t num_stripes;
+  if (encoded.size() < sizeof(num_stripes)) {
+    std::cerr << "Invalid PerStripeXor encoding." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::memcpy(&num_stripes, encoded.data(), sizeof(num_stripes));
+  const size_t filters_size = num_stripes * sizeof(StripeFilter);
+  if (encoded.size() < sizeof(num_stripes) + filters_size) {
+    std::cerr << "Invalid PerStripeXor encoding." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  num_stripes_ = num_stripes;
+  filters_ = encoded.data() + sizeof(num_stripes);
+  fingerprints_ = reinterpret_cast<const uint8_t*>(filters_ + filters_size);
+  encoded_ = encoded;
+  // Lookups don't check bounds, so reject filters reaching beyond the
+  // fingerprints.
+  const size_t fingerprints_size =
+      encoded.size() - sizeof(num_stripes) - filters_size;
+  for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+    const StripeFilter filter = GetFilter(stripe_id);
+    if (filter.block_length == 0 ||
+        size_t{filter.offset} + 3 * size_t{filter.block_length} >
+            fingerprints_size) {
+      std::cerr << "Invalid PerStripeXor encoding." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+bool PerStripeXor::PopulateFilter(absl::Span<const Probe> probes,
+                                  uint32_t block_length,
+                                  uint8_t* fingerprints) {
+  const size_t num_fingerprints = 3 * size_t{block_length};
+  auto get_positions = [block_length](const Probe& probe, uint32_t* positions) {
+    positions[0] = Reduce(probe.r0, block_length);
+    positions[1] = Reduce(probe.r1, block_length) + block_length;
+    positions[2] = Reduce(probe.r2, block_length) + 2 * block_length;
+  };
+
+  // Per position: the number of keys mapped to it and the xor of their ids.
+  std::vector<uint32_t> counts(num_fingerprints, 0);
+  std::vector<uint32_t> key_xors(num_fingerprints, 0);
+  uint32_t positions[3];
+  for (uint32_t key = 0; key < probes.size(); ++key) {
+    get_positions(probes[key], positions);
+    for (const uint32_t position : positions) {
+      ++counts[position];
+      key_xors[position] ^= key;
+    }
+  }
+
+  // Peel keys off positions that only they are mapped to.
+  std::vector<uint32_t> queue;
+  for (uint32_t position = 0; position < num_fingerprints; ++position)
+    if (counts[position] == 1) queue.push_back(position);
+  // The peeled keys and their positions.
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  stack.reserve(probes.size());
+  while (!queue.empty()) {
+    const uint32_t position = queue.back();
+    queue.pop_back();
+    if (counts[position] != 1) continue;
+    const uint32_t key = key_xors[position];
+    stack.emplace_back(key, position);
+    get_positions(probes[key], positions);
+    for (const uint32_t other : positions) {
+      key_xors[other] ^= key;
+      if (--counts[other] == 1) queue.push_back(other);
+    }
+  }
+  if (stack.size() != probes.size()) return false;
+
+  // Assign the fingerprints in reverse peeling order: a key's position isn't
+  // used by any of the keys assigned after it.
+  std::fill(fingerprints, fingerprints + num_fingerprints, 0);
+  for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+    const Probe& probe = probes[it->first];
+    get_positions(probe, positions);
+    fingerprints[it->second] = probe.fingerprint ^ fingerprints[positions[0]] ^
+                               fingerprints[positions[1]] ^
+                               fingerprints[positions[2]];
+  }
+  return true;
+}
+
+}  // namespace ci
@@ -19,70 +19,201 @@
 #ifndef CI_PER_STRIPE_XOR_H_
 #define CI_PER_STRIPE_XOR_H_
 
-#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
 
-#include "absl/strings/str_cat.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/mapped_file.h"
+#include "common/memoized.h"
 #include "data.h"
 #include "evaluation_utils.h"
 #include "index_structure.h"
-#include "xor_filter.h"
 
 namespace ci {
 
-// Creates one Xor8 filter per stripe.
+// Creates one Xor filter with 8-bit fingerprints per stripe (~10 bits per
+// distinct value, false positive probability of ~0.4%, see xor_filter.h).
+//
+// All filters are packed into a single buffer, which also is the on-disk
+// format (see Encode()):
+//   uint32 num_stripes
+//   {uint32 offset, uint32 block_length} per stripe
+//   uint8 fingerprints of all stripes, the ones of stripe `i` starting at
+//   its `offset` and spanning 3 * `block_length` bytes.
+// Unlike the original Xor filter, the filters don't have seeds: a key is
+// hashed once and its three positions in each filter only depend on that
+// filter's block length. Stripes whose keys can't be placed are retried with
+// a larger block length.
 class PerStripeXor : public IndexStructure {
  public:
-  PerStripeXor(const std::vector<long>& data, std::size_t num_rows_per_stripe) {
-    num_stripes_ = data.size() / num_rows_per_stripe;
-    filters_.reserve(num_stripes_);
-    for (size_t stripe_id = 0; stripe_id < num_stripes_; ++stripe_id) {
-      const std::size_t stripe_begin = num_rows_per_stripe * stripe_id;
-      const std::size_t stripe_end = stripe_begin + num_rows_per_stripe;
-      const std::size_t num_values = stripe_end - stripe_begin;
-      // Collect values of current stripe.
-      absl::flat_hash_set<uint64_t> values;
-      values.reserve(num_values);
-      for (size_t i = stripe_begin; i < stripe_end; ++i) values.insert(data[i]);
-
-      // Create the filter for the current stripe.
-      const std::vector<uint64_t> keys(values.begin(), values.end());
-      filters_.push_back(absl::make_unique<Xor8>(keys));
-    }
-  }
+  PerStripeXor(absl::Span<const long> data, std::size_t num_rows_per_stripe);
+
+  // Opens the filters from bytes previously returned by Encode(). `data` is
+  // *not* copied and needs to outlive the returned index.
+  static std::unique_ptr<PerStripeXor> Open(absl::string_view data);
+
+  // Like Open(..), but memory-maps the file at `path`. The mapping is owned by
+  // the returned index.
+  static std::unique_ptr<PerStripeXor> OpenFile(const std::string& path);
 
   bool StripeContains(std::size_t stripe_id, long value) const override {
     if (stripe_id >= num_stripes_) {
       std::cerr << "`stripe_id` is out of bounds." << std::endl;
       exit(EXIT_FAILURE);
     }
-    // Probe corresponding filter.
-    return filters_[stripe_id]->Contains(value);
+    return FilterContains(GetFilter(stripe_id), Probe(value));
+  }
+
+  // Hashes `value` once and probes the filters of all stripes in a single
+  // pass, prefetching the fingerprints a few stripes ahead.
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override;
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override;
+
+  // Hashes `value` once and only probes the filters of the candidates.
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override {
+    CheckNumStripes(candidates->bits(), num_stripes_);
+    const Probe probe(value);
+    candidates->RetainIf([&](size_t stripe_id) {
+      return FilterContains(GetFilter(stripe_id), probe);
+    });
   }
 
   std::string name() const override { return std::string("PerStripeXor"); }
 
-  size_t byte_size() const override {
-    size_t result = 0;
-    for (size_t i = 0; i < filters_.size(); ++i)
-      result += filters_[i]->SizeInBytes();
-    return result;
-  }
+  size_t byte_size() const override { return encoded_.size(); }
 
+  // Compresses the encoding on first use.
   size_t compressed_byte_size() const override {
-    std::string data;
-    for (size_t i = 0; i < filters_.size(); ++i)
-      absl::StrAppend(&data, filters_[i]->Data());
-    return Compress(data).size();
+    return compressed_byte_size_.Get(
+        [this]() { return Compress(encoded_).size(); });
   }
 
-  std::size_t num_stripes() { return num_stripes_; }
+  // Returns the on-disk format of the filters which can be passed to Open(..).
+  std::string Encode() const { return std::string(encoded_); }
+
+  std::size_t num_stripes() const { return num_stripes_; }
 
  private:
+  friend class PerStripeXorBuilder;
+
+  // The filter of a stripe, as stored in the encoding.
+  struct StripeFilter {
+    // Offset of the fingerprints in the fingerprints section.
+    uint32_t offset;
+    // Number of fingerprints per block.
+    uint32_t block_length;
+  };
+
+  // The hash of a value, computed once for all stripes.
+  struct Probe {
+    explicit Probe(long value);
+
+    // Projections of the hash onto the three blocks of a filter.
+    uint32_t r0;
+    uint32_t r1;
+    uint32_t r2;
+    uint8_t fingerprint;
+  };
+
+  // Creates an empty index, stripes are added with AddStripe(..) and the
+  // encoding is created by Finish().
+  PerStripeXor() : num_stripes_(0), filters_(nullptr), fingerprints_(nullptr) {}
+
+  // Creates the filter for the next stripe.
+  void AddStripe(absl::Span<const long> stripe);
+
+  // Lays out all added filters in `data_`.
+  void Finish();
+
+  // Points the members below at `encoded`.
+  void Init(absl::string_view encoded);
+
+  // Sets the 3 * `block_length` `fingerprints` so that the filter contains
+  // all `probes`. Returns false if the keys can't be placed, i.e., if the
+  // filter needs to be retried with another block length.
+  static bool PopulateFilter(absl::Span<const Probe> probes,
+                             uint32_t block_length, uint8_t* fingerprints);
+
+  // Maps `hash` to [0, `n`) without a division.
+  static uint32_t Reduce(uint32_t hash, uint32_t n) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(hash) * n) >> 32);
+  }
+
+  // The encoding may not be aligned, so the filters are copied out of it.
+  StripeFilter GetFilter(size_t stripe_id) const {
+    StripeFilter filter;
+    std::memcpy(&filter, filters_ + stripe_id * sizeof(StripeFilter),
+                sizeof(StripeFilter));
+    return filter;
+  }
+
+  bool FilterContains(const StripeFilter& filter, const Probe& probe) const {
+    const uint8_t* fingerprints = fingerprints_ + filter.offset;
+    const uint32_t block_length = filter.block_length;
+    const uint8_t f =
+        fingerprints[Reduce(probe.r0, block_length)] ^
+        fingerprints[Reduce(probe.r1, block_length) + block_length] ^
+        fingerprints[Reduce(probe.r2, block_length) + 2 * block_length];
+    return f == probe.fingerprint;
+  }
+
+  void PrefetchFilter(const StripeFilter& filter, const Probe& probe) const {
+    const uint8_t* fingerprints = fingerprints_ + filter.offset;
+    const uint32_t block_length = filter.block_length;
+    __builtin_prefetch(fingerprints + Reduce(probe.r0, block_length));
+    __builtin_prefetch(fingerprints + Reduce(probe.r1, block_length) +
+                       block_length);
+    __builtin_prefetch(fingerprints + Reduce(probe.r2, block_length) +
+                       2 * block_length);
+  }
+
   std::size_t num_stripes_;
-  std::vector<std::unique_ptr<Xor8>> filters_;
+  // Point into `encoded_`.
+  const char* filters_;
+  const uint8_t* fingerprints_;
+
+  // Only used while adding stripes.
+  std::vector<StripeFilter> stripe_filters_;
+  std::vector<uint8_t> stripe_fingerprints_;
+
+  // The encoding, held in `data_` for created indexes and by the caller or
+  // `mapped_file_` for opened ones.
+  std::string data_;
+  absl::string_view encoded_;
+  MappedFilePtr mapped_file_;
+
+  Memoized<size_t> compressed_byte_size_;
+};
+
+// Builds a `PerStripeXor` stripe by stripe, only keeping the filters.
+class PerStripeXorBuilder : public IndexStructureBuilder {
+ public:
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  PerStripeXorBuilder() : index_(absl::WrapUnique(new PerStripeXor())) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    index_->AddStripe(stripe);
+  }
+
+  IndexStructurePtr Finish() override {
+    index_->Finish();
+    return std::move(index_);
+  }
+
+ private:
+  std::unique_ptr<PerStripeXor> index_;
 };
 
 class PerStripeXorFactory : public IndexStructureFactory {
@@ -93,6 +224,10 @@ class PerStripeXorFactory : public IndexStructureFactory {
     return absl::make_unique<PerStripeXor>(column.data(), num_rows_per_stripe);
   }
 
+  IndexStructureBuilderPtr CreateBuilder() const override {
+    return absl::make_unique<PerStripeXorBuilder>();
+  }
+
   std::string index_name() const override {
     return std::string("PerStripeXor");
   }
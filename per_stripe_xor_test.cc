@@ -18,6 +18,10 @@
 
 #include "per_stripe_xor.h"
 
+#include <cstdio>
+#include <fstream>
+#include <random>
+
 #include "gtest/gtest.h"
 
 namespace ci {
@@ -31,4 +35,118 @@ TEST(PerStripeXorTest, StripeContains) {
   EXPECT_TRUE(per_stripe_xor.StripeContains(/*stripe_id=*/1, /*value=*/4));
 }
 
+TEST(PerStripeXorTest, FillQualifyingStripesAgreesWithStripeContains) {
+  PerStripeXor index(/*data=*/{1, 2, 3, 4}, /*num_rows_per_stripe=*/2);
+
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (long value = 0; value < 6; ++value) {
+    index.FillQualifyingStripes(value, /*num_stripes=*/2, &result);
+    index.FillQualifyingStripeIds(value, /*num_stripes=*/2, &stripe_ids);
+    ASSERT_EQ(result.bits(), 2);
+    std::vector<uint32_t> expected_stripe_ids;
+    for (size_t stripe_id = 0; stripe_id < 2; ++stripe_id) {
+      EXPECT_EQ(result.Get(stripe_id), index.StripeContains(stripe_id, value));
+      if (result.Get(stripe_id)) expected_stripe_ids.push_back(stripe_id);
+    }
+    EXPECT_EQ(stripe_ids, expected_stripe_ids);
+  }
+}
+
+TEST(PerStripeXorTest, BuilderCreatesSameFilters) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5};
+  const PerStripeXor index(data, /*num_rows_per_stripe=*/2);
+  const IndexStructureBuilderPtr builder =
+      PerStripeXorFactory().CreateBuilder();
+  for (size_t i = 0; i < data.size(); i += 2)
+    builder->AddStripe(absl::MakeConstSpan(data).subspan(i, 2));
+  const IndexStructurePtr built = builder->Finish();
+
+  EXPECT_EQ(built->byte_size(), index.byte_size());
+  for (long value = 0; value < 7; ++value) {
+    EXPECT_EQ(built->GetQualifyingStripes(value, /*num_stripes=*/3).ToString(),
+              index.GetQualifyingStripes(value, /*num_stripes=*/3).ToString());
+  }
+}
+
+TEST(PerStripeXorTest, NoFalseNegativesAndFewFalsePositives) {
+  constexpr size_t kNumRows = 100000;
+  constexpr size_t kNumRowsPerStripe = 1000;
+  std::mt19937_64 gen(42);
+  std::vector<long> data(kNumRows);
+  // Values in [0, 2^40), i.e., (almost certainly) distinct.
+  for (long& value : data) value = gen() >> 24;
+  const PerStripeXor index(data, kNumRowsPerStripe);
+  const size_t num_stripes = kNumRows / kNumRowsPerStripe;
+  ASSERT_EQ(index.num_stripes(), num_stripes);
+
+  Bitmap64 result;
+  for (size_t row = 0; row < kNumRows; ++row) {
+    ASSERT_TRUE(index.StripeContains(row / kNumRowsPerStripe, data[row]));
+    index.FillQualifyingStripes(data[row], num_stripes, &result);
+    ASSERT_TRUE(result.Get(row / kNumRowsPerStripe));
+  }
+
+  // Negative values aren't in the data.
+  size_t num_false_positives = 0;
+  constexpr size_t kNumProbes = 1000;
+  for (long value = -1; value >= -static_cast<long>(kNumProbes); --value)
+    num_false_positives +=
+        index.GetQualifyingStripes(value, num_stripes).GetOnesCount();
+  // 8-bit fingerprints yield a false positive probability of 1/256.
+  EXPECT_LT(num_false_positives, 0.01 * kNumProbes * num_stripes);
+}
+
+TEST(PerStripeXorTest, EmptyStripes) {
+  const IndexStructureBuilderPtr builder =
+      PerStripeXorFactory().CreateBuilder();
+  const std::vector<long> stripe = {1, 2};
+  builder->AddStripe({});
+  builder->AddStripe(stripe);
+  builder->AddStripe({});
+  const IndexStructurePtr index = builder->Finish();
+  EXPECT_TRUE(index->StripeContains(/*stripe_id=*/1, /*value=*/1));
+  EXPECT_TRUE(index->StripeContains(/*stripe_id=*/1, /*value=*/2));
+}
+
+TEST(PerStripeXorTest, Open) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5, 6, 7};
+  const PerStripeXor index(data, /*num_rows_per_stripe=*/2);
+  const std::string encoded = index.Encode();
+  const std::unique_ptr<PerStripeXor> opened = PerStripeXor::Open(encoded);
+  EXPECT_EQ(opened->num_stripes(), index.num_stripes());
+  EXPECT_EQ(opened->byte_size(), index.byte_size());
+  EXPECT_EQ(opened->Encode(), encoded);
+  for (long value = 0; value < 9; ++value) {
+    EXPECT_EQ(opened->GetQualifyingStripes(value, /*num_stripes=*/4).ToString(),
+              index.GetQualifyingStripes(value, /*num_stripes=*/4).ToString());
+  }
+}
+
+TEST(PerStripeXorTest, OpenRejectsFiltersBeyondFingerprints) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5, 6, 7};
+  const std::string encoded =
+      PerStripeXor(data, /*num_rows_per_stripe=*/2).Encode();
+  // Drop the last fingerprint, so that the last stripe's filter is truncated.
+  EXPECT_DEATH(PerStripeXor::Open(
+                   absl::string_view(encoded).substr(0, encoded.size() - 1)),
+               "Invalid PerStripeXor encoding");
+}
+
+TEST(PerStripeXorTest, OpenFile) {
+  const std::vector<long> data = {1, 2, 3, 4, 2, 5, 6, 7};
+  const PerStripeXor index(data, /*num_rows_per_stripe=*/2);
+  const std::string path = ::testing::TempDir() + "/per_stripe_xor_open_file";
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << index.Encode();
+  }
+
+  const std::unique_ptr<PerStripeXor> opened = PerStripeXor::OpenFile(path);
+  EXPECT_EQ(opened->byte_size(), index.byte_size());
+  for (size_t row = 0; row < data.size(); ++row)
+    EXPECT_TRUE(opened->StripeContains(row / 2, data[row]));
+  std::remove(path.c_str());
+}
+
 }  // namespace ci
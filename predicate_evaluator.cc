@@ -0,0 +1,77 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: predicate_evaluator.cc
+// -----------------------------------------------------------------------------
+
+#include "predicate_evaluator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+
+namespace ci {
+
+std::vector<size_t> PredicateEvaluator::GetEvaluationOrder(
+    absl::Span<const EqualityPredicate> conjuncts) const {
+  std::vector<double> selectivities;
+  selectivities.reserve(conjuncts.size());
+  for (const EqualityPredicate& conjunct : conjuncts) {
+    selectivities.push_back(
+        GetIndex(conjunct.column_name).EstimateSelectivity(conjunct.value));
+  }
+  std::vector<size_t> order(conjuncts.size());
+  std::iota(order.begin(), order.end(), 0);
+  // Keeps the given order for equal (e.g., unknown) selectivities.
+  std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+    return selectivities[lhs] < selectivities[rhs];
+  });
+  return order;
+}
+
+Bitmap64 PredicateEvaluator::Evaluate(
+    absl::Span<const EqualityPredicate> conjuncts,
+    size_t* num_evaluated) const {
+  const std::vector<size_t> order = GetEvaluationOrder(conjuncts);
+  Bitmap64 candidates(/*size=*/num_stripes_);
+  size_t i = 0;
+  if (order.empty()) {
+    candidates = Bitmap64(/*size=*/num_stripes_, /*fill_value=*/true);
+  } else {
+    const EqualityPredicate& first = conjuncts[order[0]];
+    GetIndex(first.column_name)
+        .FillQualifyingStripes(first.value, num_stripes_, &candidates);
+    for (i = 1; i < order.size() && !candidates.IsAllZeroes(); ++i) {
+      const EqualityPredicate& conjunct = conjuncts[order[i]];
+      GetIndex(conjunct.column_name)
+          .FilterQualifyingStripes(conjunct.value, &candidates);
+    }
+  }
+  if (num_evaluated != nullptr) *num_evaluated = i;
+  return candidates;
+}
+
+const IndexStructure& PredicateEvaluator::GetIndex(
+    const std::string& column_name) const {
+  const auto it = indexes_->find(column_name);
+  if (it == indexes_->end()) {
+    std::cerr << "No index for column " << column_name << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return *it->second;
+}
+
+}  // namespace ci
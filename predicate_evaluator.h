@@ -0,0 +1,74 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: predicate_evaluator.h
+// -----------------------------------------------------------------------------
+//
+// Evaluates conjunctions of equality predicates on multiple columns of a table
+// using one index per column.
+
+#ifndef CUCKOO_INDEX_PREDICATE_EVALUATOR_H_
+#define CUCKOO_INDEX_PREDICATE_EVALUATOR_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "common/bitmap.h"
+#include "table_indexer.h"
+
+namespace ci {
+
+// The predicate `column_name` = `value`.
+struct EqualityPredicate {
+  std::string column_name;
+  long value;
+};
+
+// Returns the stripes possibly qualifying for all conjuncts. The conjuncts are
+// evaluated in the order of their estimated selectivities (see
+// IndexStructure::EstimateSelectivity(..)), most selective first, and each
+// index only probes the stripes that qualified for all previous ones (see
+// IndexStructure::FilterQualifyingStripes(..)). The evaluation stops once no
+// stripe is left.
+class PredicateEvaluator {
+ public:
+  // `indexes` must contain an index of each column referenced by the
+  // conjuncts and outlive the evaluator.
+  PredicateEvaluator(const ColumnIndexes* indexes, size_t num_stripes)
+      : indexes_(indexes), num_stripes_(num_stripes) {}
+
+  // Returns the indices of `conjuncts` in the order they are evaluated in.
+  std::vector<size_t> GetEvaluationOrder(
+      absl::Span<const EqualityPredicate> conjuncts) const;
+
+  // Returns a bitmap of `num_stripes` bits indicating the stripes that
+  // possibly qualify for all `conjuncts` (i.e., all stripes for no
+  // conjuncts). If `num_evaluated` is given, sets it to the number of
+  // conjuncts looked up before the result was known.
+  Bitmap64 Evaluate(absl::Span<const EqualityPredicate> conjuncts,
+                    size_t* num_evaluated = nullptr) const;
+
+ private:
+  const IndexStructure& GetIndex(const std::string& column_name) const;
+
+  const ColumnIndexes* indexes_;
+  const size_t num_stripes_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_PREDICATE_EVALUATOR_H_
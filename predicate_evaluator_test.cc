@@ -0,0 +1,135 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: predicate_evaluator_test.cc
+// -----------------------------------------------------------------------------
+
+#include "predicate_evaluator.h"
+
+#include "absl/memory/memory.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+#include "zone_map.h"
+
+namespace ci {
+
+constexpr size_t kNumRowsPerStripe = 10;
+constexpr size_t kNumStripes = 100;
+
+// Creates a CuckooIndex for each of the columns:
+// - "dense": values 1..10, each in all stripes.
+// - "sparse": values 1..1000, each in a single stripe.
+// - "clustered": values 1..10, each in 10 consecutive stripes.
+ColumnIndexes CreateIndexes() {
+  std::vector<long> dense, sparse, clustered;
+  for (size_t row = 0; row < kNumStripes * kNumRowsPerStripe; ++row) {
+    dense.push_back(row % 10 + 1);
+    sparse.push_back(row + 1);
+    clustered.push_back(row / (10 * kNumRowsPerStripe) + 1);
+  }
+  const CuckooIndexFactory factory(
+      CuckooAlgorithm::SKEWED_KICKING, kMaxLoadFactor2SlotsPerBucket,
+      /*scan_rate=*/0.01, /*slots_per_bucket=*/2,
+      /*prefix_bits_optimization=*/false);
+  ColumnIndexes indexes;
+  indexes["dense"] = factory.Create(*Column::IntColumn("dense", dense),
+                                    kNumRowsPerStripe);
+  indexes["sparse"] = factory.Create(*Column::IntColumn("sparse", sparse),
+                                     kNumRowsPerStripe);
+  indexes["clustered"] = factory.Create(
+      *Column::IntColumn("clustered", clustered), kNumRowsPerStripe);
+  return indexes;
+}
+
+TEST(PredicateEvaluatorTest, ReturnsIntersectionOfConjuncts) {
+  const ColumnIndexes indexes = CreateIndexes();
+  const PredicateEvaluator evaluator(&indexes, kNumStripes);
+  for (long value = 1; value <= 10; ++value) {
+    const std::vector<EqualityPredicate> conjuncts = {
+        {"dense", value}, {"clustered", value}, {"sparse", 100 * value - 5}};
+    Bitmap64 expected(/*size=*/kNumStripes, /*fill_value=*/true);
+    for (const EqualityPredicate& conjunct : conjuncts) {
+      expected &= indexes.at(conjunct.column_name)
+                      ->GetQualifyingStripes(conjunct.value, kNumStripes);
+    }
+    EXPECT_EQ(evaluator.Evaluate(conjuncts).ToString(), expected.ToString());
+    // Row 100 * value - 6 is in stripe 10 * value - 1.
+    EXPECT_TRUE(evaluator.Evaluate(conjuncts).Get(10 * value - 1));
+  }
+}
+
+TEST(PredicateEvaluatorTest, NoConjunctsQualifyAllStripes) {
+  const ColumnIndexes indexes = CreateIndexes();
+  const PredicateEvaluator evaluator(&indexes, kNumStripes);
+  size_t num_evaluated;
+  EXPECT_TRUE(evaluator.Evaluate({}, &num_evaluated).IsAllOnes());
+  EXPECT_EQ(num_evaluated, 0);
+}
+
+TEST(PredicateEvaluatorTest, EvaluatesMostSelectiveFirst) {
+  const ColumnIndexes indexes = CreateIndexes();
+  const PredicateEvaluator evaluator(&indexes, kNumStripes);
+  EXPECT_LT(indexes.at("sparse")->EstimateSelectivity(1),
+            indexes.at("clustered")->EstimateSelectivity(1));
+  EXPECT_LT(indexes.at("clustered")->EstimateSelectivity(1),
+            indexes.at("dense")->EstimateSelectivity(1));
+  EXPECT_EQ(evaluator.GetEvaluationOrder(
+                {{"dense", 1}, {"clustered", 1}, {"sparse", 1}}),
+            std::vector<size_t>({2, 1, 0}));
+  // The order of conjuncts with the same estimate is kept.
+  EXPECT_EQ(evaluator.GetEvaluationOrder({{"dense", 2}, {"dense", 1}}),
+            std::vector<size_t>({0, 1}));
+}
+
+TEST(PredicateEvaluatorTest, StopsOnceNoStripeIsLeft) {
+  const ColumnIndexes indexes = CreateIndexes();
+  const PredicateEvaluator evaluator(&indexes, kNumStripes);
+  size_t num_evaluated;
+  // Sparse value 1 is in stripe 0, clustered value 5 in stripes 40 to 49.
+  EXPECT_TRUE(evaluator
+                  .Evaluate({{"dense", 1}, {"clustered", 5}, {"sparse", 1}},
+                            &num_evaluated)
+                  .IsAllZeroes());
+  EXPECT_EQ(num_evaluated, 2);
+  // A value that isn't found is evaluated first (skipping absent values that
+  // collide with the fingerprint of a present one).
+  long absent_value = 1001;
+  while (indexes.at("sparse")->EstimateSelectivity(absent_value) > 0.0)
+    ++absent_value;
+  EXPECT_TRUE(
+      evaluator
+          .Evaluate({{"dense", 1}, {"sparse", absent_value}}, &num_evaluated)
+          .IsAllZeroes());
+  EXPECT_EQ(num_evaluated, 1);
+}
+
+TEST(PredicateEvaluatorTest, SupportsIndexesWithoutEstimates) {
+  ColumnIndexes indexes = CreateIndexes();
+  std::vector<long> data;
+  for (size_t row = 0; row < kNumStripes * kNumRowsPerStripe; ++row)
+    data.push_back(row + 1);
+  indexes["zone_map"] = absl::make_unique<ZoneMap>(data, kNumRowsPerStripe);
+  const PredicateEvaluator evaluator(&indexes, kNumStripes);
+  EXPECT_EQ(
+      evaluator.GetEvaluationOrder({{"zone_map", 15}, {"clustered", 1}}),
+      std::vector<size_t>({1, 0}));
+  const Bitmap64 result =
+      evaluator.Evaluate({{"zone_map", 15}, {"clustered", 1}});
+  EXPECT_EQ(result.GetOnesCount(), 1);
+  EXPECT_TRUE(result.Get(1));
+}
+
+}  // namespace ci
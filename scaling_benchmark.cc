@@ -0,0 +1,229 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: scaling_benchmark.cc
+// -----------------------------------------------------------------------------
+//
+// Standard scaling suite: sweeps synthetic columns (see data_generators.h) over
+// the distributions, numbers of rows, cardinalities and stripe sizes given by
+// the flags and reports for every `IndexStructure` its build time, the latency
+// of positive and negative lookups, the scan rate of negative lookups and its
+// size. Columns are streamed stripe by stripe into the indexes' builders, i.e.,
+// are never materialized as a whole (indexes whose factories don't implement
+// CreateBuilder() still buffer the rows, see BufferingIndexStructureBuilder).
+//
+// To run the benchmark run:
+// bazel run -c opt --cxxopt='-std=c++17' --dynamic_mode=off :scaling_benchmark
+// -- --distributions=ZIPF,CLUSTERED --num_rows=1000000000
+// --num_unique_values=1000000 --num_threads=16
+//
+// add --benchmark_format=csv --undefok=benchmark_format to output in the CSV
+// format.
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
+#include "benchmark/benchmark.h"
+#include "common/bitmap.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "data_generators.h"
+#include "index_structure.h"
+#include "per_stripe_bloom.h"
+#include "per_stripe_xor.h"
+
+ABSL_FLAG(std::vector<std::string>, distributions,
+          std::vector<std::string>({"UNIFORM", "ZIPF", "CLUSTERED"}),
+          "Comma-separated list of distributions (see ci::DataDistribution).");
+ABSL_FLAG(std::vector<std::string>, num_rows,
+          std::vector<std::string>({"1000000", "10000000"}),
+          "Comma-separated list of numbers of rows.");
+ABSL_FLAG(std::vector<std::string>, num_unique_values,
+          std::vector<std::string>({"1000", "100000"}),
+          "Comma-separated list of cardinalities.");
+ABSL_FLAG(std::vector<std::string>, num_rows_per_stripe,
+          std::vector<std::string>({"8192", "65536"}),
+          "Comma-separated list of stripe sizes.");
+ABSL_FLAG(double, zipf_exponent, 1.0, "Exponent of the ZIPF distribution.");
+ABSL_FLAG(long, num_threads, 1,
+          "Number of threads generating the data (and collecting the stripe "
+          "bitmaps of the CuckooIndex).");
+ABSL_FLAG(long, num_lookups, 10000,
+          "Number of positive and of negative lookups per index.");
+
+// Parses the numbers of `flag` or exits.
+std::vector<size_t> ParseNumbers(const std::vector<std::string>& flag) {
+  std::vector<size_t> numbers;
+  for (const std::string& value : flag) {
+    size_t number;
+    if (!absl::SimpleAtoi(value, &number) || number == 0) {
+      std::cerr << "Invalid number: " << value << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    numbers.push_back(number);
+  }
+  return numbers;
+}
+
+// Returns the average latency of looking up all `values` in nanoseconds and
+// adds the number of qualifying stripes to `num_qualifying_stripes`.
+double TimeLookups(const ci::IndexStructure& index,
+                   absl::Span<const long> values, size_t num_stripes,
+                   size_t* num_qualifying_stripes) {
+  ci::Bitmap64 result;
+  const auto start = std::chrono::steady_clock::now();
+  for (const long value : values) {
+    index.FillQualifyingStripes(value, num_stripes, &result);
+    *num_qualifying_stripes += result.GetOnesCount();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         values.size();
+}
+
+// The benchmark's time is the build time of the index, including generating
+// the data (which is reported separately as "GenerateTime" in seconds).
+void BM_Scaling(const ci::DataGenerator& generator,
+                const ci::IndexStructureFactory& factory,
+                size_t num_rows_per_stripe, size_t num_threads,
+                size_t num_lookups, benchmark::State& state) {
+  ci::IndexStructurePtr index;
+  for (auto _ : state) {
+    // Destroys the previous index first to not run out of memory.
+    index.reset();
+    const ci::IndexStructureBuilderPtr builder = factory.CreateBuilder();
+    generator.ForEachStripe(
+        num_rows_per_stripe, num_threads,
+        [&](size_t /*stripe_id*/, absl::Span<const long> stripe) {
+          builder->AddStripe(stripe);
+        });
+    index = builder->Finish();
+    benchmark::DoNotOptimize(index);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  long checksum = 0;
+  generator.ForEachStripe(num_rows_per_stripe, num_threads,
+                          [&](size_t /*stripe_id*/,
+                              absl::Span<const long> stripe) {
+                            checksum += stripe[0];
+                          });
+  benchmark::DoNotOptimize(checksum);
+  state.counters["GenerateTime"] = std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count();
+
+  const size_t num_rows = generator.options().num_rows;
+  const size_t num_stripes = num_rows / num_rows_per_stripe;
+  if (num_stripes == 0) return;
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> d_row(
+      0, num_stripes * num_rows_per_stripe - 1);
+  std::vector<long> positive_values, negative_values;
+  for (size_t i = 0; i < num_lookups; ++i) {
+    positive_values.push_back(generator.GetValue(d_row(gen)));
+    negative_values.push_back(generator.GetAbsentValue(i));
+  }
+  size_t num_positive_stripes = 0, num_negative_stripes = 0;
+  state.counters["PositiveLookupNs"] = TimeLookups(
+      *index, positive_values, num_stripes, &num_positive_stripes);
+  state.counters["NegativeLookupNs"] = TimeLookups(
+      *index, negative_values, num_stripes, &num_negative_stripes);
+  state.counters["NegativeScanRate"] =
+      static_cast<double>(num_negative_stripes) / (num_lookups * num_stripes);
+
+  state.counters["ByteSize"] =
+      benchmark::Counter(index->byte_size(), benchmark::Counter::kDefaults,
+                         benchmark::Counter::kIs1024);
+  state.counters["CompressedByteSize"] = benchmark::Counter(
+      index->compressed_byte_size(), benchmark::Counter::kDefaults,
+      benchmark::Counter::kIs1024);
+  state.counters["BitsPerRow"] =
+      static_cast<double>(index->byte_size()) * 8 / num_rows;
+}
+
+long main(long argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+
+  const size_t num_threads = absl::GetFlag(FLAGS_num_threads);
+  const size_t num_lookups = absl::GetFlag(FLAGS_num_lookups);
+
+  // Define the data.
+  std::vector<std::unique_ptr<ci::DataGenerator>> generators;
+  for (const std::string& name : absl::GetFlag(FLAGS_distributions)) {
+    ci::DataGeneratorOptions options;
+    if (!ci::ParseDataDistribution(name, &options.distribution)) {
+      std::cerr << "Invalid distribution: " << name << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    options.zipf_exponent = absl::GetFlag(FLAGS_zipf_exponent);
+    for (const size_t num_rows : ParseNumbers(absl::GetFlag(FLAGS_num_rows))) {
+      for (const size_t num_unique_values :
+           ParseNumbers(absl::GetFlag(FLAGS_num_unique_values))) {
+        options.num_rows = num_rows;
+        options.num_unique_values = num_unique_values;
+        generators.push_back(absl::make_unique<ci::DataGenerator>(options));
+      }
+    }
+  }
+  const std::vector<size_t> stripe_sizes =
+      ParseNumbers(absl::GetFlag(FLAGS_num_rows_per_stripe));
+
+  std::vector<std::unique_ptr<ci::IndexStructureFactory>> index_factories;
+  index_factories.push_back(absl::make_unique<ci::CuckooIndexFactory>(
+      ci::CuckooAlgorithm::SKEWED_KICKING, ci::kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.01, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false, /*fingerprint_directory=*/0,
+      ci::HashingScheme::SEEDED_CITY64, num_threads));
+  index_factories.push_back(
+      absl::make_unique<ci::PerStripeBloomFactory>(/*num_bits_per_key=*/10));
+  index_factories.push_back(absl::make_unique<ci::PerStripeXorFactory>());
+
+  // Set up the benchmarks.
+  for (const std::unique_ptr<ci::DataGenerator>& generator : generators) {
+    for (const size_t num_rows_per_stripe : stripe_sizes) {
+      for (const std::unique_ptr<ci::IndexStructureFactory>& factory :
+           index_factories) {
+        const std::string benchmark_name =
+            absl::StrFormat(/*format=*/"Scaling/%s/%d/%s", generator->name(),
+                            num_rows_per_stripe, factory->index_name());
+        ::benchmark::RegisterBenchmark(
+            benchmark_name.c_str(),
+            [&generator, &factory, num_rows_per_stripe, num_threads,
+             num_lookups](::benchmark::State& st) -> void {
+              BM_Scaling(*generator, *factory, num_rows_per_stripe,
+                         num_threads, num_lookups, st);
+            })
+            ->Iterations(1)
+            ->Unit(benchmark::kMillisecond);
+      }
+    }
+  }
+
+  ::benchmark::Initialize(&argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,420 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: slot_bitmaps.cc
+// -----------------------------------------------------------------------------
+
+#include "slot_bitmaps.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "common/byte_coding.h"
+
+namespace ci {
+namespace {
+
+size_t GetNumWords(size_t num_bits) { return (num_bits + 63) / 64; }
+
+// All bitmaps concatenated to a single RleBitmap. The encoding is the one of
+// the RleBitmap, i.e., the same as before the other backends existed.
+class RleSlotBitmaps : public SlotBitmaps {
+ public:
+  RleSlotBitmaps(size_t num_stripes, RleBitmapPtr bitmap)
+      : SlotBitmaps(num_stripes), bitmap_(std::move(bitmap)) {}
+
+  SlotBitmapEncoding encoding() const override {
+    return SlotBitmapEncoding::RLE;
+  }
+
+  absl::string_view data() const override { return bitmap_->data(); }
+
+  bool Get(size_t slot, size_t stripe_id) const override {
+    return bitmap_->Get(num_stripes_ * slot + stripe_id);
+  }
+
+  void ExtractInto(size_t slot, size_t size, Bitmap64* result) const override {
+    bitmap_->ExtractInto(/*offset=*/num_stripes_ * slot, size, result);
+  }
+
+  void TrueBitIndices(size_t slot, size_t size,
+                      std::vector<uint32_t>* indices) const override {
+    bitmap_->TrueBitIndicesInRange(/*offset=*/num_stripes_ * slot, size,
+                                   indices);
+  }
+
+  void IntersectInto(size_t slot, Bitmap64* candidates) const override {
+    bitmap_->IntersectInto(/*offset=*/num_stripes_ * slot, candidates);
+  }
+
+  size_t GetOnesCount(size_t slot) const override {
+    return bitmap_->GetOnesCountInRange(/*offset=*/num_stripes_ * slot,
+                                        num_stripes_);
+  }
+
+  // Scans the encoding only once (see RleBitmap::ExtractUnionInto(..)).
+  void ExtractUnionInto(absl::Span<const size_t> slots,
+                        Bitmap64* result) const override {
+    std::vector<size_t> offsets;
+    offsets.reserve(slots.size());
+    for (const size_t slot : slots) offsets.push_back(num_stripes_ * slot);
+    bitmap_->ExtractUnionInto(offsets, /*size=*/num_stripes_, result);
+  }
+
+ private:
+  const RleBitmapPtr bitmap_;
+};
+
+// Each bitmap padded to whole words, stored as raw little-endian words (which
+// may not be aligned in the encoding and are accessed through Bitmap64Views).
+class DenseSlotBitmaps : public SlotBitmaps {
+ public:
+  // The encoding is either owned (`data`) or external (`encoded`).
+  DenseSlotBitmaps(size_t num_stripes, std::string data,
+                   absl::string_view encoded)
+      : SlotBitmaps(num_stripes),
+        num_words_per_slot_(GetNumWords(num_stripes)),
+        data_(std::move(data)),
+        encoded_(data_.empty() ? encoded : absl::string_view(data_)) {}
+
+  SlotBitmapEncoding encoding() const override {
+    return SlotBitmapEncoding::DENSE;
+  }
+
+  absl::string_view data() const override { return encoded_; }
+
+  bool Get(size_t slot, size_t stripe_id) const override {
+    return (GetWord(slot, stripe_id / 64) >> (stripe_id % 64)) & 1ULL;
+  }
+
+  void ExtractInto(size_t slot, size_t size, Bitmap64* result) const override {
+    result->Assign(GetBitmap(slot, size));
+  }
+
+  void TrueBitIndices(size_t slot, size_t size,
+                      std::vector<uint32_t>* indices) const override {
+    indices->clear();
+    GetBitmap(slot, size).ForEachSetBit(
+        [&](size_t stripe_id) { indices->push_back(stripe_id); });
+  }
+
+  void IntersectInto(size_t slot, Bitmap64* candidates) const override {
+    candidates->And(GetBitmap(slot, candidates->bits()));
+  }
+
+  size_t GetOnesCount(size_t slot) const override {
+    return GetBitmap(slot, num_stripes_).GetOnesCount();
+  }
+
+  void ExtractUnionInto(absl::Span<const size_t> slots,
+                        Bitmap64* result) const override {
+    result->Reset(num_stripes_);
+    for (const size_t slot : slots) result->Or(GetBitmap(slot, num_stripes_));
+  }
+
+ private:
+  uint64_t GetWord(size_t slot, size_t word_idx) const {
+    return internal::LoadWord(encoded_.data(),
+                              num_words_per_slot_ * slot + word_idx);
+  }
+
+  // Returns a view of the first `size` bits of the bitmap of `slot`.
+  Bitmap64View GetBitmap(size_t slot, size_t size) const {
+    return Bitmap64View(
+        encoded_.data() + sizeof(uint64_t) * num_words_per_slot_ * slot, size);
+  }
+
+  const size_t num_words_per_slot_;
+  const std::string data_;
+  const absl::string_view encoded_;
+};
+
+// One Roaring bitmap per slot. Encoded as the number of slots (varint32),
+// followed by the portable serialization of each bitmap (as string).
+class RoaringSlotBitmaps : public SlotBitmaps {
+ public:
+  // The encoding is either owned (`data`) or external (`encoded`).
+  RoaringSlotBitmaps(size_t num_stripes, std::vector<Roaring> bitmaps,
+                     std::string data, absl::string_view encoded)
+      : SlotBitmaps(num_stripes),
+        bitmaps_(std::move(bitmaps)),
+        data_(std::move(data)),
+        encoded_(data_.empty() ? encoded : absl::string_view(data_)) {}
+
+  SlotBitmapEncoding encoding() const override {
+    return SlotBitmapEncoding::ROARING;
+  }
+
+  absl::string_view data() const override { return encoded_; }
+
+  bool Get(size_t slot, size_t stripe_id) const override {
+    return bitmaps_[slot].contains(stripe_id);
+  }
+
+  void ExtractInto(size_t slot, size_t size, Bitmap64* result) const override {
+    result->Reset(size);
+    for (const uint32_t stripe_id : bitmaps_[slot]) {
+      if (stripe_id >= size) break;
+      result->Set(stripe_id, true);
+    }
+  }
+
+  void TrueBitIndices(size_t slot, size_t size,
+                      std::vector<uint32_t>* indices) const override {
+    indices->clear();
+    for (const uint32_t stripe_id : bitmaps_[slot]) {
+      if (stripe_id >= size) break;
+      indices->push_back(stripe_id);
+    }
+  }
+
+  void IntersectInto(size_t slot, Bitmap64* candidates) const override {
+    const Roaring& bitmap = bitmaps_[slot];
+    candidates->RetainIf(
+        [&](size_t stripe_id) { return bitmap.contains(stripe_id); });
+  }
+
+  size_t GetOnesCount(size_t slot) const override {
+    return bitmaps_[slot].cardinality();
+  }
+
+  Roaring ToRoaring(size_t slot) const override { return bitmaps_[slot]; }
+
+ private:
+  const std::vector<Roaring> bitmaps_;
+  const std::string data_;
+  const absl::string_view encoded_;
+};
+
+}  // namespace
+
+SlotBitmapsPtr SlotBitmaps::Decode(SlotBitmapEncoding encoding,
+                                   size_t num_stripes,
+                                   absl::string_view data) {
+  switch (encoding) {
+    case SlotBitmapEncoding::RLE:
+      return absl::make_unique<RleSlotBitmaps>(num_stripes,
+                                               RleBitmap::Decode(data));
+    case SlotBitmapEncoding::DENSE:
+      return absl::make_unique<DenseSlotBitmaps>(num_stripes,
+                                                 /*data=*/std::string(), data);
+    case SlotBitmapEncoding::ROARING: {
+      const absl::Span<const char> span =
+          absl::MakeConstSpan(data.data(), data.size());
+      size_t pos = 0;
+      std::vector<Roaring> bitmaps(GetVarint32(span, &pos));
+      for (Roaring& bitmap : bitmaps) {
+        const absl::string_view serialized = GetString(span, &pos);
+        bitmap = Roaring::readSafe(serialized.data(), serialized.size());
+      }
+      assert(pos == data.size());
+      return absl::make_unique<RoaringSlotBitmaps>(
+          num_stripes, std::move(bitmaps), /*data=*/std::string(), data);
+    }
+    case SlotBitmapEncoding::ADAPTIVE:
+      break;
+  }
+  std::cerr << "Invalid slot bitmap encoding." << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+std::string CompressedSlotBitmaps::Encode(const SlotBitmaps& slot_bitmaps,
+                                          size_t num_slots,
+                                          size_t chunk_size) {
+  const size_t num_stripes = slot_bitmaps.num_stripes();
+  const size_t num_slots_per_chunk = std::max<size_t>(
+      1, chunk_size * 8 / std::max<size_t>(num_stripes, 1));
+  std::vector<std::string> chunks;
+  std::vector<uint32_t> stripe_ids;
+  for (size_t first = 0; first < num_slots; first += num_slots_per_chunk) {
+    SlotBitmapsBuilder builder(slot_bitmaps.encoding(), num_stripes);
+    for (size_t slot = first;
+         slot < std::min(first + num_slots_per_chunk, num_slots); ++slot) {
+      slot_bitmaps.TrueBitIndices(slot, num_stripes, &stripe_ids);
+      builder.AddSlot(stripe_ids);
+    }
+    chunks.emplace_back(builder.Build()->data());
+  }
+
+  ByteBuffer header;
+  PutVarint32(static_cast<uint32_t>(slot_bitmaps.encoding()), &header);
+  PutVarint32(num_slots_per_chunk, &header);
+  return absl::StrCat(absl::string_view(header.data(), header.pos()),
+                      EncodeCompressedChunks(chunks));
+}
+
+CompressedSlotBitmaps::CompressedSlotBitmaps(size_t num_stripes,
+                                             absl::string_view data,
+                                             size_t max_cached_chunks)
+    : SlotBitmaps(num_stripes), encoded_(data) {
+  const absl::Span<const char> span =
+      absl::MakeConstSpan(data.data(), data.size());
+  size_t pos = 0;
+  encoding_ = static_cast<SlotBitmapEncoding>(GetVarint32(span, &pos));
+  num_slots_per_chunk_ = GetVarint32(span, &pos);
+  const SlotBitmapEncoding encoding = encoding_;
+  chunks_ = absl::make_unique<ChunkCache<Chunk>>(
+      data.substr(pos), max_cached_chunks,
+      [encoding, num_stripes](std::string uncompressed) {
+        // Decode from the final location of the bytes, since the bitmaps may
+        // point into them.
+        std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+        chunk->data = std::move(uncompressed);
+        chunk->bitmaps =
+            SlotBitmaps::Decode(encoding, num_stripes, chunk->data);
+        return std::shared_ptr<const Chunk>(std::move(chunk));
+      });
+}
+
+bool CompressedSlotBitmaps::Get(size_t slot, size_t stripe_id) const {
+  return GetChunk(slot)->bitmaps->Get(slot % num_slots_per_chunk_, stripe_id);
+}
+
+void CompressedSlotBitmaps::ExtractInto(size_t slot, size_t size,
+                                        Bitmap64* result) const {
+  GetChunk(slot)->bitmaps->ExtractInto(slot % num_slots_per_chunk_, size,
+                                       result);
+}
+
+void CompressedSlotBitmaps::TrueBitIndices(
+    size_t slot, size_t size, std::vector<uint32_t>* indices) const {
+  GetChunk(slot)->bitmaps->TrueBitIndices(slot % num_slots_per_chunk_, size,
+                                          indices);
+}
+
+void CompressedSlotBitmaps::IntersectInto(size_t slot,
+                                          Bitmap64* candidates) const {
+  GetChunk(slot)->bitmaps->IntersectInto(slot % num_slots_per_chunk_,
+                                         candidates);
+}
+
+size_t CompressedSlotBitmaps::GetOnesCount(size_t slot) const {
+  return GetChunk(slot)->bitmaps->GetOnesCount(slot % num_slots_per_chunk_);
+}
+
+void CompressedSlotBitmaps::ExtractUnionInto(absl::Span<const size_t> slots,
+                                             Bitmap64* result) const {
+  result->Reset(num_stripes_);
+  Bitmap64 chunk_union;
+  std::vector<size_t> chunk_slots;
+  // The slots are sorted, i.e., the ones of a chunk are consecutive.
+  for (size_t i = 0; i < slots.size();) {
+    const size_t chunk_idx = slots[i] / num_slots_per_chunk_;
+    chunk_slots.clear();
+    for (; i < slots.size() && slots[i] / num_slots_per_chunk_ == chunk_idx;
+         ++i)
+      chunk_slots.push_back(slots[i] % num_slots_per_chunk_);
+    GetChunk(slots[i - 1])->bitmaps->ExtractUnionInto(chunk_slots,
+                                                      &chunk_union);
+    result->Or(chunk_union.view());
+  }
+}
+
+Roaring CompressedSlotBitmaps::ToRoaring(size_t slot) const {
+  return GetChunk(slot)->bitmaps->ToRoaring(slot % num_slots_per_chunk_);
+}
+
+void SlotBitmaps::ExtractUnionInto(absl::Span<const size_t> slots,
+                                   Bitmap64* result) const {
+  result->Reset(num_stripes_);
+  Bitmap64 bitmap;
+  for (const size_t slot : slots) {
+    if (result->IsAllOnes()) break;
+    ExtractInto(slot, num_stripes_, &bitmap);
+    *result |= bitmap;
+  }
+}
+
+Roaring SlotBitmaps::ToRoaring(size_t slot) const {
+  std::vector<uint32_t> indices;
+  TrueBitIndices(slot, num_stripes_, &indices);
+  return Roaring(indices.size(), indices.data());
+}
+
+SlotBitmapEncoding ChooseSlotBitmapEncoding(size_t num_bits, size_t num_ones,
+                                            size_t num_one_fills) {
+  if (num_ones == 0) return SlotBitmapEncoding::RLE;
+  const double density = static_cast<double>(num_ones) / num_bits;
+  const double clustering = static_cast<double>(num_ones) / num_one_fills;
+  if (clustering >= 8.0) return SlotBitmapEncoding::RLE;
+  if (density >= 1.0 / 16) return SlotBitmapEncoding::DENSE;
+  return SlotBitmapEncoding::ROARING;
+}
+
+SlotBitmapsBuilder::SlotBitmapsBuilder(SlotBitmapEncoding encoding,
+                                       size_t num_stripes)
+    : encoding_(encoding), num_stripes_(num_stripes) {
+  if (encoding_ == SlotBitmapEncoding::ADAPTIVE) {
+    std::cerr << "ADAPTIVE needs to be resolved before building slot bitmaps."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void SlotBitmapsBuilder::AddSlot(absl::Span<const uint32_t> stripe_ids) {
+  switch (encoding_) {
+    case SlotBitmapEncoding::RLE:
+      rle_builder_.AddTrueBitIndices(stripe_ids, num_stripes_);
+      break;
+    case SlotBitmapEncoding::DENSE: {
+      const size_t first_word = words_.size();
+      words_.resize(first_word + GetNumWords(num_stripes_), 0);
+      for (const uint32_t stripe_id : stripe_ids)
+        words_[first_word + stripe_id / 64] |= 1ULL << (stripe_id % 64);
+      break;
+    }
+    case SlotBitmapEncoding::ROARING:
+      roarings_.emplace_back(stripe_ids.size(), stripe_ids.data());
+      roarings_.back().runOptimize();
+      roarings_.back().shrinkToFit();
+      break;
+    case SlotBitmapEncoding::ADAPTIVE:
+      break;
+  }
+}
+
+SlotBitmapsPtr SlotBitmapsBuilder::Build() {
+  switch (encoding_) {
+    case SlotBitmapEncoding::DENSE: {
+      std::string data(reinterpret_cast<const char*>(words_.data()),
+                       words_.size() * sizeof(uint64_t));
+      return absl::make_unique<DenseSlotBitmaps>(num_stripes_, std::move(data),
+                                                 /*encoded=*/"");
+    }
+    case SlotBitmapEncoding::ROARING: {
+      ByteBuffer buffer;
+      PutVarint32(roarings_.size(), &buffer);
+      std::string serialized;
+      for (const Roaring& bitmap : roarings_) {
+        serialized.resize(bitmap.getSizeInBytes(/*portable=*/true));
+        bitmap.write(&serialized[0], /*portable=*/true);
+        PutString(serialized, &buffer);
+      }
+      return absl::make_unique<RoaringSlotBitmaps>(
+          num_stripes_, std::move(roarings_),
+          std::string(buffer.data(), buffer.pos()), /*encoded=*/"");
+    }
+    default:
+      return absl::make_unique<RleSlotBitmaps>(num_stripes_,
+                                               rle_builder_.Build());
+  }
+}
+
+}  // namespace ci
@@ -0,0 +1,206 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: slot_bitmaps.h
+// -----------------------------------------------------------------------------
+//
+// Storage backends for the stripe bitmaps of the (active) slots of a
+// CuckooIndex, i.e., one bitmap of `num_stripes` bits per slot.
+
+#ifndef CUCKOO_INDEX_SLOT_BITMAPS_H_
+#define CUCKOO_INDEX_SLOT_BITMAPS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/bitmap.h"
+#include "common/rle_bitmap.h"
+#include "compressed_chunks.h"
+#include "roaring.hh"
+
+namespace ci {
+
+// How the slot bitmaps are stored:
+// - RLE: all bitmaps concatenated to a single RleBitmap. The smallest encoding
+//   for clustered bitmaps, but extracting long ranges steps over every run.
+// - DENSE: uncompressed, each bitmap padded to whole 64-bit words, i.e., slices
+//   are copied a word at a time.
+// - ROARING: one Roaring bitmap per slot. Roaring picks the container (array,
+//   bitset or runs) per 2^16 stripes, so that each bitmap gets the encoding
+//   that suits its own density and clustering.
+// - ADAPTIVE: only valid when building, chooses one of the above based on the
+//   density and clustering of all bitmaps (see ChooseSlotBitmapEncoding(..)).
+//
+// The values are stored in encodings, so don't change existing ones.
+enum class SlotBitmapEncoding { RLE, DENSE, ROARING, ADAPTIVE };
+
+class SlotBitmaps;
+using SlotBitmapsPtr = std::unique_ptr<SlotBitmaps>;
+
+class SlotBitmaps {
+ public:
+  explicit SlotBitmaps(size_t num_stripes) : num_stripes_(num_stripes) {}
+  virtual ~SlotBitmaps() {}
+
+  // Decodes slot bitmaps from bytes previously returned by data() of the given
+  // `encoding`. Does *not* copy `data` (except for ROARING), i.e., its
+  // lifetime must be longer than the lifetime of the returned bitmaps.
+  static SlotBitmapsPtr Decode(SlotBitmapEncoding encoding, size_t num_stripes,
+                               absl::string_view data);
+
+  virtual SlotBitmapEncoding encoding() const = 0;
+
+  // Returns the encoding which can be passed to Decode(..).
+  virtual absl::string_view data() const = 0;
+
+  // Returns bit `stripe_id` of the bitmap of `slot`.
+  virtual bool Get(size_t slot, size_t stripe_id) const = 0;
+
+  // Writes the first `size` bits of the bitmap of `slot` to the caller-owned
+  // `result` (which is reset first).
+  virtual void ExtractInto(size_t slot, size_t size,
+                           Bitmap64* result) const = 0;
+
+  // Sets `indices` to the sorted set bits among the first `size` bits of the
+  // bitmap of `slot`.
+  virtual void TrueBitIndices(size_t slot, size_t size,
+                              std::vector<uint32_t>* indices) const = 0;
+
+  // Unsets the bits of `candidates` (of at most `num_stripes()` bits) that are
+  // unset in the bitmap of `slot`, i.e., ANDs the bitmap of `slot` into
+  // `candidates` without materializing it.
+  virtual void IntersectInto(size_t slot, Bitmap64* candidates) const = 0;
+
+  // Returns the number of set bits of the bitmap of `slot`.
+  virtual size_t GetOnesCount(size_t slot) const = 0;
+
+  // Sets `result` to the union (bitwise OR) of the bitmaps of the sorted and
+  // distinct `slots`.
+  virtual void ExtractUnionInto(absl::Span<const size_t> slots,
+                                Bitmap64* result) const;
+
+  // Returns the bitmap of `slot` as Roaring bitmap, e.g., for combining it with
+  // other Roaring bitmaps. Doesn't convert anything for ROARING.
+  virtual Roaring ToRoaring(size_t slot) const;
+
+  size_t num_stripes() const { return num_stripes_; }
+
+ protected:
+  const size_t num_stripes_;
+};
+
+// Slot bitmaps split into chunks of consecutive slots, each encoded like the
+// original bitmaps and compressed on its own (see compressed_chunks.h). Only
+// decompresses (and decodes) the chunks of the accessed slots, of which the
+// most recently used ones are cached. The encoding (which is data()) is:
+//   varint32 encoding of the chunks, varint32 num_slots_per_chunk
+//   the compressed chunks
+class CompressedSlotBitmaps : public SlotBitmaps {
+ public:
+  // Returns the `num_slots` bitmaps of `slot_bitmaps` in chunks of about
+  // `chunk_size` (uncompressed) bitmap bytes, i.e., of at least one slot.
+  static std::string Encode(const SlotBitmaps& slot_bitmaps, size_t num_slots,
+                            size_t chunk_size);
+
+  // Opens bitmaps previously returned by Encode(..), caching up to
+  // `max_cached_chunks` decompressed chunks. Does *not* copy `data`, i.e., its
+  // lifetime must be longer than the lifetime of the returned bitmaps.
+  CompressedSlotBitmaps(size_t num_stripes, absl::string_view data,
+                        size_t max_cached_chunks);
+
+  // Returns the encoding of the chunks.
+  SlotBitmapEncoding encoding() const override { return encoding_; }
+
+  absl::string_view data() const override { return encoded_; }
+
+  bool Get(size_t slot, size_t stripe_id) const override;
+
+  void ExtractInto(size_t slot, size_t size, Bitmap64* result) const override;
+
+  void TrueBitIndices(size_t slot, size_t size,
+                      std::vector<uint32_t>* indices) const override;
+
+  void IntersectInto(size_t slot, Bitmap64* candidates) const override;
+
+  size_t GetOnesCount(size_t slot) const override;
+
+  // Decompresses each chunk of the `slots` once.
+  void ExtractUnionInto(absl::Span<const size_t> slots,
+                        Bitmap64* result) const override;
+
+  Roaring ToRoaring(size_t slot) const override;
+
+  size_t num_slots_per_chunk() const { return num_slots_per_chunk_; }
+
+  // Returns the number of chunks decompressed so far (i.e., cache misses).
+  size_t num_decompressed_chunks() const { return chunks_->misses(); }
+
+ private:
+  // The decompressed encoding of a chunk and its bitmaps decoded from it.
+  struct Chunk {
+    std::string data;
+    SlotBitmapsPtr bitmaps;
+  };
+
+  std::shared_ptr<const Chunk> GetChunk(size_t slot) const {
+    return chunks_->Get(slot / num_slots_per_chunk_);
+  }
+
+  const absl::string_view encoded_;
+  SlotBitmapEncoding encoding_;
+  size_t num_slots_per_chunk_;
+  std::unique_ptr<ChunkCache<Chunk>> chunks_;
+};
+
+// Returns the encoding ADAPTIVE resolves to for bitmaps of `num_bits` bits in
+// total with `num_ones` set bits, forming `num_one_fills` 1-fills (i.e., runs
+// of consecutive 1s):
+// - DENSE if the bitmaps are dense (>= 1/16 of the bits set) without long
+//   1-fills, since Roaring arrays would need more than a bit per stripe.
+// - RLE if the 1-fills are long (on average >= 8 bits).
+// - ROARING otherwise.
+SlotBitmapEncoding ChooseSlotBitmapEncoding(size_t num_bits, size_t num_ones,
+                                            size_t num_one_fills);
+
+// Builds slot bitmaps of `num_stripes` bits a slot at a time.
+class SlotBitmapsBuilder {
+ public:
+  // `encoding` must not be ADAPTIVE.
+  SlotBitmapsBuilder(SlotBitmapEncoding encoding, size_t num_stripes);
+
+  // Appends the bitmap of the next slot, in which (only) the sorted
+  // `stripe_ids` are set.
+  void AddSlot(absl::Span<const uint32_t> stripe_ids);
+
+  // Returns the bitmaps of all added slots. May only be called once.
+  SlotBitmapsPtr Build();
+
+ private:
+  const SlotBitmapEncoding encoding_;
+  const size_t num_stripes_;
+  // Only the one of `encoding_` is used.
+  RleBitmapBuilder rle_builder_;
+  std::vector<uint64_t> words_;
+  std::vector<Roaring> roarings_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_SLOT_BITMAPS_H_
@@ -0,0 +1,165 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: slot_bitmaps_test.cc
+// -----------------------------------------------------------------------------
+
+#include "slot_bitmaps.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace ci {
+
+constexpr size_t kNumSlots = 50;
+// Not a multiple of 64 to also cover partial words.
+constexpr size_t kNumStripes = 150;
+
+// Returns the stripe ids of `kNumSlots` random slot bitmaps of varying
+// densities.
+std::vector<std::vector<uint32_t>> CreateSlots() {
+  std::mt19937 gen(42);
+  std::vector<std::vector<uint32_t>> slots(kNumSlots);
+  for (size_t slot = 0; slot < kNumSlots; ++slot) {
+    std::bernoulli_distribution d(static_cast<double>(slot) / kNumSlots);
+    for (uint32_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id) {
+      if (d(gen)) slots[slot].push_back(stripe_id);
+    }
+  }
+  return slots;
+}
+
+void CheckSlotBitmaps(const std::vector<std::vector<uint32_t>>& slots,
+                      const SlotBitmaps& bitmaps) {
+  Bitmap64 bitmap;
+  std::vector<uint32_t> indices;
+  for (size_t slot = 0; slot < slots.size(); ++slot) {
+    Bitmap64 expected(/*size=*/kNumStripes);
+    for (const uint32_t stripe_id : slots[slot]) expected.Set(stripe_id, true);
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; ++stripe_id)
+      ASSERT_EQ(bitmaps.Get(slot, stripe_id), expected.Get(stripe_id));
+
+    bitmaps.ExtractInto(slot, kNumStripes, &bitmap);
+    ASSERT_EQ(bitmap.ToString(), expected.ToString());
+    bitmaps.TrueBitIndices(slot, kNumStripes, &indices);
+    ASSERT_EQ(indices, slots[slot]);
+
+    // Prefixes of the bitmaps.
+    bitmaps.ExtractInto(slot, /*size=*/70, &bitmap);
+    ASSERT_EQ(bitmap.bits(), 70);
+    ASSERT_EQ(bitmap.GetOnesCount(), expected.GetOnesCountBeforeLimit(70));
+    bitmaps.TrueBitIndices(slot, /*size=*/70, &indices);
+    ASSERT_EQ(indices.size(), expected.GetOnesCountBeforeLimit(70));
+
+    ASSERT_EQ(bitmaps.GetOnesCount(slot), slots[slot].size());
+
+    // Intersections with every third stripe and with a prefix of stripes.
+    Bitmap64 candidates(/*size=*/kNumStripes);
+    for (size_t stripe_id = 0; stripe_id < kNumStripes; stripe_id += 3)
+      candidates.Set(stripe_id, true);
+    Bitmap64 expected_intersection = candidates;
+    expected_intersection &= expected;
+    bitmaps.IntersectInto(slot, &candidates);
+    ASSERT_EQ(candidates.ToString(), expected_intersection.ToString());
+    candidates = Bitmap64(/*size=*/70, /*fill_value=*/true);
+    bitmaps.IntersectInto(slot, &candidates);
+    ASSERT_EQ(candidates.GetOnesCount(), expected.GetOnesCountBeforeLimit(70));
+
+    const Roaring roaring = bitmaps.ToRoaring(slot);
+    ASSERT_EQ(roaring.cardinality(), slots[slot].size());
+    for (const uint32_t stripe_id : slots[slot])
+      ASSERT_TRUE(roaring.contains(stripe_id));
+  }
+
+  const std::vector<size_t> union_slots = {1, 7, 8, 20};
+  Bitmap64 expected(/*size=*/kNumStripes);
+  for (const size_t slot : union_slots) {
+    for (const uint32_t stripe_id : slots[slot]) expected.Set(stripe_id, true);
+  }
+  bitmaps.ExtractUnionInto(union_slots, &bitmap);
+  EXPECT_EQ(bitmap.ToString(), expected.ToString());
+}
+
+TEST(SlotBitmapsTest, AllEncodings) {
+  const std::vector<std::vector<uint32_t>> slots = CreateSlots();
+  for (const SlotBitmapEncoding encoding :
+       {SlotBitmapEncoding::RLE, SlotBitmapEncoding::DENSE,
+        SlotBitmapEncoding::ROARING}) {
+    SlotBitmapsBuilder builder(encoding, kNumStripes);
+    for (const std::vector<uint32_t>& stripe_ids : slots)
+      builder.AddSlot(stripe_ids);
+    const SlotBitmapsPtr bitmaps = builder.Build();
+    EXPECT_EQ(bitmaps->encoding(), encoding);
+    CheckSlotBitmaps(slots, *bitmaps);
+
+    // Decode a copy of the encoding.
+    const std::string data(bitmaps->data());
+    const SlotBitmapsPtr decoded =
+        SlotBitmaps::Decode(encoding, kNumStripes, data);
+    EXPECT_EQ(decoded->data(), data);
+    CheckSlotBitmaps(slots, *decoded);
+  }
+}
+
+TEST(SlotBitmapsTest, CompressedSlotBitmaps) {
+  const std::vector<std::vector<uint32_t>> slots = CreateSlots();
+  for (const SlotBitmapEncoding encoding :
+       {SlotBitmapEncoding::RLE, SlotBitmapEncoding::DENSE,
+        SlotBitmapEncoding::ROARING}) {
+    SlotBitmapsBuilder builder(encoding, kNumStripes);
+    for (const std::vector<uint32_t>& stripe_ids : slots)
+      builder.AddSlot(stripe_ids);
+    const SlotBitmapsPtr bitmaps = builder.Build();
+
+    // Chunks of 4 slots, i.e., the last one is partial.
+    const std::string data = CompressedSlotBitmaps::Encode(
+        *bitmaps, kNumSlots, /*chunk_size=*/4 * kNumStripes / 8);
+    const CompressedSlotBitmaps compressed(kNumStripes, data,
+                                           /*max_cached_chunks=*/2);
+    EXPECT_EQ(compressed.encoding(), encoding);
+    EXPECT_EQ(compressed.num_slots_per_chunk(), 4);
+    EXPECT_EQ(compressed.data(), data);
+
+    // Only decompresses the chunk of the accessed slot.
+    compressed.GetOnesCount(/*slot=*/5);
+    compressed.GetOnesCount(/*slot=*/6);
+    EXPECT_EQ(compressed.num_decompressed_chunks(), 1);
+
+    CheckSlotBitmaps(slots, compressed);
+  }
+}
+
+TEST(SlotBitmapsTest, ChooseSlotBitmapEncoding) {
+  EXPECT_EQ(ChooseSlotBitmapEncoding(/*num_bits=*/1000, /*num_ones=*/0,
+                                     /*num_one_fills=*/0),
+            SlotBitmapEncoding::RLE);
+  // Long 1-fills.
+  EXPECT_EQ(ChooseSlotBitmapEncoding(/*num_bits=*/1000, /*num_ones=*/500,
+                                     /*num_one_fills=*/10),
+            SlotBitmapEncoding::RLE);
+  // Dense, but scattered.
+  EXPECT_EQ(ChooseSlotBitmapEncoding(/*num_bits=*/1000, /*num_ones=*/500,
+                                     /*num_one_fills=*/400),
+            SlotBitmapEncoding::DENSE);
+  // Sparse and scattered.
+  EXPECT_EQ(ChooseSlotBitmapEncoding(/*num_bits=*/1000, /*num_ones=*/10,
+                                     /*num_one_fills=*/10),
+            SlotBitmapEncoding::ROARING);
+}
+
+}  // namespace ci
@@ -0,0 +1,185 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: table_indexer.cc
+// -----------------------------------------------------------------------------
+
+#include "table_indexer.h"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <utility>
+
+#include "absl/synchronization/mutex.h"
+#include "common/profiling.h"
+
+namespace ci {
+namespace {
+
+// Rough size of the build state of each distinct value: its hash-map entry
+// with the set of stripes it occurs in, and its slot and fingerprint.
+constexpr size_t kBuildBytesPerDistinctValue = 64;
+
+// Building the index of column `column_idx` with factory `factory_idx`.
+struct Task {
+  size_t column_idx;
+  size_t factory_idx;
+  size_t memory;
+};
+
+// The tasks of one worker. The worker takes tasks from the front, others
+// steal from the back.
+class TaskQueue {
+ public:
+  void Push(const Task& task) {
+    absl::MutexLock lock(&mutex_);
+    tasks_.push_back(task);
+  }
+
+  bool PopFront(Task* task) {
+    absl::MutexLock lock(&mutex_);
+    if (tasks_.empty()) return false;
+    *task = tasks_.front();
+    tasks_.pop_front();
+    return true;
+  }
+
+  bool PopBack(Task* task) {
+    absl::MutexLock lock(&mutex_);
+    if (tasks_.empty()) return false;
+    *task = tasks_.back();
+    tasks_.pop_back();
+    return true;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::deque<Task> tasks_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Blocks builds until their estimated memory fits into the budget.
+class MemoryBudget {
+ public:
+  explicit MemoryBudget(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+  void Acquire(size_t bytes) {
+    absl::MutexLock lock(&mutex_);
+    if (max_bytes_ != TableIndexer::kUnlimitedMemory) {
+      // Always admit a build if no other one is running, even if it exceeds
+      // the budget on its own.
+      const auto fits = [this, bytes]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+        return used_bytes_ == 0 || used_bytes_ + bytes <= max_bytes_;
+      };
+      mutex_.Await(absl::Condition(&fits));
+    }
+    used_bytes_ += bytes;
+  }
+
+  void Release(size_t bytes) {
+    absl::MutexLock lock(&mutex_);
+    used_bytes_ -= bytes;
+  }
+
+ private:
+  const size_t max_bytes_;
+  absl::Mutex mutex_;
+  size_t used_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace
+
+size_t TableIndexer::EstimateBuildMemory(const Column& column) {
+  return column.EstimateNumDistinctValues() * kBuildBytesPerDistinctValue;
+}
+
+std::vector<ColumnIndexes> TableIndexer::IndexTable(
+    const Table& table,
+    absl::Span<const std::unique_ptr<IndexStructureFactory>> factories,
+    size_t num_rows_per_stripe) const {
+  const std::vector<ColumnPtr>& columns = table.GetColumns();
+
+  // Start with the largest builds, so that the small ones fill the gaps at the
+  // end.
+  std::vector<Task> tasks;
+  tasks.reserve(columns.size() * factories.size());
+  for (size_t column_idx = 0; column_idx < columns.size(); ++column_idx) {
+    const size_t memory = EstimateBuildMemory(*columns[column_idx]);
+    for (size_t factory_idx = 0; factory_idx < factories.size(); ++factory_idx)
+      tasks.push_back({column_idx, factory_idx, memory});
+  }
+  std::stable_sort(tasks.begin(), tasks.end(),
+                   [](const Task& lhs, const Task& rhs) {
+                     return lhs.memory > rhs.memory;
+                   });
+
+  const size_t num_workers =
+      std::max<size_t>(1, std::min(num_threads_, tasks.size()));
+  std::vector<TaskQueue> queues(num_workers);
+  for (size_t i = 0; i < tasks.size(); ++i)
+    queues[i % num_workers].Push(tasks[i]);
+
+  // Workers write to distinct entries, indexed by [factory][column].
+  std::vector<std::vector<IndexStructurePtr>> indexes(factories.size());
+  for (std::vector<IndexStructurePtr>& factory_indexes : indexes)
+    factory_indexes.resize(columns.size());
+
+  MemoryBudget budget(max_memory_bytes_);
+  Profiler& caller_profiler = Profiler::GetThreadInstance();
+  absl::Mutex profiler_mutex;
+  auto work = [&](size_t worker_idx) {
+    Task task;
+    while (true) {
+      bool found = queues[worker_idx].PopFront(&task);
+      for (size_t i = 1; !found && i < num_workers; ++i)
+        found = queues[(worker_idx + i) % num_workers].PopBack(&task);
+      // Tasks are only added upfront, so all queues are empty now.
+      if (!found) break;
+
+      budget.Acquire(task.memory);
+      indexes[task.factory_idx][task.column_idx] =
+          factories[task.factory_idx]->Create(*columns[task.column_idx],
+                                              num_rows_per_stripe);
+      budget.Release(task.memory);
+    }
+  };
+
+  if (num_workers == 1) {
+    work(/*worker_idx=*/0);
+  } else {
+    std::vector<std::thread> workers;
+    workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.emplace_back([&, i]() {
+        work(i);
+        // The calling thread is blocked in join() below.
+        absl::MutexLock lock(&profiler_mutex);
+        caller_profiler.Merge(Profiler::GetThreadInstance());
+      });
+    }
+    for (std::thread& worker : workers) worker.join();
+  }
+
+  std::vector<ColumnIndexes> results(factories.size());
+  for (size_t factory_idx = 0; factory_idx < factories.size(); ++factory_idx) {
+    for (size_t column_idx = 0; column_idx < columns.size(); ++column_idx) {
+      results[factory_idx][columns[column_idx]->name()] =
+          std::move(indexes[factory_idx][column_idx]);
+    }
+  }
+  return results;
+}
+
+}  // namespace ci
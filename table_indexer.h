@@ -0,0 +1,73 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: table_indexer.h
+// -----------------------------------------------------------------------------
+//
+// Builds the indexes of all columns of a table concurrently.
+
+#ifndef CUCKOO_INDEX_TABLE_INDEXER_H_
+#define CUCKOO_INDEX_TABLE_INDEXER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "data.h"
+#include "index_structure.h"
+
+namespace ci {
+
+// The indexes created by one factory, keyed by column name.
+using ColumnIndexes = absl::flat_hash_map<std::string, IndexStructurePtr>;
+
+// Creates an index per (column, factory) pair on a pool of worker threads.
+// Each worker has its own queue of builds (largest columns first) and steals
+// from the back of the other queues once its own is empty. Builds are only
+// started while the estimated memory of all running builds stays within
+// `max_memory_bytes`; a single build exceeding it still runs on its own.
+class TableIndexer {
+ public:
+  // Bound on the estimated build memory for unlimited concurrent builds.
+  static constexpr size_t kUnlimitedMemory = 0;
+
+  explicit TableIndexer(size_t num_threads,
+                        size_t max_memory_bytes = kUnlimitedMemory)
+      : num_threads_(num_threads), max_memory_bytes_(max_memory_bytes) {}
+
+  // Returns one entry per factory (in the same order), holding the indexes
+  // of all columns of `table`. The factories' Create(..) must be safe to call
+  // concurrently. The Profiler counters of all builds are added to the
+  // Profiler of the calling thread.
+  std::vector<ColumnIndexes> IndexTable(
+      const Table& table,
+      absl::Span<const std::unique_ptr<IndexStructureFactory>> factories,
+      size_t num_rows_per_stripe) const;
+
+  // Returns the estimated peak memory of building an index for `column`
+  // (besides the column itself), dominated by the per-value build state.
+  static size_t EstimateBuildMemory(const Column& column);
+
+ private:
+  const size_t num_threads_;
+  const size_t max_memory_bytes_;
+};
+
+}  // namespace ci
+
+#endif  // CUCKOO_INDEX_TABLE_INDEXER_H_
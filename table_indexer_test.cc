@@ -0,0 +1,120 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: table_indexer_test.cc
+// -----------------------------------------------------------------------------
+
+#include "table_indexer.h"
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "common/profiling.h"
+#include "cuckoo_index.h"
+#include "cuckoo_utils.h"
+#include "gtest/gtest.h"
+#include "zone_map.h"
+
+namespace ci {
+
+constexpr size_t kNumRows = 1000;
+constexpr size_t kNumRowsPerStripe = 10;
+
+std::unique_ptr<Table> CreateTable(size_t num_columns) {
+  std::vector<ColumnPtr> columns;
+  for (size_t i = 0; i < num_columns; ++i) {
+    // Columns of different cardinalities.
+    const size_t num_values = 10 * (i + 1);
+    std::vector<long> data(kNumRows);
+    for (size_t row = 0; row < kNumRows; ++row) data[row] = row % num_values;
+    columns.push_back(
+        Column::IntColumn(absl::StrCat("column-", i), std::move(data)));
+  }
+  return Table::Create("table", std::move(columns));
+}
+
+std::vector<std::unique_ptr<IndexStructureFactory>> CreateFactories() {
+  std::vector<std::unique_ptr<IndexStructureFactory>> factories;
+  factories.push_back(absl::make_unique<CuckooIndexFactory>(
+      // The matching is deterministic, i.e., creates the same index each time.
+      CuckooAlgorithm::MATCHING, kMaxLoadFactor1SlotsPerBucket,
+      /*scan_rate=*/0.02, /*slots_per_bucket=*/1,
+      /*prefix_bits_optimization=*/false));
+  factories.push_back(absl::make_unique<ZoneMapFactory>());
+  return factories;
+}
+
+// Checks that the indexes are the same as the ones created serially.
+void CheckIndexes(const Table& table,
+                  const std::vector<std::unique_ptr<IndexStructureFactory>>&
+                      factories,
+                  const std::vector<ColumnIndexes>& results) {
+  ASSERT_EQ(results.size(), factories.size());
+  const size_t num_stripes = kNumRows / kNumRowsPerStripe;
+  for (size_t i = 0; i < factories.size(); ++i) {
+    ASSERT_EQ(results[i].size(), table.GetColumns().size());
+    for (const ColumnPtr& column : table.GetColumns()) {
+      const auto it = results[i].find(column->name());
+      ASSERT_NE(it, results[i].end());
+      const IndexStructurePtr expected =
+          factories[i]->Create(*column, kNumRowsPerStripe);
+      EXPECT_EQ(it->second->name(), expected->name());
+      EXPECT_EQ(it->second->byte_size(), expected->byte_size());
+      for (long value = 0; value < 100; ++value) {
+        ASSERT_EQ(
+            it->second->GetQualifyingStripes(value, num_stripes).ToString(),
+            expected->GetQualifyingStripes(value, num_stripes).ToString());
+      }
+    }
+  }
+}
+
+TEST(TableIndexerTest, IndexesAllColumns) {
+  const std::unique_ptr<Table> table = CreateTable(/*num_columns=*/7);
+  const auto factories = CreateFactories();
+  for (const size_t num_threads : {1, 3, 16}) {
+    const std::vector<ColumnIndexes> results =
+        TableIndexer(num_threads).IndexTable(*table, factories,
+                                             kNumRowsPerStripe);
+    CheckIndexes(*table, factories, results);
+  }
+}
+
+TEST(TableIndexerTest, SmallMemoryBudget) {
+  const std::unique_ptr<Table> table = CreateTable(/*num_columns=*/5);
+  const auto factories = CreateFactories();
+  // Every build exceeds the budget and therefore runs on its own.
+  const std::vector<ColumnIndexes> results =
+      TableIndexer(/*num_threads=*/4, /*max_memory_bytes=*/1)
+          .IndexTable(*table, factories, kNumRowsPerStripe);
+  CheckIndexes(*table, factories, results);
+}
+
+TEST(TableIndexerTest, AggregatesProfilerCounters) {
+  const std::unique_ptr<Table> table = CreateTable(/*num_columns=*/4);
+  const auto factories = CreateFactories();
+  Profiler& profiler = Profiler::GetThreadInstance();
+  profiler.Reset();
+  TableIndexer(/*num_threads=*/4).IndexTable(*table, factories,
+                                             kNumRowsPerStripe);
+  // The builds ran on the workers, but their timers are added to the
+  // profiler of this thread.
+  EXPECT_GT(profiler.GetValue(Counter::ValueToStripeBitmaps), 0);
+  EXPECT_GT(profiler.GetValue(Counter::DistributeValues), 0);
+  EXPECT_GT(profiler.GetValue(Counter::CreateSlots), 0);
+  EXPECT_GT(profiler.GetValue(Counter::GetGlobalBitmap), 0);
+  profiler.Reset();
+}
+
+}  // namespace ci
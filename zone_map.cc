@@ -0,0 +1,179 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: zone_map.cc
+// -----------------------------------------------------------------------------
+
+#include "zone_map.h"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "common/byte_coding.h"
+
+namespace ci {
+namespace {
+
+// Returns a word with bit `i` set iff the zone [`minimums[i]`, `maximums[i]`]
+// overlaps with [`lo`, `hi`], for the first `n` (at most 64) zones. Zones of
+// stripes without values have a minimum larger than their maximum and never
+// overlap.
+uint64_t GetOverlapMask(const long* minimums, const long* maximums, size_t n,
+                        long lo, long hi) {
+  uint64_t word = 0;
+  size_t i = 0;
+#if defined(__AVX512F__)
+  const __m512i lo_vec = _mm512_set1_epi64(lo);
+  const __m512i hi_vec = _mm512_set1_epi64(hi);
+  for (; i + 8 <= n; i += 8) {
+    const __m512i mins = _mm512_loadu_si512(minimums + i);
+    const __m512i maxs = _mm512_loadu_si512(maximums + i);
+    const __mmask8 mask = _mm512_cmple_epi64_mask(mins, hi_vec) &
+                          _mm512_cmpge_epi64_mask(maxs, lo_vec) &
+                          _mm512_cmple_epi64_mask(mins, maxs);
+    word |= static_cast<uint64_t>(mask) << i;
+  }
+#elif defined(__AVX2__)
+  const __m256i lo_vec = _mm256_set1_epi64x(lo);
+  const __m256i hi_vec = _mm256_set1_epi64x(hi);
+  for (; i + 4 <= n; i += 4) {
+    const __m256i mins =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(minimums + i));
+    const __m256i maxs =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maximums + i));
+    // AVX2 only has a greater-than comparison, so compute the disjoint zones.
+    const __m256i disjoint = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpgt_epi64(mins, hi_vec),
+                        _mm256_cmpgt_epi64(lo_vec, maxs)),
+        _mm256_cmpgt_epi64(mins, maxs));
+    const uint64_t mask =
+        ~_mm256_movemask_pd(_mm256_castsi256_pd(disjoint)) & 0xF;
+    word |= mask << i;
+  }
+#endif
+  for (; i < n; ++i) {
+    word |= static_cast<uint64_t>(minimums[i] <= hi && maximums[i] >= lo &&
+                                  minimums[i] <= maximums[i])
+            << i;
+  }
+  return word;
+}
+
+}  // namespace
+
+void ZoneMap::FillQualifyingStripeIds(
+    long value, size_t num_stripes, std::vector<uint32_t>* stripe_ids) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  stripe_ids->clear();
+  for (size_t first_stripe = 0; first_stripe < num_stripes;
+       first_stripe += 64) {
+    const size_t n = std::min<size_t>(64, num_stripes - first_stripe);
+    for (uint64_t word = GetQualifyingWord(first_stripe, n, value, value);
+         word != 0; word &= word - 1)
+      stripe_ids->push_back(first_stripe + __builtin_ctzll(word));
+  }
+}
+
+void ZoneMap::FillQualifyingStripesForRange(long lo, long hi,
+                                            size_t num_stripes,
+                                            Bitmap64* result) const {
+  CheckNumStripes(num_stripes, num_stripes_);
+  result->Reset(num_stripes);
+  if (lo > hi) return;
+  for (size_t first_stripe = 0; first_stripe < num_stripes;
+       first_stripe += 64) {
+    const size_t n = std::min<size_t>(64, num_stripes - first_stripe);
+    const uint64_t word = GetQualifyingWord(first_stripe, n, lo, hi);
+    if (word != 0) result->SetWord(first_stripe / 64, word);
+  }
+}
+
+void ZoneMap::FilterQualifyingStripes(long value, Bitmap64* candidates) const {
+  const size_t num_stripes = candidates->bits();
+  CheckNumStripes(num_stripes, num_stripes_);
+  for (size_t first_stripe = 0; first_stripe < num_stripes;
+       first_stripe += 64) {
+    const uint64_t candidate_word = candidates->GetWord(first_stripe / 64);
+    // Skip words without candidates.
+    if (candidate_word == 0) continue;
+    const size_t n = std::min<size_t>(64, num_stripes - first_stripe);
+    candidates->SetWord(first_stripe / 64,
+                        candidate_word &
+                            GetQualifyingWord(first_stripe, n, value, value));
+  }
+}
+
+uint64_t ZoneMap::GetQualifyingWord(size_t first_stripe, size_t num_stripes,
+                                    long lo, long hi) const {
+  if (!compact_) {
+    return GetOverlapMask(minimums_.data() + first_stripe,
+                          maximums_.data() + first_stripe, num_stripes, lo,
+                          hi);
+  }
+  long minimums[64];
+  long maximums[64];
+  for (size_t i = 0; i < num_stripes; ++i) {
+    minimums[i] = GetMinimum(first_stripe + i);
+    maximums[i] = GetMaximum(first_stripe + i);
+  }
+  return GetOverlapMask(minimums, maximums, num_stripes, lo, hi);
+}
+
+void ZoneMap::Compact() {
+  // Stripes without values have a minimum larger than their maximum.
+  frame_of_reference_ = 0;
+  bool has_values = false;
+  for (size_t i = 0; i < num_stripes_; ++i) {
+    if (minimums_[i] > maximums_[i]) continue;
+    frame_of_reference_ =
+        has_values ? std::min(frame_of_reference_, minimums_[i]) : minimums_[i];
+    has_values = true;
+  }
+
+  // Offsets are computed on unsigned values, since they may exceed the range
+  // of `long`. Empty stripes get the zone [1, 0].
+  std::vector<uint64_t> min_offsets(num_stripes_);
+  std::vector<uint64_t> max_offsets(num_stripes_);
+  uint64_t max_offset = 0;
+  for (size_t i = 0; i < num_stripes_; ++i) {
+    if (minimums_[i] > maximums_[i]) {
+      min_offsets[i] = 1;
+      max_offsets[i] = 0;
+    } else {
+      min_offsets[i] = static_cast<uint64_t>(minimums_[i]) -
+                       static_cast<uint64_t>(frame_of_reference_);
+      max_offsets[i] = static_cast<uint64_t>(maximums_[i]) -
+                       static_cast<uint64_t>(frame_of_reference_);
+    }
+    max_offset = std::max({max_offset, min_offsets[i], max_offsets[i]});
+  }
+
+  const long bit_width = BitWidth<uint64_t>(max_offset);
+  ByteBuffer buffer;
+  StoreBitPacked<uint64_t>(min_offsets, bit_width, &buffer);
+  const size_t max_offsets_pos = buffer.pos();
+  StoreBitPacked<uint64_t>(max_offsets, bit_width, &buffer);
+  PutSlopBytes(&buffer);
+  packed_ = std::string(buffer.data(), buffer.pos());
+  packed_minimums_ = BitPackedReader<uint64_t>(bit_width, packed_.data());
+  packed_maximums_ =
+      BitPackedReader<uint64_t>(bit_width, packed_.data() + max_offsets_pos);
+
+  std::vector<long>().swap(minimums_);
+  std::vector<long>().swap(maximums_);
+}
+
+}  // namespace ci
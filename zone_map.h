@@ -23,53 +23,55 @@
 #include <cstdlib>
 #include <iostream>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "common/bit_packing.h"
+#include "common/memoized.h"
 #include "data.h"
 #include "evaluation_utils.h"
 #include "index_structure.h"
 
 namespace ci {
 
+// Stores the minimum and maximum of every stripe. Lookups compare the zones of
+// 64 stripes at a time (with AVX2 or AVX-512 if available) and set the
+// corresponding bitmap word at once.
+//
+// Compact zone maps store the zones frame-of-reference encoded instead, i.e.,
+// their offsets from the smallest minimum, bit-packed with the bit-width of
+// the largest offset. They are decoded 64 stripes at a time for lookups.
 class ZoneMap : public IndexStructure {
  public:
-  ZoneMap(const std::vector<long>& data, std::size_t num_rows_per_stripe) {
+  ZoneMap(absl::Span<const long> data, std::size_t num_rows_per_stripe,
+          bool compact = false)
+      : ZoneMap(compact) {
     if (data.size() % num_rows_per_stripe != 0) {
       std::cout << "WARNING: Number of values is not a multiple of "
                    "`num_rows_per_stripe`. Ignoring last stripe."
                 << std::endl;
     }
-    num_stripes_ = data.size() / num_rows_per_stripe;
-    minimums_.reserve(num_stripes_);
-    maximums_.reserve(num_stripes_);
-    for (size_t stripe_id = 0; stripe_id < num_stripes_; ++stripe_id) {
-      const std::size_t stripe_begin = num_rows_per_stripe * stripe_id;
-      const std::size_t stripe_end = stripe_begin + num_rows_per_stripe;
-
-      long per_stripe_min = std::numeric_limits<long>::max();
-      long per_stripe_max = std::numeric_limits<long>::min();
-
-      for (size_t row_id = stripe_begin; row_id < stripe_end; ++row_id) {
-        if (data[row_id] == Column::kIntNullSentinel) continue;
-
-        per_stripe_min = std::min(per_stripe_min, data[row_id]);
-        per_stripe_max = std::max(per_stripe_max, data[row_id]);
-      }
-
-      minimums_.push_back(per_stripe_min);
-      maximums_.push_back(per_stripe_max);
+    const std::size_t num_stripes = data.size() / num_rows_per_stripe;
+    minimums_.reserve(num_stripes);
+    maximums_.reserve(num_stripes);
+    for (size_t stripe_id = 0; stripe_id < num_stripes; ++stripe_id) {
+      AddStripe(absl::MakeConstSpan(data).subspan(
+          num_rows_per_stripe * stripe_id, num_rows_per_stripe));
     }
+    if (compact_) Compact();
   }
 
-  ZoneMap(const Column& column, std::size_t num_rows_per_stripe)
-      : ZoneMap(column.data(), num_rows_per_stripe) {}
+  ZoneMap(const Column& column, std::size_t num_rows_per_stripe,
+          bool compact = false)
+      : ZoneMap(column.data(), num_rows_per_stripe, compact) {}
 
   void PrintZones() {
     for (size_t i = 0; i < num_stripes_; ++i) {
-      std::cout << "Stripe " << i << ": " << minimums_[i] << ", "
-                << maximums_[i] << std::endl;
+      std::cout << "Stripe " << i << ": " << GetMinimum(i) << ", "
+                << GetMaximum(i) << std::endl;
     }
   }
 
@@ -78,42 +80,166 @@ class ZoneMap : public IndexStructure {
       std::cerr << "`stripe_id` is out of bounds." << std::endl;
       exit(EXIT_FAILURE);
     }
-    return value >= minimums_[stripe_id] && value <= maximums_[stripe_id];
+    return value >= GetMinimum(stripe_id) && value <= GetMaximum(stripe_id);
   }
 
-  std::string name() const override { return "ZoneMap"; }
+  void FillQualifyingStripes(long value, size_t num_stripes,
+                             Bitmap64* result) const override {
+    FillQualifyingStripesForRange(value, value, num_stripes, result);
+  }
+
+  void FillQualifyingStripeIds(
+      long value, size_t num_stripes,
+      std::vector<uint32_t>* stripe_ids) const override;
+
+  // Compares the zones of all stripes of a word with candidates at once.
+  void FilterQualifyingStripes(long value,
+                               Bitmap64* candidates) const override;
+
+  // Returns a bitmap indicating the stripes that possibly contain values in
+  // [`lo`, `hi`] (none for `lo` > `hi`). Probes up to `num_stripes` stripes.
+  Bitmap64 GetQualifyingStripesForRange(long lo, long hi,
+                                        size_t num_stripes) const {
+    Bitmap64 result;
+    FillQualifyingStripesForRange(lo, hi, num_stripes, &result);
+    return result;
+  }
+
+  // Same as above, but writes the result to the caller-owned `result` (which
+  // is reset first).
+  void FillQualifyingStripesForRange(long lo, long hi, size_t num_stripes,
+                                     Bitmap64* result) const;
+
+  std::string name() const override {
+    return compact_ ? "ZoneMap/compact" : "ZoneMap";
+  }
 
   size_t byte_size() const override {
+    if (compact_) return packed_.size() + sizeof(frame_of_reference_);
     return sizeof(long) * minimums_.size() + sizeof(long) * maximums_.size();
   }
 
+  // Compresses the zones on first use.
   size_t compressed_byte_size() const override {
-    std::string data;
-    absl::StrAppend(&data, absl::string_view(
-                               reinterpret_cast<const char*>(minimums_.data()),
-                               sizeof(minimums_[0]) * minimums_.size()));
-    absl::StrAppend(&data, absl::string_view(
-                               reinterpret_cast<const char*>(maximums_.data()),
-                               sizeof(maximums_[0]) * maximums_.size()));
-
-    return Compress(data).size();
+    return compressed_byte_size_.Get([this]() {
+      if (compact_) return Compress(packed_).size();
+      std::string data;
+      absl::StrAppend(
+          &data, absl::string_view(
+                     reinterpret_cast<const char*>(minimums_.data()),
+                     sizeof(minimums_[0]) * minimums_.size()));
+      absl::StrAppend(
+          &data, absl::string_view(
+                     reinterpret_cast<const char*>(maximums_.data()),
+                     sizeof(maximums_[0]) * maximums_.size()));
+
+      return Compress(data).size();
+    });
   }
 
   std::size_t num_stripes() { return num_stripes_; }
 
  private:
+  friend class ZoneMapBuilder;
+
+  // Creates an empty index, stripes are added with AddStripe(..).
+  explicit ZoneMap(bool compact)
+      : compact_(compact), num_stripes_(0), frame_of_reference_(0) {}
+
+  // Adds the zone of the next stripe.
+  void AddStripe(absl::Span<const long> stripe) {
+    long per_stripe_min = std::numeric_limits<long>::max();
+    long per_stripe_max = std::numeric_limits<long>::min();
+
+    for (const long value : stripe) {
+      if (value == Column::kIntNullSentinel) continue;
+
+      per_stripe_min = std::min(per_stripe_min, value);
+      per_stripe_max = std::max(per_stripe_max, value);
+    }
+
+    minimums_.push_back(per_stripe_min);
+    maximums_.push_back(per_stripe_max);
+    ++num_stripes_;
+  }
+
+  // Replaces `minimums_` and `maximums_` by their compact encoding.
+  void Compact();
+
+  long GetMinimum(size_t stripe_id) const {
+    if (!compact_) return minimums_[stripe_id];
+    // Adds unsigned, since the offset may exceed the range of `long`.
+    return static_cast<long>(static_cast<uint64_t>(frame_of_reference_) +
+                             packed_minimums_.Get(stripe_id));
+  }
+
+  long GetMaximum(size_t stripe_id) const {
+    if (!compact_) return maximums_[stripe_id];
+    // Adds unsigned, since the offset may exceed the range of `long`.
+    return static_cast<long>(static_cast<uint64_t>(frame_of_reference_) +
+                             packed_maximums_.Get(stripe_id));
+  }
+
+  // Returns the bits of the (up to 64) stripes starting at `first_stripe`
+  // (which is a multiple of 64) that overlap with [`lo`, `hi`].
+  uint64_t GetQualifyingWord(size_t first_stripe, size_t num_stripes, long lo,
+                             long hi) const;
+
+  const bool compact_;
   std::size_t num_stripes_;
+  // Only set for non-compact zone maps (and while adding stripes).
   std::vector<long> minimums_, maximums_;
+
+  // Only set for compact zone maps: the bit-packed offsets of the minimums and
+  // maximums from `frame_of_reference_`.
+  long frame_of_reference_;
+  std::string packed_;
+  BitPackedReader<uint64_t> packed_minimums_;
+  BitPackedReader<uint64_t> packed_maximums_;
+
+  Memoized<size_t> compressed_byte_size_;
+};
+
+// Builds a `ZoneMap` stripe by stripe, only keeping the zones.
+class ZoneMapBuilder : public IndexStructureBuilder {
+ public:
+  // Need to use WrapUnique<>(..) since we're calling a private c'tor.
+  explicit ZoneMapBuilder(bool compact = false)
+      : index_(absl::WrapUnique(new ZoneMap(compact))) {}
+
+  void AddStripe(absl::Span<const long> stripe) override {
+    index_->AddStripe(stripe);
+  }
+
+  IndexStructurePtr Finish() override {
+    if (index_->compact_) index_->Compact();
+    return std::move(index_);
+  }
+
+ private:
+  std::unique_ptr<ZoneMap> index_;
 };
 
 class ZoneMapFactory : public IndexStructureFactory {
  public:
+  explicit ZoneMapFactory(bool compact = false) : compact_(compact) {}
+
   std::unique_ptr<IndexStructure> Create(
       const Column& column, size_t num_rows_per_stripe) const override {
-    return absl::make_unique<ZoneMap>(column.data(), num_rows_per_stripe);
+    return absl::make_unique<ZoneMap>(column.data(), num_rows_per_stripe,
+                                      compact_);
   }
 
-  std::string index_name() const { return "ZoneMap"; }
+  IndexStructureBuilderPtr CreateBuilder() const override {
+    return absl::make_unique<ZoneMapBuilder>(compact_);
+  }
+
+  std::string index_name() const {
+    return compact_ ? "ZoneMap/compact" : "ZoneMap";
+  }
+
+ private:
+  const bool compact_;
 };
 
 }  // namespace ci
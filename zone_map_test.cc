@@ -18,6 +18,9 @@
 
 #include "zone_map.h"
 
+#include <limits>
+#include <random>
+
 #include "gtest/gtest.h"
 
 namespace ci {
@@ -62,6 +65,42 @@ TEST(ZoneMapTest, StripeContainsDuplicateValues) {
   EXPECT_FALSE(zone_map.StripeContains(/*stripe_id=*/1, /*value=*/3));
 }
 
+TEST(ZoneMapTest, FillQualifyingStripes) {
+  ZoneMap zone_map(/*data=*/{1, 2, 3, 4, 2, 5}, /*num_rows_per_stripe=*/2);
+
+  // Re-use the same buffers across lookups.
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  zone_map.FillQualifyingStripes(/*value=*/2, /*num_stripes=*/3, &result);
+  EXPECT_EQ(result.ToString(), "101");
+  zone_map.FillQualifyingStripeIds(/*value=*/2, /*num_stripes=*/3, &stripe_ids);
+  EXPECT_EQ(stripe_ids, std::vector<uint32_t>({0, 2}));
+
+  zone_map.FillQualifyingStripes(/*value=*/4, /*num_stripes=*/3, &result);
+  EXPECT_EQ(result.ToString(), "110");
+  zone_map.FillQualifyingStripeIds(/*value=*/4, /*num_stripes=*/3, &stripe_ids);
+  EXPECT_EQ(stripe_ids, std::vector<uint32_t>({1, 2}));
+
+  zone_map.FillQualifyingStripes(/*value=*/0, /*num_stripes=*/2, &result);
+  EXPECT_EQ(result.ToString(), "00");
+  zone_map.FillQualifyingStripeIds(/*value=*/0, /*num_stripes=*/2, &stripe_ids);
+  EXPECT_TRUE(stripe_ids.empty());
+}
+
+TEST(ZoneMapTest, GetQualifyingStripesForAny) {
+  ZoneMap zone_map(/*data=*/{1, 2, 3, 4, 5, 6}, /*num_rows_per_stripe=*/2);
+
+  EXPECT_EQ(zone_map.GetQualifyingStripesForAny({1, 6}, /*num_stripes=*/3)
+                .ToString(),
+            "101");
+  EXPECT_EQ(zone_map.GetQualifyingStripesForAny({0, 7}, /*num_stripes=*/3)
+                .ToString(),
+            "000");
+  EXPECT_TRUE(zone_map.GetQualifyingStripesForAny({1, 3, 5, 42},
+                                                  /*num_stripes=*/3)
+                  .IsAllOnes());
+}
+
 TEST(ZoneMapTest, NullValuesAreIgnored) {
   ZoneMap zone_map(
       /*data=*/{1, Column::kIntNullSentinel, 3, 4, Column::kIntNullSentinel, 6},
@@ -78,4 +117,143 @@ TEST(ZoneMapTest, NullValuesAreIgnored) {
   EXPECT_FALSE(zone_map.StripeContains(/*stripe_id=*/1, /*value=*/7));
 }
 
+TEST(ZoneMapTest, Builder) {
+  const IndexStructureBuilderPtr builder = ZoneMapFactory().CreateBuilder();
+  // Unlike for Create(..), stripes may differ in size.
+  builder->AddStripe({1, 2});
+  builder->AddStripe({3, 4, 6});
+  builder->AddStripe({2});
+  const IndexStructurePtr zone_map = builder->Finish();
+
+  EXPECT_EQ(zone_map->GetQualifyingStripes(/*value=*/2, /*num_stripes=*/3)
+                .ToString(),
+            "101");
+  EXPECT_EQ(zone_map->GetQualifyingStripes(/*value=*/5, /*num_stripes=*/3)
+                .ToString(),
+            "010");
+}
+
+TEST(ZoneMapTest, GetQualifyingStripesForRange) {
+  ZoneMap zone_map(/*data=*/{1, 2, 3, 4, 2, 5}, /*num_rows_per_stripe=*/2);
+
+  EXPECT_EQ(zone_map.GetQualifyingStripesForRange(/*lo=*/3, /*hi=*/3,
+                                                  /*num_stripes=*/3)
+                .ToString(),
+            "110");
+  EXPECT_EQ(zone_map.GetQualifyingStripesForRange(/*lo=*/0, /*hi=*/1,
+                                                  /*num_stripes=*/3)
+                .ToString(),
+            "001");
+  EXPECT_EQ(zone_map.GetQualifyingStripesForRange(/*lo=*/5, /*hi=*/100,
+                                                  /*num_stripes=*/3)
+                .ToString(),
+            "100");
+  EXPECT_EQ(zone_map.GetQualifyingStripesForRange(/*lo=*/6, /*hi=*/100,
+                                                  /*num_stripes=*/3)
+                .ToString(),
+            "000");
+  // Empty ranges.
+  EXPECT_EQ(zone_map.GetQualifyingStripesForRange(/*lo=*/4, /*hi=*/2,
+                                                  /*num_stripes=*/3)
+                .ToString(),
+            "000");
+}
+
+// Compares all lookups against a scan of the zones.
+void CheckAgainstZones(const std::vector<long>& data,
+                       size_t num_rows_per_stripe, bool compact) {
+  const ZoneMap zone_map(data, num_rows_per_stripe, compact);
+  const size_t num_stripes = data.size() / num_rows_per_stripe;
+  std::vector<long> minimums(num_stripes, std::numeric_limits<long>::max());
+  std::vector<long> maximums(num_stripes, std::numeric_limits<long>::min());
+  for (size_t row = 0; row < num_stripes * num_rows_per_stripe; ++row) {
+    if (data[row] == Column::kIntNullSentinel) continue;
+    const size_t stripe = row / num_rows_per_stripe;
+    minimums[stripe] = std::min(minimums[stripe], data[row]);
+    maximums[stripe] = std::max(maximums[stripe], data[row]);
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> row_dist(0, data.size() - 1);
+  Bitmap64 result;
+  std::vector<uint32_t> stripe_ids;
+  for (size_t i = 0; i < 100; ++i) {
+    long lo = data[row_dist(gen)];
+    long hi = data[row_dist(gen)];
+    if (lo > hi) std::swap(lo, hi);
+    zone_map.FillQualifyingStripesForRange(lo, hi, num_stripes, &result);
+    ASSERT_EQ(result.bits(), num_stripes);
+    for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+      ASSERT_EQ(result.Get(stripe),
+                minimums[stripe] <= hi && maximums[stripe] >= lo);
+    }
+
+    zone_map.FillQualifyingStripeIds(lo, num_stripes, &stripe_ids);
+    std::vector<uint32_t> expected;
+    for (size_t stripe = 0; stripe < num_stripes; ++stripe) {
+      ASSERT_EQ(zone_map.StripeContains(stripe, lo),
+                minimums[stripe] <= lo && maximums[stripe] >= lo);
+      if (zone_map.StripeContains(stripe, lo)) expected.push_back(stripe);
+    }
+    ASSERT_EQ(stripe_ids, expected);
+  }
+}
+
+TEST(ZoneMapTest, LookupsAgreeWithZones) {
+  std::mt19937 gen(42);
+  for (const bool compact : {false, true}) {
+    SCOPED_TRACE(compact);
+    // 1000 stripes of 10 rows, some of them only holding nulls.
+    std::vector<long> data(10000);
+    std::uniform_int_distribution<long> value_dist(-100000, 100000);
+    for (size_t row = 0; row < data.size(); ++row) {
+      data[row] = (row / 10) % 7 == 0 ? Column::kIntNullSentinel
+                                      : value_dist(gen);
+    }
+    data[5] = 42;
+    CheckAgainstZones(data, /*num_rows_per_stripe=*/10, compact);
+
+    // Values spanning the whole range of `long`.
+    std::vector<long> extreme_data = {std::numeric_limits<long>::max(),
+                                      std::numeric_limits<long>::max(),
+                                      std::numeric_limits<long>::min() + 1,
+                                      0,
+                                      -1,
+                                      1};
+    CheckAgainstZones(extreme_data, /*num_rows_per_stripe=*/2, compact);
+  }
+}
+
+TEST(ZoneMapTest, CompactZoneMapIsSmaller) {
+  // Small zones relative to the frame of reference.
+  std::vector<long> data(64000);
+  for (size_t row = 0; row < data.size(); ++row) data[row] = 1000000 + row;
+  const ZoneMap zone_map(data, /*num_rows_per_stripe=*/64);
+  const ZoneMap compact_zone_map(data, /*num_rows_per_stripe=*/64,
+                                 /*compact=*/true);
+  EXPECT_EQ(compact_zone_map.name(), "ZoneMap/compact");
+  // 16 instead of 64 bits per minimum and maximum.
+  EXPECT_LT(compact_zone_map.byte_size(), zone_map.byte_size() / 3);
+  for (const long value : {0L, 1000000L, 1000063L, 1000064L, 1063999L})
+    EXPECT_EQ(compact_zone_map.GetQualifyingStripes(value, 1000).ToString(),
+              zone_map.GetQualifyingStripes(value, 1000).ToString());
+}
+
+TEST(ZoneMapTest, CompactBuilder) {
+  const IndexStructureBuilderPtr builder =
+      ZoneMapFactory(/*compact=*/true).CreateBuilder();
+  builder->AddStripe({1, 2});
+  builder->AddStripe({Column::kIntNullSentinel});
+  builder->AddStripe({3, 4, 6});
+  builder->AddStripe({2});
+  const IndexStructurePtr zone_map = builder->Finish();
+
+  EXPECT_EQ(zone_map->GetQualifyingStripes(/*value=*/2, /*num_stripes=*/4)
+                .ToString(),
+            "1001");
+  EXPECT_EQ(zone_map->GetQualifyingStripes(/*value=*/5, /*num_stripes=*/4)
+                .ToString(),
+            "0100");
+}
+
 }  // namespace ci